@@ -0,0 +1,94 @@
+/**
+    @file   AreaScan.cpp
+    @author Mark Zieg <mzieg@wasatchphotonics.com>
+    @brief  implementation of WasatchVCPP::AreaScan
+    @note   customers normally wouldn't access this file; use WasatchVCPP.h instead
+*/
+
+#include "pch.h"
+#include "AreaScan.h"
+
+#include <algorithm>
+
+using std::vector;
+
+WasatchVCPP::AreaScan::AreaScan(int rows, int cols)
+    : rows(std::max(0, rows)), cols(std::max(0, cols))
+{
+    frame.resize((size_t)this->rows * this->cols);
+    seen.resize(this->rows);
+}
+
+//! heap held by a frame of the given dimensions
+size_t WasatchVCPP::AreaScan::getMemoryBytes(int rows, int cols)
+{
+    return sizeof(AreaScan) + (size_t)rows * cols * sizeof(double) + rows;
+}
+
+//! start assembling a new frame (the buffer is reused, not reallocated)
+void WasatchVCPP::AreaScan::reset()
+{
+    std::fill(seen.begin(), seen.end(), 0);
+    received = 0;
+    lastRow = -1;
+}
+
+//! Add one row-tagged line of area-scan data.
+//!
+//! @param line (Input) one detector row, with the row number in pixel 0
+//! @returns true if this line completed the frame
+bool WasatchVCPP::AreaScan::addRow(const vector<uint16_t>& line)
+{
+    if (line.size() < 2 || (int)line.size() > cols)
+        return false;
+
+    int row = line[0];
+    if (row >= rows)
+        return false;
+
+    if (isComplete())
+        reset();
+
+    // a row number at or below the last one means the device has moved on
+    // to the next frame
+    if (row <= lastRow && !isComplete())
+    {
+        discarded++;
+        reset();
+    }
+    lastRow = row;
+
+    // the row tag replaced pixel 0, so stomp it with its neighbor
+    double* dest = &frame[(size_t)row * cols];
+    dest[0] = line[1];
+    for (size_t i = 1; i < line.size(); i++)
+        dest[i] = line[i];
+
+    if (!seen[row])
+    {
+        seen[row] = 1;
+        received++;
+    }
+    return isComplete();
+}
+
+//! Vertically bin (sum) a range of rows of the current frame into a spectrum.
+//!
+//! @param firstRow (Input) first row to include
+//! @param lastRow  (Input) last row to include
+//! @param spectrum (Output) 'cols' pixels
+//! @returns false if the range is invalid
+bool WasatchVCPP::AreaScan::bin(int firstRow, int lastRow, vector<double>& spectrum) const
+{
+    if (firstRow < 0 || lastRow >= rows || firstRow > lastRow)
+        return false;
+
+    spectrum.assign(cols, 0.0);
+    for (int row = firstRow; row <= lastRow; row++)
+    {
+        const double* src = &frame[(size_t)row * cols];
+        for (int i = 0; i < cols; i++)
+            spectrum[i] += src[i];
+    }
+    return true;
+}
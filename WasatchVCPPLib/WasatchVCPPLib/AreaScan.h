@@ -0,0 +1,50 @@
+/**
+    @file   AreaScan.h
+    @author Mark Zieg <mzieg@wasatchphotonics.com>
+    @brief  interface of WasatchVCPP::AreaScan
+    @note   customers normally wouldn't access this file; use WasatchVCPP.h instead
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace WasatchVCPP
+{
+    //! Internal class assembling 2D detector frames from area-scan readout.
+    //!
+    //! In area-scan mode the spectrometer sends the detector one row at a time,
+    //! with the row number in place of the first pixel.  Rows are copied into a
+    //! preallocated, row-major frame buffer as they arrive; the frame is
+    //! complete once every row has been seen.  If the row number wraps before
+    //! that, the partial frame is discarded and assembly restarts.
+    class AreaScan
+    {
+        public:
+            AreaScan(int rows, int cols);
+
+            void reset();
+            bool addRow(const std::vector<uint16_t>& line);
+
+            bool isComplete() const { return received == rows; }
+            int getRowsReceived() const { return received; }
+            int getDiscardedFrames() const { return discarded; }
+
+            const std::vector<double>& getFrame() const { return frame; }
+            bool bin(int firstRow, int lastRow, std::vector<double>& spectrum) const;
+
+            static size_t getMemoryBytes(int rows, int cols);
+
+            const int rows;
+            const int cols;
+
+        private:
+            std::vector<double> frame;      //!< rows x cols, row-major
+            std::vector<uint8_t> seen;      //!< per-row flag
+            int received = 0;
+            int lastRow = -1;
+            int discarded = 0;
+    };
+}
@@ -0,0 +1,422 @@
+/**
+    @file   AsyncControl.cpp
+    @author Mark Zieg <mzieg@wasatchphotonics.com>
+    @brief  implementation of WasatchVCPP::AsyncControl
+    @note   customers normally wouldn't access this file; use WasatchVCPP.h instead
+*/
+
+#include "pch.h"
+#include "AsyncControl.h"
+#include "Spectrometer.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+using std::shared_ptr;
+using std::unique_lock;
+using std::lock_guard;
+using std::mutex;
+
+const int HOST_TO_DEVICE = 0x40;
+const int DEVICE_TO_HOST = 0xC0;
+
+const int MIN_ARM_LEN = 8;
+
+//! how often the shared event thread checks whether it should exit
+const int EVENT_POLL_MS = 100;
+
+//! completed operations held for wait() per spectrometer, beyond which the
+//! oldest are released uncollected
+const size_t MAX_UNCOLLECTED = 1024;
+
+////////////////////////////////////////////////////////////////////////////////
+// Lifecycle
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef USE_LIBUSB_WIN32
+mutex WasatchVCPP::AsyncControl::mutEvents;
+int WasatchVCPP::AsyncControl::instances = 0;
+std::atomic<bool> WasatchVCPP::AsyncControl::eventsRunning(false);
+std::thread WasatchVCPP::AsyncControl::eventThread;
+#endif
+
+WasatchVCPP::AsyncControl::AsyncControl(Spectrometer& spec, Logger& logger)
+    : spec(spec), logger(logger), nextPriority(-1)
+{
+#ifndef USE_LIBUSB_WIN32
+    xfer = libusb_alloc_transfer(0);
+
+    lock_guard<mutex> lock(mutEvents);
+    instances++;
+#endif
+}
+
+WasatchVCPP::AsyncControl::~AsyncControl()
+{
+    stop();
+
+#ifndef USE_LIBUSB_WIN32
+    if (xfer != nullptr)
+        libusb_free_transfer(xfer);
+
+    // the last spectrometer out stops the event thread (before libusb_exit)
+    lock_guard<mutex> lock(mutEvents);
+    if (--instances == 0 && eventsRunning)
+    {
+        eventsRunning = false;
+        eventThread.join();
+    }
+#endif
+}
+
+//! Fail anything still queued, and wait for (or cancel) the transfer in
+//! flight.  Called when the spectrometer is closed; nothing can be submitted
+//! afterwards.
+void WasatchVCPP::AsyncControl::stop()
+{
+    std::deque<shared_ptr<Operation> > abandoned;
+    shared_ptr<Operation> op;
+    {
+        lock_guard<mutex> lock(mut);
+        if (stopped)
+            return;
+        stopped = true;
+        abandoned.swap(queue);
+        op = inFlight;
+        updateNextPriority();
+    }
+
+    // synchronous callers may have been yielding to the abandoned queue
+    spec.cvComm.notify_all();
+
+    for (auto& queued : abandoned)
+        complete(queued, Spectrometer::ErrorCodes::Error);
+
+    if (op != nullptr)
+    {
+#if USE_LIBUSB_WIN32
+        // the worker will finish its current call
+#else
+        libusb_cancel_transfer(xfer);
+#endif
+        unique_lock<mutex> lock(mut);
+        cv.wait(lock, [&op] { return op->done; });
+    }
+
+#if USE_LIBUSB_WIN32
+    cv.notify_all();
+    if (worker.joinable())
+        worker.join();
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Operations
+////////////////////////////////////////////////////////////////////////////////
+
+//! Queue an operation behind any already pending on this spectrometer.
+//!
+//! @returns handle (positive), or negative on error
+int WasatchVCPP::AsyncControl::submit(shared_ptr<Operation> op)
+{
+    // ARM firmware expects all commands to carry at least 8 payload bytes
+    if (spec.isARM() && (int)op->data.size() < MIN_ARM_LEN && (op->read || op->data.empty()))
+        op->data.resize(MIN_ARM_LEN);
+
+    {
+        lock_guard<mutex> lock(mut);
+        if (stopped)
+            return Spectrometer::ErrorCodes::Error;
+
+        op->handle = nextHandle++;
+        if (nextHandle <= 0)
+            nextHandle = 1;
+        if (op->callback == nullptr)
+            operations[op->handle] = op;
+        op->queued = std::chrono::steady_clock::now();
+
+        // behind everything of the same or higher priority
+        auto iter = queue.begin();
+        while (iter != queue.end() && (*iter)->priority >= op->priority)
+            iter++;
+        queue.insert(iter, op);
+        updateNextPriority();
+
+#if USE_LIBUSB_WIN32
+        if (!worker.joinable())
+            worker = std::thread(&AsyncControl::run, this);
+#endif
+    }
+
+    logger.debug("AsyncControl: queued handle %d (%s bRequest 0x%02x, wValue 0x%04x, wIndex 0x%04x, %d bytes)",
+        op->handle, op->read ? "read" : "write", op->bRequest, op->wValue, op->wIndex, (int)op->data.size());
+
+    resume();
+    return op->handle;
+}
+
+//! Poll or wait for an operation submitted without a callback.  Once reported
+//! complete, the handle is released.
+//!
+//! @param handle (Input) as returned by submit()
+//! @param timeoutMS (Input) how long to wait (0 to poll)
+//! @param op (Output) the completed operation (result and any response)
+//! @returns 1 if complete, 0 if still pending, -1 if the handle is unknown
+int WasatchVCPP::AsyncControl::wait(int handle, int timeoutMS, Operation& op)
+{
+    unique_lock<mutex> lock(mut);
+    auto iter = operations.find(handle);
+    if (iter == operations.end())
+        return -1;
+
+    auto pending = iter->second;
+    if (!pending->done && timeoutMS > 0)
+        cv.wait_for(lock, std::chrono::milliseconds(timeoutMS), [&pending] { return pending->done; });
+    if (!pending->done)
+        return 0;
+
+    op = *pending;
+    operations.erase(handle);
+    return 1;
+}
+
+//! @returns operations queued or in flight
+int WasatchVCPP::AsyncControl::getPending()
+{
+    lock_guard<mutex> lock(mut);
+    return (int)queue.size() + (inFlight != nullptr ? 1 : 0);
+}
+
+//! Fail queued (not yet submitted) operations, e.g. a laser-enable which 
+//! would otherwise follow an urgent laser-disable onto the bus.
+//!
+//! @returns number of operations removed
+int WasatchVCPP::AsyncControl::cancelQueued(std::function<bool(const Operation&)> match)
+{
+    std::deque<shared_ptr<Operation> > cancelled;
+    {
+        lock_guard<mutex> lock(mut);
+        for (auto iter = queue.begin(); iter != queue.end(); )
+            if (match(**iter))
+            {
+                cancelled.push_back(*iter);
+                iter = queue.erase(iter);
+            }
+            else
+                iter++;
+        updateNextPriority();
+    }
+
+    for (auto& op : cancelled)
+    {
+        logger.debug("AsyncControl: cancelled queued handle %d (bRequest 0x%02x)", op->handle, op->bRequest);
+        complete(op, Spectrometer::ErrorCodes::Error);
+    }
+    return (int)cancelled.size();
+}
+
+//! Publish the priority of the queue's head for Spectrometer::lockComm (call
+//! with mut held).
+void WasatchVCPP::AsyncControl::updateNextPriority()
+{
+    nextPriority = stopped || queue.empty() ? -1 : (int)queue.front()->priority;
+}
+
+//! Record an operation's result and notify whoever is waiting on it.
+void WasatchVCPP::AsyncControl::complete(shared_ptr<Operation> op, int result)
+{
+    logger.debug("AsyncControl: handle %d (bRequest 0x%02x) completed with %d", op->handle, op->bRequest, result);
+
+    if (op->read)
+        op->data.resize(result > 0 ? result : 0);
+    op->result = result;
+
+    if (op->onComplete)
+        op->onComplete(result);
+    if (op->callback != nullptr)
+        op->callback(spec.index, op->handle, result, op->data.empty() ? nullptr : &op->data[0], op->userData);
+
+    {
+        lock_guard<mutex> lock(mut);
+        op->done = true;
+
+        // don't hold on forever to operations nobody waits on
+        if (op->callback == nullptr)
+        {
+            uncollected.push_back(op->handle);
+            while (uncollected.size() > MAX_UNCOLLECTED)
+            {
+                if (operations.erase(uncollected.front()) > 0)
+                    logger.debug("AsyncControl: released uncollected handle %d", uncollected.front());
+                uncollected.pop_front();
+            }
+        }
+    }
+    cv.notify_all();
+}
+
+#if USE_LIBUSB_WIN32
+
+////////////////////////////////////////////////////////////////////////////////
+// libusb-win32
+////////////////////////////////////////////////////////////////////////////////
+
+//! Nothing to do: the worker picks up new operations itself.
+void WasatchVCPP::AsyncControl::resume()
+{
+    cv.notify_all();
+}
+
+//! Drain the queue in order through the synchronous transfer functions.
+void WasatchVCPP::AsyncControl::run()
+{
+    while (true)
+    {
+        shared_ptr<Operation> op;
+        {
+            unique_lock<mutex> lock(mut);
+            cv.wait(lock, [this] { return stopped || !queue.empty(); });
+            if (queue.empty())
+                return;
+            op = inFlight = queue.front();
+            queue.pop_front();
+            updateNextPriority();
+        }
+
+        int result = Spectrometer::ErrorCodes::Error;
+        if (op->read)
+            result = spec.readControl(op->bRequest, op->wValue, op->wIndex, op->data, op->len, op->priority);
+        else if (spec.lockComm(op->priority))
+        {
+            if (!op->isCurrent || op->isCurrent())
+                result = spec.sendCmdLocked(op->bRequest, op->wValue, op->wIndex, op->data.empty() ? nullptr : &op->data[0], (int)op->data.size());
+            else
+                logger.debug("AsyncControl: dropped superseded handle %d (bRequest 0x%02x)", op->handle, op->bRequest);
+            spec.unlockComm(false);
+        }
+
+        {
+            lock_guard<mutex> lock(mut);
+            inFlight.reset();
+        }
+        complete(op, result);
+    }
+}
+
+#else
+
+////////////////////////////////////////////////////////////////////////////////
+// libusb-1.0
+////////////////////////////////////////////////////////////////////////////////
+
+static void LIBUSB_CALL onControlTransferComplete(libusb_transfer* transfer)
+{ ((WasatchVCPP::AsyncControl*)transfer->user_data)->onTransferComplete(); }
+
+//! Submit the next queued operation, if nothing is in flight and the comm
+//! lock is free.  Called on submit, and whenever the comm lock is released.
+void WasatchVCPP::AsyncControl::resume()
+{
+    while (true)
+    {
+        shared_ptr<Operation> op;
+        {
+            lock_guard<mutex> lock(mut);
+            if (stopped || inFlight != nullptr || queue.empty())
+                return;
+            if (!spec.tryLockComm(queue.front()->priority, queue.front()->queued))
+                return;
+            op = inFlight = queue.front();
+            queue.pop_front();
+            updateNextPriority();
+        }
+
+        int result = Spectrometer::ErrorCodes::Error;
+        if (op->isCurrent && !op->isCurrent())
+            logger.debug("AsyncControl: dropped superseded handle %d (bRequest 0x%02x)", op->handle, op->bRequest);
+        else if ((result = submitTransfer(*op)) == 0)
+            return;
+        else
+            logger.error("AsyncControl: unable to submit handle %d (%s)", op->handle, libusb_strerror(libusb_error(result)));
+        {
+            lock_guard<mutex> lock(mut);
+            inFlight.reset();
+        }
+        spec.unlockComm(false);
+        complete(op, result);
+    }
+}
+
+//! @returns 0 on success, else a libusb error
+int WasatchVCPP::AsyncControl::submitTransfer(const Operation& op)
+{
+    if (xfer == nullptr || spec.udev == nullptr)
+        return LIBUSB_ERROR_NO_DEVICE;
+
+    int len = (int)op.data.size();
+    xferBuf.assign(LIBUSB_CONTROL_SETUP_SIZE + len, 0);
+    libusb_fill_control_setup(&xferBuf[0], (uint8_t)(op.read ? DEVICE_TO_HOST : HOST_TO_DEVICE),
+        op.bRequest, op.wValue, op.wIndex, (uint16_t)len);
+    if (!op.read && len > 0)
+        memcpy(&xferBuf[LIBUSB_CONTROL_SETUP_SIZE], &op.data[0], len);
+
+    libusb_fill_control_transfer(xfer, spec.udev, &xferBuf[0], onControlTransferComplete, this, spec.maxTimeoutMS);
+
+    startEvents();
+    return libusb_submit_transfer(xfer);
+}
+
+//! Release the comm lock (letting the next operation go out) before
+//! notifying anyone, so the bus stays busy while callbacks run.
+void WasatchVCPP::AsyncControl::onTransferComplete()
+{
+    shared_ptr<Operation> op;
+    {
+        lock_guard<mutex> lock(mut);
+        op = inFlight;
+        inFlight.reset();
+    }
+    if (op == nullptr)
+        return;
+
+    int result;
+    switch (xfer->status)
+    {
+        case LIBUSB_TRANSFER_COMPLETED: result = xfer->actual_length;     break;
+        case LIBUSB_TRANSFER_TIMED_OUT: result = LIBUSB_ERROR_TIMEOUT;    break;
+        case LIBUSB_TRANSFER_STALL:     result = LIBUSB_ERROR_PIPE;       break;
+        case LIBUSB_TRANSFER_NO_DEVICE: result = LIBUSB_ERROR_NO_DEVICE;  break;
+        case LIBUSB_TRANSFER_CANCELLED: result = LIBUSB_ERROR_INTERRUPTED; break;
+        default:                        result = LIBUSB_ERROR_IO;         break;
+    }
+    if (op->read && result > 0)
+        memcpy(&op->data[0], libusb_control_transfer_get_data(xfer), std::min(result, (int)op->data.size()));
+
+    spec.unlockComm();
+    complete(op, result);
+}
+
+void WasatchVCPP::AsyncControl::startEvents()
+{
+    if (eventsRunning)
+        return;
+
+    lock_guard<mutex> lock(mutEvents);
+    if (!eventsRunning)
+    {
+        eventsRunning = true;
+        eventThread = std::thread(&AsyncControl::runEvents);
+    }
+}
+
+//! Shared by all spectrometers: dispatches completion callbacks.
+void WasatchVCPP::AsyncControl::runEvents()
+{
+    while (eventsRunning)
+    {
+        struct timeval tv = { 0, EVENT_POLL_MS * 1000 };
+        libusb_handle_events_timeout_completed(nullptr, &tv, nullptr);
+    }
+}
+
+#endif
@@ -0,0 +1,149 @@
+/**
+    @file   AsyncControl.h
+    @author Mark Zieg <mzieg@wasatchphotonics.com>
+    @brief  interface of WasatchVCPP::AsyncControl
+    @note   customers normally wouldn't access this file; use WasatchVCPP.h instead
+*/
+
+#pragma once
+
+#include "Logger.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifndef USE_LIBUSB_WIN32
+struct libusb_transfer;
+#endif
+
+namespace WasatchVCPP
+{
+    class Spectrometer;
+
+    //! Classes of control transfer, granted the bus in this order (highest
+    //! last).  Within a class, transfers go first-come first-served.
+    //!
+    //! @see Spectrometer::lockComm
+    enum class CommandPriority
+    {
+        Background,     //!< bulk housekeeping (EEPROM access)
+        Normal,
+        Urgent          //!< safety and responsiveness (laser off, cancel)
+    };
+    const int COMMAND_PRIORITIES = 3;
+
+    //! Internal class queueing asynchronous control transfers to one
+    //! spectrometer.
+    //!
+    //! Operations are submitted with libusb_submit_transfer on endpoint 0,
+    //! one at a time and in the order they were queued, so a batch of
+    //! settings reaches the device exactly as the equivalent sequence of
+    //! sendCmd calls would.  Each transfer holds the spectrometer's comm lock
+    //! from submission to completion, so it never overlaps a synchronous
+    //! control transfer; if the lock is busy, the queue resumes as soon as
+    //! it's released (@see Spectrometer::unlockComm).
+    //!
+    //! Completions are handled by one event thread shared by all spectrometers
+    //! (started on first use), so any number of operations can be pending
+    //! across the fleet without a thread per call.  Each operation has a
+    //! handle which can be polled or waited on through wait(), or else a
+    //! callback.  Completed operations which are never collected are 
+    //! released once 1024 newer ones have completed.  Callbacks run on a libusb event-handling thread, so must not
+    //! block or call synchronous library functions.
+    //!
+    //! Urgent operations are queued ahead of any other class still waiting
+    //! (but behind earlier urgent ones), and the head of the queue competes
+    //! for the comm lock at its own priority against synchronous callers.
+    //!
+    //! libusb-win32 has no asynchronous control transfers, so there each
+    //! spectrometer's queue is drained by its own worker thread instead.
+    class AsyncControl
+    {
+        public:
+            //! @param result bytes transferred, or negative on error
+            //! @param data response to a read (valid only during the callback)
+            typedef void (*Callback)(int specIndex, int handle, int result, const uint8_t* data, void* userData);
+
+            struct Operation
+            {
+                int handle = 0;
+                bool read = false;
+                uint8_t bRequest = 0;
+                uint16_t wValue = 0;
+                uint16_t wIndex = 0;
+                std::vector<uint8_t> data;      //!< payload, or response
+                int len = 0;                    //!< bytes the caller needs back (reads)
+                CommandPriority priority = CommandPriority::Normal;
+                std::chrono::steady_clock::time_point queued;
+
+                Callback callback = nullptr;
+                void* userData = nullptr;
+                std::function<bool()> isCurrent;        //!< internal, checked once granted the bus; false drops the operation
+                std::function<void(int)> onComplete;    //!< internal bookkeeping, run before the callback
+
+                bool done = false;
+                int result = 0;                 //!< bytes transferred, or negative on error
+            };
+
+            AsyncControl(Spectrometer& spec, Logger& logger);
+            ~AsyncControl();
+
+            int submit(std::shared_ptr<Operation> op);
+            int wait(int handle, int timeoutMS, Operation& op);
+            int getPending();
+            int cancelQueued(std::function<bool(const Operation&)> match);
+
+            //! priority of the next operation to submit, or -1 if none
+            int getNextPriority() const { return nextPriority; }
+            void resume();
+            void stop();
+
+#ifndef USE_LIBUSB_WIN32
+            void onTransferComplete();  //!< called from the libusb completion callback
+#endif
+
+        private:
+            Spectrometer& spec;
+            Logger& logger;
+
+            std::mutex mut;
+            std::condition_variable cv;
+            std::deque<std::shared_ptr<Operation> > queue;          //!< not yet submitted
+            std::shared_ptr<Operation> inFlight;
+            std::map<int, std::shared_ptr<Operation> > operations;  //!< by handle, until collected
+            std::deque<int> uncollected;                            //!< completed handles, oldest first
+            int nextHandle = 1;
+            bool stopped = false;
+            std::atomic<int> nextPriority;
+
+            void complete(std::shared_ptr<Operation> op, int result);
+            void updateNextPriority();
+
+#if USE_LIBUSB_WIN32
+            std::thread worker;
+            void run();
+#else
+            libusb_transfer* xfer = nullptr;
+            std::vector<uint8_t> xferBuf;   //!< setup packet followed by data stage
+
+            int submitTransfer(const Operation& op);
+
+            // shared event thread
+            static std::mutex mutEvents;
+            static int instances;
+            static std::atomic<bool> eventsRunning;
+            static std::thread eventThread;
+            static void startEvents();
+            static void runEvents();
+#endif
+    };
+}
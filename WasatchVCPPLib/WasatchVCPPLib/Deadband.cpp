@@ -0,0 +1,246 @@
+/**
+    @file   Deadband.cpp
+    @author Mark Zieg <mzieg@wasatchphotonics.com>
+    @brief  implementation of WasatchVCPP::Deadband
+    @note   customers normally wouldn't access this file; use WasatchVCPP.h instead
+*/
+
+#include "pch.h"
+#include "Deadband.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "SIMD.h"
+
+using std::vector;
+
+WasatchVCPP::Deadband::Deadband(Logger& logger)
+    : logger(logger)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Configuration
+////////////////////////////////////////////////////////////////////////////////
+
+//! @param metric      (Input) how to measure change (Off to emit every frame)
+//! @param threshold   (Input) change (in counts) a frame must exceed to be emitted
+//! @param heartbeatMS (Input) emit at least this often regardless (0 for never)
+bool WasatchVCPP::Deadband::configure(Metric metric, double threshold, int heartbeatMS)
+{
+    if (metric != Off && metric != MaxAbs && metric != RMS)
+    {
+        logger.error("Deadband: invalid metric %d", (int)metric);
+        return false;
+    }
+    if (!std::isfinite(threshold) || threshold < 0 || heartbeatMS < 0)
+    {
+        logger.error("Deadband: invalid threshold %g or heartbeat %d", threshold, heartbeatMS);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mut);
+    this->metric = metric;
+    this->threshold = threshold;
+    this->heartbeatMS = heartbeatMS;
+    last.clear();
+    stats = Stats();
+    return true;
+}
+
+//! @param bounds (Input) first and last pixel (inclusive) of each region,
+//!               or nullptr to compare whole spectra
+//! @param count  (Input) number of regions
+bool WasatchVCPP::Deadband::setRegions(const int* bounds, int count)
+{
+    vector<std::pair<int, int> > ranges;
+    if (bounds != nullptr && count > 0)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            int first = bounds[2 * i];
+            int lastPixel = bounds[2 * i + 1];
+            if (first < 0 || lastPixel < first)
+            {
+                logger.error("Deadband: invalid region %d (%d to %d)", i, first, lastPixel);
+                return false;
+            }
+            ranges.push_back(std::make_pair(first, lastPixel + 1));
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mut);
+    regions.swap(ranges);
+    return true;
+}
+
+bool WasatchVCPP::Deadband::isEnabled()
+{
+    std::lock_guard<std::mutex> lock(mut);
+    return metric != Off;
+}
+
+//! Forget the last frame emitted, so the next one is emitted regardless.
+void WasatchVCPP::Deadband::reset()
+{
+    std::lock_guard<std::mutex> lock(mut);
+    last.clear();
+}
+
+WasatchVCPP::Deadband::Stats WasatchVCPP::Deadband::getStats()
+{
+    std::lock_guard<std::mutex> lock(mut);
+    return stats;
+}
+
+size_t WasatchVCPP::Deadband::getMemoryBytes()
+{
+    std::lock_guard<std::mutex> lock(mut);
+    return last.capacity() * sizeof(double) + regions.capacity() * sizeof(regions[0]);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Comparison
+////////////////////////////////////////////////////////////////////////////////
+
+//! largest |a[i] - b[i]|
+double WasatchVCPP::Deadband::maxAbsChange(const double* a, const double* b, int n)
+{
+    int i = 0;
+    double result = 0;
+#if WPVCPP_SSE2
+    // clearing the sign bit is |x|; two accumulators hide the max latency
+    const __m128d mask = _mm_castsi128_pd(_mm_set_epi32(0x7fffffff, -1, 0x7fffffff, -1));
+    __m128d max0 = _mm_setzero_pd();
+    __m128d max1 = _mm_setzero_pd();
+    for (; i + 4 <= n; i += 4)
+    {
+        max0 = _mm_max_pd(max0, _mm_and_pd(mask, _mm_sub_pd(_mm_loadu_pd(a + i),     _mm_loadu_pd(b + i))));
+        max1 = _mm_max_pd(max1, _mm_and_pd(mask, _mm_sub_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2))));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, _mm_max_pd(max0, max1));
+    result = std::max(lanes[0], lanes[1]);
+#elif WPVCPP_NEON
+    float64x2_t max0 = vdupq_n_f64(0);
+    float64x2_t max1 = vdupq_n_f64(0);
+    for (; i + 4 <= n; i += 4)
+    {
+        max0 = vmaxq_f64(max0, vabdq_f64(vld1q_f64(a + i),     vld1q_f64(b + i)));
+        max1 = vmaxq_f64(max1, vabdq_f64(vld1q_f64(a + i + 2), vld1q_f64(b + i + 2)));
+    }
+    result = vmaxvq_f64(vmaxq_f64(max0, max1));
+#endif
+    for (; i < n; i++)
+        result = std::max(result, std::fabs(a[i] - b[i]));
+    return result;
+}
+
+//! sum of (a[i] - b[i])^2
+double WasatchVCPP::Deadband::sumSquaredChange(const double* a, const double* b, int n)
+{
+    int i = 0;
+    double result = 0;
+#if WPVCPP_SSE2
+    __m128d sum0 = _mm_setzero_pd();
+    __m128d sum1 = _mm_setzero_pd();
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128d d0 = _mm_sub_pd(_mm_loadu_pd(a + i),     _mm_loadu_pd(b + i));
+        __m128d d1 = _mm_sub_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2));
+        sum0 = _mm_add_pd(sum0, _mm_mul_pd(d0, d0));
+        sum1 = _mm_add_pd(sum1, _mm_mul_pd(d1, d1));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, _mm_add_pd(sum0, sum1));
+    result = lanes[0] + lanes[1];
+#elif WPVCPP_NEON
+    float64x2_t sum0 = vdupq_n_f64(0);
+    float64x2_t sum1 = vdupq_n_f64(0);
+    for (; i + 4 <= n; i += 4)
+    {
+        float64x2_t d0 = vsubq_f64(vld1q_f64(a + i),     vld1q_f64(b + i));
+        float64x2_t d1 = vsubq_f64(vld1q_f64(a + i + 2), vld1q_f64(b + i + 2));
+        sum0 = vfmaq_f64(sum0, d0, d0);
+        sum1 = vfmaq_f64(sum1, d1, d1);
+    }
+    result = vaddvq_f64(vaddq_f64(sum0, sum1));
+#endif
+    for (; i < n; i++)
+        result += (a[i] - b[i]) * (a[i] - b[i]);
+    return result;
+}
+
+//! change from the last frame emitted over the configured regions (clipped
+//! to the spectrum); a region lying wholly outside it is ignored
+double WasatchVCPP::Deadband::measure(const double* spectrum, int pixels)
+{
+    const double* prev = &last[0];
+    double maxAbs = 0;
+    double sumSquares = 0;
+    int count = 0;
+
+    auto compare = [&](int first, int end)
+    {
+        end = std::min(end, pixels);
+        if (first >= end)
+            return;
+        if (metric == MaxAbs)
+            maxAbs = std::max(maxAbs, maxAbsChange(spectrum + first, prev + first, end - first));
+        else
+            sumSquares += sumSquaredChange(spectrum + first, prev + first, end - first);
+        count += end - first;
+    };
+
+    if (regions.empty())
+        compare(0, pixels);
+    else
+        for (const auto& region : regions)
+            compare(region.first, region.second);
+
+    if (metric == MaxAbs)
+        return maxAbs;
+    return count > 0 ? std::sqrt(sumSquares / count) : 0;
+}
+
+//! Decide whether a frame should be delivered, remembering it if so.
+//!
+//! @param spectrum   (Input) the frame, as it would be delivered
+//! @param generation (Input) settings generation it was taken under
+//! @param when       (Input) when it arrived
+//! @returns true to emit the frame, false to suppress it
+bool WasatchVCPP::Deadband::accept(const double* spectrum, int pixels, uint32_t generation, Clock::time_point when)
+{
+    std::lock_guard<std::mutex> lock(mut);
+    if (metric == Off || pixels <= 0)
+    {
+        stats.framesEmitted++;
+        return true;
+    }
+
+    bool emit = true;
+    bool heartbeat = false;
+    if ((int)last.size() == pixels && generation == lastGeneration)
+    {
+        stats.lastChange = measure(spectrum, pixels);
+        emit = stats.lastChange > threshold;
+        if (!emit && heartbeatMS > 0 && when - lastTime >= std::chrono::milliseconds(heartbeatMS))
+            emit = heartbeat = true;
+    }
+
+    if (!emit)
+    {
+        stats.framesSuppressed++;
+        return false;
+    }
+
+    last.resize(pixels);
+    memcpy(&last[0], spectrum, pixels * sizeof(double));
+    lastGeneration = generation;
+    lastTime = when;
+    stats.framesEmitted++;
+    stats.heartbeats += heartbeat;
+    return true;
+}
@@ -0,0 +1,85 @@
+/**
+    @file   Deadband.h
+    @author Mark Zieg <mzieg@wasatchphotonics.com>
+    @brief  interface of WasatchVCPP::Deadband
+    @note   customers normally wouldn't access this file; use WasatchVCPP.h instead
+*/
+
+#pragma once
+
+#include "Logger.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace WasatchVCPP
+{
+    //! Internal class deciding which frames of a continuous stream are worth
+    //! delivering.
+    //!
+    //! Each frame is compared against the last one emitted, by the largest
+    //! per-pixel change (MaxAbs) or the root-mean-square change (RMS) over
+    //! the configured regions (the whole spectrum if none).  A frame is
+    //! emitted if that change exceeds the threshold, if the heartbeat interval
+    //! has passed since the last emission, or if it was taken under different
+    //! settings; otherwise it's suppressed.
+    //!
+    //! The comparison is SSE2 (x86) or NEON (AArch64), so it costs well under
+    //! a microsecond on a 2048-pixel frame.
+    class Deadband
+    {
+        public:
+            typedef std::chrono::steady_clock Clock;
+
+            enum Metric
+            {
+                Off,        //!< emit every frame
+                MaxAbs,
+                RMS
+            };
+
+            struct Stats
+            {
+                uint64_t framesEmitted = 0;
+                uint64_t framesSuppressed = 0;
+                uint64_t heartbeats = 0;    //!< emitted only because the heartbeat was due
+                double lastChange = 0;      //!< change measured on the latest frame
+            };
+
+            Deadband(Logger& logger);
+
+            bool configure(Metric metric, double threshold, int heartbeatMS);
+            bool setRegions(const int* bounds, int count);
+            bool isEnabled();
+            void reset();
+
+            bool accept(const double* spectrum, int pixels, uint32_t generation, Clock::time_point when);
+            Stats getStats();
+
+            size_t getMemoryBytes();
+
+            static double maxAbsChange(const double* a, const double* b, int n);
+            static double sumSquaredChange(const double* a, const double* b, int n);
+
+        private:
+            Logger& logger;
+            std::mutex mut;
+
+            Metric metric = Off;
+            double threshold = 0;
+            int heartbeatMS = 0;
+
+            //! [first, last) pixel ranges, or empty for the whole spectrum
+            std::vector<std::pair<int, int> > regions;
+
+            std::vector<double> last;       //!< last frame emitted (empty if none)
+            uint32_t lastGeneration = 0;
+            Clock::time_point lastTime;
+            Stats stats;
+
+            double measure(const double* spectrum, int pixels);
+    };
+}
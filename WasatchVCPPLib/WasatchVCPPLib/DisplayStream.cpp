@@ -0,0 +1,257 @@
+/**
+    @file   DisplayStream.cpp
+    @author Mark Zieg <mzieg@wasatchphotonics.com>
+    @brief  implementation of WasatchVCPP::DisplayStream
+    @note   customers normally wouldn't access this file; use WasatchVCPP.h instead
+*/
+
+#include "pch.h"
+#include "DisplayStream.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "SIMD.h"
+
+using std::unique_lock;
+using std::mutex;
+
+WasatchVCPP::DisplayStream::DisplayStream(Logger& logger)
+    : logger(logger), period(Clock::duration::zero())
+{
+}
+
+WasatchVCPP::DisplayStream::~DisplayStream()
+{
+    close();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Configuration
+////////////////////////////////////////////////////////////////////////////////
+
+//! @param width (Input) buckets per envelope (0 to disable); capped at the
+//!              spectrum's pixel count
+//! @param maxHz (Input) most envelopes per second (0 for one per spectrum)
+bool WasatchVCPP::DisplayStream::configure(int width, double maxHz)
+{
+    if (width < 0 || !std::isfinite(maxHz) || maxHz < 0)
+    {
+        logger.error("DisplayStream: invalid width %d or rate %g", width, maxHz);
+        return false;
+    }
+
+    std::lock_guard<mutex> lock(mut);
+    if (closed)
+    {
+        logger.error("DisplayStream: closed");
+        return false;
+    }
+    this->width = width;
+    period = maxHz > 0
+        ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / maxHz))
+        : Clock::duration::zero();
+    started = false;
+    sequence = sequenceRead = 0;
+    if (width == 0)
+    {
+        // disabling releases the envelope
+        std::vector<float>().swap(mins);
+        std::vector<float>().swap(maxs);
+    }
+    cv.notify_all();
+    return true;
+}
+
+//! Disable the stream for good (the spectrometer is closing): wake any 
+//! waiting readers, and wait for them to leave.
+void WasatchVCPP::DisplayStream::close()
+{
+    unique_lock<mutex> lock(mut);
+    closed = true;
+    width = 0;
+    cv.notify_all();
+    cv.wait(lock, [this] { return readers == 0; });
+}
+
+bool WasatchVCPP::DisplayStream::isEnabled()
+{
+    std::lock_guard<mutex> lock(mut);
+    return width > 0;
+}
+
+size_t WasatchVCPP::DisplayStream::getMemoryBytes()
+{
+    std::lock_guard<mutex> lock(mut);
+    return (mins.capacity() + maxs.capacity()) * sizeof(float);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Producer
+////////////////////////////////////////////////////////////////////////////////
+
+//! Reduce each bucket of pixels to its extremes.  Bucket b covers pixels
+//! [b * pixels / width, (b + 1) * pixels / width), so with width <= pixels
+//! every bucket holds at least one pixel.
+void WasatchVCPP::DisplayStream::envelope(const double* spectrum, int pixels, float* mins, float* maxs, int width)
+{
+    // bucket edges are stepped rather than divided: with buckets only a few
+    // pixels wide, a division per bucket costs as much as the comparisons
+    const int step = pixels / width;
+    const int remainder = pixels % width;
+    int carry = 0;
+
+    int start = 0;
+    for (int b = 0; b < width; b++)
+    {
+        int end = start + step;
+        carry += remainder;
+        if (carry >= width)
+        {
+            carry -= width;
+            end++;
+        }
+
+        int i = start;
+        double lo = spectrum[i];
+        double hi = spectrum[i];
+        i++;
+#if WPVCPP_SSE2
+        if (i + 2 <= end)
+        {
+            // two pairs of accumulators, so wide buckets aren't bound by
+            // min/max latency
+            __m128d vlo = _mm_set1_pd(lo);
+            __m128d vhi = vlo;
+            __m128d vlo2 = vlo;
+            __m128d vhi2 = vlo;
+            for (; i + 4 <= end; i += 4)
+            {
+                __m128d v = _mm_loadu_pd(spectrum + i);
+                __m128d v2 = _mm_loadu_pd(spectrum + i + 2);
+                vlo = _mm_min_pd(vlo, v);
+                vhi = _mm_max_pd(vhi, v);
+                vlo2 = _mm_min_pd(vlo2, v2);
+                vhi2 = _mm_max_pd(vhi2, v2);
+            }
+            for (; i + 2 <= end; i += 2)
+            {
+                __m128d v = _mm_loadu_pd(spectrum + i);
+                vlo = _mm_min_pd(vlo, v);
+                vhi = _mm_max_pd(vhi, v);
+            }
+            vlo = _mm_min_pd(vlo, vlo2);
+            vhi = _mm_max_pd(vhi, vhi2);
+            double lanes[2];
+            _mm_storeu_pd(lanes, vlo);
+            lo = std::min(lanes[0], lanes[1]);
+            _mm_storeu_pd(lanes, vhi);
+            hi = std::max(lanes[0], lanes[1]);
+        }
+#elif WPVCPP_NEON
+        if (i + 2 <= end)
+        {
+            float64x2_t vlo = vdupq_n_f64(lo);
+            float64x2_t vhi = vlo;
+            float64x2_t vlo2 = vlo;
+            float64x2_t vhi2 = vlo;
+            for (; i + 4 <= end; i += 4)
+            {
+                float64x2_t v = vld1q_f64(spectrum + i);
+                float64x2_t v2 = vld1q_f64(spectrum + i + 2);
+                vlo = vminq_f64(vlo, v);
+                vhi = vmaxq_f64(vhi, v);
+                vlo2 = vminq_f64(vlo2, v2);
+                vhi2 = vmaxq_f64(vhi2, v2);
+            }
+            for (; i + 2 <= end; i += 2)
+            {
+                float64x2_t v = vld1q_f64(spectrum + i);
+                vlo = vminq_f64(vlo, v);
+                vhi = vmaxq_f64(vhi, v);
+            }
+            lo = vminvq_f64(vminq_f64(vlo, vlo2));
+            hi = vmaxvq_f64(vmaxq_f64(vhi, vhi2));
+        }
+#endif
+        for (; i < end; i++)
+        {
+            lo = std::min(lo, spectrum[i]);
+            hi = std::max(hi, spectrum[i]);
+        }
+        mins[b] = (float)lo;
+        maxs[b] = (float)hi;
+        start = end;
+    }
+}
+
+//! Called with every spectrum acquired; makes a new envelope if one is due.
+//!
+//! @param generation (Input) settings generation the spectrum was taken under
+//! @param when       (Input) when it was acquired
+void WasatchVCPP::DisplayStream::offer(const double* spectrum, int pixels, uint32_t generation, Clock::time_point when)
+{
+    std::lock_guard<mutex> lock(mut);
+    if (width <= 0 || pixels <= 0)
+        return;
+    if (started && when - lastTime < period)
+        return;
+
+    const int buckets = std::min(width, pixels);
+    mins.resize(buckets);
+    maxs.resize(buckets);
+    envelope(spectrum, pixels, &mins[0], &maxs[0], buckets);
+
+    this->generation = generation;
+    lastTime = when;
+    started = true;
+    sequence++;
+    cv.notify_all();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Consumer
+////////////////////////////////////////////////////////////////////////////////
+
+//! Collect the latest envelope, if it hasn't already been read.
+//!
+//! @param mins       (Output) lowest value in each bucket
+//! @param maxs       (Output) highest value in each bucket
+//! @param len        (Input)  allocated length of mins and maxs
+//! @param timeoutMS  (Input)  how long to wait for a new envelope
+//! @param generation (Output) settings generation of the spectrum (optional)
+//! @returns number of buckets, 0 on timeout, or -1 if disabled or 'len' is
+//!          too short
+int WasatchVCPP::DisplayStream::read(float* mins, float* maxs, int len, int timeoutMS, uint32_t* generation)
+{
+    unique_lock<mutex> lock(mut);
+    if (width <= 0)
+        return -1;
+
+    if (sequence == sequenceRead && timeoutMS > 0)
+    {
+        readers++;
+        cv.wait_for(lock, std::chrono::milliseconds(timeoutMS), [this] { return sequence != sequenceRead || width <= 0; });
+        if (--readers == 0 && closed)
+            cv.notify_all();
+    }
+    if (width <= 0)
+        return -1;
+    if (sequence == sequenceRead)
+        return 0;
+
+    const int buckets = (int)this->mins.size();
+    if (len < buckets)
+    {
+        logger.error("DisplayStream: insufficient storage (%d of %d buckets)", len, buckets);
+        return -1;
+    }
+
+    memcpy(mins, &this->mins[0], buckets * sizeof(float));
+    memcpy(maxs, &this->maxs[0], buckets * sizeof(float));
+    if (generation != nullptr)
+        *generation = this->generation;
+    sequenceRead = sequence;
+    return buckets;
+}
@@ -0,0 +1,73 @@
+/**
+    @file   DisplayStream.h
+    @author Mark Zieg <mzieg@wasatchphotonics.com>
+    @brief  interface of WasatchVCPP::DisplayStream
+    @note   customers normally wouldn't access this file; use WasatchVCPP.h instead
+*/
+
+#pragma once
+
+#include "Logger.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace WasatchVCPP
+{
+    //! Internal class reducing spectra to a min/max envelope for live plots.
+    //!
+    //! The spectrum is divided into 'width' buckets of adjacent pixels (one
+    //! per plotted column), and each bucket reports its lowest and highest
+    //! value, so peaks survive however far the plot is decimated.  Every
+    //! spectrum acquired is offered, but an envelope is only computed when
+    //! one is due at the configured rate, so the cost follows the display
+    //! rate rather than the acquisition rate.  The envelope is one pass over
+    //! the spectrum, SSE2 (x86) or NEON (AArch64) within each bucket.
+    //!
+    //! Only the latest envelope is kept; a reader which falls behind simply
+    //! skips to it.  close() wakes any reader still waiting, and doesn't 
+    //! return until every reader has left, so the stream can then be 
+    //! destroyed.
+    class DisplayStream
+    {
+        public:
+            typedef std::chrono::steady_clock Clock;
+
+            DisplayStream(Logger& logger);
+            ~DisplayStream();
+
+            bool configure(int width, double maxHz);
+            void close();
+            bool isEnabled();
+
+            void offer(const double* spectrum, int pixels, uint32_t generation, Clock::time_point when = Clock::now());
+            int read(float* mins, float* maxs, int len, int timeoutMS, uint32_t* generation = nullptr);
+
+            size_t getMemoryBytes();
+
+            static void envelope(const double* spectrum, int pixels, float* mins, float* maxs, int width);
+
+        private:
+            Logger& logger;
+            std::mutex mut;
+            std::condition_variable cv;
+
+            int width = 0;                  //!< requested buckets (0 if disabled)
+            Clock::duration period;         //!< least time between envelopes
+            Clock::time_point lastTime;
+            bool started = false;           //!< whether an envelope has been made
+
+            std::vector<float> mins;        //!< latest envelope
+            std::vector<float> maxs;
+            uint32_t generation = 0;        //!< settings generation of the latest envelope
+            uint64_t sequence = 0;          //!< envelopes made
+            uint64_t sequenceRead = 0;      //!< envelopes made when last read
+
+            int readers = 0;                //!< threads inside read()
+            bool closed = false;
+    };
+}
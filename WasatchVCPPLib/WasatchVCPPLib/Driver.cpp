@@ -10,6 +10,7 @@
 #include "Spectrometer.h"
 #include "Util.h"
 
+#include <cstdint>
 #include <stdio.h>
 #include <string>
 #include <iostream>
@@ -58,6 +59,7 @@ void WasatchVCPP::Driver::destroy()
 ////////////////////////////////////////////////////////////////////////////////
 
 WasatchVCPP::Driver::Driver()
+    : scheduler(logger), memoryBudget(0), compactMode(false), framePoolFrames(4), framePoolFlags(0)
 {
 }
 
@@ -120,8 +122,14 @@ int WasatchVCPP::Driver::openAllSpectrometers()
 
                             int index = (int)spectrometers.size();
                             auto spec = new Spectrometer(udev, pid, index, logger);
+                            spec->setFramePool(framePoolFrames, framePoolFlags, getMemoryUsageLocked().total());
                             logger.debug("adding Spectrometer as index %d", index);
 
+                            // libusb-win32 doesn't expose the port path or speed
+                            spec->usbBus = (int)bus->location;
+                            spec->usbPorts = Util::sprintf("%d", dev->devnum);
+                            logger.info("spectrometer %d on bus %d device %s", index, spec->usbBus, spec->usbPorts.c_str());
+
                             spectrometers.insert(make_pair(index, spec));
                         }
                         else
@@ -201,8 +209,30 @@ int WasatchVCPP::Driver::openAllSpectrometers()
 
                         int index = (int)spectrometers.size();
                         auto spec = new Spectrometer(udev, pid, index, logger);
+                        spec->setFramePool(framePoolFrames, framePoolFlags, getMemoryUsageLocked().total());
                         logger.debug("adding Spectrometer as index %d", index);
 
+                        // record where it sits in the USB topology, so the 
+                        // Scheduler can respect per-bus bandwidth
+                        spec->usbBus = libusb_get_bus_number(dev);
+                        uint8_t ports[8];
+                        int depth = libusb_get_port_numbers(dev, ports, sizeof(ports));
+                        for (int p = 0; p < depth; p++)
+                            spec->usbPorts += Util::sprintf(p ? ".%d" : "%d", ports[p]);
+                        switch (libusb_get_device_speed(dev))
+                        {
+                            case LIBUSB_SPEED_LOW:        spec->usbSpeedMbps = 1;     break;
+                            case LIBUSB_SPEED_FULL:       spec->usbSpeedMbps = 12;    break;
+                            case LIBUSB_SPEED_HIGH:       spec->usbSpeedMbps = 480;   break;
+                            case LIBUSB_SPEED_SUPER:      spec->usbSpeedMbps = 5000;  break;
+#if defined(LIBUSB_API_VERSION) && LIBUSB_API_VERSION >= 0x01000106
+                            case LIBUSB_SPEED_SUPER_PLUS: spec->usbSpeedMbps = 10000; break;
+#endif
+                            default:                      spec->usbSpeedMbps = 0;     break;
+                        }
+                        logger.info("spectrometer %d on bus %d port %s (%d Mbps)", 
+                            index, spec->usbBus, spec->usbPorts.c_str(), spec->usbSpeedMbps);
+
                         spectrometers.insert(make_pair(index, spec));
                     }
                     else
@@ -248,6 +278,9 @@ bool WasatchVCPP::Driver::removeSpectrometer(int index)
     auto spec = getSpectrometer(index);
     if (spec == nullptr)
         return false;
+
+    // scheduled acquisitions reference every planned spectrometer
+    scheduler.stop();
     
     mutSpectrometers.lock();
 
@@ -279,3 +312,126 @@ bool WasatchVCPP::Driver::closeAllSpectrometers()
 
 string WasatchVCPP::Driver::getLibraryVersion() { return libraryVersion; }
 
+//! Start scheduled acquisitions on all spectrometers with a plan.
+//!
+//! @see Scheduler
+bool WasatchVCPP::Driver::startSchedule()
+{
+    mutSpectrometers.lock();
+    bool ok = scheduler.start(spectrometers);
+    mutSpectrometers.unlock();
+    return ok;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Memory
+////////////////////////////////////////////////////////////////////////////////
+
+//! Cap the memory held by all spectrometers' optional buffers (hardware-
+//! triggering queues, area-scan frames, flight recorders and frame pools),
+//! which are sized to fit when created.  Buffers already allocated are not
+//! shrunk.
+//!
+//! @param bytes (Input) budget for the whole library, or 0 for unlimited
+void WasatchVCPP::Driver::setMemoryBudget(size_t bytes)
+{
+    memoryBudget = bytes;
+}
+
+//! @returns approximate heap held across all open spectrometers, whatever
+//!          their indices
+WasatchVCPP::Spectrometer::MemoryUsage WasatchVCPP::Driver::getMemoryUsage()
+{
+    std::lock_guard<std::mutex> lock(mutSpectrometers);
+    return getMemoryUsageLocked();
+}
+
+WasatchVCPP::Spectrometer::MemoryUsage WasatchVCPP::Driver::getMemoryUsageLocked()
+{
+    Spectrometer::MemoryUsage usage;
+    for (auto& pair : spectrometers)
+        usage += pair.second->getMemoryUsage();
+    return usage;
+}
+
+//! @returns bytes remaining within the budget (SIZE_MAX if unlimited)
+size_t WasatchVCPP::Driver::getMemoryAvailable()
+{
+    size_t budget = memoryBudget;
+    if (budget == 0)
+        return SIZE_MAX;
+
+    size_t used = getMemoryUsage().total();
+    return used < budget ? budget - used : 0;
+}
+
+//! Compact mode trades convenience for footprint: EEPROM fields are no longer
+//! rendered as strings (so wp_get_eeprom etc return nothing), and axes are 
+//! held in single precision.  Applies to spectrometers already open, and to
+//! any opened later.
+void WasatchVCPP::Driver::setCompactMode(bool flag)
+{
+    compactMode = flag;
+    mutSpectrometers.lock();
+    for (auto& pair : spectrometers)
+        pair.second->setCompact(flag);
+    mutSpectrometers.unlock();
+}
+
+//! Size and options of each spectrometer's frame pool.  Applies to 
+//! spectrometers already open (replacing their pools once the frames in use
+//! are returned), and to any opened later.
+//!
+//! @returns false if any open spectrometer couldn't allocate the new pool
+bool WasatchVCPP::Driver::setFramePool(int frames, int flags)
+{
+    if (frames < 0)
+        return false;
+
+    framePoolFrames = frames;
+    framePoolFlags = flags;
+
+    bool ok = true;
+    mutSpectrometers.lock();
+    for (auto& pair : spectrometers)
+        ok = pair.second->setFramePool(frames, flags, getMemoryUsageLocked().total()) && ok;
+    mutSpectrometers.unlock();
+    return ok;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Warm Restore
+////////////////////////////////////////////////////////////////////////////////
+
+//! Remember a spectrometer's settings as it's closed, so they can be restored
+//! if the same unit is reopened.
+void WasatchVCPP::Driver::saveSettings(const std::string& serialNumber, const Spectrometer::Settings& settings)
+{
+    std::lock_guard<std::mutex> lock(mutSavedSettings);
+    if (warmRestore)
+        savedSettings[serialNumber] = settings;
+}
+
+bool WasatchVCPP::Driver::getSavedSettings(const std::string& serialNumber, Spectrometer::Settings& settings)
+{
+    std::lock_guard<std::mutex> lock(mutSavedSettings);
+    if (!warmRestore)
+        return false;
+
+    auto iter = savedSettings.find(serialNumber);
+    if (iter == savedSettings.end())
+        return false;
+    settings = iter->second;
+    return true;
+}
+
+//! Disabling warm restore also forgets any settings already saved, so every
+//! subsequent open starts from EEPROM defaults.
+void WasatchVCPP::Driver::setWarmRestore(bool flag)
+{
+    std::lock_guard<std::mutex> lock(mutSavedSettings);
+    warmRestore = flag;
+    if (!flag)
+        savedSettings.clear();
+}
+
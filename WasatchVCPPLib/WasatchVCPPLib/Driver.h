@@ -15,7 +15,10 @@
 #endif
 
 #include "Logger.h"
+#include "Scheduler.h"
+#include "Spectrometer.h"
 
+#include <atomic>
 #include <string>
 #include <mutex>
 #include <map>
@@ -45,11 +48,12 @@ namespace WasatchVCPP
         control message may be exchanged over endpoint 0 at any given time (per
         Spectrometer).
 
-        There are no specific locks in place, presently, to preclude things like:
-
-        - changing integration time during acquisition (in fact, cancelOperation
-          will do precisely this)
-        - changing laser state during acquisition
+        Control messages are deliberately not blocked during acquisition, so 
+        things like changing integration time (in fact, cancelOperation will do
+        precisely this) or laser state may be done while a spectrum is being 
+        read.  Each acquisition moves through an atomic state machine 
+        (Spectrometer::AcquisitionState), which documents which operations may
+        overlap an in-flight bulk read.
     */
     class Driver
     {
@@ -77,7 +81,28 @@ namespace WasatchVCPP
 
             std::string getLibraryVersion();
 
+            bool startSchedule();
+
+            // warm restore (@see Spectrometer::Settings)
+            void saveSettings(const std::string& serialNumber, const Spectrometer::Settings& settings);
+            bool getSavedSettings(const std::string& serialNumber, Spectrometer::Settings& settings);
+            void setWarmRestore(bool flag);
+
+            // memory (@see Spectrometer::MemoryUsage)
+            void setMemoryBudget(size_t bytes);
+            size_t getMemoryBudget() const { return memoryBudget; }
+            Spectrometer::MemoryUsage getMemoryUsage();
+            size_t getMemoryAvailable();
+            void setCompactMode(bool flag);
+            bool getCompactMode() const { return compactMode; }
+
+            // frame pools (@see FramePool)
+            bool setFramePool(int frames, int flags);
+            int getFramePoolFrames() const { return framePoolFrames; }
+            int getFramePoolFlags() const { return framePoolFlags; }
+
             Logger logger;
+            Scheduler scheduler;
 
         private:
             static std::mutex mutDriver;        //!< synchronize singleton 
@@ -86,6 +111,17 @@ namespace WasatchVCPP
 
             Driver(); 
 
+            Spectrometer::MemoryUsage getMemoryUsageLocked(); //!< for callers holding mutSpectrometers
+
             std::map<int, Spectrometer*> spectrometers;
+
+            bool warmRestore = false;   //!< opt-in (@see setWarmRestore)
+            std::mutex mutSavedSettings;
+            std::map<std::string, Spectrometer::Settings> savedSettings; //!< by serial number
+
+            std::atomic<size_t> memoryBudget;   //!< bytes, or 0 for unlimited
+            std::atomic<bool> compactMode;
+            std::atomic<int> framePoolFrames;   //!< for spectrometers opened later
+            std::atomic<int> framePoolFlags;
     };
 }
@@ -11,114 +11,480 @@
 #include "Util.h"
 
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <type_traits>
 
 using std::vector;
 using std::string;
 using std::set;
 using std::isnan;
 
-WasatchVCPP::EEPROM::EEPROM(Logger& logger)
-    : logger(logger)
+typedef WasatchVCPP::EEPROM EEPROM;
+typedef WasatchVCPP::EEPROM::Field Field;
+typedef WasatchVCPP::EEPROM::FieldType FieldType;
+
+////////////////////////////////////////////////////////////////////////////////
+// Layout
+////////////////////////////////////////////////////////////////////////////////
+
+//! maps the C++ type of an EEPROM attribute to its FieldType
+template <typename T> struct NativeType;
+template <> struct NativeType<bool>                 { static const FieldType value = FieldType::Bool; };
+template <> struct NativeType<uint8_t>              { static const FieldType value = FieldType::UInt8; };
+template <> struct NativeType<int16_t>              { static const FieldType value = FieldType::Int16; };
+template <> struct NativeType<uint16_t>             { static const FieldType value = FieldType::UInt16; };
+template <> struct NativeType<uint32_t>             { static const FieldType value = FieldType::UInt32; };
+template <> struct NativeType<float>                { static const FieldType value = FieldType::Float; };
+template <> struct NativeType<string>               { static const FieldType value = FieldType::String; };
+template <> struct NativeType<vector<uint8_t> >     { static const FieldType value = FieldType::Bytes; };
+template <> struct NativeType<set<int16_t> >        { static const FieldType value = FieldType::PixelList; };
+template <> struct NativeType<WasatchVCPP::FeatureMask> { static const FieldType value = FieldType::FeatureMask; };
+template <> struct NativeType<EEPROM::Subformats>   { static const FieldType value = FieldType::Subformat; };
+
+//! declares one row of the layout table
+#define EEPROM_FIELD(NAME, ATTR, PAGE, OFFSET, WIRE, LEN, MIN_FMT, MAX_FMT, FMT)                  \
+    { NAME, PAGE, OFFSET, FieldType::WIRE, LEN, MIN_FMT, MAX_FMT, FMT,                              \
+      NativeType<std::remove_reference<decltype(((EEPROM*)nullptr)->ATTR)>::type>::value,           \
+      [](EEPROM& e) -> void* { return &e.ATTR; } }
+
+const uint8_t ALL = 0xff; //!< maxFormat of rows which haven't (yet) been retired
+
+//! The EEPROM layout, per ENG-0034.
+//!
+//! The table is built once, on first use; it can't be a compile-time constant
+//! because each row's attribute accessor is a (captureless) lambda.
+//!
+//! Rows with a nullptr format are rendered by hand in stringifyAll(), generally
+//! because they were historically reported under a different name or grouping.
+//! Raman Intensity Calibration (page 6) is variable-length and shares its page
+//! with user data depending on subformat, so it is handled outside the table.
+const vector<Field>& WasatchVCPP::EEPROM::layout()
 {
+    static const vector<Field> fields = 
+    {
+        //           name                              attribute                          pg  off  wire       len  min  max   fmt
+        EEPROM_FIELD("model",                          model,                              0,   0, String,     16,  0, ALL,  "%s"),
+        EEPROM_FIELD("serialNumber",                   serialNumber,                       0,  16, String,     16,  0, ALL,  "%s"),
+        EEPROM_FIELD("baudRate",                       baudRate,                           0,  32, UInt32,      0,  0, ALL,  "%d"),
+        EEPROM_FIELD("hasCooling",                     hasCooling,                         0,  36, Bool,        0,  0, ALL,  "%d"),
+        EEPROM_FIELD("hasBattery",                     hasBattery,                         0,  37, Bool,        0,  0, ALL,  "%d"),
+        EEPROM_FIELD("hasLaser",                       hasLaser,                           0,  38, Bool,        0,  0, ALL,  "%d"),
+        EEPROM_FIELD("excitationNM",                   excitationNM,                       0,  39, UInt16,      0,  0,   3,  "%.3f"),
+        EEPROM_FIELD("featureMask",                    featureMask,                        0,  39, UInt16,      0,  9, ALL,  nullptr),
+        EEPROM_FIELD("slitSizeUM",                     slitSizeUM,                         0,  41, UInt16,      0,  0, ALL,  "%u"),
+        EEPROM_FIELD("startupIntegrationTimeMS",       startupIntegrationTimeMS,           0,  43, UInt16,      0,  0, ALL,  "%u"),
+        EEPROM_FIELD("startupDetectorTemperatureDegC", startupDetectorTemperatureDegC,     0,  45, Int16,       0,  0, ALL,  "%d"),
+        EEPROM_FIELD("startupTriggeringMode",          startupTriggeringMode,              0,  47, UInt8,       0,  0, ALL,  "%u"),
+        EEPROM_FIELD("detectorGain",                   detectorGain,                       0,  48, Float,       0,  0, ALL,  "%.2f"),
+        EEPROM_FIELD("detectorOffset",                 detectorOffset,                     0,  52, Int16,       0,  0, ALL,  "%d"),
+        EEPROM_FIELD("detectorGainOdd",                detectorGainOdd,                    0,  54, Float,       0,  0, ALL,  "%.2f"),
+        EEPROM_FIELD("detectorOffsetOdd",              detectorOffsetOdd,                  0,  58, Int16,       0,  0, ALL,  "%d"),
+        EEPROM_FIELD("format",                         format,                             0,  63, UInt8,       0,  0, ALL,  "%d"),
+
+        EEPROM_FIELD("wavecalCoeffs[0]",               wavecalCoeffs[0],                   1,   0, Float,       0,  0, ALL,  "%g"),
+        EEPROM_FIELD("wavecalCoeffs[1]",               wavecalCoeffs[1],                   1,   4, Float,       0,  0, ALL,  "%g"),
+        EEPROM_FIELD("wavecalCoeffs[2]",               wavecalCoeffs[2],                   1,   8, Float,       0,  0, ALL,  "%g"),
+        EEPROM_FIELD("wavecalCoeffs[3]",               wavecalCoeffs[3],                   1,  12, Float,       0,  0, ALL,  "%g"),
+        EEPROM_FIELD("degCToDACCoeffs[0]",             degCToDACCoeffs[0],                 1,  16, Float,       0,  0, ALL,  "%g"),
+        EEPROM_FIELD("degCToDACCoeffs[1]",             degCToDACCoeffs[1],                 1,  20, Float,       0,  0, ALL,  "%g"),
+        EEPROM_FIELD("degCToDACCoeffs[2]",             degCToDACCoeffs[2],                 1,  24, Float,       0,  0, ALL,  "%g"),
+        EEPROM_FIELD("detectorTempMax",                detectorTempMax,                    1,  28, Int16,       0,  0, ALL,  "%d"),
+        EEPROM_FIELD("detectorTempMin",                detectorTempMin,                    1,  30, Int16,       0,  0, ALL,  "%d"),
+        EEPROM_FIELD("adcToDegCCoeffs[0]",             adcToDegCCoeffs[0],                 1,  32, Float,       0,  0, ALL,  "%g"),
+        EEPROM_FIELD("adcToDegCCoeffs[1]",             adcToDegCCoeffs[1],                 1,  36, Float,       0,  0, ALL,  "%g"),
+        EEPROM_FIELD("adcToDegCCoeffs[2]",             adcToDegCCoeffs[2],                 1,  40, Float,       0,  0, ALL,  "%g"),
+        EEPROM_FIELD("thermistorResistanceAt298K",     thermistorResistanceAt298K,         1,  44, Int16,       0,  0, ALL,  "%d"),
+        EEPROM_FIELD("thermistorBeta",                 thermistorBeta,                     1,  46, Int16,       0,  0, ALL,  "%d"),
+        EEPROM_FIELD("calibrationDate",                calibrationDate,                    1,  48, String,     12,  0, ALL,  "%s"),
+        EEPROM_FIELD("calibrationBy",                  calibrationBy,                      1,  60, String,      3,  0, ALL,  "%s"),
+
+        EEPROM_FIELD("detectorName",                   detectorName,                       2,   0, String,     16,  0, ALL,  "%s"),
+        EEPROM_FIELD("activePixelsHoriz",              activePixelsHoriz,                  2,  16, UInt16,      0,  0, ALL,  "%u"),
+        EEPROM_FIELD("activePixelsVert",               activePixelsVert,                   2,  19, UInt16,      0,  0, ALL,  "%u"),
+        EEPROM_FIELD("minIntegrationTimeMS",           minIntegrationTimeMS,               2,  21, UInt16,      0,  0,   4,  "%u"),
+        EEPROM_FIELD("maxIntegrationTimeMS",           maxIntegrationTimeMS,               2,  23, UInt16,      0,  0,   4,  "%u"),
+        EEPROM_FIELD("wavecalCoeffs[4]",               wavecalCoeffs[4],                   2,  21, Float,       0,  8, ALL,  "%g"),
+        EEPROM_FIELD("actualPixelsHoriz",              actualPixelsHoriz,                  2,  25, UInt16,      0,  0, ALL,  "%u"),
+        EEPROM_FIELD("ROIHorizStart",                  ROIHorizStart,                      2,  27, UInt16,      0,  0, ALL,  "%u"),
+        EEPROM_FIELD("ROIHorizEnd",                    ROIHorizEnd,                        2,  29, UInt16,      0,  0, ALL,  "%u"),
+        EEPROM_FIELD("ROIVertRegionStart[0]",          ROIVertRegionStart[0],              2,  31, UInt16,      0,  0, ALL,  nullptr),
+        EEPROM_FIELD("ROIVertRegionEnd[0]",            ROIVertRegionEnd[0],                2,  33, UInt16,      0,  0, ALL,  nullptr),
+        EEPROM_FIELD("ROIVertRegionStart[1]",          ROIVertRegionStart[1],              2,  35, UInt16,      0,  0, ALL,  nullptr),
+        EEPROM_FIELD("ROIVertRegionEnd[1]",            ROIVertRegionEnd[1],                2,  37, UInt16,      0,  0, ALL,  nullptr),
+        EEPROM_FIELD("ROIVertRegionStart[2]",          ROIVertRegionStart[2],              2,  39, UInt16,      0,  0, ALL,  nullptr),
+        EEPROM_FIELD("ROIVertRegionEnd[2]",            ROIVertRegionEnd[2],                2,  41, UInt16,      0,  0, ALL,  nullptr),
+        EEPROM_FIELD("linearityCoeffs[0]",             linearityCoeffs[0],                 2,  43, Float,       0,  0, ALL,  "%g"),
+        EEPROM_FIELD("linearityCoeffs[1]",             linearityCoeffs[1],                 2,  47, Float,       0,  0, ALL,  "%g"),
+        EEPROM_FIELD("linearityCoeffs[2]",             linearityCoeffs[2],                 2,  51, Float,       0,  0, ALL,  "%g"),
+        EEPROM_FIELD("linearityCoeffs[3]",             linearityCoeffs[3],                 2,  55, Float,       0,  0, ALL,  "%g"),
+        EEPROM_FIELD("linearityCoeffs[4]",             linearityCoeffs[4],                 2,  59, Float,       0,  0, ALL,  "%g"),
+
+        // page 3 bytes 0-11 (lifetime counters, laser temperature limits) are 
+        // not parsed, but are preserved by serialize()
+        EEPROM_FIELD("laserPowerCoeffs[0]",            laserPowerCoeffs[0],                3,  12, Float,       0,  0, ALL,  "%g"),
+        EEPROM_FIELD("laserPowerCoeffs[1]",            laserPowerCoeffs[1],                3,  16, Float,       0,  0, ALL,  "%g"),
+        EEPROM_FIELD("laserPowerCoeffs[2]",            laserPowerCoeffs[2],                3,  20, Float,       0,  0, ALL,  "%g"),
+        EEPROM_FIELD("laserPowerCoeffs[3]",            laserPowerCoeffs[3],                3,  24, Float,       0,  0, ALL,  "%g"),
+        EEPROM_FIELD("maxLaserPowerMW",                maxLaserPowerMW,                    3,  28, Float,       0,  0, ALL,  "%g"),
+        EEPROM_FIELD("minLaserPowerMW",                minLaserPowerMW,                    3,  32, Float,       0,  0, ALL,  "%g"),
+        EEPROM_FIELD("excitationNM",                   excitationNM,                       3,  36, Float,       0,  4, ALL,  "%.3f"),
+        EEPROM_FIELD("minIntegrationTimeMS",           minIntegrationTimeMS,               3,  40, UInt32,      0,  5, ALL,  "%u"),
+        EEPROM_FIELD("maxIntegrationTimeMS",           maxIntegrationTimeMS,               3,  44, UInt32,      0,  5, ALL,  "%u"),
+        EEPROM_FIELD("avgResolution",                  avgResolution,                      3,  48, Float,       0,  7, ALL,  "%.2f"),
+
+        EEPROM_FIELD("userData",                       userData,                           4,   0, Bytes,      64,  0, ALL,  "%s"),
+
+        EEPROM_FIELD("badPixels",                      badPixels,                          5,   0, PixelList,  15,  0, ALL,  "%d"),
+        EEPROM_FIELD("productConfiguration",           productConfiguration,               5,  30, String,     16,  5, ALL,  "%s"),
+        EEPROM_FIELD("subformat",                      subformat,                          5,  63, UInt8,       0,  8, ALL,  "%u"),
+    };
+    return fields;
 }
 
-bool WasatchVCPP::EEPROM::parse(const vector<vector<uint8_t> >& pages_in)
+#undef EEPROM_FIELD
+
+////////////////////////////////////////////////////////////////////////////////
+// Layout engine (private helpers)
+////////////////////////////////////////////////////////////////////////////////
+
+static bool applies(const Field& f, uint8_t format)
+{ return format >= f.minFormat && format <= f.maxFormat; }
+
+static bool isNumeric(FieldType t)
 {
-    // cache so caller can retrieve if desired
-    pages = pages_in;
+    return t != FieldType::String 
+        && t != FieldType::Bytes 
+        && t != FieldType::PixelList;
+}
 
-    format = ParseData::toUInt8(pages[0], 63);
+//! @returns how many bytes the field occupies within its page
+static int wireSize(const Field& f)
+{
+    switch (f.wire)
+    {
+        case FieldType::Bool:
+        case FieldType::UInt8:      return 1;
+        case FieldType::Int16:
+        case FieldType::UInt16:     return 2;
+        case FieldType::UInt32:
+        case FieldType::Float:      return 4;
+        case FieldType::String:
+        case FieldType::Bytes:      return f.len;
+        case FieldType::PixelList:  return 2 * f.len;
+        default:                    return 0;
+    }
+}
 
-    model = ParseData::toString(pages[0], 0, 16);
-    serialNumber = ParseData::toString(pages[0], 16, 16);
-    baudRate = ParseData::toUInt32(pages[0], 32);
-    hasCooling = ParseData::toBool(pages[0], 36);
-    hasBattery = ParseData::toBool(pages[0], 37);
-    hasLaser = ParseData::toBool(pages[0], 38);
-    excitationNM = ParseData::toUInt16(pages[0], 39); // for old formats, first read this as excitation
-    slitSizeUM = ParseData::toUInt16(pages[0], 41);
-
-    startupIntegrationTimeMS = ParseData::toUInt16(pages[0], 43);
-    startupDetectorTemperatureDegC = ParseData::toInt16(pages[0], 45);
-    startupTriggeringMode = ParseData::toUInt8(pages[0], 47);
-    detectorGain = ParseData::toFloat(pages[0], 48); 
-    detectorOffset = ParseData::toInt16(pages[0], 52); 
-    detectorGainOdd = ParseData::toFloat(pages[0], 54); 
-    detectorOffsetOdd = ParseData::toInt16(pages[0], 58);
-
-    wavecalCoeffs[0] = ParseData::toFloat(pages[1], 0);
-    wavecalCoeffs[1] = ParseData::toFloat(pages[1], 4);
-    wavecalCoeffs[2] = ParseData::toFloat(pages[1], 8);
-    wavecalCoeffs[3] = ParseData::toFloat(pages[1], 12);
-    degCToDACCoeffs[0] = ParseData::toFloat(pages[1], 16);
-    degCToDACCoeffs[1] = ParseData::toFloat(pages[1], 20);
-    degCToDACCoeffs[2] = ParseData::toFloat(pages[1], 24);
-    detectorTempMax = ParseData::toInt16(pages[1], 28);
-    detectorTempMin = ParseData::toInt16(pages[1], 30);
-    adcToDegCCoeffs[0] = ParseData::toFloat(pages[1], 32);
-    adcToDegCCoeffs[1] = ParseData::toFloat(pages[1], 36);
-    adcToDegCCoeffs[2] = ParseData::toFloat(pages[1], 40);
-    thermistorResistanceAt298K = ParseData::toInt16(pages[1], 44);
-    thermistorBeta = ParseData::toInt16(pages[1], 46);
-    calibrationDate = ParseData::toString(pages[1], 48, 12);
-    calibrationBy = ParseData::toString(pages[1], 60, 3);
-
-    detectorName = ParseData::toString(pages[2], 0, 16);
-    activePixelsHoriz = ParseData::toUInt16(pages[2], 16); // note: byte 18 unused
-    activePixelsVert = ParseData::toUInt16(pages[2], 19);
-    minIntegrationTimeMS = ParseData::toUInt16(pages[2], 21); // will overwrite if 
-    maxIntegrationTimeMS = ParseData::toUInt16(pages[2], 23); //   format >= 5
-    actualPixelsHoriz = ParseData::toUInt16(pages[2], 25);
-    ROIHorizStart = ParseData::toUInt16(pages[2], 27);
-    ROIHorizEnd = ParseData::toUInt16(pages[2], 29);
-    ROIVertRegionStart[0] = ParseData::toUInt16(pages[2], 31);
-    ROIVertRegionEnd[0] = ParseData::toUInt16(pages[2], 33);
-    ROIVertRegionStart[1] = ParseData::toUInt16(pages[2], 35);
-    ROIVertRegionEnd[1] = ParseData::toUInt16(pages[2], 37);
-    ROIVertRegionStart[2] = ParseData::toUInt16(pages[2], 39);
-    ROIVertRegionEnd[2] = ParseData::toUInt16(pages[2], 41);
-    linearityCoeffs[0] = ParseData::toFloat(pages[2], 43);
-    linearityCoeffs[1] = ParseData::toFloat(pages[2], 47);
-    linearityCoeffs[2] = ParseData::toFloat(pages[2], 51);
-    linearityCoeffs[3] = ParseData::toFloat(pages[2], 55);
-    linearityCoeffs[4] = ParseData::toFloat(pages[2], 59);
-
-    // deviceLifetimeOperationMinutes = ParseData::toInt32(pages[3], 0);
-    // laserLifetimeOperationMinutes = ParseData::toInt32(pages[3], 4);
-    // laserTemperatureMax  = ParseData::toInt16(pages[3], 8);
-    // laserTemperatureMin  = ParseData::toInt16(pages[3], 10);
-
-    laserPowerCoeffs[0] = ParseData::toFloat(pages[3], 12);
-    laserPowerCoeffs[1] = ParseData::toFloat(pages[3], 16);
-    laserPowerCoeffs[2] = ParseData::toFloat(pages[3], 20);
-    laserPowerCoeffs[3] = ParseData::toFloat(pages[3], 24);
-    maxLaserPowerMW = ParseData::toFloat(pages[3], 28);
-    minLaserPowerMW = ParseData::toFloat(pages[3], 32);
-
-    // correct laser excitation across formats
-    if (format >= 4)
-        excitationNM = ParseData::toFloat(pages[3], 36);
-
-    if (format >= 5)
+//! the range of integral values representable by a numeric type
+static bool integralRange(FieldType t, double& lo, double& hi)
+{
+    switch (t)
     {
-        minIntegrationTimeMS = ParseData::toUInt32(pages[3], 40);
-        maxIntegrationTimeMS = ParseData::toUInt32(pages[3], 44);
+        case FieldType::Bool:        lo = 0;      hi = 1;          return true;
+        case FieldType::UInt8:       lo = 0;      hi = 0xff;       return true;
+        case FieldType::Int16:       lo = -32768; hi = 32767;      return true;
+        case FieldType::UInt16:      lo = 0;      hi = 0xffff;     return true;
+        case FieldType::UInt32:      lo = 0;      hi = 0xffffffff; return true;
+        case FieldType::FeatureMask: lo = 0;      hi = 0xffff;     return true;
+        case FieldType::Subformat:   lo = 0;      hi = (int)EEPROM::Subformats::SUBFORMAT_COUNT - 1; return true;
+        default:                                                   return false;
     }
+}
 
-    userData = pages[4]; // technically, on format < 4, should only be 63 bytes
+static double loadNumber(const Field& f, EEPROM& e)
+{
+    void* p = f.attr(e);
+    switch (f.native)
+    {
+        case FieldType::Bool:        return *(bool*)p ? 1 : 0;
+        case FieldType::UInt8:       return *(uint8_t*)p;
+        case FieldType::Int16:       return *(int16_t*)p;
+        case FieldType::UInt16:      return *(uint16_t*)p;
+        case FieldType::UInt32:      return *(uint32_t*)p;
+        case FieldType::Float:       return *(float*)p;
+        case FieldType::FeatureMask: return ((WasatchVCPP::FeatureMask*)p)->toUInt16();
+        case FieldType::Subformat:   return (int)*(EEPROM::Subformats*)p;
+        default:                     return 0;
+    }
+}
 
-    badPixels.clear();
-    for (int i = 0; i < 15; i++)
+static void storeNumber(const Field& f, EEPROM& e, double value)
+{
+    void* p = f.attr(e);
+    int64_t i = f.native == FieldType::Float ? 0 : (int64_t)value;
+    switch (f.native)
     {
-        auto pixel = ParseData::toInt16(pages[5], i * 2);
-        if (pixel >= 0)
-            badPixels.insert(pixel); 
+        case FieldType::Bool:        *(bool*)p     = value != 0;       break;
+        case FieldType::UInt8:       *(uint8_t*)p  = (uint8_t)i;       break;
+        case FieldType::Int16:       *(int16_t*)p  = (int16_t)i;       break;
+        case FieldType::UInt16:      *(uint16_t*)p = (uint16_t)i;      break;
+        case FieldType::UInt32:      *(uint32_t*)p = (uint32_t)i;      break;
+        case FieldType::Float:       *(float*)p    = (float)value;     break;
+        case FieldType::FeatureMask: *(WasatchVCPP::FeatureMask*)p = WasatchVCPP::FeatureMask((uint16_t)i); break;
+        case FieldType::Subformat:   *(EEPROM::Subformats*)p = (EEPROM::Subformats)(uint8_t)i; break;
+        default:                                                       break;
+    }
+}
+
+//! reset the field's attribute to its zero value
+static void clearField(const Field& f, EEPROM& e)
+{
+    void* p = f.attr(e);
+    switch (f.native)
+    {
+        case FieldType::String:    ((string*)p)->clear();          break;
+        case FieldType::Bytes:     ((vector<uint8_t>*)p)->clear(); break;
+        case FieldType::PixelList: ((set<int16_t>*)p)->clear();    break;
+        default:                   storeNumber(f, e, 0);           break;
+    }
+}
+
+static void readField(const Field& f, EEPROM& e, const vector<uint8_t>& page)
+{
+    void* p = f.attr(e);
+    switch (f.wire)
+    {
+        case FieldType::String:    
+            *(string*)p = WasatchVCPP::ParseData::toString(page, f.offset, f.len); 
+            break;
+        case FieldType::Bytes:     
+            ((vector<uint8_t>*)p)->assign(page.begin() + f.offset, page.begin() + f.offset + f.len); 
+            break;
+        case FieldType::PixelList:
+            ((set<int16_t>*)p)->clear();
+            for (int i = 0; i < f.len; i++)
+            {
+                auto pixel = WasatchVCPP::ParseData::toInt16(page, f.offset + i * 2);
+                if (pixel >= 0)
+                    ((set<int16_t>*)p)->insert(pixel);
+            }
+            break;
+        case FieldType::Bool:   storeNumber(f, e, WasatchVCPP::ParseData::toBool  (page, f.offset)); break;
+        case FieldType::UInt8:  storeNumber(f, e, WasatchVCPP::ParseData::toUInt8 (page, f.offset)); break;
+        case FieldType::Int16:  storeNumber(f, e, WasatchVCPP::ParseData::toInt16 (page, f.offset)); break;
+        case FieldType::UInt16: storeNumber(f, e, WasatchVCPP::ParseData::toUInt16(page, f.offset)); break;
+        case FieldType::UInt32: storeNumber(f, e, WasatchVCPP::ParseData::toUInt32(page, f.offset)); break;
+        case FieldType::Float:  storeNumber(f, e, WasatchVCPP::ParseData::toFloat (page, f.offset)); break;
+        default: break;
+    }
+}
+
+static bool writeField(const Field& f, EEPROM& e, vector<uint8_t>& page)
+{
+    void* p = f.attr(e);
+    switch (f.wire)
+    {
+        case FieldType::String:
+            return WasatchVCPP::ParseData::writeString(*(string*)p, page, f.offset, f.len);
+        case FieldType::Bytes:
+        {
+            const vector<uint8_t>& bytes = *(vector<uint8_t>*)p;
+            for (int i = 0; i < f.len; i++)
+                page[f.offset + i] = i < (int)bytes.size() ? bytes[i] : 0;
+            return true;
+        }
+        case FieldType::PixelList:
+        {
+            const set<int16_t>& pixels = *(set<int16_t>*)p;
+            auto iter = pixels.begin();
+            for (int i = 0; i < f.len; i++)
+            {
+                int16_t pixel = -1;
+                if (iter != pixels.end())
+                    pixel = *iter++;
+                if (!WasatchVCPP::ParseData::writeInt16(pixel, page, f.offset + i * 2))
+                    return false;
+            }
+            return true;
+        }
+        default:
+            break;
     }
 
-    if (format >= 5)
-        productConfiguration = ParseData::toString(pages[5], 30, 16);
+    double value = loadNumber(f, e);
+    switch (f.wire)
+    {
+        case FieldType::Bool:   return WasatchVCPP::ParseData::writeBool  (value != 0,                 page, f.offset);
+        case FieldType::UInt8:  return WasatchVCPP::ParseData::writeUInt8 ((uint8_t) (int64_t)value,  page, f.offset);
+        case FieldType::Int16:  return WasatchVCPP::ParseData::writeInt16 ((int16_t) (int64_t)value,  page, f.offset);
+        case FieldType::UInt16: return WasatchVCPP::ParseData::writeUInt16((uint16_t)(int64_t)value,  page, f.offset);
+        case FieldType::UInt32: return WasatchVCPP::ParseData::writeUInt32((uint32_t)(int64_t)value,  page, f.offset);
+        case FieldType::Float:  return WasatchVCPP::ParseData::writeFloat ((float)value,              page, f.offset);
+        default:                return false;
+    }
+}
+
+//! @returns whether the field's attribute holds the same value in both
+static bool sameField(const Field& f, EEPROM& a, EEPROM& b)
+{
+    switch (f.native)
+    {
+        case FieldType::String:    return *(string*)f.attr(a) == *(string*)f.attr(b);
+        case FieldType::Bytes:     return *(vector<uint8_t>*)f.attr(a) == *(vector<uint8_t>*)f.attr(b);
+        case FieldType::PixelList: return *(set<int16_t>*)f.attr(a) == *(set<int16_t>*)f.attr(b);
+        case FieldType::Float:     return memcmp(f.attr(a), f.attr(b), sizeof(float)) == 0;
+        default:                   return loadNumber(f, a) == loadNumber(f, b);
+    }
+}
+
+//! @returns an empty string if the attribute can be written to the field, 
+//!          else a description of why not
+static string checkField(const Field& f, EEPROM& e)
+{
+    void* p = f.attr(e);
+    switch (f.wire)
+    {
+        case FieldType::String:
+        {
+            const string& s = *(string*)p;
+            if ((int)s.size() > f.len)
+                return WasatchVCPP::Util::sprintf("%s: length %d exceeds %d", f.name, (int)s.size(), f.len);
+            if (s.find('\0') != string::npos)
+                return WasatchVCPP::Util::sprintf("%s: embedded null", f.name);
+            return "";
+        }
+        case FieldType::Bytes:
+            if ((int)((vector<uint8_t>*)p)->size() > f.len)
+                return WasatchVCPP::Util::sprintf("%s: length %d exceeds %d", f.name, (int)((vector<uint8_t>*)p)->size(), f.len);
+            return "";
+        case FieldType::PixelList:
+        {
+            const set<int16_t>& pixels = *(set<int16_t>*)p;
+            if ((int)pixels.size() > f.len)
+                return WasatchVCPP::Util::sprintf("%s: %d entries exceeds %d", f.name, (int)pixels.size(), f.len);
+            if (!pixels.empty() && *pixels.begin() < 0)
+                return WasatchVCPP::Util::sprintf("%s: negative pixel %d", f.name, *pixels.begin());
+            return "";
+        }
+        default:
+            break;
+    }
+
+    double value = loadNumber(f, e);
+    double lo = 0, hi = 0;
+    if (f.wire == FieldType::Float)
+    {
+        if (isnan(value))
+            return WasatchVCPP::Util::sprintf("%s: NaN", f.name);
+    }
+    else if (integralRange(f.wire, lo, hi) && (value < lo || value > hi || value != std::floor(value)))
+        return WasatchVCPP::Util::sprintf("%s: %g out of range (%g, %g)", f.name, value, lo, hi);
+    return "";
+}
+
+//! parse a stringified value into the field's attribute
+//! @returns false if the string can't be represented by the field
+static bool parseField(const Field& f, EEPROM& e, const string& value)
+{
+    void* p = f.attr(e);
+    switch (f.native)
+    {
+        case FieldType::String:
+            *(string*)p = value;
+            return true;
+
+        case FieldType::Bytes:
+        {
+            // accept the "0x01 02 03" form produced by Util::toHex
+            string hex;
+            for (size_t i = (value.compare(0, 2, "0x") == 0 ? 2 : 0); i < value.size(); i++)
+                if (isxdigit((unsigned char)value[i]))
+                    hex += value[i];
+                else if (value[i] != ' ')
+                    return false;
+            if (hex.size() % 2 != 0)
+                return false;
+
+            vector<uint8_t> bytes;
+            for (size_t i = 0; i < hex.size(); i += 2)
+                bytes.push_back((uint8_t)strtol(hex.substr(i, 2).c_str(), nullptr, 16));
+            *(vector<uint8_t>*)p = bytes;
+            return true;
+        }
+
+        case FieldType::PixelList:
+        {
+            // accept the "1, 2, 3" form produced by Util::join
+            set<int16_t> pixels;
+            const char* s = value.c_str();
+            while (*s)
+            {
+                char* end = nullptr;
+                long pixel = strtol(s, &end, 10);
+                if (end == s || pixel < 0 || pixel > 32767)
+                    return false;
+                pixels.insert((int16_t)pixel);
+                s = end;
+                while (*s == ',' || *s == ' ')
+                    s++;
+            }
+            *(set<int16_t>*)p = pixels;
+            return true;
+        }
+
+        default:
+            break;
+    }
+
+    double number = 0;
+    string lc = WasatchVCPP::Util::toLower(value);
+    if (f.native == FieldType::Bool && (lc == "true" || lc == "false"))
+        number = lc == "true" ? 1 : 0;
     else
-        productConfiguration.clear();
+    {
+        char* end = nullptr;
+        number = f.native == FieldType::Float ? strtod(value.c_str(), &end)
+                                              : (double)strtoll(value.c_str(), &end, 0);
+        if (end == value.c_str() || *end != 0)
+            return false;
+    }
+
+    // must fit the attribute as well as the wire encoding
+    double lo = 0, hi = 0;
+    if (integralRange(f.native, lo, hi) && (number < lo || number > hi))
+        return false;
+
+    storeNumber(f, e, number);
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Lifecycle
+////////////////////////////////////////////////////////////////////////////////
+
+WasatchVCPP::EEPROM::EEPROM(Logger& logger)
+    : logger(logger)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Parsing and serialization
+////////////////////////////////////////////////////////////////////////////////
+
+bool WasatchVCPP::EEPROM::parse(const vector<vector<uint8_t> >& pages_in)
+{
+    static bool layoutValid = validateLayout();
+    if (!layoutValid)
+        logger.error("EEPROM::parse: invalid layout table");
+
+    // cache so caller can retrieve if desired (padded in case any page 
+    // couldn't be read)
+    pages = pages_in;
+    pages.resize(MAX_PAGES);
+    for (auto& page : pages)
+        page.resize(PAGE_SIZE);
+
+    for (auto& f : layout())
+        clearField(f, *this);
+
+    // format determines which rows apply, so read it before the rest (and 
+    // after clearing, which zeroes it along with every other field)
+    format = ParseData::toUInt8(pages[0], 63);
+
+    for (auto& f : layout())
+        if (applies(f, format))
+            readField(f, *this, pages[f.page]);
 
     // Raman Intensity Calibration (SRM)
     intensityCorrectionOrder = 0;
@@ -131,16 +497,10 @@ bool WasatchVCPP::EEPROM::parse(const vector<vector<uint8_t> >& pages_in)
             numCoeffs = 0;
         for (int i = 0; i < numCoeffs; ++i)
             intensityCorrectionCoeffs.push_back(ParseData::toFloat(pages[6], 1 + 4 * i));
-        if (numCoeffs > 0)
-            srm_present = true;
     }
 
-    avgResolution = format >= 7 ? ParseData::toFloat(pages[3], 48) : 0.f;
-
     if (format >= 8)
     {
-        wavecalCoeffs[4] = ParseData::toFloat(pages[2], 21);
-        subformat = (Subformats) ParseData::toUInt8(pages[5], 63);
         if (subformat == Subformats::SUBFORMAT_USER_DATA)
         {
             intensityCorrectionOrder = 0;
@@ -154,9 +514,7 @@ bool WasatchVCPP::EEPROM::parse(const vector<vector<uint8_t> >& pages_in)
         else
             subformat = Subformats::SUBFORMAT_USER_DATA;
     }
-
-    if (format >= 9)
-        featureMask = FeatureMask(ParseData::toUInt16(pages[0], 39));
+    srm_present = !intensityCorrectionCoeffs.empty();
 
     // ensure startupTemperature within bounds
     if (startupDetectorTemperatureDegC < detectorTempMin)
@@ -170,8 +528,176 @@ bool WasatchVCPP::EEPROM::parse(const vector<vector<uint8_t> >& pages_in)
     return true;
 }
 
+//! Render the current field values into a complete EEPROM image.
+//!
+//! The image starts as the most recently parsed pages, and only fields whose
+//! values differ from what those pages parse to are written over it.  So an
+//! unmodified EEPROM serializes to exactly the bytes it was parsed from, 
+//! including reserved bytes, and encodings parse() normalizes (NaN floats, 
+//! booleans other than 0 and 1, bytes after a string's terminator, unsorted
+//! or duplicate bad pixels).
+//!
+//! @param pagesOut (Output) MAX_PAGES pages of PAGE_SIZE bytes
+//! @returns false if any field fails validation (pagesOut is then undefined)
+bool WasatchVCPP::EEPROM::serialize(vector<vector<uint8_t> >& pagesOut) const
+{
+    vector<string> errors;
+    if (!validate(&errors))
+    {
+        for (auto& err : errors)
+            logger.error("EEPROM::serialize: %s", err.c_str());
+        return false;
+    }
+
+    pagesOut = pages;
+    pagesOut.resize(MAX_PAGES);
+    for (auto& page : pagesOut)
+        page.resize(PAGE_SIZE);
+
+    EEPROM parsed(logger);
+    parsed.compact = true;
+    parsed.parse(pages);
+
+    EEPROM& self = const_cast<EEPROM&>(*this);
+    for (auto& f : layout())
+        if (applies(f, format) && !sameField(f, self, parsed))
+            if (!writeField(f, self, pagesOut[f.page]))
+                return false;
+
+    if (format >= 6 && subformat == Subformats::SUBFORMAT_RAMAN_INTENSITY_CALIBRATION &&
+        (intensityCorrectionOrder != parsed.intensityCorrectionOrder || 
+         intensityCorrectionCoeffs != parsed.intensityCorrectionCoeffs))
+    {
+        ParseData::writeUInt8(intensityCorrectionOrder, pagesOut[6], 0);
+        for (int i = 0; i < (int)intensityCorrectionCoeffs.size(); i++)
+            ParseData::writeFloat(intensityCorrectionCoeffs[i], pagesOut[6], 1 + 4 * i);
+    }
+
+    return true;
+}
+
+//! Confirm every field applicable to the current format can be represented
+//! in its on-EEPROM encoding.
+//!
+//! @param errors (Output) optional list of human-readable problems
+//! @returns true if serialize() would produce a faithful image
+bool WasatchVCPP::EEPROM::validate(vector<string>* errors) const
+{
+    bool ok = true;
+    EEPROM& self = const_cast<EEPROM&>(*this);
+    for (auto& f : layout())
+    {
+        if (!applies(f, format))
+            continue;
+        string err = checkField(f, self);
+        if (!err.empty())
+        {
+            ok = false;
+            if (errors)
+                errors->push_back(err);
+        }
+    }
+
+    if (format >= 6 && subformat == Subformats::SUBFORMAT_RAMAN_INTENSITY_CALIBRATION)
+    {
+        if (intensityCorrectionCoeffs.size() > 8 || 
+            (!intensityCorrectionCoeffs.empty() && intensityCorrectionCoeffs.size() != intensityCorrectionOrder + 1u))
+        {
+            ok = false;
+            if (errors)
+                errors->push_back(Util::sprintf("intensityCorrectionCoeffs: %d coeffs for order %u", 
+                    (int)intensityCorrectionCoeffs.size(), intensityCorrectionOrder));
+        }
+    }
+    return ok;
+}
+
+//! Typed write of one field, by its stringified name (case-insensitive).
+//!
+//! Only the parsed attribute (and 'stringified') are updated; 'pages' continues
+//! to reflect the last image parsed, so callers can use serialize() to see
+//! what changed.
+//!
+//! @returns false if the field is unknown, doesn't apply to this EEPROM's 
+//!          format, or the value can't be represented
+bool WasatchVCPP::EEPROM::setField(const string& name, const string& value)
+{
+    string lc = Util::toLower(name);
+    for (auto& f : layout())
+    {
+        if (!applies(f, format) || lc != Util::toLower(f.name))
+            continue;
+
+        // stage the change so a rejected value leaves the attribute untouched
+        EEPROM staged(*this);
+        if (!parseField(f, staged, value))
+        {
+            logger.error("EEPROM::setField: can't parse %s = %s", f.name, value.c_str());
+            return false;
+        }
+
+        string err = checkField(f, staged);
+        if (!err.empty())
+        {
+            logger.error("EEPROM::setField: %s", err.c_str());
+            return false;
+        }
+
+        parseField(f, *this, value);
+        stringifyAll();
+        return true;
+    }
+
+    logger.error("EEPROM::setField: unknown field %s for format %u", name.c_str(), format);
+    return false;
+}
+
+//! Self-check of the layout table: every row fits within its page, native and
+//! wire types are compatible, and no two rows overlap within any format.
+bool WasatchVCPP::EEPROM::validateLayout(vector<string>* errors)
+{
+    bool ok = true;
+    auto fail = [&](const string& err) { ok = false; if (errors) errors->push_back(err); };
+
+    const vector<Field>& fields = layout();
+    for (auto& f : fields)
+    {
+        if (f.page < 0 || f.page >= MAX_PAGES || f.offset < 0 || f.offset + wireSize(f) > PAGE_SIZE)
+            fail(Util::sprintf("%s: page %d offset %d size %d out of bounds", f.name, f.page, f.offset, wireSize(f)));
+        if (isNumeric(f.wire) != isNumeric(f.native) || (!isNumeric(f.wire) && f.wire != f.native))
+            fail(Util::sprintf("%s: incompatible wire and native types", f.name));
+    }
+
+    for (int fmt = 0; fmt <= LATEST_FORMAT; fmt++)
+        for (size_t i = 0; i < fields.size(); i++)
+            for (size_t j = i + 1; j < fields.size(); j++)
+            {
+                const Field& a = fields[i];
+                const Field& b = fields[j];
+                if (a.page != b.page || !applies(a, fmt) || !applies(b, fmt))
+                    continue;
+                if (a.offset < b.offset + wireSize(b) && b.offset < a.offset + wireSize(a))
+                    fail(Util::sprintf("format %d: %s overlaps %s", fmt, a.name, b.name));
+            }
+
+    return ok;
+}
+
 inline const char* toBool(bool b) { return b ? "true" : "false"; }
 
+//! approximate heap held by the page cache and string views
+size_t WasatchVCPP::EEPROM::getMemoryBytes() const
+{
+    size_t bytes = sizeof(EEPROM);
+    for (auto& page : pages)
+        bytes += page.capacity();
+
+    // std::map nodes carry three pointers and a color beyond the pair itself
+    for (auto& pair : stringified)
+        bytes += sizeof(pair) + 4 * sizeof(void*) + pair.first.capacity() + pair.second.capacity();
+    return bytes;
+}
+
 void WasatchVCPP::EEPROM::stringify(const string& name, const string& value)
 {
     stringified.insert(make_pair(name, value));
@@ -231,70 +757,36 @@ bool WasatchVCPP::EEPROM::has_srm()
 void WasatchVCPP::EEPROM::stringifyAll()
 {
     stringified.clear();
+    if (compact)
+        return;
+
+    EEPROM& self = *this;
+    for (auto& f : layout())
+    {
+        if (f.fmt == nullptr || stringified.count(f.name))
+            continue;
 
-    stringify("format", Util::sprintf("%d", format));
-    stringify("model", model);
-    stringify("serialNumber", serialNumber);
-    stringify("baudRate", Util::sprintf("%d", baudRate));
-    stringify("hasCooling", toBool(hasCooling));
-    stringify("hasBattery", toBool(hasBattery));
-    stringify("hasLaser", toBool(hasLaser));
+        void* p = f.attr(self);
+        switch (f.native)
+        {
+            case FieldType::Bool:      stringify(f.name, toBool(*(bool*)p)); break;
+            case FieldType::String:    stringify(f.name, *(string*)p); break;
+            case FieldType::Bytes:     stringify(f.name, Util::toHex(*(vector<uint8_t>*)p)); break; // should be about 195 characters
+            case FieldType::PixelList: stringify(f.name, Util::join(*(set<int16_t>*)p, f.fmt)); break;
+            case FieldType::Float:     stringify(f.name, Util::sprintf(f.fmt, loadNumber(f, self))); break;
+            default:                   stringify(f.name, Util::sprintf(f.fmt, (int)loadNumber(f, self))); break;
+        }
+    }
+
+    // fields which are reported differently than they're stored
     stringify("bin2x2", toBool(featureMask.bin2x2));
     stringify("invertXAxis", toBool(featureMask.invertXAxis));
     stringify("gen15", toBool(featureMask.gen15));
     stringify("cutoffFilterInstalled", toBool(featureMask.cutoffFilterInstalled));
     stringify("hardwareEvenOdd", toBool(featureMask.hardwareEvenOdd));
-    stringify("excitationNM", Util::sprintf("%.3f", excitationNM));
-    stringify("slitSizeUM", Util::sprintf("%u", slitSizeUM));
-
-    stringify("startupIntegrationTimeMS", Util::sprintf("%u", startupIntegrationTimeMS));
-    stringify("startupDetectorTemperatureDegC", Util::sprintf("%d", startupDetectorTemperatureDegC));
-    stringify("startupTriggeringMode", Util::sprintf("%u", startupTriggeringMode));
-    stringify("detectorGain", Util::sprintf("%.2f", detectorGain));
-    stringify("detectorOffset", Util::sprintf("%d", detectorOffset));
-    stringify("detectorGainOdd", Util::sprintf("%.2f", detectorGainOdd));
-    stringify("detectorOffsetOdd", Util::sprintf("%d", detectorOffsetOdd));
-                                                       
-    stringify("detectorTempMax", Util::sprintf("%d", detectorTempMax));
-    stringify("detectorTempMin", Util::sprintf("%d", detectorTempMin));
-    stringify("thermistorResistanceAt298K", Util::sprintf("%d", thermistorResistanceAt298K));
-    stringify("thermistorBeta", Util::sprintf("%d", thermistorBeta));
-    stringify("calibrationDate", calibrationDate);
-    stringify("calibrationBy", calibrationBy);
-
-    stringify("detectorName", detectorName);
-    stringify("activePixelsHoriz", Util::sprintf("%u", activePixelsHoriz));
-    stringify("activePixelsVert", Util::sprintf("%u", activePixelsVert));
-    stringify("minIntegrationTimeMS", Util::sprintf("%u", minIntegrationTimeMS));
-    stringify("maxIntegrationTimeMS", Util::sprintf("%u", maxIntegrationTimeMS));
-    stringify("actualPixelsHoriz", Util::sprintf("%u", actualPixelsHoriz));
-    stringify("ROIHorizStart", Util::sprintf("%u", ROIHorizStart));
-    stringify("ROIHorizEnd", Util::sprintf("%u", ROIHorizEnd));
-    stringify("maxLaserPowerMW", Util::sprintf("%g", maxLaserPowerMW));
-    stringify("minLaserPowerMW", Util::sprintf("%g", minLaserPowerMW));
-
-    stringify("userData", Util::toHex(userData)); // should be about 195 characters
     stringify("userText", userText);
-
-    stringify("badPixels", Util::join(badPixels, "%d"));
-    stringify("productConfiguration", productConfiguration);
-    stringify("avgResolution", Util::sprintf("%.2f", avgResolution));
-
-    stringify("subformat", Util::sprintf("%u", subformat));
-
     stringify("intensityCorrectionOrder", Util::sprintf("%u", intensityCorrectionOrder));
     stringify("intensityCorrectionCoeffs", Util::join(intensityCorrectionCoeffs, "%g"));
-
-    for (int i = 0; i < 5; i++)
-        stringify(Util::sprintf("wavecalCoeffs[%d]", i), Util::sprintf("%g", wavecalCoeffs[i]));
-    for (int i = 0; i < 3; i++)
-        stringify(Util::sprintf("degCToDACCoeffs[%d]", i), Util::sprintf("%g", degCToDACCoeffs[i]));
-    for (int i = 0; i < 3; i++)
-        stringify(Util::sprintf("adcToDegCCoeffs[%d]", i), Util::sprintf("%g", adcToDegCCoeffs[i]));
     for (int i = 0; i < 3; i++)
         stringify(Util::sprintf("ROIVertRegion[%d]", i), Util::sprintf("(%u, %u)", ROIVertRegionStart[i], ROIVertRegionEnd[i]));
-    for (int i = 0; i < 5; i++)
-        stringify(Util::sprintf("linearityCoeffs[%d]", i), Util::sprintf("%g", linearityCoeffs[i]));
-    for (int i = 0; i < 4; i++)
-        stringify(Util::sprintf("laserPowerCoeffs[%d]", i), Util::sprintf("%g", laserPowerCoeffs[i]));
 }
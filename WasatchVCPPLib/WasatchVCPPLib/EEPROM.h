@@ -35,6 +35,46 @@ namespace WasatchVCPP
                 SUBFORMAT_COUNT = 3
             };
 
+            //! How a field is encoded within its EEPROM page (the "wire" type),
+            //! or how it is stored within this class (the "native" type).
+            enum class FieldType
+            {
+                Bool,
+                UInt8,
+                Int16,
+                UInt16,
+                UInt32,
+                Float,
+                String,         //!< null-padded ASCII of 'len' bytes
+                Bytes,          //!< raw binary of 'len' bytes
+                PixelList,      //!< 'len' int16 slots, negative for unused
+                FeatureMask,    //!< native only (FeatureMask, uint16 on the wire)
+                Subformat       //!< native only (Subformats, uint8 on the wire)
+            };
+
+            //! One row in the declarative EEPROM layout.
+            //!
+            //! Each row says where a field lives (page, offset), how it is 
+            //! encoded, which EEPROM formats it applies to, and how it should be
+            //! rendered in 'stringified'.  parse(), serialize(), stringifyAll(),
+            //! validate() and setField() are all generated from this table.
+            //!
+            //! The same name may appear on more than one row, where a field moved
+            //! (or changed encoding) between formats.
+            struct Field
+            {
+                const char* name;           //!< key in 'stringified'
+                int page;                   //!< 0 to MAX_PAGES - 1
+                int offset;                 //!< byte offset within page
+                FieldType wire;             //!< encoding within the page
+                int len;                    //!< bytes (String, Bytes) or slots (PixelList)
+                uint8_t minFormat;          //!< first format containing this row
+                uint8_t maxFormat;          //!< last format containing this row
+                const char* fmt;            //!< printf format, or nullptr if stringified by hand
+                FieldType native;           //!< type of the EEPROM attribute
+                void* (*attr)(EEPROM&);     //!< address of the EEPROM attribute
+            };
+
             ////////////////////////////////////////////////////////////////////
             // Constants
             ////////////////////////////////////////////////////////////////////
@@ -42,6 +82,9 @@ namespace WasatchVCPP
             static const int MAX_PAGES = 8;
             static const int PAGE_SIZE = 64;
 
+            //! newest format this class knows how to write
+            static const uint8_t LATEST_FORMAT = 9;
+
             ////////////////////////////////////////////////////////////////////
             // Methods
             ////////////////////////////////////////////////////////////////////
@@ -49,10 +92,17 @@ namespace WasatchVCPP
             EEPROM(Logger& logger);
 
             bool parse(const std::vector<std::vector<uint8_t> >& pages);
+            bool serialize(std::vector<std::vector<uint8_t> >& pagesOut) const;
+            bool validate(std::vector<std::string>* errors = nullptr) const;
+            bool setField(const std::string& name, const std::string& value);
             bool has_srm();
 
+            static const std::vector<Field>& layout();
+            static bool validateLayout(std::vector<std::string>* errors = nullptr);
+
             void stringifyAll();
             void stringify(const std::string& name, const std::string& value);
+            size_t getMemoryBytes() const;
             bool hasLaserPowerCalibration(void);
             float laserPowermWToPercent(float mW);
             ////////////////////////////////////////////////////////////////////
@@ -62,6 +112,7 @@ namespace WasatchVCPP
             Logger& logger;
             std::map<std::string, std::string> stringified;
             std::vector<std::vector<uint8_t> > pages;
+            bool compact = false;   //!< leave 'stringified' empty (@see Driver::setCompactMode)
 
             ////////////////////////////////////////////////////////////////////
             // EEPROM fields
@@ -124,7 +175,7 @@ namespace WasatchVCPP
             
             float avgResolution = 0;
 
-            Subformats subformat;
+            Subformats subformat = Subformats::SUBFORMAT_USER_DATA;
 
             FeatureMask featureMask;
     };
@@ -0,0 +1,727 @@
+/**
+    @file   Expression.cpp
+    @author Mark Zieg <mzieg@wasatchphotonics.com>
+    @brief  implementation of WasatchVCPP::Expression
+    @note   customers normally wouldn't access this file; use WasatchVCPP.h instead
+*/
+
+#include "pch.h"
+#include "Expression.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "SIMD.h"
+
+using std::string;
+using std::vector;
+
+//! deepest nesting compile() accepts (bounds the parser's recursion)
+const int MAX_DEPTH = 64;
+
+static const char* OP_NAMES[] = { "add", "sub", "mul", "div", "min", "max", "pow", "neg", "abs", "sqrt", "exp", "log", "log10", "copy" };
+static const char* SOURCE_NAMES[] = { "s", "dark", "ref", "wl", "wn" };
+
+////////////////////////////////////////////////////////////////////////////////
+// Kernels
+////////////////////////////////////////////////////////////////////////////////
+
+#if WPVCPP_SSE2
+typedef __m128d Vec;
+static inline Vec load(const double* p) { return _mm_loadu_pd(p); }
+static inline void store(double* p, Vec v) { _mm_storeu_pd(p, v); }
+static inline Vec broadcast(double x) { return _mm_set1_pd(x); }
+#elif WPVCPP_NEON
+typedef float64x2_t Vec;
+static inline Vec load(const double* p) { return vld1q_f64(p); }
+static inline void store(double* p, Vec v) { vst1q_f64(p, v); }
+static inline Vec broadcast(double x) { return vdupq_n_f64(x); }
+#endif
+
+// Each operation, per pixel and per pair of pixels.  min and max follow the
+// SSE2 convention (the second operand if either is NaN).
+#if WPVCPP_SSE2
+struct AddOp  { static double apply(double a, double b) { return a + b; }     static Vec apply(Vec a, Vec b) { return _mm_add_pd(a, b); } };
+struct SubOp  { static double apply(double a, double b) { return a - b; }     static Vec apply(Vec a, Vec b) { return _mm_sub_pd(a, b); } };
+struct MulOp  { static double apply(double a, double b) { return a * b; }     static Vec apply(Vec a, Vec b) { return _mm_mul_pd(a, b); } };
+struct DivOp  { static double apply(double a, double b) { return a / b; }     static Vec apply(Vec a, Vec b) { return _mm_div_pd(a, b); } };
+struct MinOp  { static double apply(double a, double b) { return a < b ? a : b; } static Vec apply(Vec a, Vec b) { return _mm_min_pd(a, b); } };
+struct MaxOp  { static double apply(double a, double b) { return a > b ? a : b; } static Vec apply(Vec a, Vec b) { return _mm_max_pd(a, b); } };
+struct NegOp  { static double apply(double a) { return -a; }                  static Vec apply(Vec a) { return _mm_xor_pd(a, _mm_set1_pd(-0.0)); } };
+struct AbsOp  { static double apply(double a) { return std::fabs(a); }        static Vec apply(Vec a) { return _mm_andnot_pd(_mm_set1_pd(-0.0), a); } };
+struct SqrtOp { static double apply(double a) { return std::sqrt(a); }        static Vec apply(Vec a) { return _mm_sqrt_pd(a); } };
+struct CopyOp { static double apply(double a) { return a; }                   static Vec apply(Vec a) { return a; } };
+#elif WPVCPP_NEON
+struct AddOp  { static double apply(double a, double b) { return a + b; }     static Vec apply(Vec a, Vec b) { return vaddq_f64(a, b); } };
+struct SubOp  { static double apply(double a, double b) { return a - b; }     static Vec apply(Vec a, Vec b) { return vsubq_f64(a, b); } };
+struct MulOp  { static double apply(double a, double b) { return a * b; }     static Vec apply(Vec a, Vec b) { return vmulq_f64(a, b); } };
+struct DivOp  { static double apply(double a, double b) { return a / b; }     static Vec apply(Vec a, Vec b) { return vdivq_f64(a, b); } };
+struct MinOp  { static double apply(double a, double b) { return a < b ? a : b; } static Vec apply(Vec a, Vec b) { return vbslq_f64(vcltq_f64(a, b), a, b); } };
+struct MaxOp  { static double apply(double a, double b) { return a > b ? a : b; } static Vec apply(Vec a, Vec b) { return vbslq_f64(vcgtq_f64(a, b), a, b); } };
+struct NegOp  { static double apply(double a) { return -a; }                  static Vec apply(Vec a) { return vnegq_f64(a); } };
+struct AbsOp  { static double apply(double a) { return std::fabs(a); }        static Vec apply(Vec a) { return vabsq_f64(a); } };
+struct SqrtOp { static double apply(double a) { return std::sqrt(a); }        static Vec apply(Vec a) { return vsqrtq_f64(a); } };
+struct CopyOp { static double apply(double a) { return a; }                   static Vec apply(Vec a) { return a; } };
+#else
+struct AddOp  { static double apply(double a, double b) { return a + b; } };
+struct SubOp  { static double apply(double a, double b) { return a - b; } };
+struct MulOp  { static double apply(double a, double b) { return a * b; } };
+struct DivOp  { static double apply(double a, double b) { return a / b; } };
+struct MinOp  { static double apply(double a, double b) { return a < b ? a : b; } };
+struct MaxOp  { static double apply(double a, double b) { return a > b ? a : b; } };
+struct NegOp  { static double apply(double a) { return -a; } };
+struct AbsOp  { static double apply(double a) { return std::fabs(a); } };
+struct SqrtOp { static double apply(double a) { return std::sqrt(a); } };
+struct CopyOp { static double apply(double a) { return a; } };
+#endif
+
+//! d = a op b, or (a op b) * scale if SC, where a scalar operand is one value
+//! applied to every pixel
+template <typename Op, bool AS, bool BS, bool SC>
+static void binaryLoop(const double* a, const double* b, const double* scale, double* d, int n)
+{
+    int i = 0;
+#if WPVCPP_SSE2 || WPVCPP_NEON
+    const Vec va = broadcast(*a);
+    const Vec vb = broadcast(*b);
+    const Vec vs = broadcast(SC ? *scale : 1.0);
+    for (; i + 4 <= n; i += 4)
+    {
+        Vec lo = Op::apply(AS ? va : load(a + i),     BS ? vb : load(b + i));
+        Vec hi = Op::apply(AS ? va : load(a + i + 2), BS ? vb : load(b + i + 2));
+        store(d + i,     SC ? MulOp::apply(lo, vs) : lo);
+        store(d + i + 2, SC ? MulOp::apply(hi, vs) : hi);
+    }
+#endif
+    for (; i < n; i++)
+    {
+        double x = Op::apply(AS ? *a : a[i], BS ? *b : b[i]);
+        d[i] = SC ? x * *scale : x;
+    }
+}
+
+template <typename Op, bool SC>
+static void binary(const double* a, bool aScalar, const double* b, bool bScalar, const double* scale, double* d, int n)
+{
+    if (!aScalar && !bScalar)
+        binaryLoop<Op, false, false, SC>(a, b, scale, d, n);
+    else if (!aScalar)
+        binaryLoop<Op, false, true, SC>(a, b, scale, d, n);
+    else if (!bScalar)
+        binaryLoop<Op, true, false, SC>(a, b, scale, d, n);
+    else
+        binaryLoop<Op, true, true, SC>(a, b, scale, d, n);
+}
+
+template <typename Op>
+static void binary(const double* a, bool aScalar, const double* b, bool bScalar, const double* scale, double* d, int n)
+{
+    if (scale)
+        binary<Op, true>(a, aScalar, b, bScalar, scale, d, n);
+    else
+        binary<Op, false>(a, aScalar, b, bScalar, scale, d, n);
+}
+
+template <typename Op, bool AS>
+static void unaryLoop(const double* a, double* d, int n)
+{
+    int i = 0;
+#if WPVCPP_SSE2 || WPVCPP_NEON
+    const Vec va = broadcast(*a);
+    for (; i + 4 <= n; i += 4)
+    {
+        store(d + i,     Op::apply(AS ? va : load(a + i)));
+        store(d + i + 2, Op::apply(AS ? va : load(a + i + 2)));
+    }
+#endif
+    for (; i < n; i++)
+        d[i] = Op::apply(AS ? *a : a[i]);
+}
+
+template <typename Op>
+static void unary(const double* a, bool aScalar, double* d, int n)
+{
+    if (aScalar)
+        unaryLoop<Op, true>(a, d, n);
+    else
+        unaryLoop<Op, false>(a, d, n);
+}
+
+//! operations with no vector form
+static void scalarLoop(double (*f)(double), const double* a, bool aScalar, double* d, int n)
+{
+    for (int i = 0; i < n; i++)
+        d[i] = f(aScalar ? *a : a[i]);
+}
+
+static double power(double a, double b) { return std::pow(a, b); }
+static double exponential(double a) { return std::exp(a); }
+static double logarithm(double a) { return std::log(a); }
+static double logarithm10(double a) { return std::log10(a); }
+
+//! @param scale (Input) multiplies the result, or nullptr (binary operations only)
+void WasatchVCPP::Expression::execute(const Instruction& instruction, const double* a, bool aScalar,
+    const double* b, bool bScalar, const double* scale, double* dst, int n)
+{
+    switch (instruction.op)
+    {
+        case Add:   binary<AddOp>(a, aScalar, b, bScalar, scale, dst, n); break;
+        case Sub:   binary<SubOp>(a, aScalar, b, bScalar, scale, dst, n); break;
+        case Mul:   binary<MulOp>(a, aScalar, b, bScalar, scale, dst, n); break;
+        case Div:   binary<DivOp>(a, aScalar, b, bScalar, scale, dst, n); break;
+        case Min:   binary<MinOp>(a, aScalar, b, bScalar, scale, dst, n); break;
+        case Max:   binary<MaxOp>(a, aScalar, b, bScalar, scale, dst, n); break;
+        case Neg:   unary<NegOp>(a, aScalar, dst, n); break;
+        case Abs:   unary<AbsOp>(a, aScalar, dst, n); break;
+        case Sqrt:  unary<SqrtOp>(a, aScalar, dst, n); break;
+        case Copy:  unary<CopyOp>(a, aScalar, dst, n); break;
+        case Exp:   scalarLoop(exponential, a, aScalar, dst, n); break;
+        case Log:   scalarLoop(logarithm, a, aScalar, dst, n); break;
+        case Log10: scalarLoop(logarithm10, a, aScalar, dst, n); break;
+        case Pow:
+            for (int i = 0; i < n; i++)
+                dst[i] = power(aScalar ? *a : a[i], bScalar ? *b : b[i]);
+            break;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Compiler
+////////////////////////////////////////////////////////////////////////////////
+
+//! Recursive-descent parser emitting bytecode as it goes:
+//!
+//!     expr    := term (('+' | '-') term)*
+//!     term    := factor (('*' | '/') factor)*
+//!     factor  := ('-' | '+') factor | power
+//!     power   := primary ('^' factor)?
+//!     primary := number | name | function '(' expr (',' expr)? ')' | '(' expr ')'
+//!
+//! Each rule returns where its result is: a literal, a constant, a buffer,
+//! or the register its last instruction wrote.
+class WasatchVCPP::Expression::Compiler
+{
+    public:
+        Compiler(const string& text, const std::map<string, double>& constants, Logger& logger)
+            : text(text), constants(constants), logger(logger) {}
+
+        bool run(Program& out)
+        {
+            Operand result = parseExpr();
+            skipSpace();
+            if (!failed && pos < text.size())
+                fail("unexpected character");
+            if (failed)
+                return false;
+
+            // the formula's result goes straight to the output: the last
+            // instruction wrote it, unless it's a lone name or number
+            if (result.kind == Operand::Register)
+                program.code.back().dst = -1;
+            else
+                emit(Copy, result, result, -1);
+
+            out = program;
+            return true;
+        }
+
+    private:
+        const string& text;
+        const std::map<string, double>& constants;
+        Logger& logger;
+
+        Program program;
+        vector<bool> busy;
+        size_t pos = 0;
+        int depth = 0;
+        bool failed = false;
+
+        static Operand literal(double value) { Operand o = { Operand::Literal, 0, value }; return o; }
+        static Operand reg(int index) { Operand o = { Operand::Register, index, 0 }; return o; }
+        static bool isScalar(const Operand& o) { return o.kind == Operand::Literal || o.kind == Operand::Constant; }
+
+        Operand fail(const char* msg)
+        {
+            if (!failed)
+                logger.error("Expression: %s at column %d of \"%s\"", msg, (int)pos + 1, text.c_str());
+            failed = true;
+            return literal(0);
+        }
+
+        void skipSpace()
+        {
+            while (pos < text.size() && isspace((unsigned char)text[pos]))
+                pos++;
+        }
+
+        bool accept(char c)
+        {
+            skipSpace();
+            if (pos < text.size() && text[pos] == c)
+            {
+                pos++;
+                return true;
+            }
+            return false;
+        }
+
+        //! lowest free register
+        int allocate()
+        {
+            for (size_t i = 0; i < busy.size(); i++)
+                if (!busy[i])
+                {
+                    busy[i] = true;
+                    return (int)i;
+                }
+            busy.push_back(true);
+            program.registers = (int)busy.size();
+            return (int)busy.size() - 1;
+        }
+
+        void release(const Operand& operand)
+        {
+            if (operand.kind == Operand::Register)
+                busy[operand.index] = false;
+        }
+
+        void emit(Op op, Operand a, Operand b, int dst)
+        {
+            Instruction instruction = { op, a, b, dst, false, literal(1) };
+            program.code.push_back(instruction);
+        }
+
+        static double fold(Op op, double a, double b)
+        {
+            switch (op)
+            {
+                case Add:   return a + b;
+                case Sub:   return a - b;
+                case Mul:   return a * b;
+                case Div:   return a / b;
+                case Min:   return MinOp::apply(a, b);
+                case Max:   return MaxOp::apply(a, b);
+                case Pow:   return std::pow(a, b);
+                case Neg:   return -a;
+                case Abs:   return std::fabs(a);
+                case Sqrt:  return std::sqrt(a);
+                case Exp:   return std::exp(a);
+                case Log:   return std::log(a);
+                case Log10: return std::log10(a);
+                default:    return a;
+            }
+        }
+
+        Operand emitUnary(Op op, Operand a)
+        {
+            if (failed)
+                return literal(0);
+            if (a.kind == Operand::Literal)
+                return literal(fold(op, a.value, 0));
+
+            release(a);
+            int dst = allocate();
+            emit(op, a, a, dst);
+            return reg(dst);
+        }
+
+        Operand emitBinary(Op op, Operand a, Operand b)
+        {
+            if (failed)
+                return literal(0);
+            if (a.kind == Operand::Literal && b.kind == Operand::Literal)
+                return literal(fold(op, a.value, b.value));
+
+            // common powers don't need pow()
+            if (op == Pow && b.kind == Operand::Literal && b.value == 2)
+            {
+                op = Mul;
+                b = a;
+            }
+            else if (op == Pow && b.kind == Operand::Literal && b.value == 0.5)
+                return emitUnary(Sqrt, a);
+
+            // scaling the result of the previous instruction takes no pass
+            // of its own
+            if (op == Mul && isScalar(a) && !isScalar(b))
+                std::swap(a, b);
+            if (op == Mul && isScalar(b) && a.kind == Operand::Register && !program.code.empty())
+            {
+                Instruction& last = program.code.back();
+                if (last.dst == a.index && last.op <= Max && !last.scaled)
+                {
+                    last.scaled = true;
+                    last.scale = b;
+                    return a;
+                }
+            }
+
+            release(a);
+            release(b);
+            int dst = allocate();
+            emit(op, a, b, dst);
+            return reg(dst);
+        }
+
+        Operand parseExpr()
+        {
+            if (++depth > MAX_DEPTH)
+                return fail("too deeply nested");
+
+            Operand a = parseTerm();
+            while (!failed)
+            {
+                if (accept('+'))
+                    a = emitBinary(Add, a, parseTerm());
+                else if (accept('-'))
+                    a = emitBinary(Sub, a, parseTerm());
+                else
+                    break;
+            }
+            depth--;
+            return a;
+        }
+
+        Operand parseTerm()
+        {
+            Operand a = parseFactor();
+            while (!failed)
+            {
+                if (accept('*'))
+                    a = emitBinary(Mul, a, parseFactor());
+                else if (accept('/'))
+                    a = emitBinary(Div, a, parseFactor());
+                else
+                    break;
+            }
+            return a;
+        }
+
+        Operand parseFactor()
+        {
+            if (++depth > MAX_DEPTH)
+                return fail("too deeply nested");
+
+            Operand a;
+            if (accept('-'))
+                a = emitUnary(Neg, parseFactor());
+            else if (accept('+'))
+                a = parseFactor();
+            else
+                a = parsePower();
+            depth--;
+            return a;
+        }
+
+        Operand parsePower()
+        {
+            Operand a = parsePrimary();
+            if (!failed && accept('^'))
+                a = emitBinary(Pow, a, parseFactor());
+            return a;
+        }
+
+        Operand parsePrimary()
+        {
+            if (failed)
+                return literal(0);
+
+            skipSpace();
+            if (pos >= text.size())
+                return fail("unexpected end");
+
+            char c = text[pos];
+            if (isdigit((unsigned char)c) || c == '.')
+            {
+                const char* start = text.c_str() + pos;
+                char* end = nullptr;
+                double value = strtod(start, &end);
+                if (end == start)
+                    return fail("invalid number");
+                pos += end - start;
+                return literal(value);
+            }
+
+            if (accept('('))
+            {
+                Operand a = parseExpr();
+                if (!failed && !accept(')'))
+                    return fail("expected ')'");
+                return a;
+            }
+
+            if (!isalpha((unsigned char)c) && c != '_')
+                return fail("expected a number, name or '('");
+
+            size_t start = pos;
+            while (pos < text.size() && (isalnum((unsigned char)text[pos]) || text[pos] == '_'))
+                pos++;
+            string name = text.substr(start, pos - start);
+
+            if (accept('('))
+                return parseFunction(name);
+
+            Source source = findSource(name);
+            if (source != Sources)
+            {
+                program.uses[source] = true;
+                Operand o = { Operand::Buffer, (int)source, 0 };
+                return o;
+            }
+
+            auto constant = constants.find(name);
+            if (constant != constants.end())
+            {
+                auto& names = program.constantNames;
+                int index = (int)(std::find(names.begin(), names.end(), name) - names.begin());
+                if (index == (int)names.size())
+                {
+                    names.push_back(name);
+                    program.constantValues.push_back(constant->second);
+                }
+                Operand o = { Operand::Constant, index, 0 };
+                return o;
+            }
+
+            pos = start;
+            return fail("unknown name");
+        }
+
+        //! after the opening parenthesis
+        Operand parseFunction(const string& name)
+        {
+            static const struct { const char* name; Op op; int args; } functions[] =
+            {
+                { "abs", Abs, 1 }, { "sqrt", Sqrt, 1 }, { "exp", Exp, 1 }, { "log", Log, 1 },
+                { "log10", Log10, 1 }, { "min", Min, 2 }, { "max", Max, 2 }
+            };
+
+            for (const auto& f : functions)
+            {
+                if (name != f.name)
+                    continue;
+
+                Operand a = parseExpr();
+                Operand b = a;
+                if (f.args == 2 && !failed && !accept(','))
+                    return fail("expected ','");
+                if (f.args == 2)
+                    b = parseExpr();
+                if (!failed && !accept(')'))
+                    return fail("expected ')'");
+                return f.args == 2 ? emitBinary(f.op, a, b) : emitUnary(f.op, a);
+            }
+            return fail("unknown function");
+        }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Lifecycle
+////////////////////////////////////////////////////////////////////////////////
+
+WasatchVCPP::Expression::Expression(Logger& logger)
+    : logger(logger)
+{
+}
+
+//! @returns the buffer a name refers to, or Sources if none
+WasatchVCPP::Expression::Source WasatchVCPP::Expression::findSource(const string& name)
+{
+    if (name == "s" || name == "spectrum")      return Spectrum;
+    if (name == "dark")                         return Dark;
+    if (name == "ref" || name == "reference")   return Reference;
+    if (name == "wl" || name == "wavelength")   return Wavelength;
+    if (name == "wn" || name == "wavenumber")   return Wavenumber;
+    return Sources;
+}
+
+//! @param text (Input) formula (empty to clear)
+//! @returns false (keeping any previous formula) if it doesn't parse
+bool WasatchVCPP::Expression::compile(const string& text)
+{
+    // constants are read and the program installed under one lock, so a
+    // setConstant() can't land in between and be lost
+    Program compiled;
+    {
+        std::lock_guard<std::mutex> lock(mut);
+        if (!text.empty())
+        {
+            Compiler compiler(text, constants, logger);
+            if (!compiler.run(compiled))
+                return false;
+        }
+        this->text = text;
+        program = compiled;
+        scratch.assign((size_t)program.registers * ChunkPixels, 0.0);
+    }
+    if (!text.empty())
+        logger.debug("Expression: compiled \"%s\" to %d instructions, %d registers",
+            text.c_str(), (int)compiled.code.size(), compiled.registers);
+    return true;
+}
+
+bool WasatchVCPP::Expression::isCompiled()
+{
+    std::lock_guard<std::mutex> lock(mut);
+    return !program.code.empty();
+}
+
+bool WasatchVCPP::Expression::uses(Source source)
+{
+    std::lock_guard<std::mutex> lock(mut);
+    return source >= 0 && source < Sources && program.uses[source];
+}
+
+//! @param name   (Input) "dark" or "ref"
+//! @param values (Input) per-pixel values, or nullptr to clear
+bool WasatchVCPP::Expression::setBuffer(const string& name, const double* values, int len)
+{
+    Source source = findSource(name);
+    if (source != Dark && source != Reference)
+    {
+        logger.error("Expression: %s is not a settable buffer (use dark or ref)", name.c_str());
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mut);
+    if (values == nullptr || len <= 0)
+        vector<double>().swap(buffers[source]);
+    else
+        buffers[source].assign(values, values + len);
+    return true;
+}
+
+//! Define a constant, or change its value (taking effect without
+//! recompiling).  Constants must be defined before a formula uses them.
+bool WasatchVCPP::Expression::setConstant(const string& name, double value)
+{
+    bool valid = !name.empty() && (isalpha((unsigned char)name[0]) || name[0] == '_');
+    for (char c : name)
+        valid = valid && (isalnum((unsigned char)c) || c == '_');
+    if (!valid || findSource(name) != Sources)
+    {
+        logger.error("Expression: invalid constant name %s", name.c_str());
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mut);
+    constants[name] = value;
+    for (size_t i = 0; i < program.constantNames.size(); i++)
+        if (program.constantNames[i] == name)
+            program.constantValues[i] = value;
+    return true;
+}
+
+size_t WasatchVCPP::Expression::getMemoryBytes()
+{
+    std::lock_guard<std::mutex> lock(mut);
+    size_t bytes = scratch.capacity() * sizeof(double) + program.code.capacity() * sizeof(Instruction);
+    for (const auto& buffer : buffers)
+        bytes += buffer.capacity() * sizeof(double);
+    return bytes;
+}
+
+//! The compiled program, one instruction per line (for debugging).
+string WasatchVCPP::Expression::disassemble()
+{
+    std::lock_guard<std::mutex> lock(mut);
+    string result;
+    char buf[64];
+    auto describe = [&](const Operand& o) -> string
+    {
+        switch (o.kind)
+        {
+            case Operand::Literal:  snprintf(buf, sizeof(buf), "%g", o.value); return buf;
+            case Operand::Constant: return program.constantNames[o.index];
+            case Operand::Buffer:   return SOURCE_NAMES[o.index];
+            default:                snprintf(buf, sizeof(buf), "r%d", o.index); return buf;
+        }
+    };
+    for (const auto& instruction : program.code)
+    {
+        if (instruction.dst < 0)
+            result += "out = ";
+        else
+        {
+            snprintf(buf, sizeof(buf), "r%d = ", instruction.dst);
+            result += buf;
+        }
+        result += OP_NAMES[instruction.op];
+        result += " " + describe(instruction.a);
+        if (instruction.op <= Pow)
+            result += ", " + describe(instruction.b);
+        if (instruction.scaled)
+            result += " * " + describe(instruction.scale);
+        result += "\n";
+    }
+    return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Evaluation
+////////////////////////////////////////////////////////////////////////////////
+
+//! Apply the compiled formula.  'out' may be 'spectrum'.
+//!
+//! @param spectrum    (Input)  'pixels' values
+//! @param wavelengths (Input)  axis, or nullptr if unavailable
+//! @param wavenumbers (Input)  axis, or nullptr if unavailable
+//! @param out         (Output) 'pixels' results
+//! @returns false if nothing is compiled, or the formula references a
+//!          buffer which isn't available for every pixel
+bool WasatchVCPP::Expression::evaluate(const double* spectrum, const double* wavelengths, const double* wavenumbers,
+    double* out, int pixels)
+{
+    std::lock_guard<std::mutex> lock(mut);
+    if (program.code.empty())
+    {
+        logger.error("Expression: no formula compiled");
+        return false;
+    }
+
+    const double* sources[Sources] = { spectrum, nullptr, nullptr, wavelengths, wavenumbers };
+    for (int source : { Dark, Reference })
+        if ((int)buffers[source].size() >= pixels && pixels > 0)
+            sources[source] = &buffers[source][0];
+    for (int source = 0; source < Sources; source++)
+    {
+        if (program.uses[source] && sources[source] == nullptr)
+        {
+            logger.error("Expression: %s is not available for %d pixels", SOURCE_NAMES[source], pixels);
+            return false;
+        }
+    }
+
+    for (int start = 0; start < pixels; start += ChunkPixels)
+    {
+        const int n = std::min(ChunkPixels, pixels - start);
+        for (const auto& instruction : program.code)
+        {
+            const double* operands[2];
+            bool scalar[2];
+            const Operand* o[2] = { &instruction.a, &instruction.b };
+            for (int i = 0; i < 2; i++)
+            {
+                scalar[i] = o[i]->kind == Operand::Literal || o[i]->kind == Operand::Constant;
+                switch (o[i]->kind)
+                {
+                    case Operand::Literal:  operands[i] = &o[i]->value; break;
+                    case Operand::Constant: operands[i] = &program.constantValues[o[i]->index]; break;
+                    case Operand::Buffer:   operands[i] = sources[o[i]->index] + start; break;
+                    default:                operands[i] = &scratch[(size_t)o[i]->index * ChunkPixels]; break;
+                }
+            }
+            const double* scale = nullptr;
+            if (instruction.scaled)
+                scale = instruction.scale.kind == Operand::Literal ? &instruction.scale.value
+                    : &program.constantValues[instruction.scale.index];
+            double* dst = instruction.dst < 0 ? out + start : &scratch[(size_t)instruction.dst * ChunkPixels];
+            execute(instruction, operands[0], scalar[0], operands[1], scalar[1], scale, dst, n);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,121 @@
+/**
+    @file   Expression.h
+    @author Mark Zieg <mzieg@wasatchphotonics.com>
+    @brief  interface of WasatchVCPP::Expression
+    @note   customers normally wouldn't access this file; use WasatchVCPP.h instead
+*/
+
+#pragma once
+
+#include "Logger.h"
+
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace WasatchVCPP
+{
+    //! Internal class compiling a user-defined per-pixel formula, and
+    //! evaluating it over spectra.
+    //!
+    //! A formula is arithmetic over per-pixel buffers, numbers and named
+    //! constants, for instance:
+    //!
+    //! @code
+    //!     (s - dark) / (ref - dark) * k
+    //!     log10(ref / s)
+    //!     max(s - dark, 0) * 1e7 / wl
+    //! @endcode
+    //!
+    //! The buffers are s (or spectrum), the spectrum being processed; dark and
+    //! ref (or reference), set through setBuffer; and wl (or wavelength) and
+    //! wn (or wavenumber), the spectrometer's axes.  Constants are set through
+    //! setConstant, and can be changed without recompiling.  Operators are
+    //! + - * / and ^ (power, right-associative), with unary minus and
+    //! parentheses; functions are abs, sqrt, exp, log, log10, min and max.
+    //!
+    //! compile() turns the formula into a register bytecode: one instruction
+    //! per operation, reading buffers, constants or registers and writing a
+    //! register (the last writes the output).  Operations on numbers alone
+    //! are folded at compile time, and registers are reused as soon as
+    //! they're consumed, so a formula needs only as many as its nesting is
+    //! deep.  evaluate() runs the whole program over ChunkPixels pixels at a
+    //! time, so the registers stay in L1 cache and the formula takes a single
+    //! pass over the spectrum; arithmetic and sqrt are SSE2 (x86) or NEON
+    //! (AArch64), while exp, log and non-square powers are scalar.  A
+    //! multiplication by a number or constant is folded into the binary
+    //! operation before it, as in the "* k" above.
+    //!
+    //! Each instruction is still its own loop over the chunk, so a formula
+    //! costs about one L1 pass per operation; code a compiler can fuse and
+    //! vectorize as a whole is faster (tests/bench-expression compares them).
+    class Expression
+    {
+        public:
+            //! per-pixel buffers a formula can reference
+            enum Source { Spectrum, Dark, Reference, Wavelength, Wavenumber, Sources };
+
+            static const int ChunkPixels = 256;
+
+            Expression(Logger& logger);
+
+            bool compile(const std::string& text);
+            bool isCompiled();
+            bool uses(Source source);
+
+            bool setBuffer(const std::string& name, const double* values, int len);
+            bool setConstant(const std::string& name, double value);
+
+            bool evaluate(const double* spectrum, const double* wavelengths, const double* wavenumbers,
+                double* out, int pixels);
+
+            std::string disassemble();
+            size_t getMemoryBytes();
+
+        private:
+            enum Op { Add, Sub, Mul, Div, Min, Max, Pow, Neg, Abs, Sqrt, Exp, Log, Log10, Copy };
+
+            struct Operand
+            {
+                enum Kind { Literal, Constant, Buffer, Register } kind;
+                int index;      //!< constant, Source or register
+                double value;   //!< if Literal
+            };
+
+            struct Instruction
+            {
+                Op op;
+                Operand a;
+                Operand b;      //!< (binary operations only)
+                int dst;        //!< register, or -1 for the output
+                bool scaled;    //!< result multiplied by 'scale' (binary operations only)
+                Operand scale;  //!< literal or constant
+            };
+
+            struct Program
+            {
+                std::vector<Instruction> code;
+                int registers = 0;
+                std::vector<std::string> constantNames;
+                std::vector<double> constantValues;
+                bool uses[Sources] = {};
+            };
+
+            class Compiler;
+
+            Logger& logger;
+            std::mutex mut;
+
+            std::string text;
+            Program program;                            //!< empty if none compiled
+            std::vector<double> scratch;                //!< program.registers chunks
+            std::map<std::string, double> constants;
+            std::vector<double> buffers[Sources];       //!< Dark and Reference
+
+            static Source findSource(const std::string& name);
+            static void execute(const Instruction& instruction, const double* a, bool aScalar,
+                const double* b, bool bScalar, const double* scale, double* dst, int n);
+    };
+}
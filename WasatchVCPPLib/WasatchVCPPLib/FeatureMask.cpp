@@ -16,7 +16,7 @@ WasatchVCPP::FeatureMask::FeatureMask(uint16_t value)
     hardwareEvenOdd       = 0 != (value & FLAG_EVEN_ODD);
 }
 
-uint16_t WasatchVCPP::FeatureMask::toUInt16()
+uint16_t WasatchVCPP::FeatureMask::toUInt16() const
 {
     uint16_t value = 0;
     if (invertXAxis)           value |= FLAG_INVERT_X_AXIS;
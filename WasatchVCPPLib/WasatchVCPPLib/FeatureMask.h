@@ -29,7 +29,7 @@ namespace WasatchVCPP
 
             FeatureMask(uint16_t value = 0);
 
-            uint16_t toUInt16();
+            uint16_t toUInt16() const;
 
             //! The orientations of the grating and detector in this spectrometer are 
             //! rotated such that spectra are read-out "red-to-blue" rather than the
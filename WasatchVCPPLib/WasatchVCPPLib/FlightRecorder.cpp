@@ -0,0 +1,141 @@
+/**
+    @file   FlightRecorder.cpp
+    @author Mark Zieg <mzieg@wasatchphotonics.com>
+    @brief  implementation of WasatchVCPP::FlightRecorder
+    @note   customers normally wouldn't access this file; use WasatchVCPP.h instead
+*/
+
+#include "pch.h"
+#include "FlightRecorder.h"
+#include "Util.h"
+
+#include <algorithm>
+#include <fstream>
+
+using std::string;
+using std::vector;
+
+WasatchVCPP::FlightRecorder::FlightRecorder(Logger& logger, int capacity, int pixels)
+    : capacity(std::max(1, capacity)), pixels(std::max(0, pixels)), logger(logger), dumping(false)
+{
+    ring.resize(this->capacity);
+    snapshot.resize(this->capacity);
+    for (int i = 0; i < this->capacity; i++)
+    {
+        ring[i].spectrum.resize(this->pixels);
+        snapshot[i].spectrum.resize(this->pixels);
+    }
+}
+
+WasatchVCPP::FlightRecorder::~FlightRecorder()
+{
+    // let any dump in progress finish
+    if (writer.joinable())
+        writer.join();
+}
+
+//! Overwrite the oldest slot with a new frame.
+//!
+//! @param raw (Input) 'len' little-endian pixels, as read from the detector
+void WasatchVCPP::FlightRecorder::record(const uint8_t* raw, int len, uint32_t settingsGeneration, 
+    int integrationTimeMS, bool laserEnabled)
+{
+    std::lock_guard<std::mutex> lock(mut);
+
+    Frame& frame = ring[next];
+    frame.frameId = nextFrameId++;
+    frame.timestamp = Clock::now();
+    frame.settingsGeneration = settingsGeneration;
+    frame.integrationTimeMS = integrationTimeMS;
+    frame.laserEnabled = laserEnabled;
+
+    int n = std::min(pixels, len);
+    for (int i = 0; i < n; i++)
+        frame.spectrum[i] = (uint16_t)(raw[2 * i] | (raw[2 * i + 1] << 8));
+    std::fill(frame.spectrum.begin() + n, frame.spectrum.end(), 0);
+
+    next = (next + 1) % capacity;
+    count = std::min(count + 1, capacity);
+}
+
+int WasatchVCPP::FlightRecorder::getCount()
+{
+    std::lock_guard<std::mutex> lock(mut);
+    return count;
+}
+
+//! bytes held by the ring and dump buffers of a recorder of the given size
+size_t WasatchVCPP::FlightRecorder::getMemoryBytes(int capacity, int pixels)
+{
+    return 2 * (size_t)capacity * (sizeof(Frame) + (size_t)pixels * sizeof(uint16_t));
+}
+
+//! Snapshot the ring and write it to 'pathname' in the background.
+//!
+//! The file is CSV, one frame per line, oldest first.  Each line has the 
+//! frame ID, milliseconds before the dump (negative), settings generation,
+//! integration time, laser enable and then the pixel intensities.
+//!
+//! @param label (Input) included in the file header (e.g. serial number)
+//! @returns false if the ring is empty or a previous dump is still being written
+bool WasatchVCPP::FlightRecorder::dump(const string& pathname, const string& label)
+{
+    bool idle = false;
+    if (!dumping.compare_exchange_strong(idle, true))
+    {
+        logger.error("FlightRecorder::dump: previous dump still in progress");
+        return false;
+    }
+    if (writer.joinable())
+        writer.join();
+
+    {
+        std::lock_guard<std::mutex> lock(mut);
+        if (count == 0)
+        {
+            logger.error("FlightRecorder::dump: no frames recorded");
+            dumping = false;
+            return false;
+        }
+
+        // slot vectors are the same size, so these copies don't allocate
+        int oldest = (next - count + capacity) % capacity;
+        for (int i = 0; i < count; i++)
+            snapshot[i] = ring[(oldest + i) % capacity];
+        snapshotCount = count;
+        snapshotTime = Clock::now();
+    }
+
+    snapshotPathname = pathname;
+    snapshotLabel = label;
+    writer = std::thread(&FlightRecorder::write, this);
+    return true;
+}
+
+void WasatchVCPP::FlightRecorder::write()
+{
+    std::ofstream outfile(snapshotPathname.c_str());
+    if (!outfile.is_open())
+    {
+        logger.error("FlightRecorder: unable to open %s", snapshotPathname.c_str());
+        dumping = false;
+        return;
+    }
+
+    outfile << "# flight recorder " << snapshotLabel << ", " << snapshotCount << " frames, dumped " << Util::timestamp() << "\n";
+    outfile << "frameId,msBeforeDump,settingsGeneration,integrationTimeMS,laserEnabled,intensities\n";
+    for (int i = 0; i < snapshotCount; i++)
+    {
+        const Frame& frame = snapshot[i];
+        double ms = std::chrono::duration<double, std::milli>(frame.timestamp - snapshotTime).count();
+        outfile << frame.frameId << "," << Util::sprintf("%.3f", ms) << "," << frame.settingsGeneration << ","
+                << frame.integrationTimeMS << "," << (frame.laserEnabled ? 1 : 0);
+        for (auto value : frame.spectrum)
+            outfile << "," << value;
+        outfile << "\n";
+    }
+    outfile.close();
+
+    logger.debug("FlightRecorder: wrote %d frames to %s", snapshotCount, snapshotPathname.c_str());
+    dumping = false;
+}
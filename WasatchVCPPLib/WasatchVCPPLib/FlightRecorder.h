@@ -0,0 +1,79 @@
+/**
+    @file   FlightRecorder.h
+    @author Mark Zieg <mzieg@wasatchphotonics.com>
+    @brief  interface of WasatchVCPP::FlightRecorder
+    @note   customers normally wouldn't access this file; use WasatchVCPP.h instead
+*/
+
+#pragma once
+
+#include "Logger.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace WasatchVCPP
+{
+    //! Internal class keeping the most recent spectra from one spectrometer,
+    //! so the history leading up to an event can be saved after the fact.
+    //! Spectra are kept as the detector sent them, before any post-processing.
+    //!
+    //! Every slot of the ring is allocated when the recorder is created, so
+    //! recording a frame is a single copy with no allocation, and memory use
+    //! is constant.  A dump copies the ring (oldest first) into a second
+    //! preallocated buffer, then writes that to disk from a background thread
+    //! while recording carries on.  One dump may be in progress at a time.
+    class FlightRecorder
+    {
+        public:
+            typedef std::chrono::steady_clock Clock;
+
+            struct Frame
+            {
+                uint64_t frameId = 0;               //!< sequential from creation
+                Clock::time_point timestamp;
+                uint32_t settingsGeneration = 0;
+                int integrationTimeMS = 0;
+                bool laserEnabled = false;
+                std::vector<uint16_t> spectrum;     //!< raw counts
+            };
+
+            FlightRecorder(Logger& logger, int capacity, int pixels);
+            ~FlightRecorder();
+
+            void record(const uint8_t* raw, int len, uint32_t settingsGeneration, 
+                int integrationTimeMS, bool laserEnabled);
+            bool dump(const std::string& pathname, const std::string& label);
+            bool isDumping() const { return dumping; }
+            int getCount();
+            size_t getMemoryBytes() const { return getMemoryBytes(capacity, pixels); }
+            static size_t getMemoryBytes(int capacity, int pixels);
+
+            const int capacity;
+            const int pixels;
+
+        private:
+            Logger& logger;
+
+            std::mutex mut;
+            std::vector<Frame> ring;
+            int next = 0;                   //!< slot to overwrite
+            int count = 0;                  //!< slots filled
+            uint64_t nextFrameId = 0;
+
+            std::vector<Frame> snapshot;    //!< oldest first
+            int snapshotCount = 0;
+            Clock::time_point snapshotTime;
+            std::string snapshotPathname;
+            std::string snapshotLabel;
+            std::atomic<bool> dumping;
+            std::thread writer;
+
+            void write();
+    };
+}
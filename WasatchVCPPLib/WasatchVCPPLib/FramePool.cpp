@@ -0,0 +1,301 @@
+/**
+    @file   FramePool.cpp
+    @author Mark Zieg <mzieg@wasatchphotonics.com>
+    @brief  implementation of WasatchVCPP::FramePool
+    @note   customers normally wouldn't access this file; use WasatchVCPP.h instead
+*/
+
+#include "pch.h"
+#include "FramePool.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+const size_t CACHE_LINE = 64;
+
+//! page size assumed for explicit huge pages where the OS can't tell us
+const size_t HUGE_PAGE = 2 * 1024 * 1024;
+
+static size_t roundUp(size_t n, size_t multiple)
+{ return (n + multiple - 1) / multiple * multiple; }
+
+static size_t getPageSize()
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#else
+    return (size_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Lifecycle
+////////////////////////////////////////////////////////////////////////////////
+
+WasatchVCPP::FramePool::FramePool(Logger& logger, int pixels, int frames, int flags)
+    : pixels(std::max(0, pixels)), frames(std::max(0, frames)), flags(flags), logger(logger), pageFaults(0)
+{
+    frameBytes = roundUp(std::max((size_t)1, (size_t)this->pixels * sizeof(double)), CACHE_LINE);
+    available.reserve(this->frames);
+    if (this->frames == 0)
+        return;
+
+    size_t len = frameBytes * this->frames;
+    if (flags & HugePages)
+    {
+        if (!map(len, true))
+            logger.error("FramePool: huge pages unavailable, using normal pages");
+    }
+    if (base == nullptr && !map(len, false))
+    {
+        logger.error("FramePool: unable to allocate %d frames (%llu bytes)", this->frames, (unsigned long long)len);
+        return;
+    }
+
+    // fault every page in now, rather than on the acquisition path
+    memset(base, 0, bytes);
+
+    if (flags & Lock)
+    {
+#ifdef _WIN32
+        // large pages are never paged out; otherwise the working set must
+        // be big enough to hold the locked region
+        bool locked = pageType == PageType::Explicit;
+        if (!locked)
+        {
+            SIZE_T minWS = 0, maxWS = 0;
+            HANDLE process = GetCurrentProcess();
+            if (GetProcessWorkingSetSize(process, &minWS, &maxWS))
+                SetProcessWorkingSetSize(process, minWS + bytes, std::max(maxWS, minWS + bytes));
+            locked = VirtualLock(base, bytes) != 0;
+        }
+#else
+        bool locked = mlock(base, bytes) == 0;
+#endif
+        if (locked)
+            lockedBytes = bytes;
+        else
+            logger.error("FramePool: unable to lock %llu bytes into memory (check RLIMIT_MEMLOCK or working set quota)",
+                (unsigned long long)bytes);
+    }
+
+    // hand out the lowest addresses first
+    for (int i = this->frames - 1; i >= 0; i--)
+        available.push_back((double*)(base + i * frameBytes));
+
+    logger.debug("FramePool: %d frames of %d pixels in %llu bytes (%s pages%s)", this->frames, this->pixels,
+        (unsigned long long)bytes, pageType == PageType::Explicit ? "huge" : pageType == PageType::Transparent ? "transparent huge" : "normal",
+        lockedBytes ? ", locked" : "");
+}
+
+WasatchVCPP::FramePool::~FramePool()
+{
+    unmap();
+}
+
+//! @param huge (Input) try explicit, then transparent, huge pages
+bool WasatchVCPP::FramePool::map(size_t len, bool huge)
+{
+#ifdef _WIN32
+    if (huge)
+    {
+        size_t large = GetLargePageMinimum();
+        if (large == 0)
+            return false;
+        size_t size = roundUp(len, large);
+        void* p = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        if (p == nullptr)
+            return false;   // typically lacking SeLockMemoryPrivilege
+        base = (uint8_t*)p;
+        bytes = size;
+        pageType = PageType::Explicit;
+        return true;
+    }
+
+    size_t size = roundUp(len, getPageSize());
+    void* p = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (p == nullptr)
+        return false;
+    base = (uint8_t*)p;
+    bytes = size;
+    pageType = PageType::Normal;
+    return true;
+#else
+    if (huge)
+    {
+#ifdef MAP_HUGETLB
+        // reserved huge pages (vm.nr_hugepages)
+        void* explicitPages = mmap(nullptr, roundUp(len, HUGE_PAGE), PROT_READ | PROT_WRITE, 
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (explicitPages != MAP_FAILED)
+        {
+            base = (uint8_t*)explicitPages;
+            bytes = roundUp(len, HUGE_PAGE);
+            pageType = PageType::Explicit;
+            return true;
+        }
+#endif
+#ifdef MADV_HUGEPAGE
+        // no reserved huge pages: ask for transparent ones, which needs
+        // huge-page alignment to be of any use
+        size_t size = roundUp(len, HUGE_PAGE);
+        void* p = mmap(nullptr, size + HUGE_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            return false;
+        uint8_t* aligned = (uint8_t*)roundUp((size_t)p, HUGE_PAGE);
+        size_t head = aligned - (uint8_t*)p;
+        if (head)
+            munmap(p, head);
+        munmap(aligned + size, HUGE_PAGE - head);
+        if (madvise(aligned, size, MADV_HUGEPAGE) != 0)
+        {
+            munmap(aligned, size);
+            return false;
+        }
+        base = aligned;
+        bytes = size;
+        pageType = PageType::Transparent;
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    size_t size = roundUp(len, getPageSize());
+    void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+        return false;
+    base = (uint8_t*)p;
+    bytes = size;
+    pageType = PageType::Normal;
+    return true;
+#endif
+}
+
+void WasatchVCPP::FramePool::unmap()
+{
+    if (base == nullptr)
+        return;
+
+#ifdef _WIN32
+    if (lockedBytes && pageType != PageType::Explicit)
+        VirtualUnlock(base, bytes);
+    VirtualFree(base, 0, MEM_RELEASE);
+#else
+    if (lockedBytes)
+        munlock(base, bytes);
+    munmap(base, bytes);
+#endif
+    base = nullptr;
+    bytes = 0;
+    lockedBytes = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Frames
+////////////////////////////////////////////////////////////////////////////////
+
+//! @returns a frame of 'pixels' doubles (contents undefined), or nullptr if
+//!          all are in use
+double* WasatchVCPP::FramePool::acquire()
+{
+    std::lock_guard<std::mutex> lock(mut);
+    if (available.empty())
+    {
+        exhausted++;
+        return nullptr;
+    }
+
+    double* frame = available.back();
+    available.pop_back();
+    acquired++;
+    highWater = std::max(highWater, frames - (int)available.size());
+    return frame;
+}
+
+//! Return a frame from acquire() (nullptr is ignored).
+void WasatchVCPP::FramePool::release(double* frame)
+{
+    if (frame == nullptr)
+        return;
+
+    std::lock_guard<std::mutex> lock(mut);
+    available.push_back(frame);
+}
+
+//! Attribute page faults counted by getThreadPageFaults to the pool's users.
+void WasatchVCPP::FramePool::addPageFaults(int64_t faults)
+{
+    if (faults > 0)
+        pageFaults += faults;
+}
+
+WasatchVCPP::FramePool::Stats WasatchVCPP::FramePool::getStats()
+{
+    Stats stats;
+    stats.frames = frames;
+    stats.pixels = pixels;
+    stats.bytes = bytes;
+    stats.lockedBytes = lockedBytes;
+    stats.pageType = pageType;
+    stats.pageFaults = getThreadPageFaults() < 0 ? -1 : pageFaults.load();
+
+    std::lock_guard<std::mutex> lock(mut);
+    stats.inUse = frames - (int)available.size();
+    stats.highWater = highWater;
+    stats.acquired = acquired;
+    stats.exhausted = exhausted;
+    return stats;
+}
+
+//! approximate bytes for a pool of the given size (before page rounding)
+size_t WasatchVCPP::FramePool::getMemoryBytes(int pixels, int frames)
+{
+    return roundUp(std::max((size_t)1, (size_t)std::max(0, pixels) * sizeof(double)), CACHE_LINE) * std::max(0, frames);
+}
+
+//! Page faults taken by the calling thread so far, or -1 where the OS
+//! doesn't count them per thread.  Callers take the difference across a
+//! stretch of acquisition.
+int64_t WasatchVCPP::FramePool::getThreadPageFaults()
+{
+#if !defined(_WIN32) && defined(RUSAGE_THREAD)
+    struct rusage usage;
+    if (getrusage(RUSAGE_THREAD, &usage) == 0)
+        return (int64_t)usage.ru_minflt + usage.ru_majflt;
+#endif
+    return -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// PooledFrame
+////////////////////////////////////////////////////////////////////////////////
+
+WasatchVCPP::PooledFrame::PooledFrame(std::shared_ptr<FramePool> pool, int pixels)
+    : pool(pool)
+{
+    if (pool != nullptr && pool->pixels >= pixels)
+        frame = pool->acquire();
+    pooled = frame != nullptr;
+    if (!pooled)
+    {
+        heap.resize(std::max(1, pixels));
+        frame = &heap[0];
+    }
+}
+
+WasatchVCPP::PooledFrame::~PooledFrame()
+{
+    if (pooled)
+        pool->release(frame);
+}
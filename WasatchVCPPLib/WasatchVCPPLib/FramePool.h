@@ -0,0 +1,119 @@
+/**
+    @file   FramePool.h
+    @author Mark Zieg <mzieg@wasatchphotonics.com>
+    @brief  interface of WasatchVCPP::FramePool
+    @note   customers normally wouldn't access this file; use WasatchVCPP.h instead
+*/
+
+#pragma once
+
+#include "Logger.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace WasatchVCPP
+{
+    //! Internal class holding one spectrometer's frame buffers.
+    //!
+    //! The whole pool is a single mapping allocated up front, with every page
+    //! touched before first use, so drawing a frame never calls the heap
+    //! allocator or takes a page fault.  Each frame starts on a cache line.
+    //! Optionally the mapping is locked into RAM (so it can't be paged out
+    //! later), and/or backed by huge pages to reduce TLB pressure: explicit
+    //! huge pages where the host has some reserved, else transparent huge
+    //! pages where supported.  Either option degrades to ordinary pages
+    //! (with a logged error) rather than failing.
+    //!
+    //! When every frame is in use, acquire() returns nullptr and the caller
+    //! falls back to its own storage; that's counted in Stats::exhausted, so
+    //! an undersized pool shows up in the statistics.
+    class FramePool
+    {
+        public:
+            //! keep synchronized with WasatchVCPP.h WP_FRAME_POOL_*
+            enum Flags
+            {
+                Lock        = 0x01,     //!< mlock / VirtualLock the pool
+                HugePages   = 0x02      //!< back the pool with huge pages if possible
+            };
+
+            enum class PageType { Normal, Transparent, Explicit };
+
+            struct Stats
+            {
+                int frames = 0;
+                int pixels = 0;
+                int inUse = 0;
+                int highWater = 0;          //!< most frames in use at once
+                uint64_t acquired = 0;      //!< frames drawn from the pool
+                uint64_t exhausted = 0;     //!< draws which found the pool empty
+                size_t bytes = 0;           //!< size of the mapping
+                size_t lockedBytes = 0;
+                PageType pageType = PageType::Normal;
+                int64_t pageFaults = -1;    //!< taken on acquisition threads while drawing from the pool (-1 if unknown)
+            };
+
+            FramePool(Logger& logger, int pixels, int frames, int flags);
+            ~FramePool();
+
+            double* acquire();
+            void release(double* frame);
+            void addPageFaults(int64_t faults);
+            Stats getStats();
+
+            size_t getMemoryBytes() const { return bytes; }
+            static size_t getMemoryBytes(int pixels, int frames);
+            static int64_t getThreadPageFaults();
+
+            const int pixels;
+            const int frames;
+            const int flags;
+
+        private:
+            Logger& logger;
+
+            uint8_t* base = nullptr;
+            size_t bytes = 0;
+            size_t frameBytes = 0;          //!< stride between frames
+            size_t lockedBytes = 0;
+            PageType pageType = PageType::Normal;
+
+            std::mutex mut;
+            std::vector<double*> available; //!< reserved to 'frames' up front
+            int highWater = 0;
+            uint64_t acquired = 0;
+            uint64_t exhausted = 0;
+            std::atomic<int64_t> pageFaults;
+
+            bool map(size_t len, bool huge);
+            void unmap();
+    };
+
+    //! One frame of spectrum storage, drawn from a FramePool if there is one
+    //! with a frame to spare, else from the heap.  Returned to the pool on
+    //! destruction.
+    class PooledFrame
+    {
+        public:
+            PooledFrame(std::shared_ptr<FramePool> pool, int pixels);
+            ~PooledFrame();
+
+            double* data() { return frame; }
+            bool isPooled() const { return pooled; }
+            FramePool* getPool() { return pool.get(); }
+
+        private:
+            std::shared_ptr<FramePool> pool;
+            double* frame = nullptr;
+            bool pooled = false;
+            std::vector<double> heap;
+
+            PooledFrame(const PooledFrame&) = delete;
+            PooledFrame& operator=(const PooledFrame&) = delete;
+    };
+}
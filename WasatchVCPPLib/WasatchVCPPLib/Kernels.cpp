@@ -0,0 +1,101 @@
+/**
+    @file   Kernels.cpp
+    @author Mark Zieg <mzieg@wasatchphotonics.com>
+    @brief  implementation of WasatchVCPP::Kernels
+    @note   customers normally wouldn't access this file; use WasatchVCPP.h instead
+*/
+
+#include "pch.h"
+#include "Kernels.h"
+
+#include <cstring>
+
+#include "SIMD.h"
+
+// bulk data is little-endian, as is every host we build for, but don't
+// assume so where the compiler says otherwise
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define KERNELS_BIG_ENDIAN 1
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+// Blocks of 8 pixels
+////////////////////////////////////////////////////////////////////////////////
+
+static inline uint16_t readPixel(const uint8_t* in, int i)
+{ return (uint16_t)(in[2 * i] | (in[2 * i + 1] << 8)); }
+
+static inline void demarshal8(const uint8_t* in, double* out)
+{
+#if WPVCPP_SSE2 && !KERNELS_BIG_ENDIAN
+    const __m128i zero = _mm_setzero_si128();
+    __m128i v = _mm_loadu_si128((const __m128i*)in);
+    __m128i lo = _mm_unpacklo_epi16(v, zero);
+    __m128i hi = _mm_unpackhi_epi16(v, zero);
+    _mm_storeu_pd(out + 0, _mm_cvtepi32_pd(lo));
+    _mm_storeu_pd(out + 2, _mm_cvtepi32_pd(_mm_srli_si128(lo, 8)));
+    _mm_storeu_pd(out + 4, _mm_cvtepi32_pd(hi));
+    _mm_storeu_pd(out + 6, _mm_cvtepi32_pd(_mm_srli_si128(hi, 8)));
+#elif WPVCPP_NEON && !KERNELS_BIG_ENDIAN
+    uint16x8_t v = vld1q_u16((const uint16_t*)in);
+    uint32x4_t lo = vmovl_u16(vget_low_u16(v));
+    uint32x4_t hi = vmovl_u16(vget_high_u16(v));
+    vst1q_f64(out + 0, vcvtq_f64_u64(vmovl_u32(vget_low_u32(lo))));
+    vst1q_f64(out + 2, vcvtq_f64_u64(vmovl_u32(vget_high_u32(lo))));
+    vst1q_f64(out + 4, vcvtq_f64_u64(vmovl_u32(vget_low_u32(hi))));
+    vst1q_f64(out + 6, vcvtq_f64_u64(vmovl_u32(vget_high_u32(hi))));
+#else
+    for (int i = 0; i < 8; i++)
+        out[i] = readPixel(in, i);
+#endif
+}
+
+static inline void accumulate8(const uint16_t* in, uint32_t* sums)
+{
+#if WPVCPP_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    __m128i v = _mm_loadu_si128((const __m128i*)in);
+    __m128i* s = (__m128i*)sums;
+    _mm_storeu_si128(s + 0, _mm_add_epi32(_mm_loadu_si128(s + 0), _mm_unpacklo_epi16(v, zero)));
+    _mm_storeu_si128(s + 1, _mm_add_epi32(_mm_loadu_si128(s + 1), _mm_unpackhi_epi16(v, zero)));
+#elif WPVCPP_NEON
+    uint16x8_t v = vld1q_u16(in);
+    vst1q_u32(sums + 0, vaddw_u16(vld1q_u32(sums + 0), vget_low_u16(v)));
+    vst1q_u32(sums + 4, vaddw_u16(vld1q_u32(sums + 4), vget_high_u16(v)));
+#else
+    for (int i = 0; i < 8; i++)
+        sums[i] += in[i];
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Kernels
+////////////////////////////////////////////////////////////////////////////////
+
+void WasatchVCPP::Kernels::demarshal(const uint8_t* in, double* out, int pixels)
+{
+    int i = 0;
+    for (; i + 8 <= pixels; i += 8)
+        demarshal8(in + 2 * i, out + i);
+    for (; i < pixels; i++)
+        out[i] = readPixel(in, i);
+}
+
+void WasatchVCPP::Kernels::demarshalRaw(const uint8_t* in, uint16_t* out, int pixels)
+{
+#if KERNELS_BIG_ENDIAN
+    for (int i = 0; i < pixels; i++)
+        out[i] = readPixel(in, i);
+#else
+    memcpy(out, in, pixels * sizeof(uint16_t));
+#endif
+}
+
+void WasatchVCPP::Kernels::accumulate(const uint16_t* in, uint32_t* sums, int pixels)
+{
+    int i = 0;
+    for (; i + 8 <= pixels; i += 8)
+        accumulate8(in + i, sums + i);
+    for (; i < pixels; i++)
+        sums[i] += in[i];
+}
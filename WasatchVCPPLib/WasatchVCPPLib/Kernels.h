@@ -0,0 +1,32 @@
+/**
+    @file   Kernels.h
+    @author Mark Zieg <mzieg@wasatchphotonics.com>
+    @brief  interface of WasatchVCPP::Kernels
+    @note   customers normally wouldn't access this file; use WasatchVCPP.h instead
+*/
+
+#pragma once
+
+#include <cstdint>
+
+namespace WasatchVCPP
+{
+    //! Internal class holding the per-pixel loops on the acquisition path.
+    //!
+    //! Each processes blocks of 8 pixels with SSE2 (x86) or NEON (AArch64),
+    //! then any remainder one at a time.  (Versions instantiated for the 
+    //! common detector geometries timed the same as these, so there's one
+    //! set for every geometry.)
+    class Kernels
+    {
+        public:
+            //! little-endian pixels from one endpoint to doubles
+            static void demarshal(const uint8_t* in, double* out, int pixels);
+
+            //! little-endian pixels from one endpoint to raw counts
+            static void demarshalRaw(const uint8_t* in, uint16_t* out, int pixels);
+
+            //! add one spectrum of raw counts to running sums
+            static void accumulate(const uint16_t* in, uint32_t* sums, int pixels);
+    };
+}
@@ -9,6 +9,8 @@
 #include "ParseData.h"
 
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
  
 using std::string;
 using std::vector;
@@ -18,132 +20,153 @@ using std::vector;
 #endif
 
 ////////////////////////////////////////////////////////////////////////////////
-// Parsing EEPROM (convert buffer to native types)
+// Byte-order primitives
 ////////////////////////////////////////////////////////////////////////////////
 
-bool WasatchVCPP::ParseData::toBool(const vector<uint8_t>& buf, int index)
-{
-    if (index >= (int)buf.size())
-        return false;
+// These compile to a single (unaligned) load, plus a byte-swap instruction 
+// where the requested order differs from the host's.
 
-    return buf[index] != 0;
-}
+#if defined(_MSC_VER)
+#define WPVCPP_BSWAP16(x) _byteswap_ushort(x)
+#define WPVCPP_BSWAP32(x) _byteswap_ulong(x)
+#else
+#define WPVCPP_BSWAP16(x) __builtin_bswap16(x)
+#define WPVCPP_BSWAP32(x) __builtin_bswap32(x)
+#endif
 
-uint8_t WasatchVCPP::ParseData::toUInt8(const vector<uint8_t>& buf, int index)
-{
-    if (index >= (int)buf.size())
-        return 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+static const bool HOST_BIG_ENDIAN = true;
+#else
+static const bool HOST_BIG_ENDIAN = false; // x86, x64 and ARM (Windows, Linux, Raspberry Pi)
+#endif
 
-    return buf[index];
+static inline uint16_t load16(const uint8_t* p, bool bigEndian)
+{
+    uint16_t raw;
+    memcpy(&raw, p, sizeof(raw));
+    return bigEndian == HOST_BIG_ENDIAN ? raw : (uint16_t)WPVCPP_BSWAP16(raw);
 }
 
-//! assumes little endian
-int16_t WasatchVCPP::ParseData::toInt16(const vector<uint8_t>& buf, int index, bool bigEndian)
+static inline uint32_t load32(const uint8_t* p, bool bigEndian)
 {
-    uint16_t raw = toUInt16(buf, index, bigEndian);
-    return *((int16_t*)&raw);
+    uint32_t raw;
+    memcpy(&raw, p, sizeof(raw));
+    return bigEndian == HOST_BIG_ENDIAN ? raw : (uint32_t)WPVCPP_BSWAP32(raw);
 }
 
-//! assumes little endian
-uint16_t WasatchVCPP::ParseData::toUInt16(const vector<uint8_t>& buf, int index, bool bigEndian)
-{
-    if (index + 1 >= (int)buf.size())
-        return 0;
+//! true if 'width' bytes starting at 'index' lie within the buffer
+static inline bool inBounds(size_t size, int index, size_t width)
+{ return index >= 0 && (size_t)index + width <= size; }
 
-    uint16_t raw = bigEndian ? ((buf[index] << 8) | buf[index + 1])
-                             : ((buf[index + 1] << 8) | buf[index]);
-    return raw;
-}
+////////////////////////////////////////////////////////////////////////////////
+// Parsing spans (convert raw buffer to native types)
+////////////////////////////////////////////////////////////////////////////////
 
-//! integration time is a 24-bit value
-uint32_t WasatchVCPP::ParseData::toUInt24(const vector<uint8_t>& buf, int index, bool bigEndian)
-{
-    if (index + 2 >= (int)buf.size())
-        return 0;
+bool WasatchVCPP::ParseData::toBool(const uint8_t* buf, size_t size, int index)
+{ return inBounds(size, index, 1) ? buf[index] != 0 : false; }
 
-    uint32_t raw = bigEndian ? ((buf[index + 2]) | (buf[index + 1] << 8) | (buf[index] << 16))
-                             : ((buf[index + 2] << 16) | (buf[index + 1] <<  8) | (buf[index]));
-    return raw;
-}
+uint8_t WasatchVCPP::ParseData::toUInt8(const uint8_t* buf, size_t size, int index)
+{ return inBounds(size, index, 1) ? buf[index] : 0; }
 
-//! assumes little endian
-int32_t WasatchVCPP::ParseData::toInt32(const vector<uint8_t>& buf, int index, bool bigEndian)
-{
-    uint32_t raw = toUInt32(buf, index, bigEndian);
-    return *((int32_t*)&raw);
-}
+int16_t WasatchVCPP::ParseData::toInt16(const uint8_t* buf, size_t size, int index, bool bigEndian)
+{ return (int16_t)toUInt16(buf, size, index, bigEndian); }
 
-//! assumes little endian
-uint32_t WasatchVCPP::ParseData::toUInt32(const vector<uint8_t>& buf, int index, bool bigEndian)
+uint16_t WasatchVCPP::ParseData::toUInt16(const uint8_t* buf, size_t size, int index, bool bigEndian)
+{ return inBounds(size, index, 2) ? load16(buf + index, bigEndian) : 0; }
+
+//! integration time is a 24-bit value
+uint32_t WasatchVCPP::ParseData::toUInt24(const uint8_t* buf, size_t size, int index, bool bigEndian)
 {
-    if (index + 3 >= (int)buf.size())
+    if (!inBounds(size, index, 3))
         return 0;
 
-    uint32_t raw;
-    if (bigEndian)
-        raw = (buf[index + 3]) 
-            | (buf[index + 2] <<  8)
-            | (buf[index + 1] << 16)
-            | (buf[index + 0] << 24);
-    else
-        raw = (buf[index + 3] << 24) 
-            | (buf[index + 2] << 16)
-            | (buf[index + 1] <<  8)
-            | (buf[index + 0]);
-    return raw;
+    const uint8_t* p = buf + index;
+    return bigEndian ? ((uint32_t)load16(p, true) << 8) | p[2]
+                     : ((uint32_t)p[2] << 16) | load16(p, false);
 }
 
+int32_t WasatchVCPP::ParseData::toInt32(const uint8_t* buf, size_t size, int index, bool bigEndian)
+{ return (int32_t)toUInt32(buf, size, index, bigEndian); }
+
+uint32_t WasatchVCPP::ParseData::toUInt32(const uint8_t* buf, size_t size, int index, bool bigEndian)
+{ return inBounds(size, index, 4) ? load32(buf + index, bigEndian) : 0; }
+
 //! used for laser modulation
-uint64_t WasatchVCPP::ParseData::toUInt40(const vector<uint8_t>& buf, int index, bool bigEndian)
+uint64_t WasatchVCPP::ParseData::toUInt40(const uint8_t* buf, size_t size, int index, bool bigEndian)
 {
-    if (index + 4 >= (int)buf.size())
+    if (!inBounds(size, index, 5))
         return 0;
 
-    uint64_t raw = 0;
-    if (bigEndian)
-        raw = (((uint64_t)buf[index + 0]) << 32)
-            |            (buf[index + 1]  << 24)
-            |            (buf[index + 2]  << 16)
-            |            (buf[index + 3]  << 8)
-            |            (buf[index + 4]);
-    else
-        raw = (((uint64_t)buf[index + 4]) << 32)
-            |            (buf[index + 3]  << 24)
-            |            (buf[index + 2]  << 16)
-            |            (buf[index + 1]  << 8)
-            |            (buf[index + 0]);
-    return raw;
+    const uint8_t* p = buf + index;
+    return bigEndian ? ((uint64_t)p[0] << 32) | load32(p + 1, true)
+                     : ((uint64_t)p[4] << 32) | load32(p, false);
 }
 
-
-float WasatchVCPP::ParseData::toFloat (const vector<uint8_t>& buf, int index)
+float WasatchVCPP::ParseData::toFloat(const uint8_t* buf, size_t size, int index)
 {
-    uint32_t raw = toUInt32(buf, index);
-    float f = *((float*)&raw);
+    uint32_t raw = toUInt32(buf, size, index);
+    float f;
+    memcpy(&f, &raw, sizeof(f));
     if (isnan(f))
         f = 0;
     return f;
 }
 
-string WasatchVCPP::ParseData::toString(const vector<uint8_t>& buf, int index, int len)
+string WasatchVCPP::ParseData::toString(const uint8_t* buf, size_t size, int index, int len)
 {
     if (len == 0)
-        len = (int)buf.size();
-
-    std::string s;
-    for (int i = 0; i < len; i++)
-    {
-        if (index + i < (int)buf.size())
-        {
-            if (buf[index + 1] == 0)
-                break;
-            else
-                s += (char)buf[index + i];
-        }
-    }
-    return s;
+        len = (int)size;
+    if (index < 0 || (size_t)index >= size)
+        return "";
+
+    // stop at the first null, or the end of the field or buffer
+    size_t avail = size - index;
+    size_t maxLen = (size_t)len < avail ? (size_t)len : avail;
+    const uint8_t* p = buf + index;
+    const void* nul = memchr(p, 0, maxLen);
+    return string((const char*)p, nul ? (const uint8_t*)nul - p : maxLen);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Parsing EEPROM (convert buffer to native types)
+////////////////////////////////////////////////////////////////////////////////
+
+bool WasatchVCPP::ParseData::toBool(const vector<uint8_t>& buf, int index)
+{ return toBool(buf.data(), buf.size(), index); }
+
+uint8_t WasatchVCPP::ParseData::toUInt8(const vector<uint8_t>& buf, int index)
+{ return toUInt8(buf.data(), buf.size(), index); }
+
+//! assumes little endian
+int16_t WasatchVCPP::ParseData::toInt16(const vector<uint8_t>& buf, int index, bool bigEndian)
+{ return toInt16(buf.data(), buf.size(), index, bigEndian); }
+
+//! assumes little endian
+uint16_t WasatchVCPP::ParseData::toUInt16(const vector<uint8_t>& buf, int index, bool bigEndian)
+{ return toUInt16(buf.data(), buf.size(), index, bigEndian); }
+
+//! integration time is a 24-bit value
+uint32_t WasatchVCPP::ParseData::toUInt24(const vector<uint8_t>& buf, int index, bool bigEndian)
+{ return toUInt24(buf.data(), buf.size(), index, bigEndian); }
+
+//! assumes little endian
+int32_t WasatchVCPP::ParseData::toInt32(const vector<uint8_t>& buf, int index, bool bigEndian)
+{ return toInt32(buf.data(), buf.size(), index, bigEndian); }
+
+//! assumes little endian
+uint32_t WasatchVCPP::ParseData::toUInt32(const vector<uint8_t>& buf, int index, bool bigEndian)
+{ return toUInt32(buf.data(), buf.size(), index, bigEndian); }
+
+//! used for laser modulation
+uint64_t WasatchVCPP::ParseData::toUInt40(const vector<uint8_t>& buf, int index, bool bigEndian)
+{ return toUInt40(buf.data(), buf.size(), index, bigEndian); }
+
+float WasatchVCPP::ParseData::toFloat(const vector<uint8_t>& buf, int index)
+{ return toFloat(buf.data(), buf.size(), index); }
+
+string WasatchVCPP::ParseData::toString(const vector<uint8_t>& buf, int index, int len)
+{ return toString(buf.data(), buf.size(), index, len); }
+
 ////////////////////////////////////////////////////////////////////////////////
 // Writing EEPROM (convert native types to buffer)
 ////////////////////////////////////////////////////////////////////////////////
@@ -189,9 +212,9 @@ bool WasatchVCPP::ParseData::writeUInt32(uint32_t value, vector<uint8_t>& buf, i
         return false;
 
     buf[index + 0] = (value      ) & 0xff;
-    buf[index + 1] = (value <<  8) & 0xff;
-    buf[index + 2] = (value << 16) & 0xff;
-    buf[index + 3] = (value << 24) & 0xff;
+    buf[index + 1] = (value >>  8) & 0xff;
+    buf[index + 2] = (value >> 16) & 0xff;
+    buf[index + 3] = (value >> 24) & 0xff;
 
     return true;
 }
@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <string>
 #include <vector>
@@ -21,9 +22,26 @@ namespace WasatchVCPP
     //! from WasatchVCPP::Spectrometer.
     //! 
     //! @note all serialized data is presumed little-endian unless specified otherwise
+    //!
+    //! Each reader is provided in two forms: one taking a vector, and a "span" 
+    //! form taking a raw pointer and size, so callers holding a receive buffer 
+    //! (or a page within a larger image) can parse in place without copying.
+    //! Both are bounds-checked, returning zero when the field would overrun 
+    //! the buffer.
     class ParseData
     {
         public:
+            static bool         toBool  (const uint8_t* buf, size_t size, int index = 0);
+            static uint8_t      toUInt8 (const uint8_t* buf, size_t size, int index = 0);
+            static int16_t      toInt16 (const uint8_t* buf, size_t size, int index = 0, bool bigEndian = false);
+            static uint16_t     toUInt16(const uint8_t* buf, size_t size, int index = 0, bool bigEndian = false);
+            static uint32_t     toUInt24(const uint8_t* buf, size_t size, int index = 0, bool bigEndian = false);
+            static int32_t      toInt32 (const uint8_t* buf, size_t size, int index = 0, bool bigEndian = false);
+            static uint32_t     toUInt32(const uint8_t* buf, size_t size, int index = 0, bool bigEndian = false);
+            static uint64_t     toUInt40(const uint8_t* buf, size_t size, int index = 0, bool bigEndian = false);
+            static float        toFloat (const uint8_t* buf, size_t size, int index = 0);
+            static std::string  toString(const uint8_t* buf, size_t size, int index = 0, int len = 0);
+
             static bool         toBool  (const std::vector<uint8_t>& buf, int index = 0);
             static uint8_t      toUInt8 (const std::vector<uint8_t>& buf, int index = 0);
             static int16_t      toInt16 (const std::vector<uint8_t>& buf, int index = 0, bool bigEndian = false);
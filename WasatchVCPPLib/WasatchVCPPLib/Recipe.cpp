@@ -0,0 +1,429 @@
+/**
+    @file   Recipe.cpp
+    @author Mark Zieg <mzieg@wasatchphotonics.com>
+    @brief  implementation of WasatchVCPP::Recipe
+    @note   customers normally wouldn't access this file; use WasatchVCPP.h instead
+*/
+
+#include "pch.h"
+#include "Recipe.h"
+#include "Spectrometer.h"
+#include "Util.h"
+
+#include <algorithm>
+#include <sstream>
+#include <math.h>
+
+using std::string;
+using std::vector;
+using std::unique_lock;
+using std::mutex;
+
+typedef std::chrono::steady_clock Clock;
+
+//! how often wait_for_tec polls the detector temperature
+const int TEC_POLL_MS = 250;
+
+////////////////////////////////////////////////////////////////////////////////
+// Lifecycle
+////////////////////////////////////////////////////////////////////////////////
+
+WasatchVCPP::Recipe::Recipe(Spectrometer& spec, Logger& logger)
+    : spec(spec), logger(logger), state(Idle), stopRequested(false)
+{
+}
+
+WasatchVCPP::Recipe::~Recipe()
+{
+    stop();
+}
+
+//! Parse a recipe, replacing any previously parsed.
+//!
+//! @param text (Input) one step per line (see class documentation)
+//! @returns false (with the offending line logged) if the recipe is invalid
+bool WasatchVCPP::Recipe::parse(const string& text)
+{
+    steps.clear();
+
+    std::istringstream lines(text);
+    string line;
+    int lineNum = 0;
+    while (std::getline(lines, line))
+    {
+        lineNum++;
+        auto comment = line.find('#');
+        if (comment != string::npos)
+            line.erase(comment);
+
+        std::istringstream tokens(line);
+        vector<string> args;
+        string token;
+        while (tokens >> token)
+            args.push_back(token);
+        if (args.empty())
+            continue;
+
+        Step step;
+        step.line = lineNum;
+        string keyword = Util::toLower(args[0]);
+        size_t argc = args.size() - 1;
+        bool ok = true;
+        try
+        {
+            if      (keyword == "integration_time_ms") { step.op = Op::IntegrationTimeMS; ok = argc == 1; if (ok) step.value = std::stod(args[1]); }
+            else if (keyword == "laser_power_perc")    { step.op = Op::LaserPowerPerc;    ok = argc == 1; if (ok) step.value = std::stod(args[1]); }
+            else if (keyword == "laser_power_mw")      { step.op = Op::LaserPowerMW;      ok = argc == 1; if (ok) step.value = std::stod(args[1]); }
+            else if (keyword == "detector_gain")       { step.op = Op::DetectorGain;      ok = argc == 1; if (ok) step.value = std::stod(args[1]); }
+            else if (keyword == "tec_setpoint_degc")   { step.op = Op::TECSetpointDegC;   ok = argc == 1; if (ok) step.value = std::stod(args[1]); }
+            else if (keyword == "wait_ms")             { step.op = Op::WaitMS;            ok = argc == 1; if (ok) step.value = std::stod(args[1]); }
+            else if (keyword == "at_ms")               { step.op = Op::AtMS;              ok = argc == 1; if (ok) step.value = std::stod(args[1]); }
+            else if (keyword == "wait_for_tec")
+            {
+                step.op = Op::WaitForTEC;
+                ok = argc == 2;
+                if (ok)
+                {
+                    step.value = std::stod(args[1]);
+                    step.value2 = std::stod(args[2]);
+                }
+            }
+            else if (keyword == "laser")
+            {
+                step.op = Op::Laser;
+                string arg = argc == 1 ? Util::toLower(args[1]) : "";
+                ok = arg == "on" || arg == "off";
+                step.value = arg == "on" ? 1 : 0;
+            }
+            else if (keyword == "acquire")
+            {
+                step.op = Op::Acquire;
+                ok = argc == 2;
+                if (ok)
+                {
+                    step.value = std::stoi(args[1]);
+                    step.name = args[2];
+                    ok = step.value >= 1;
+                }
+            }
+            else if (keyword == "subtract")
+            {
+                step.op = Op::Subtract;
+                ok = argc == 3;
+                if (ok)
+                {
+                    step.a = args[1];
+                    step.b = args[2];
+                    step.name = args[3];
+                }
+            }
+            else if (keyword == "emit")
+            {
+                step.op = Op::Emit;
+                ok = argc == 1;
+                if (ok)
+                    step.name = args[1];
+            }
+            else
+            {
+                logger.error("Recipe: line %d: unknown step %s", lineNum, args[0].c_str());
+                steps.clear();
+                return false;
+            }
+        }
+        catch (...)
+        {
+            ok = false;
+        }
+
+        if (!ok || (step.value < 0 && step.op != Op::TECSetpointDegC))
+        {
+            logger.error("Recipe: line %d: invalid arguments to %s", lineNum, args[0].c_str());
+            steps.clear();
+            return false;
+        }
+        steps.push_back(step);
+    }
+
+    // check buffer references before anything touches the hardware
+    std::map<string, bool> defined;
+    for (const auto& step : steps)
+    {
+        if ((step.op == Op::Subtract && (!defined.count(step.a) || !defined.count(step.b))) ||
+            (step.op == Op::Emit && !defined.count(step.name)))
+        {
+            logger.error("Recipe: line %d: references undefined buffer", step.line);
+            steps.clear();
+            return false;
+        }
+        if (step.op == Op::Acquire || step.op == Op::Subtract)
+            defined[step.name] = true;
+    }
+
+    if (steps.empty())
+    {
+        logger.error("Recipe: no steps");
+        return false;
+    }
+    coalesce();
+    logger.debug("Recipe: parsed %d steps", (int)steps.size());
+    return true;
+}
+
+//! Within each run of consecutive settings steps, mark all but the last 
+//! write of each setting as superseded, so only the final values are sent.
+void WasatchVCPP::Recipe::coalesce()
+{
+    auto isSetting = [](Op op)
+    {
+        return op == Op::IntegrationTimeMS || op == Op::LaserPowerPerc || op == Op::LaserPowerMW 
+            || op == Op::DetectorGain || op == Op::TECSetpointDegC;
+    };
+
+    int superseded = 0;
+    for (size_t first = 0; first < steps.size(); )
+    {
+        size_t end = first;
+        while (end < steps.size() && isSetting(steps[end].op))
+            end++;
+
+        // walking the run backwards, the first write of each setting wins
+        // (both laser power steps write the same setting)
+        std::map<Op, bool> written;
+        for (size_t i = end; i > first; i--)
+        {
+            Step& step = steps[i - 1];
+            Op setting = step.op == Op::LaserPowerMW ? Op::LaserPowerPerc : step.op;
+            step.superseded = written.count(setting) > 0;
+            written[setting] = true;
+            if (step.superseded)
+                superseded++;
+        }
+        first = end > first ? end : first + 1;
+    }
+    if (superseded > 0)
+        logger.debug("Recipe: coalesced %d superseded settings", superseded);
+}
+
+//! Begin executing the parsed recipe on a background thread.
+bool WasatchVCPP::Recipe::start()
+{
+    if (steps.empty() || state == Running)
+        return false;
+
+    {
+        unique_lock<mutex> lock(mut);
+        results.clear();
+    }
+    buffers.clear();
+    laserUsed = false;
+    stopRequested = false;
+    startTime = Clock::now();
+    state = Running;
+    worker = std::thread(&Recipe::run, this);
+    return true;
+}
+
+//! Interrupt the recipe (aborting any integration in progress) and wait for
+//! the worker to exit.  Queued results remain readable.
+void WasatchVCPP::Recipe::stop()
+{
+    stopRequested = true;
+    cv.notify_all();
+    if (state == Running)
+        spec.cancelOperation(false);
+    if (worker.joinable())
+        worker.join();
+}
+
+//! Collect the next emitted result.
+//!
+//! @param result (Output) populated if a result was available
+//! @param timeoutMS (Input) how long to wait for one (0 to poll)
+//! @returns 1 if a result was read, else 0 (timeout, or the recipe has ended)
+int WasatchVCPP::Recipe::read(Result& result, int timeoutMS)
+{
+    unique_lock<mutex> lock(mut);
+    if (results.empty() && timeoutMS > 0)
+        cv.wait_for(lock, std::chrono::milliseconds(timeoutMS), [this] { return !results.empty() || state != Running; });
+
+    if (results.empty())
+        return 0;
+
+    result = std::move(results.front());
+    results.pop_front();
+    return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Execution
+////////////////////////////////////////////////////////////////////////////////
+
+void WasatchVCPP::Recipe::run()
+{
+    State finalState = Complete;
+    for (const auto& step : steps)
+    {
+        if (stopRequested)
+        {
+            finalState = Cancelled;
+            break;
+        }
+        if (!execute(step))
+        {
+            finalState = stopRequested ? Cancelled : Failed;
+            if (finalState == Failed)
+                logger.error("Recipe: line %d failed", step.line);
+            break;
+        }
+    }
+
+    if (laserUsed)
+        spec.setLaserEnable(false);
+
+    logger.debug("Recipe: finished with state %d after %.1fms", (int)finalState, elapsedMS());
+    {
+        unique_lock<mutex> lock(mut);
+        state = finalState;
+    }
+    cv.notify_all();
+}
+
+bool WasatchVCPP::Recipe::execute(const Step& step)
+{
+    if (step.superseded)
+        return true;
+
+    switch (step.op)
+    {
+        // Settings are compared against the spectrometer's cached state, so
+        // a recipe repeated per-sample only sends what actually changes.
+        case Op::IntegrationTimeMS:
+            if (spec.integrationTimeMS == (int)step.value)
+                return true;
+            return spec.setIntegrationTimeMS((unsigned long)step.value);
+
+        case Op::LaserPowerPerc:
+            if (spec.modEnabled && spec.laserPowerPerc == (float)step.value)
+                return true;
+            return spec.setLaserPowerPerc((float)step.value);
+
+        case Op::LaserPowerMW:
+            return spec.setLaserPowermW((float)step.value);
+
+        case Op::DetectorGain:
+            return spec.setDetectorGain((float)step.value);
+
+        case Op::TECSetpointDegC:
+            if (spec.detectorTECSetointDegC == (int)step.value)
+                return true;
+            return spec.setDetectorTECSetpointDegC((int)step.value);
+
+        case Op::Laser:
+            if (step.value)
+            {
+                if (!spec.eeprom.hasLaser)
+                {
+                    logger.error("Recipe: spectrometer has no laser");
+                    return false;
+                }
+                laserUsed = true;
+                if (spec.laserEnabled)
+                    return true;
+            }
+            return spec.setLaserEnable(step.value != 0);
+
+        case Op::WaitMS:
+            return sleepUntil(Clock::now() + std::chrono::microseconds((long long)(step.value * 1000)));
+
+        case Op::AtMS:
+            return sleepUntil(startTime + std::chrono::microseconds((long long)(step.value * 1000)));
+
+        case Op::WaitForTEC:
+        {
+            float setpoint = (float)spec.getDetectorTECSetpointDegC();
+            if (setpoint == Spectrometer::InvalidTemperature)
+            {
+                logger.error("Recipe: wait_for_tec without a TEC setpoint");
+                return false;
+            }
+            auto deadline = Clock::now() + std::chrono::milliseconds((long long)step.value2);
+            while (true)
+            {
+                float degC = spec.getDetectorTemperatureDegC();
+                if (fabs(degC - setpoint) <= step.value)
+                    return true;
+                if (Clock::now() >= deadline)
+                {
+                    logger.error("Recipe: detector reached %.2fC, not %.2fC", degC, setpoint);
+                    return false;
+                }
+                if (!sleepUntil(std::min(deadline, Clock::now() + std::chrono::milliseconds(TEC_POLL_MS))))
+                    return false;
+            }
+        }
+
+        case Op::Acquire:
+        {
+            vector<double>& sum = buffers[step.name];
+            sum.clear();
+            int count = (int)step.value;
+            for (int i = 0; i < count; i++)
+            {
+                if (stopRequested)
+                    return false;
+                auto spectrum = spec.getSpectrum();
+                if (spectrum.empty() || (!sum.empty() && spectrum.size() != sum.size()))
+                    return false;
+                if (sum.empty())
+                    sum.assign(spectrum.size(), 0.0);
+                for (size_t j = 0; j < spectrum.size(); j++)
+                    sum[j] += spectrum[j];
+            }
+            for (auto& value : sum)
+                value /= count;
+            return true;
+        }
+
+        case Op::Subtract:
+        {
+            const auto& a = buffers[step.a];
+            const auto& b = buffers[step.b];
+            if (a.size() != b.size())
+                return false;
+            vector<double> diff(a.size());
+            for (size_t i = 0; i < a.size(); i++)
+                diff[i] = a[i] - b[i];
+            buffers[step.name] = std::move(diff);
+            return true;
+        }
+
+        case Op::Emit:
+        {
+            Result result;
+            result.name = step.name;
+            result.spectrum = buffers[step.name];
+            result.elapsedMS = elapsedMS();
+            {
+                unique_lock<mutex> lock(mut);
+                results.push_back(std::move(result));
+            }
+            cv.notify_all();
+            return true;
+        }
+    }
+    return false;
+}
+
+//! @returns false if stop() was called before 'when'
+bool WasatchVCPP::Recipe::sleepUntil(Clock::time_point when)
+{
+    unique_lock<mutex> lock(mut);
+    cv.wait_until(lock, when, [this] { return (bool)stopRequested; });
+    return !stopRequested;
+}
+
+double WasatchVCPP::Recipe::elapsedMS() const
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - startTime).count();
+}
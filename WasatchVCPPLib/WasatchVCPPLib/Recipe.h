@@ -0,0 +1,120 @@
+/**
+    @file   Recipe.h
+    @author Mark Zieg <mzieg@wasatchphotonics.com>
+    @brief  interface of WasatchVCPP::Recipe
+    @note   customers normally wouldn't access this file; use WasatchVCPP.h instead
+*/
+
+#pragma once
+
+#include "Logger.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace WasatchVCPP
+{
+    class Spectrometer;
+
+    //! Internal class parsing and executing a multi-step measurement recipe.
+    //!
+    //! A recipe is plain text, one step per line, with '#' comments:
+    //!
+    //! @code
+    //!     integration_time_ms 100
+    //!     laser_power_perc 50
+    //!     tec_setpoint_degc -15
+    //!     wait_for_tec 0.5 30000      # tolerance degC, timeout ms
+    //!     laser on
+    //!     wait_ms 500
+    //!     acquire 10 sample           # average 10 frames into "sample"
+    //!     emit sample
+    //!     laser off
+    //!     acquire 10 dark
+    //!     subtract sample dark corrected
+    //!     emit corrected
+    //! @endcode
+    //!
+    //! Other steps are laser_power_mw, detector_gain and at_ms (wait until N ms
+    //! after the recipe started).
+    //!
+    //! The recipe runs on its own thread.  Consecutive settings are applied
+    //! back-to-back with no client round-trips, and are coalesced: within a
+    //! run of settings steps only the last value of each setting is sent
+    //! (laser_power_perc and laser_power_mw count as one setting), and 
+    //! settings which already match the spectrometer's cached state are not
+    //! re-sent.  laser on/off ends a run, and is never coalesced.  Waits are
+    //! scheduled against the steady clock, and can be interrupted by stop().
+    //! Each emitted buffer is queued as soon as it is computed, so the caller
+    //! can consume early results while later steps are still running.
+    //!
+    //! If the recipe enabled the laser, the laser is always disabled when the
+    //! recipe ends, whether it completed, failed or was stopped.
+    class Recipe
+    {
+        public:
+            enum State { Idle, Running, Complete, Failed, Cancelled };
+
+            struct Result
+            {
+                std::string name;
+                std::vector<double> spectrum;
+                double elapsedMS = 0;           //!< since the recipe started
+            };
+
+            Recipe(Spectrometer& spec, Logger& logger);
+            ~Recipe();
+
+            bool parse(const std::string& text);
+            bool start();
+            void stop();
+
+            State getState() const { return state; }
+            int read(Result& result, int timeoutMS);
+
+        private:
+            enum class Op { IntegrationTimeMS, LaserPowerPerc, LaserPowerMW, DetectorGain, TECSetpointDegC,
+                            WaitForTEC, Laser, WaitMS, AtMS, Acquire, Subtract, Emit };
+
+            struct Step
+            {
+                Op op;
+                int line = 0;
+                double value = 0;
+                double value2 = 0;
+                std::string name;               //!< destination (or emitted) buffer
+                std::string a;                  //!< subtract operands
+                std::string b;
+                bool superseded = false;        //!< a later setting in the same run replaces this one
+            };
+
+            Spectrometer& spec;
+            Logger& logger;
+
+            std::vector<Step> steps;
+            std::map<std::string, std::vector<double> > buffers;
+
+            std::atomic<State> state;
+            std::atomic<bool> stopRequested;
+            std::thread worker;
+            std::chrono::steady_clock::time_point startTime;
+            bool laserUsed = false;
+
+            std::mutex mut;
+            std::condition_variable cv;
+            std::deque<Result> results;
+
+            void coalesce();
+            void run();
+            bool execute(const Step& step);
+            bool sleepUntil(std::chrono::steady_clock::time_point when);
+            double elapsedMS() const;
+    };
+}
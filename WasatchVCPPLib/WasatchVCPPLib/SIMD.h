@@ -0,0 +1,19 @@
+/**
+    @file   SIMD.h
+    @author Mark Zieg <mzieg@wasatchphotonics.com>
+    @brief  selects the vector instruction set for the library's kernels
+    @note   customers normally wouldn't access this file; use WasatchVCPP.h instead
+*/
+
+#pragma once
+
+// SSE2 is baseline on x86-64, but 32-bit x86 only has it when the compiler
+// was told to target it (-msse2, /arch:SSE2); otherwise the kernels fall 
+// back to their scalar loops.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define WPVCPP_SSE2 1
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define WPVCPP_NEON 1
+#include <arm_neon.h>
+#endif
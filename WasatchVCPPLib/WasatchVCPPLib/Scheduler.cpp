@@ -0,0 +1,262 @@
+/**
+    @file   Scheduler.cpp
+    @author Mark Zieg <mzieg@wasatchphotonics.com>
+    @brief  implementation of WasatchVCPP::Scheduler
+    @note   customers normally wouldn't access this file; use WasatchVCPP.h instead
+*/
+
+#include "pch.h"
+#include "Scheduler.h"
+#include "Spectrometer.h"
+
+#include <algorithm>
+
+using std::map;
+using std::vector;
+using std::unique_lock;
+using std::mutex;
+
+typedef WasatchVCPP::Scheduler::Clock Clock;
+
+////////////////////////////////////////////////////////////////////////////////
+// Lifecycle
+////////////////////////////////////////////////////////////////////////////////
+
+WasatchVCPP::Scheduler::Scheduler(Logger& logger)
+    : logger(logger), running(false)
+{
+}
+
+WasatchVCPP::Scheduler::~Scheduler()
+{
+    stop();
+}
+
+//! Set the acquisition plan for one spectrometer (applied on the next start).
+bool WasatchVCPP::Scheduler::setPlan(int index, const Plan& plan)
+{
+    unique_lock<mutex> lock(mutDevices);
+    if (running || plan.cadenceHz < 0 || plan.integrationTimeMS < 0)
+        return false;
+    plans[index] = plan;
+    return true;
+}
+
+void WasatchVCPP::Scheduler::clearPlans()
+{
+    unique_lock<mutex> lock(mutDevices);
+    if (!running)
+        plans.clear();
+}
+
+//! Approximate sustained bulk-IN throughput of a USB bus at a given signaling
+//! rate, after protocol overhead.
+double WasatchVCPP::Scheduler::getBusBytesPerSec(int speedMbps)
+{
+    if (speedMbps <= 0)
+        speedMbps = 480; // unknown: assume high-speed
+
+    if (speedMbps <= 12)
+        return speedMbps * 1e6 / 8 * 0.8;   // low/full-speed framing overhead
+    if (speedMbps <= 480)
+        return 40e6;                        // practical high-speed bulk limit
+    return speedMbps * 1e6 / 10 * 0.8;      // SuperSpeed 8b/10b (or better) encoding
+}
+
+//! Admit all planned spectrometers against their buses' bandwidth and start
+//! acquiring.
+bool WasatchVCPP::Scheduler::start(const map<int, Spectrometer*>& spectrometers)
+{
+    unique_lock<mutex> lock(mutDevices);
+    if (running || plans.empty())
+        return false;
+
+    devices.clear();
+    busReadout.clear();
+
+    // group planned spectrometers by bus
+    map<int, vector<Device*> > buses;
+    for (auto& pair : plans)
+    {
+        auto iter = spectrometers.find(pair.first);
+        if (iter == spectrometers.end() || iter->second == nullptr)
+        {
+            logger.error("Scheduler: no spectrometer %d", pair.first);
+            devices.clear();
+            return false;
+        }
+
+        auto device = new Device();
+        device->spec = iter->second;
+        device->plan = pair.second;
+        devices[pair.first].reset(device);
+        buses[device->spec->usbBus].push_back(device);
+    }
+
+    // admit each bus independently
+    for (auto& bus : buses)
+    {
+        auto& members = bus.second;
+        double budget = getBusBytesPerSec(members[0]->spec->usbSpeedMbps) * busUtilization;
+        double demand = 0;
+        for (auto device : members)
+        {
+            Spectrometer& spec = *device->spec;
+            int integrationTimeMS = device->plan.integrationTimeMS > 0 ? device->plan.integrationTimeMS : spec.integrationTimeMS.load();
+            double maxHz = 1000.0 / std::max(1, integrationTimeMS);
+            device->grantedHz = device->plan.cadenceHz > 0 ? std::min(device->plan.cadenceHz, maxHz) : maxHz;
+            demand += device->grantedHz * spec.pixels * 2;
+        }
+
+        if (demand > budget)
+        {
+            double scale = budget / demand;
+            logger.info("Scheduler: bus %d oversubscribed (%.0f of %.0f bytes/sec), scaling cadences by %.3f",
+                bus.first, demand, budget, scale);
+            for (auto device : members)
+                device->grantedHz *= scale;
+        }
+
+        // stagger triggers across each spectrometer's period
+        for (size_t i = 0; i < members.size(); i++)
+        {
+            auto device = members[i];
+            auto periodUS = (long long)(1e6 / device->grantedHz);
+            device->offset = std::chrono::microseconds(periodUS * (long long)i / (long long)members.size());
+        }
+
+        busReadout[bus.first] = std::make_shared<mutex>();
+        logger.debug("Scheduler: bus %d has %d spectrometers, budget %.0f bytes/sec",
+            bus.first, (int)members.size(), budget);
+    }
+
+    // configure everything before the first trigger
+    for (auto& pair : devices)
+    {
+        auto device = pair.second.get();
+        if (device->plan.integrationTimeMS > 0)
+            device->spec->setIntegrationTimeMS(device->plan.integrationTimeMS);
+        device->spec->setBusReadout(busReadout[device->spec->usbBus]);
+    }
+
+    running = true;
+    startTime = Clock::now();
+    for (auto& pair : devices)
+    {
+        auto device = pair.second.get();
+        device->worker = std::thread(&Scheduler::run, this, device);
+    }
+    logger.info("Scheduler: started %d spectrometers on %d buses", (int)devices.size(), (int)buses.size());
+    return true;
+}
+
+//! Stop all scheduled acquisitions.  Stats and latest spectra remain readable
+//! until the next start().
+void WasatchVCPP::Scheduler::stop()
+{
+    unique_lock<mutex> lock(mutDevices);
+    if (!running)
+        return;
+
+    running = false;
+    cvWake.notify_all();
+    for (auto& pair : devices)
+        if (pair.second->worker.joinable())
+            pair.second->worker.join();
+    stopTime = Clock::now();
+
+    for (auto& pair : devices)
+    {
+        auto device = pair.second.get();
+        device->spec->setBusReadout(nullptr);
+
+        Stats stats;
+        getStats(device, stats);
+        logger.info("Scheduler: spectrometer %d (bus %d port %s) requested %.2fHz, granted %.2fHz, achieved %.2fHz (%d late)",
+            pair.first, stats.bus, stats.ports.c_str(), stats.requestedHz, stats.grantedHz, stats.achievedHz, (int)stats.late);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Results
+////////////////////////////////////////////////////////////////////////////////
+
+bool WasatchVCPP::Scheduler::getStats(int index, Stats& stats)
+{
+    unique_lock<mutex> lock(mutDevices);
+    auto iter = devices.find(index);
+    if (iter == devices.end())
+        return false;
+
+    getStats(iter->second.get(), stats);
+    return true;
+}
+
+//! Caller holds mutDevices.
+void WasatchVCPP::Scheduler::getStats(Device* device, Stats& stats)
+{
+    stats.bus = device->spec->usbBus;
+    stats.ports = device->spec->usbPorts;
+    stats.speedMbps = device->spec->usbSpeedMbps;
+    stats.requestedHz = device->plan.cadenceHz;
+    stats.grantedHz = device->grantedHz;
+
+    unique_lock<mutex> lock(device->mut);
+    stats.frames = device->frames;
+    stats.late = device->late;
+
+    double sec = std::chrono::duration<double>((running ? Clock::now() : stopTime) - startTime).count();
+    stats.achievedHz = sec > 0 ? stats.frames / sec : 0;
+}
+
+//! @returns number of spectra acquired so far (-1 if not scheduled), with
+//!          the most recent copied to 'spectrum'
+int64_t WasatchVCPP::Scheduler::getLatest(int index, vector<double>& spectrum)
+{
+    unique_lock<mutex> devicesLock(mutDevices);
+    auto iter = devices.find(index);
+    if (iter == devices.end())
+        return -1;
+
+    auto device = iter->second.get();
+    unique_lock<mutex> lock(device->mut);
+    spectrum = device->latest;
+    return (int64_t)device->frames;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Worker
+////////////////////////////////////////////////////////////////////////////////
+
+void WasatchVCPP::Scheduler::run(Device* device)
+{
+    auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / device->grantedHz));
+    auto next = startTime + device->offset;
+    while (running)
+    {
+        {
+            unique_lock<mutex> lock(mutWake);
+            cvWake.wait_until(lock, next, [this] { return !running; });
+        }
+        if (!running)
+            break;
+
+        auto spectrum = device->spec->getSpectrum();
+        if (!spectrum.empty())
+        {
+            unique_lock<mutex> lock(device->mut);
+            device->latest = std::move(spectrum);
+            device->frames++;
+        }
+
+        // if we overran the next slot, don't try to catch up with a burst
+        next += period;
+        auto now = Clock::now();
+        if (now > next)
+        {
+            unique_lock<mutex> lock(device->mut);
+            device->late++;
+            next = now;
+        }
+    }
+}
@@ -0,0 +1,118 @@
+/**
+    @file   Scheduler.h
+    @author Mark Zieg <mzieg@wasatchphotonics.com>
+    @brief  interface of WasatchVCPP::Scheduler
+    @note   customers normally wouldn't access this file; use WasatchVCPP.h instead
+*/
+
+#pragma once
+
+#include "Logger.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace WasatchVCPP
+{
+    class Spectrometer;
+
+    //! Internal class running scheduled acquisitions across many spectrometers,
+    //! aware of which USB bus each one is on.
+    //!
+    //! Each spectrometer is given a plan (cadence and integration time).  On
+    //! start(), plans are grouped by USB bus (as recorded by
+    //! Driver::openAllSpectrometers) and admitted against that bus's bulk
+    //! bandwidth: if the requested cadences on a bus would exceed its budget,
+    //! they are scaled down proportionally, while spectrometers on other buses
+    //! are unaffected.
+    //!
+    //! Every spectrometer then acquires on its own thread, so integrations
+    //! overlap freely.  Triggers on the same bus are staggered across the
+    //! cadence period, and bulk reads on the same bus are serialized: a
+    //! spectrometer only takes its bus once its integration should be
+    //! complete, so readouts don't contend with one another.
+    //!
+    //! Requested, granted and achieved rates are reported by getStats().
+    class Scheduler
+    {
+        public:
+            typedef std::chrono::steady_clock Clock;
+
+            struct Plan
+            {
+                double cadenceHz = 0;           //!< requested spectra per second (0 for as fast as possible)
+                int integrationTimeMS = 0;      //!< applied on start (0 to leave unchanged)
+            };
+
+            struct Stats
+            {
+                int bus = -1;
+                std::string ports;
+                int speedMbps = 0;
+                double requestedHz = 0;
+                double grantedHz = 0;           //!< after per-bus bandwidth admission
+                double achievedHz = 0;          //!< measured since start()
+                uint64_t frames = 0;
+                uint64_t late = 0;              //!< acquisitions which missed their slot
+            };
+
+            Scheduler(Logger& logger);
+            ~Scheduler();
+
+            bool setPlan(int index, const Plan& plan);
+            void clearPlans();
+
+            bool start(const std::map<int, Spectrometer*>& spectrometers);
+            void stop();
+            bool isRunning() const { return running; }
+
+            bool getStats(int index, Stats& stats);
+            int64_t getLatest(int index, std::vector<double>& spectrum);
+
+            static double getBusBytesPerSec(int speedMbps);
+
+            //! fraction of each bus's bulk bandwidth available to scheduled reads
+            double busUtilization = 0.8;
+
+        private:
+            struct Device
+            {
+                Spectrometer* spec = nullptr;
+                Plan plan;
+                double grantedHz = 0;
+                Clock::duration offset;         //!< trigger stagger within the bus
+                std::thread worker;
+
+                std::mutex mut;
+                std::vector<double> latest;
+                uint64_t frames = 0;
+                uint64_t late = 0;
+            };
+
+            Logger& logger;
+
+            //! plans and devices are guarded by mutDevices, held throughout
+            //! start() and stop()
+            std::map<int, Plan> plans;
+            std::map<int, std::unique_ptr<Device> > devices;
+            std::map<int, std::shared_ptr<std::mutex> > busReadout;
+            std::mutex mutDevices;
+
+            std::atomic<bool> running;
+            Clock::time_point startTime;
+            Clock::time_point stopTime;
+            std::mutex mutWake;
+            std::condition_variable cvWake;
+
+            void run(Device* device);
+            void getStats(Device* device, Stats& stats);
+    };
+}
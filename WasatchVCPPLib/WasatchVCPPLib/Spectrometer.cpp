@@ -18,6 +18,7 @@
 
 #include <algorithm>
 #include <chrono>
+#include <thread>
 
 using std::string;
 using std::vector;
@@ -39,17 +40,36 @@ const int MIN_ARM_LEN = 8;
 
 unsigned long MAX_UINT24 = 16777216;
 
+//! widest share of a spectrum one FX2 bulk endpoint streams
+const int MAX_PIXELS_PER_ENDPOINT = 1024;
+
+//! spectral endpoints, in the order a split spectrum is read from them
+const uint8_t PRIMARY_ENDPOINT = 0x82;
+const uint8_t SECONDARY_ENDPOINT = 0x86;
+
+//! how often a multi-endpoint read checks for cancellation
+const int BULK_POLL_MS = 100;
+
+//! area-scan row reads kept queued on each spectral endpoint
+const int AREA_SCAN_ROWS_QUEUED = 4;
+
 ////////////////////////////////////////////////////////////////////////////////
 // Lifecycle
 ////////////////////////////////////////////////////////////////////////////////
 
 WasatchVCPP::Spectrometer::Spectrometer(WPVCPP_UDEV_TYPE* udev, int pid, int index, Logger& logger)
-    : udev(udev), pid(pid), index(index), logger(logger), eeprom(logger)
+    : eeprom(logger), pid(pid), index(index), integrationTimeMS(1), laserEnabled(false), settingsGeneration(0),
+      asyncControl(*this, logger), pipeline(logger), deadband(logger), display(logger), expression(logger),
+      udev(udev), acquisitionState(AcquisitionState::Idle), restoreIntegrationTime(false), cancelsInFlight(0),
+      throwawayFrames(0), throwawayCount(0), throwawayStopping(false),
+      memTriggered(0), memAreaScan(0), memFlightRecorder(0), logger(logger)
 {
 
     logger.debug("Spectrometer::ctor: instantiating index %d (pid 0x%04x)", index, pid);
 
     driver = Driver::getInstance();
+    if (driver != nullptr)
+        eeprom.compact = driver->getCompactMode();
 
     // read firmware versions first (useful for debugging, validates FPGA comms)
     fpgaVersion = getFPGAVersion();
@@ -66,8 +86,128 @@ WasatchVCPP::Spectrometer::Spectrometer(WPVCPP_UDEV_TYPE* udev, int pid, int ind
     // post-eeprom initialization
     ////////////////////////////////////////////////////////////////////////////
 
+    readEndpointTable();
+    applyEEPROM();
+
+    // (the Driver preallocates the frame pool once the spectrometer is open)
+
+    // If this unit was open earlier in the session (it dropped off the bus,
+    // or the application closed and reopened it), put back what it had then;
+    // otherwise apply startup defaults from the EEPROM.  Either way, each 
+    // setting is written once.
+    Settings settings;
+    if (driver != nullptr && driver->getSavedSettings(eeprom.serialNumber, settings))
+    {
+        logger.info("Spectrometer::ctor: restoring settings of %s from its last session", eeprom.serialNumber.c_str());
+        warmRestored = true;
+    }
+    else
+        settings = getStartupSettings();
+    applySettings(settings);
+
+    // initialize micro models
+    if (isMicro())
+    {
+        // @todo initVerticalROI();
+    }
+
+    logger.debug("Spectrometer::ctor: done");
+}
+
+WasatchVCPP::Spectrometer::~Spectrometer()
+{
+    logger.info("WasatchVCPP::Spectrometer::dtor");
+    close();
+}
+
+bool WasatchVCPP::Spectrometer::close()
+{
+    logger.info("Spectrometer::close");
+    display.close();
+    stopRecipe();
+    stopTriggeredAcquisition();
+    stopThrowaways();
+    asyncControl.stop();
+    releaseBulkReads();
+    releaseAreaScanReads();
+    if (udev != nullptr)
+    {
+        if (driver != nullptr && !eeprom.serialNumber.empty())
+            driver->saveSettings(eeprom.serialNumber, getSettings());
+
+        // wait out any transfer on the bus; lockComm refuses from here on
+        lockComm(CommandPriority::Urgent);
+#if USE_LIBUSB_WIN32
+        usb_release_interface(udev, 0);
+        usb_close(udev);
+#else
+        logger.info("Spectrometer::close releasing interface on Linux");
+        libusb_release_interface(udev, 0);
+        libusb_close(udev);
+#endif
+        {
+            std::lock_guard<std::mutex> lock(mutComm);
+            udev = nullptr;
+        }
+        unlockComm(false);
+    }
+    logger.info("Spectrometer::close: end");
+    return true;
+}
+
+bool WasatchVCPP::Spectrometer::readEEPROM()
+{
+    vector<vector<uint8_t> > pages;
+    for (int page = 0; page < EEPROM::MAX_PAGES; page++)
+    {
+        auto buf = getCmd2(0x01, EEPROM::PAGE_SIZE, page, 0, CommandPriority::Background);
+        pages.push_back(buf);
+        logger.debug("EEPROM page %d: %s", page, Util::toHex(buf).c_str());
+    }
+
+    if (!eeprom.parse(pages))
+    {
+        logger.error("Spectrometer::readEEPROM: unable to parse EEPROM");
+        return false;
+    }
+    return true;
+}
+
+//! Update state derived from the EEPROM (wavecal, acquisition geometry etc).
+//! Called at initialization, and again whenever the EEPROM is rewritten.
+void WasatchVCPP::Spectrometer::applyEEPROM()
+{
+    srm_in_EEPROM = eeprom.has_srm();
+
     pixels = eeprom.activePixelsHoriz;
+    computeAxes();
+
+    // initialize acquisition parameters: FX2-based units stream at most 
+    // 1024 pixels per endpoint, so wider detectors which divide evenly are
+    // split across the first spectral endpoints (the table is ranked 0x82,
+    // 0x86, then any others), falling back to one if there are too few
+    int count = 1;
+    if (!isARM() && pixels > MAX_PIXELS_PER_ENDPOINT && pixels % MAX_PIXELS_PER_ENDPOINT == 0)
+    {
+        int wanted = pixels / MAX_PIXELS_PER_ENDPOINT;
+        if ((int)bulkEndpoints.size() >= wanted)
+            count = wanted;
+        else
+            logger.error("applyEEPROM: %d pixels want %d spectral endpoints, but %d found; reading one", 
+                pixels, wanted, (int)bulkEndpoints.size());
+    }
+    endpoints.assign(bulkEndpoints.begin(), bulkEndpoints.begin() + count);
+    pixelsPerEndpoint = pixels / count;
+    bufSubspectrum.resize(pixels * 2);
+    configureBulkReads();
+
+    logger.debug("applyEEPROM: %d endpoint(s) of %d pixels", (int)endpoints.size(), pixelsPerEndpoint);
+}
 
+//! Generate the wavelength and wavenumber axes from the EEPROM calibration.
+//! In compact mode, only single-precision copies are kept.
+void WasatchVCPP::Spectrometer::computeAxes()
+{
     wavelengths.resize(pixels);
     for (int i = 0; i < pixels; i++)
         wavelengths[i] = eeprom.wavecalCoeffs[0] 
@@ -91,92 +231,339 @@ WasatchVCPP::Spectrometer::Spectrometer(WPVCPP_UDEV_TYPE* udev, int pid, int ind
     else
         wavenumbers.resize(0);
 
-    // apply configured gain/offset from EEPROM to FPGA
-    setDetectorGain     (eeprom.detectorGain);
-    setDetectorGainOdd  (eeprom.detectorGainOdd);
-    setDetectorOffset   (eeprom.detectorOffset);
-    setDetectorOffsetOdd(eeprom.detectorOffsetOdd);
+    if (eeprom.compact)
+    {
+        wavelengthsFloat.assign(wavelengths.begin(), wavelengths.end());
+        wavenumbersFloat.assign(wavenumbers.begin(), wavenumbers.end());
+        vector<double>().swap(wavelengths);
+        vector<double>().swap(wavenumbers);
+    }
+    else
+    {
+        vector<float>().swap(wavelengthsFloat);
+        vector<float>().swap(wavenumbersFloat);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Settings
+////////////////////////////////////////////////////////////////////////////////
+
+//! Startup defaults configured in the EEPROM.
+WasatchVCPP::Spectrometer::Settings WasatchVCPP::Spectrometer::getStartupSettings()
+{
+    Settings settings;
+    settings.detectorGain      = eeprom.detectorGain;
+    settings.detectorGainOdd   = eeprom.detectorGainOdd;
+    settings.detectorOffset    = eeprom.detectorOffset;
+    settings.detectorOffsetOdd = eeprom.detectorOffsetOdd;
 
-    // initialize integration time
     const int MAX_SENSIBLE_STARTUP_INTEGRATION_TIME_MS = 5000;
     if (eeprom.startupIntegrationTimeMS >= eeprom.minIntegrationTimeMS &&
         eeprom.startupIntegrationTimeMS <= eeprom.maxIntegrationTimeMS &&
         eeprom.startupIntegrationTimeMS <= MAX_SENSIBLE_STARTUP_INTEGRATION_TIME_MS)
-        setIntegrationTimeMS(eeprom.startupIntegrationTimeMS);
+        settings.integrationTimeMS = eeprom.startupIntegrationTimeMS;
     else if (eeprom.minIntegrationTimeMS <= MAX_SENSIBLE_STARTUP_INTEGRATION_TIME_MS)
-        setIntegrationTimeMS(eeprom.minIntegrationTimeMS);
+        settings.integrationTimeMS = eeprom.minIntegrationTimeMS;
 
-    // initialize TEC and setpoint
     if (eeprom.hasCooling)
     {
-        setDetectorTECSetpointDegC(eeprom.startupDetectorTemperatureDegC);
-        setDetectorTECEnable(true);
+        settings.hasTEC = true;
+        settings.detectorTECSetpointDegC = eeprom.startupDetectorTemperatureDegC;
+        settings.detectorTECEnable = true;
     }
+    return settings;
+}
 
-    // initialize micro models
-    if (isMicro())
+//! Snapshot of the settings last applied (falling back to EEPROM defaults
+//! for any never written).  Reads nothing from the spectrometer.
+WasatchVCPP::Spectrometer::Settings WasatchVCPP::Spectrometer::getSettings()
+{
+    Settings settings = getStartupSettings();
+    settings.integrationTimeMS = integrationTimeMS;
+
+    std::lock_guard<std::mutex> lock(mutStatus);
+    if (settingsCache.hasGain)      settings.detectorGain      = settingsCache.gain;
+    if (settingsCache.hasGainOdd)   settings.detectorGainOdd   = settingsCache.gainOdd;
+    if (settingsCache.hasOffset)    settings.detectorOffset    = (int16_t)settingsCache.offset;
+    if (settingsCache.hasOffsetOdd) settings.detectorOffsetOdd = (int16_t)settingsCache.offsetOdd;
+    if (settings.hasTEC)
     {
-        // @todo initVerticalROI();
+        if (detectorTECSetpointHasBeenSet)
+            settings.detectorTECSetpointDegC = detectorTECSetointDegC;
+        if (settingsCache.hasTECEnable)
+            settings.detectorTECEnable = settingsCache.tecEnable;
     }
+    settings.hasHighGainMode = settingsCache.hasHighGainMode;
+    settings.highGainModeEnable = settingsCache.highGainMode;
+    settings.hasLaserPower = settingsCache.hasLaserPower;
+    settings.laserPowerPerc = laserPowerPerc;
+    settings.hasLaserModulation = settingsCache.hasModEnable || settingsCache.hasModPeriod || settingsCache.hasModWidth;
+    settings.laserModulationEnable = modEnabled;
+    settings.laserModPeriodUS = settingsCache.hasModPeriod ? (int)modPeriodus : 0;
+    settings.laserModWidthUS = settingsCache.hasModWidth ? (int)modWidthus : 0;
+    return settings;
+}
+
+//! Write a complete set of settings back-to-back, in dependency order 
+//! (gain and offset, integration time, TEC setpoint before enable, then 
+//! laser power).  The laser itself is left off.
+//!
+//! Laser power is implemented by modulation, so when the modulation itself
+//! is known it's written as it was (covering both the last laser power and
+//! any direct setModPeriodus etc since), rather than recomputed.
+//!
+//! @returns true if every write succeeded
+bool WasatchVCPP::Spectrometer::applySettings(const Settings& settings)
+{
+    bool ok = setDetectorGain(settings.detectorGain);
+    ok = setDetectorGainOdd  (settings.detectorGainOdd)   && ok;
+    ok = setDetectorOffset   (settings.detectorOffset)    && ok;
+    ok = setDetectorOffsetOdd(settings.detectorOffsetOdd) && ok;
+
+    if (settings.integrationTimeMS > 0)
+        ok = setIntegrationTimeMS(settings.integrationTimeMS) && ok;
 
-    // initialize acquisition parameters
-    endpoints.push_back(0x82);
-    pixelsPerEndpoint = pixels;
-    if (pixels == 2048 && !isARM())
+    if (settings.hasTEC && eeprom.hasCooling)
     {
-        endpoints.push_back(0x86);
-        pixelsPerEndpoint = 1024;
+        ok = setDetectorTECSetpointDegC(settings.detectorTECSetpointDegC) && ok;
+        ok = setDetectorTECEnable(settings.detectorTECEnable) && ok;
     }
-    bufSubspectrum.resize(pixelsPerEndpoint * 2);
 
-    logger.debug("Spectrometer::ctor: done");
+    if (settings.hasHighGainMode && isInGaAs())
+        ok = setHighGainModeEnable(settings.highGainModeEnable) && ok;
+
+    if (settings.hasLaserModulation && eeprom.hasLaser)
+    {
+        if (settings.laserModPeriodUS > 0)
+            ok = setModPeriodus(settings.laserModPeriodUS) && ok;
+        if (settings.laserModWidthUS > 0)
+            ok = setModWidthus(settings.laserModWidthUS) && ok;
+        ok = setModEnable(settings.laserModulationEnable) && ok;
+        if (settings.hasLaserPower && ok)
+            cacheLaserPowerPerc(settings.laserPowerPerc);
+    }
+    else if (settings.hasLaserPower && eeprom.hasLaser)
+        ok = setLaserPowerPerc(settings.laserPowerPerc) && ok;
+
+    if (!ok)
+        logger.error("Spectrometer::applySettings: not all settings were applied");
+    return ok;
 }
 
-WasatchVCPP::Spectrometer::~Spectrometer()
+////////////////////////////////////////////////////////////////////////////////
+// EEPROM write
+////////////////////////////////////////////////////////////////////////////////
+
+//! Write one raw 64-byte page to the EEPROM (no verification).
+//!
+//! @param page (Input) which page (0 to EEPROM::MAX_PAGES - 1)
+//! @param data (Input) exactly EEPROM::PAGE_SIZE bytes
+//! @returns true if the control transfer succeeded
+bool WasatchVCPP::Spectrometer::writeEEPROMPage(int page, const vector<uint8_t>& data)
 {
-    logger.info("WasatchVCPP::Spectrometer::dtor");
-    close();
+    if (page < 0 || page >= EEPROM::MAX_PAGES || data.size() != EEPROM::PAGE_SIZE)
+    {
+        logger.error("writeEEPROMPage: invalid page %d (%d bytes)", page, (int)data.size());
+        return false;
+    }
+
+    int bytesWritten = 0;
+    if (isARM())
+        bytesWritten = sendCmd(0xff, 0x02, (uint16_t)page, data, CommandPriority::Background);
+    else
+        bytesWritten = sendCmd(0xa2, (uint16_t)((0x3c << 8) | (0x40 * page)), 0, data, CommandPriority::Background);
+
+    if (bytesWritten != EEPROM::PAGE_SIZE)
+    {
+        logger.error("writeEEPROMPage: failed to write page %d (result %d)", page, bytesWritten);
+        return false;
+    }
+    return true;
 }
 
-bool WasatchVCPP::Spectrometer::close()
+//! Write a modified EEPROM to the spectrometer.
+//!
+//! serialize() overlays only the fields which were changed onto the pages
+//! 'modified' was parsed from, so unchanged fields (and encodings the parser
+//! normalizes) go back byte for byte, and only pages holding a changed field
+//! differ from the device.
+//!
+//! @see commitEEPROMPages
+bool WasatchVCPP::Spectrometer::commitEEPROM(const EEPROM& modified, int* pagesWritten, double* elapsedMS)
 {
-    logger.info("Spectrometer::close");
-    if (udev != nullptr)
+    vector<vector<uint8_t> > image;
+    if (!modified.serialize(image))
     {
-#if USE_LIBUSB_WIN32
-        usb_release_interface(udev, 0);
-        usb_close(udev);
-#else
-        logger.info("Spectrometer::close releasing interface on Linux");
-        libusb_release_interface(udev, 0);
-        libusb_close(udev);
-#endif
-        udev = nullptr;
+        logger.error("commitEEPROM: modified EEPROM failed validation");
+        return false;
     }
-    logger.info("Spectrometer::close: end");
-    return true;
+    return commitEEPROMPages(image, pagesWritten, elapsedMS);
 }
 
-bool WasatchVCPP::Spectrometer::readEEPROM()
+//! Change one EEPROM field, by name, on a staged copy of the EEPROM.  The 
+//! live EEPROM (which acquisitions read) is untouched until 
+//! commitStagedEEPROM.
+//!
+//! @see EEPROM::setField
+bool WasatchVCPP::Spectrometer::setEEPROMField(const string& name, const string& value)
 {
-    vector<vector<uint8_t> > pages;
-    for (int page = 0; page < EEPROM::MAX_PAGES; page++)
+    std::lock_guard<std::mutex> lock(mutAcquisition);
+    if (stagedEEPROM == nullptr)
+        stagedEEPROM.reset(new EEPROM(eeprom));
+    return stagedEEPROM->setField(name, value);
+}
+
+//! Write the changes staged through setEEPROMField (if any).  If the commit
+//! fails, the changes remain staged for another attempt.
+//!
+//! @see commitEEPROMPages
+bool WasatchVCPP::Spectrometer::commitStagedEEPROM(int* pagesWritten, double* elapsedMS)
+{
+    std::unique_ptr<EEPROM> staged;
     {
-        auto buf = getCmd2(0x01, EEPROM::PAGE_SIZE, page);
-        pages.push_back(buf);
-        logger.debug("EEPROM page %d: %s", page, Util::toHex(buf).c_str());
+        std::lock_guard<std::mutex> lock(mutAcquisition);
+        staged.swap(stagedEEPROM);
     }
 
-    if (!eeprom.parse(pages))
+    if (staged == nullptr)
     {
-        logger.error("Spectrometer::readEEPROM: unable to parse EEPROM");
+        if (pagesWritten)
+            *pagesWritten = 0;
+        if (elapsedMS)
+            *elapsedMS = 0;
+        return true;
+    }
+
+    bool ok = commitEEPROM(*staged, pagesWritten, elapsedMS);
+    if (!ok)
+    {
+        // unless others were staged in the meantime
+        std::lock_guard<std::mutex> lock(mutAcquisition);
+        if (stagedEEPROM == nullptr)
+            stagedEEPROM.swap(staged);
+    }
+    return ok;
+}
+
+//! Write a complete EEPROM image to the spectrometer, transferring only those 
+//! pages which differ from the last image read from (or written to) the device.
+//! If any do, a running triggered acquisition is stopped and area-scan mode 
+//! disabled first.
+//!
+//! Each written page is verified by read-back.  Verified pages are immediately
+//! reflected in eeprom.pages, and the EEPROM (and everything derived from it,
+//! like wavelengths) is re-parsed in place, so the spectrometer does not need
+//! to be re-opened.  If any page fails, the pages which were verified are 
+//! still applied.
+//!
+//! @param image        (Input)  EEPROM::MAX_PAGES pages of EEPROM::PAGE_SIZE bytes
+//! @param pagesWritten (Output) optional count of pages actually transferred
+//! @param elapsedMS    (Output) optional wall-clock duration of the commit
+//! @returns true if every changed page was written and verified
+bool WasatchVCPP::Spectrometer::commitEEPROMPages(const vector<vector<uint8_t> >& image, int* pagesWritten, double* elapsedMS)
+{
+    auto start = std::chrono::steady_clock::now();
+    if (pagesWritten)
+        *pagesWritten = 0;
+
+    if (image.size() != EEPROM::MAX_PAGES)
+    {
+        logger.error("commitEEPROMPages: expected %d pages, received %d", EEPROM::MAX_PAGES, (int)image.size());
         return false;
     }
-    if (eeprom.has_srm()) 
+
+    // A triggered acquisition or area scan was sized for the current 
+    // geometry, which the new EEPROM may change, so stop them before writing
+    // (the triggered reads run outside mutAcquisition)
+    bool changing = false;
+    string serialNumber;
     {
-        srm_in_EEPROM = true;
+        std::lock_guard<std::mutex> lock(mutEEPROM);
+        for (int page = 0; page < EEPROM::MAX_PAGES && !changing; page++)
+            changing = page >= (int)eeprom.pages.size() || eeprom.pages[page] != image[page];
+        serialNumber = eeprom.serialNumber;
     }
-    return true;
+    if (changing)
+    {
+        if (stopTriggeredAcquisition())
+            logger.info("commitEEPROMPages: stopped triggered acquisition on %s", serialNumber.c_str());
+        if (getAreaScanEnable() && setAreaScanEnable(false))
+            logger.info("commitEEPROMPages: disabled area scan on %s", serialNumber.c_str());
+    }
+
+    const int MAX_VERIFY_ATTEMPTS = 3;
+    bool ok = true;
+    int written = 0;
+    std::shared_ptr<FramePool> pool;
+    {
+        // don't write the EEPROM in the middle of an acquisition
+        std::lock_guard<std::mutex> lock(mutAcquisition);
+
+        vector<vector<uint8_t> > pages = eeprom.pages;
+        for (int page = 0; page < EEPROM::MAX_PAGES; page++)
+        {
+            if (image[page].size() != EEPROM::PAGE_SIZE)
+            {
+                logger.error("commitEEPROMPages: page %d has %d bytes", page, (int)image[page].size());
+                ok = false;
+                break;
+            }
+
+            if (page < (int)pages.size() && pages[page] == image[page])
+                continue;
+
+            if (!writeEEPROMPage(page, image[page]))
+            {
+                ok = false;
+                break;
+            }
+            written++;
+
+            // the EEPROM may take a few ms to commit the page internally
+            bool verified = false;
+            for (int attempt = 0; attempt < MAX_VERIFY_ATTEMPTS && !verified; attempt++)
+            {
+                if (attempt > 0)
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10 * attempt));
+                verified = getCmd2(0x01, EEPROM::PAGE_SIZE, page, 0, CommandPriority::Background) == image[page];
+            }
+
+            if (!verified)
+            {
+                logger.error("commitEEPROMPages: page %d failed read-back verification", page);
+                ok = false;
+                break;
+            }
+
+            pages.resize(EEPROM::MAX_PAGES);
+            pages[page] = image[page];
+        }
+
+        if (written > 0)
+        {
+            // readers outside the acquisition path hold mutEEPROM instead
+            std::lock_guard<std::mutex> lockEEPROM(mutEEPROM);
+            eeprom.parse(pages);
+            applyEEPROM();
+            pool = getFramePool();
+        }
+    }
+
+    // resize the frame pool if the detector geometry changed (outside the 
+    // locks, as sizing it against the memory budget counts every spectrometer)
+    if (pool != nullptr && pool->pixels != pixels)
+        setFramePool(pool->frames, pool->flags);
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    logger.info("commitEEPROMPages: wrote %d of %d pages in %.1fms%s", 
+        written, EEPROM::MAX_PAGES, ms, ok ? "" : " (FAILED)");
+
+    if (pagesWritten)
+        *pagesWritten = written;
+    if (elapsedMS)
+        *elapsedMS = ms;
+    return ok;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -186,15 +573,22 @@ bool WasatchVCPP::Spectrometer::readEEPROM()
 bool WasatchVCPP::Spectrometer::setIntegrationTimeMS(unsigned long ms)
 {
     ms = clamp(ms, 1, MAX_UINT24 - 1);
+    bool ok = writeIntegrationTimeMS(ms);
+
+    integrationTimeMS = (int)ms;
+    if (ok)
+        bumpSettingsGeneration();
+    logger.debug("integrationTimeMS -> %lu", ms);
+    return ok;
+}
 
+//! send an integration time to the FPGA without changing the configured value
+bool WasatchVCPP::Spectrometer::writeIntegrationTimeMS(unsigned long ms, CommandPriority priority)
+{
     unsigned short lsw = ms & 0xffff;
     unsigned short msw = (ms >> 16) & 0x00ff;
 
-    auto bytesWritten = sendCmd(0xb2, lsw, msw);
-
-    integrationTimeMS = ms;
-    logger.debug("integrationTimeMS -> %lu", ms);
-    return bytesWritten >= 0;
+    return sendCmd(0xb2, lsw, msw, nullptr, 0, priority) >= 0;
 }
 
 bool WasatchVCPP::Spectrometer::setLaserPowerPerc(float percent)
@@ -205,7 +599,6 @@ bool WasatchVCPP::Spectrometer::setLaserPowerPerc(float percent)
         return false;
     }
     float value = float(max(0.f, min(100.f, percent)));
-    laserPowerPerc = value;
     logger.debug("set_laser_power_perc: range (0, 100), requested %.2f, applying %.2f", percent, value);
 
     value = float(max(0.f, min(100.f, value)));
@@ -219,7 +612,12 @@ bool WasatchVCPP::Spectrometer::setLaserPowerPerc(float percent)
             logger.debug("Turning off laser modulation (full power)");
             nextAppliedLaserPower = 100.0;
             logger.debug("next_applied_laser_power = 100.0");
-            setModEnable(false);
+            if (!setModEnable(false))
+            {
+                logger.error("Hardware Failure to disable laser modulation");
+                return false;
+            }
+            cacheLaserPowerPerc(value);
             return true;
         }
     }
@@ -258,9 +656,18 @@ bool WasatchVCPP::Spectrometer::setLaserPowerPerc(float percent)
     //nextAppliedLaserPower = value;
     //logger.debug("next_applied_laser_power = %s", nextAppliedLaserPower);
     //result = true;
+    cacheLaserPowerPerc(value);
     return result;
 }
 
+//! remember a laser power the spectrometer accepted (for getSettings)
+void WasatchVCPP::Spectrometer::cacheLaserPowerPerc(float percent)
+{
+    std::lock_guard<std::mutex> lock(mutStatus);
+    laserPowerPerc = percent;
+    settingsCache.hasLaserPower = true;
+}
+
 bool WasatchVCPP::Spectrometer::setLaserPowermW(float mW_in) {
     if (!eeprom.hasLaserPowerCalibration()) {
         logger.error("EEPROM doesn't have laser power calibration");
@@ -279,9 +686,16 @@ bool WasatchVCPP::Spectrometer::setLaserPowermW(float mW_in) {
 }
 
 bool WasatchVCPP::Spectrometer::setModEnable(bool flag) {
-    modEnabled = flag;
     int value = flag ? 1 : 0;
-    sendCmd(0xbd, value);
+    if (sendCmd(0xbd, value) < 0)
+        return false;
+
+    {
+        std::lock_guard<std::mutex> lock(mutStatus);
+        modEnabled = flag;
+        settingsCache.hasModEnable = true;
+    }
+    bumpSettingsGeneration();
     return true;
 }
 
@@ -318,7 +732,16 @@ bool WasatchVCPP::Spectrometer::setModPeriodus(int us) {
     msw = bit_buf.MidW;
     uint8_t buf[8] = { (uint8_t)bit_buf.MSB, 0, 0, 0, 0, 0, 0, 0 };
     auto bytesWritten = sendCmd(0xc7, lsw, msw, buf, sizeof(buf)/sizeof(buf[0]));
-    return bytesWritten >= 0;
+    if (bytesWritten < 0)
+        return false;
+
+    {
+        std::lock_guard<std::mutex> lock(mutStatus);
+        modPeriodus = (float)us;
+        settingsCache.hasModPeriod = true;
+    }
+    bumpSettingsGeneration();
+    return true;
 }
 
 bool  WasatchVCPP::Spectrometer::setModWidthus(int us) {
@@ -327,13 +750,45 @@ bool  WasatchVCPP::Spectrometer::setModWidthus(int us) {
     uint16_t msw = bit_buf.MidW;
     uint8_t buf[8] = { (uint8_t)bit_buf.MSB, 0, 0, 0, 0, 0, 0, 0 };
     auto bytesWritten = sendCmd(0xdb, lsw, msw, buf, sizeof(buf)/sizeof(buf[0]));
-    return bytesWritten >= 0;
+    if (bytesWritten < 0)
+        return false;
+
+    {
+        std::lock_guard<std::mutex> lock(mutStatus);
+        modWidthus = (float)us;
+        settingsCache.hasModWidth = true;
+    }
+    bumpSettingsGeneration();
+    return true;
 }
 
+//! Disabling the laser is sent urgently, ahead of other queued control 
+//! traffic, and supersedes every laser-enable issued before it: those still
+//! in the asynchronous queue are cancelled, and those still waiting for the
+//! bus are dropped when they get it.
+//!
+//! @returns false if the write failed, or was superseded by a disable
 bool WasatchVCPP::Spectrometer::setLaserEnable(bool flag)
 {
-    auto bytesWritten = sendCmd(0xbe, flag ? 1 : 0);
-    laserEnabled = flag;
+    const uint64_t sequence = beginLaserCommand(flag);
+    if (!flag)
+        asyncControl.cancelQueued([](const AsyncControl::Operation& op) { return op.bRequest == 0xbe && op.wValue != 0; });
+
+    if (!lockComm(flag ? CommandPriority::Normal : CommandPriority::Urgent))
+        return false;
+
+    if (!isLaserCommandCurrent(sequence, flag))
+    {
+        unlockComm();
+        logger.debug("laserEnable -> %d superseded by a later disable", flag);
+        return false;
+    }
+
+    auto bytesWritten = sendCmdLocked(0xbe, flag ? 1 : 0, 0, nullptr, 0);
+    if (bytesWritten >= 0)
+        recordLaserEnable(sequence, flag);
+    unlockComm();
+
     logger.debug("laserEnable -> %d (bytesWritten %d)", flag, bytesWritten);
     return bytesWritten >= 0;
 }
@@ -356,6 +811,14 @@ bool WasatchVCPP::Spectrometer::setDetectorGain(float value)
 
     auto bytesWritten = sendCmd(op, word);
     logger.debug("detectorGain -> 0x%04x (%.2f)", word, value);
+    if (bytesWritten >= 0)
+    {
+        std::lock_guard<std::mutex> lock(mutStatus);
+        settingsCache.hasGain = true;
+        settingsCache.gain = value;
+    }
+    if (bytesWritten >= 0)
+        bumpSettingsGeneration();
     return bytesWritten >= 0;
 }
 
@@ -369,6 +832,14 @@ bool WasatchVCPP::Spectrometer::setDetectorGainOdd(float value)
 
     auto bytesWritten = sendCmd(op, word);
     logger.debug("detectorGainOdd -> 0x%04x (%.2f)", word, value);
+    if (bytesWritten >= 0)
+    {
+        std::lock_guard<std::mutex> lock(mutStatus);
+        settingsCache.hasGainOdd = true;
+        settingsCache.gainOdd = value;
+    }
+    if (bytesWritten >= 0)
+        bumpSettingsGeneration();
     return bytesWritten >= 0;
 }
 
@@ -378,6 +849,14 @@ bool WasatchVCPP::Spectrometer::setDetectorOffset(int16_t value)
     uint16_t word = *((uint16_t*) &value); // send original signed int16 bit pattern
     auto bytesWritten = sendCmd(op, word);
     logger.debug("detectorOffset -> 0x%04x (%d)", word, value);
+    if (bytesWritten >= 0)
+    {
+        std::lock_guard<std::mutex> lock(mutStatus);
+        settingsCache.hasOffset = true;
+        settingsCache.offset = value;
+    }
+    if (bytesWritten >= 0)
+        bumpSettingsGeneration();
     return bytesWritten >= 0;
 }
 
@@ -387,6 +866,14 @@ bool WasatchVCPP::Spectrometer::setDetectorOffsetOdd(int16_t value)
     uint16_t word = *((uint16_t*) &value);
     auto bytesWritten = sendCmd(op, word);
     logger.debug("detectorOffsetOdd -> 0x%04x (%d)", word, value);
+    if (bytesWritten >= 0)
+    {
+        std::lock_guard<std::mutex> lock(mutStatus);
+        settingsCache.hasOffsetOdd = true;
+        settingsCache.offsetOdd = value;
+    }
+    if (bytesWritten >= 0)
+        bumpSettingsGeneration();
     return bytesWritten >= 0;
 }
 
@@ -404,6 +891,12 @@ bool WasatchVCPP::Spectrometer::setDetectorTECEnable(bool flag)
 
     auto bytesWritten = sendCmd(op, flag ? 1 : 0);
     logger.debug("detectorTECEnable -> %s", flag ? "on" : "off");
+    if (bytesWritten >= 0)
+    {
+        std::lock_guard<std::mutex> lock(mutStatus);
+        settingsCache.hasTECEnable = true;
+        settingsCache.tecEnable = flag;
+    }
     return bytesWritten >= 0;
 }
 
@@ -451,6 +944,14 @@ bool WasatchVCPP::Spectrometer::setHighGainModeEnable(bool flag)
     auto bytesWritten = sendCmd(op, flag ? 1 : 0, 0, junk);
 
     logger.debug("highGainModeEnable -> %s", flag ? "on" : "off");
+    if (bytesWritten >= 0)
+    {
+        std::lock_guard<std::mutex> lock(mutStatus);
+        settingsCache.hasHighGainMode = true;
+        settingsCache.highGainMode = flag;
+    }
+    if (bytesWritten >= 0)
+        bumpSettingsGeneration();
 
     return bytesWritten >= 0;
 }
@@ -524,35 +1025,48 @@ float WasatchVCPP::Spectrometer::getDetectorTemperatureDegC()
 //! @warning this function will not work correctly without custom firmware
 bool WasatchVCPP::Spectrometer::cancelOperation(bool blocking)
 {
-    if (!acquiring)
-        return false;
-
-    // This will cause this class's bulk endpoint read "retry loop" to stop 
-    // cycling, at least within maxTimeoutMS.  However, this doesn't actually 
-    // change anything inside the hardware spectrometer.
-    operationCancelled = true;
+    // Moving to Cancelling will cause this class's bulk endpoint read "retry 
+    // loop" to stop cycling, at least within maxTimeoutMS.  However, this 
+    // doesn't actually change anything inside the hardware spectrometer.
+    //
+    // Announce ourselves first, so the next acquisition can't start until 
+    // we've finished writing to the FPGA below.
+    {
+        std::lock_guard<std::mutex> lock(mutCancel);
+        cancelsInFlight++;
+    }
+    auto state = acquisitionState.load();
+    do
+    {
+        if (state == AcquisitionState::Idle || state == AcquisitionState::Cancelling)
+        {
+            endCancel();
+            return false;
+        }
+    } while (!acquisitionState.compare_exchange_weak(state, AcquisitionState::Cancelling));
 
     // To actually cause the spectrometer to abruptly end the current acquisition
     // before the original scheduled "end-of-integration time," we need to reduce
     // the current integration time.  With appropriate FPGA FW, this will cause
     // the current acquisition to "end immediately" (read-out the sensor and push
     // the abbreviated intensities to the bulk endpoint, where we may or may not
-    // bother to actually read them).
-    cancelledIntegrationTimeMS = integrationTimeMS;
-    setIntegrationTimeMS(eeprom.minIntegrationTimeMS);
+    // bother to actually read them).  The configured integrationTimeMS is left
+    // unchanged.  This goes out ahead of any other queued control traffic.
+    writeIntegrationTimeMS(eeprom.minIntegrationTimeMS, CommandPriority::Urgent);
 
     // The question now is when to restore the original integration time.  My 
-    // current approach is to set a new flag, lastAcquisitionWasCancelled, which
-    // will cause the NEXT acquisition to start by re-setting the originally-
-    // configured integration time.
-    lastAcquisitionWasCancelled = true;
+    // current approach is to set a flag, restoreIntegrationTime, which will 
+    // cause the NEXT acquisition to start by re-sending the configured 
+    // integration time.
+    restoreIntegrationTime = true;
+    endCancel();
 
     // if requested, block until current bulk read times-out
     if (blocking)
     {
         // check at least 1Hz 
         int sleepMS = min(maxTimeoutMS, 1000); 
-        while (acquiring)
+        while (acquisitionState != AcquisitionState::Idle)
         {
             logger.debug("cancelOperation: blocking while acquiring");
             Util::sleepMS(sleepMS);
@@ -561,6 +1075,14 @@ bool WasatchVCPP::Spectrometer::cancelOperation(bool blocking)
     return true;
 }
 
+//! Wake any acquisition waiting on this cancel to finish writing.
+void WasatchVCPP::Spectrometer::endCancel()
+{
+    std::lock_guard<std::mutex> lock(mutCancel);
+    if (--cancelsInFlight == 0)
+        cvCancel.notify_all();
+}
+
 //! Determine how long we should wait for an acquisition to return the spectrum.
 //!
 //! Note that this is the "full period" we should wait, which may end up being
@@ -574,99 +1096,1540 @@ long WasatchVCPP::Spectrometer::generateTotalWaitMS()
          + 500;
 }
 
-std::vector<double> WasatchVCPP::Spectrometer::getSpectrum()
+//! Move from Idle to Armed, first restoring the integration time after a 
+//! cancelled acquisition.  Caller must hold mutAcquisition.
+//!
+//! @returns false if an acquisition is already in flight
+bool WasatchVCPP::Spectrometer::beginAcquisition()
 {
-    mutAcquisition.lock();
-    logger.debug("getSpectrum started on %", eeprom.serialNumber.c_str());
-
-    // perform clean-up from cancelled operation, if any
-    if (lastAcquisitionWasCancelled)
+    // wait out any cancelOperation still shortening the previous acquisition
+    // (arming under the lock, so no new cancel can slip in between)
     {
-        setIntegrationTimeMS(cancelledIntegrationTimeMS);
-        lastAcquisitionWasCancelled = false;
-    }
+        std::unique_lock<std::mutex> lock(mutCancel);
+        cvCancel.wait(lock, [this] { return cancelsInFlight == 0; });
 
-    vector<double> spectrum;
-    if (acquiring)
-    {
-        // just in case
-        logger.error("Spectrometer %s already acquiring", eeprom.serialNumber.c_str());
-        mutAcquisition.unlock();
-        return spectrum;
+        auto expected = AcquisitionState::Idle;
+        if (!acquisitionState.compare_exchange_strong(expected, AcquisitionState::Armed))
+        {
+            // just in case
+            logger.error("Spectrometer %s already acquiring", eeprom.serialNumber.c_str());
+            return false;
+        }
     }
 
-    operationCancelled = false;
-    acquiring = true;
-
-    // send software trigger
-    logger.debug("sending ACQUIRE");
-    sendCmd(0xad);
+    // perform clean-up from cancelled operation, if any (the next frame may
+    // still have the shortened integration)
+    if (restoreIntegrationTime.exchange(false) && writeIntegrationTimeMS(integrationTimeMS))
+        bumpSettingsGeneration();
+    return true;
+}
 
-    // how long we'll wait for the FIRST subspectrum
+//! Acquire one spectrum.
+//!
+//! If throwaways are configured (@see setThrowawayFrames), frames triggered 
+//! too soon after a settings change, or during one, are read and discarded 
+//! here unless the background worker already consumed them.
+//!
+//! @param generation (Output) optional settingsGeneration the returned 
+//!        spectrum was triggered under
+std::vector<double> WasatchVCPP::Spectrometer::getSpectrum(uint32_t* generation)
+{
+    vector<double> spectrum(pixels);
+    if (spectrum.empty() || !getSpectrum(&spectrum[0], pixels, generation))
+        spectrum.clear();
+    return spectrum;
+}
+
+//! As above, into the caller's buffer.
+//!
+//! @param spectrum (Output) at least 'pixels' intensities
+//! @param len      (Input)  length of 'spectrum'
+bool WasatchVCPP::Spectrometer::getSpectrum(double* spectrum, int len, uint32_t* generation)
+{ return getSpectrumAs(SpectrumFormat::Double, spectrum, len, 1, generation); }
+
+//! Read one spectrum, converted to the requested format.  Doubles are read
+//! straight into the caller's buffer.  Other formats are read into the frame
+//! pool, so the acquisition itself neither allocates nor (with a locked pool)
+//! page-faults, and then converted into the caller's buffer; if the pool is
+//! disabled or exhausted, a scratch frame kept for the purpose is used.
+//!
+//! @param format   (Input)  element type of 'spectrum'
+//! @param spectrum (Output) at least 'pixels' elements
+//! @param len      (Input)  length of 'spectrum' in elements
+//! @param scale    (Input)  multiplier for integer formats
+bool WasatchVCPP::Spectrometer::getSpectrumAs(SpectrumFormat::Format format, void* spectrum, int len, double scale, uint32_t* generation)
+{
+    std::lock_guard<std::mutex> lock(mutAcquisition);
+    return readSpectrumAs(format, spectrum, len, scale, generation);
+}
+
+//! getSpectrumAs, for callers already holding mutAcquisition.
+bool WasatchVCPP::Spectrometer::readSpectrumAs(SpectrumFormat::Format format, void* spectrum, int len, double scale, uint32_t* generation)
+{
+    logger.debug("getSpectrum started on %s", eeprom.serialNumber.c_str());
+
+    if (triggeredAcquisition && triggeredAcquisition->isRunning())
+    {
+        logger.error("getSpectrum: triggered acquisition in progress on %s", eeprom.serialNumber.c_str());
+        return false;
+    }
+    if (spectrum == nullptr || len < pixels)
+    {
+        logger.error("getSpectrum: insufficient storage (%d of %d pixels)", len, pixels);
+        return false;
+    }
+
+    std::shared_ptr<FramePool> pool;
+    double* frame = nullptr;
+    if (format == SpectrumFormat::Double)
+        frame = (double*)spectrum;
+    else
+    {
+        pool = getFramePool();
+        frame = pool != nullptr && pool->pixels >= pixels ? pool->acquire() : nullptr;
+    }
+    bool pooled = frame != nullptr && pool != nullptr;
+    if (frame == nullptr)
+    {
+        bufConvert.resize(pixels);
+        frame = &bufConvert[0];
+    }
+    auto faults = pooled ? FramePool::getThreadPageFaults() : 0;
+
+    uint32_t triggered = 0;
+    bool ok = acquireFreshSpectrum(frame, triggered);
+
+    if (ok)
+        recordFrame(frame, &bufSubspectrum[0], pixels, triggered);
+    if (pooled)
+        pool->addPageFaults(FramePool::getThreadPageFaults() - faults);
+
+    if (ok && frame != spectrum)
+        SpectrumFormat::convert(format, frame, spectrum, pixels, scale);
+    if (pooled)
+        pool->release(frame);
+
+    if (generation != nullptr)
+        *generation = triggered;
+    return ok;
+}
+
+//! Average scansToAverage spectra, then subtract the dark and apply the gain
+//! (@see SpectrumPipeline).  Frames are read as raw counts and summed in 
+//! integers, so no floating point is involved until the end.
+//!
+//! If throwaways are enabled and a setting changes partway through, the 
+//! average restarts (once) so every scan was taken under the same settings.
+//!
+//! @param spectrum (Output) at least 'pixels' intensities
+//! @param len      (Input)  length of 'spectrum'
+bool WasatchVCPP::Spectrometer::getProcessedSpectrum(float* spectrum, int len)
+{
+    std::lock_guard<std::mutex> lock(mutAcquisition);
+
+    if (triggeredAcquisition && triggeredAcquisition->isRunning())
+    {
+        logger.error("getProcessedSpectrum: triggered acquisition in progress on %s", eeprom.serialNumber.c_str());
+        return false;
+    }
+    if (spectrum == nullptr || len < pixels || pixels <= 0)
+    {
+        logger.error("getProcessedSpectrum: insufficient storage (%d of %d pixels)", len, pixels);
+        return false;
+    }
+
+    processFrame.resize(pixels);
+    processSums.resize(pixels);
+    std::fill(processSums.begin(), processSums.end(), 0);
+
+    int scans = pipeline.getScansToAverage();
+    bool restarted = false;
+    uint32_t first = 0;
+    for (int scan = 0; scan < scans; scan++)
+    {
+        uint32_t triggered = 0;
+        if (!acquireFreshSpectrum(&processFrame[0], triggered))
+            return false;
+
+        if (scan == 0)
+            first = triggered;
+        else if (triggered != first && throwawayFrames > 0 && !restarted)
+        {
+            logger.debug("getProcessedSpectrum: settings changed after %d scans, restarting", scan);
+            std::fill(processSums.begin(), processSums.end(), 0);
+            restarted = true;
+            first = triggered;
+            scan = 0;
+        }
+        Kernels::accumulate(&processFrame[0], &processSums[0], pixels);
+        recordFrame(nullptr, &bufSubspectrum[0], pixels, triggered);
+    }
+
+    if (!pipeline.finish(&processSums[0], scans, spectrum, pixels))
+        return false;
+
+    // the display plots what was delivered
+    if (display.isEnabled())
+    {
+        bufConvert.assign(spectrum, spectrum + pixels);
+        recordFrame(&bufConvert[0], nullptr, pixels, first);
+    }
+    return true;
+}
+
+//! Acquire one spectrum and apply the compiled formula to it (@see 
+//! Expression), in a single pass over the pixels.
+//!
+//! @param spectrum (Output) at least 'pixels' results
+//! @param len      (Input)  length of 'spectrum'
+bool WasatchVCPP::Spectrometer::getExpressionSpectrum(double* spectrum, int len)
+{
+    std::lock_guard<std::mutex> lock(mutAcquisition);
+
+    if (triggeredAcquisition && triggeredAcquisition->isRunning())
+    {
+        logger.error("getExpressionSpectrum: triggered acquisition in progress on %s", eeprom.serialNumber.c_str());
+        return false;
+    }
+    if (spectrum == nullptr || len < pixels || pixels <= 0)
+    {
+        logger.error("getExpressionSpectrum: insufficient storage (%d of %d pixels)", len, pixels);
+        return false;
+    }
+    if (!expression.isCompiled())
+    {
+        logger.error("getExpressionSpectrum: no expression set on %s", eeprom.serialNumber.c_str());
+        return false;
+    }
+
+    uint32_t triggered = 0;
+    if (!acquireFreshSpectrum(spectrum, triggered))
+        return false;
+    recordFrame(spectrum, &bufSubspectrum[0], pixels, triggered);
+
+    // setCompact may be replacing the axes
+    std::lock_guard<std::mutex> lockEEPROM(mutEEPROM);
+
+    // in compact mode the axes are only held as floats
+    vector<double> wl;
+    vector<double> wn;
+    const double* wavelengthAxis = (int)wavelengths.size() >= pixels ? &wavelengths[0] : nullptr;
+    const double* wavenumberAxis = (int)wavenumbers.size() >= pixels ? &wavenumbers[0] : nullptr;
+    if (wavelengthAxis == nullptr && (int)wavelengthsFloat.size() >= pixels && expression.uses(Expression::Wavelength))
+    {
+        wl.assign(wavelengthsFloat.begin(), wavelengthsFloat.begin() + pixels);
+        wavelengthAxis = &wl[0];
+    }
+    if (wavenumberAxis == nullptr && (int)wavenumbersFloat.size() >= pixels && expression.uses(Expression::Wavenumber))
+    {
+        wn.assign(wavenumbersFloat.begin(), wavenumbersFloat.begin() + pixels);
+        wavenumberAxis = &wn[0];
+    }
+
+    return expression.evaluate(spectrum, wavelengthAxis, wavenumberAxis, spectrum, pixels);
+}
+
+//! Read one frame, discarding stale ones (@see setThrowawayFrames).  Caller
+//! must hold mutAcquisition.
+template <typename T>
+bool WasatchVCPP::Spectrometer::acquireFreshSpectrum(T* spectrum, uint32_t& generation)
+{
+    // bounded, in case settings are changing continuously
+    bool ok = false;
+    for (int attempt = 0; ; attempt++)
+    {
+        ok = acquireSpectrum(spectrum, generation);
+        if (!ok || !noteFrame(generation) || attempt > throwawayFrames)
+            break;
+        throwawayCount++;
+        logger.debug("getSpectrum: discarded stale frame (generation %u)", generation);
+    }
+    return ok;
+}
+
+//! Trigger and read one frame, as doubles or raw counts.  Caller must hold 
+//! mutAcquisition.
+//!
+//! @param spectrum   (Output) 'pixels' intensities
+//! @param generation (Output) settingsGeneration when the frame was triggered
+//! @returns false on error or cancellation
+template <typename T>
+bool WasatchVCPP::Spectrometer::acquireSpectrum(T* spectrum, uint32_t& generation)
+{
+    if (!beginAcquisition())
+        return false;
+
+    // send software trigger
+    logger.debug("sending ACQUIRE");
+    generation = settingsGeneration;
+    sendCmd(0xad);
+    auto triggerTime = std::chrono::steady_clock::now();
+
+    // (unless cancelled in the meantime)
+    auto state = AcquisitionState::Armed;
+    acquisitionState.compare_exchange_strong(state, AcquisitionState::Integrating);
+
+    // how long we'll wait for the FIRST subspectrum
     int subspectrumTimeoutMS = generateTotalWaitMS();
 
-    for (auto ep : endpoints)
+    // when scheduled alongside other spectrometers on the same bus, don't 
+    // hold the bus while we integrate
+    auto bus = getBusReadout();
+    std::unique_lock<std::mutex> busLock;
+    if (bus != nullptr)
+    {
+        auto ready = triggerTime + std::chrono::milliseconds(integrationTimeMS);
+        while (!isCancelling() && std::chrono::steady_clock::now() < ready)
+            std::this_thread::sleep_for(std::min(std::chrono::steady_clock::duration(std::chrono::milliseconds(10)), 
+                                                 ready - std::chrono::steady_clock::now()));
+        busLock = std::unique_lock<std::mutex>(*bus);
+    }
+
+    // the first bulk read waits out the integration, so the two overlap
+    state = AcquisitionState::Integrating;
+    acquisitionState.compare_exchange_strong(state, AcquisitionState::Reading);
+
+    if (!readSubspectra(subspectrumTimeoutMS))
+    {
+        if (isCancelling())
+            logger.debug("getSpectrum: operation cancelled");
+        else
+            logger.error("failed reading spectrum");
+        acquisitionState = AcquisitionState::Idle;
+        return false;
+    }
+
+    // each endpoint's slice demarshals straight into its place
+    int count = 0;
+    for (size_t e = 0; e < endpoints.size(); e++, count += pixelsPerEndpoint)
+        demarshal(&bufSubspectrum[e * pixelsPerEndpoint * 2], spectrum + count);
+
+    postProcessSpectrum(spectrum, count);
+
+    logger.debug("acquireSpectrum: read spectrum of %d pixels", count);
+    acquisitionState = AcquisitionState::Idle;
+    return true;
+}
+
+//! Minimal post-processing applied to every spectrum read from the detector,
+//! whether software- or hardware-triggered.
+void WasatchVCPP::Spectrometer::postProcessSpectrum(double* spectrum, int len)
+{
+    // stomp first pixel -- only required if start-of-frame marker enabled
+    // spectrum[0] = spectrum[1];
+
+    if (eeprom.featureMask.invertXAxis)
+        std::reverse(spectrum, spectrum + len);
+}
+
+//! As above, for raw counts.
+void WasatchVCPP::Spectrometer::postProcessSpectrum(uint16_t* spectrum, int len)
+{
+    if (eeprom.featureMask.invertXAxis)
+        std::reverse(spectrum, spectrum + len);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Throwaways
+////////////////////////////////////////////////////////////////////////////////
+
+//! Set how many frames to discard after each change to a spectrum-affecting
+//! setting (0 to disable, the default).  Detectors which latch new settings
+//! at the start of a frame typically need 1.
+bool WasatchVCPP::Spectrometer::setThrowawayFrames(int frames)
+{
+    if (frames < 0)
+        return false;
+    throwawayFrames = frames;
+    return true;
+}
+
+//! Called after each spectrum-affecting setting is written.
+void WasatchVCPP::Spectrometer::bumpSettingsGeneration()
+{
+    settingsGeneration++;
+    if (throwawayFrames <= 0)
+        return;
+
+    // start draining stale frames now, rather than when next asked
+    std::lock_guard<std::mutex> lock(mutThrowaway);
+    if (throwawayStopping)
+        return;
+    if (!throwawayWorker.joinable())
+        throwawayWorker = std::thread(&Spectrometer::runThrowaways, this);
+    throwawayRequested = true;
+    cvThrowaway.notify_all();
+}
+
+//! Account for a frame just read.  Caller must hold mutAcquisition.
+//!
+//! @param generation settingsGeneration when the frame was triggered
+//! @returns whether the frame is stale and should be thrown away
+bool WasatchVCPP::Spectrometer::noteFrame(uint32_t generation)
+{
+    if (generation != framesGeneration)
+    {
+        framesGeneration = generation;
+        framesSinceChange = 0;
+    }
+    framesSinceChange++;
+
+    int frames = throwawayFrames;
+    if (frames <= 0)
+        return false;
+    return framesSinceChange <= frames || settingsGeneration != generation;
+}
+
+//! Whether the next frame would be stale.  Caller must hold mutAcquisition.
+bool WasatchVCPP::Spectrometer::needsThrowaway()
+{
+    int frames = throwawayFrames;
+    if (frames <= 0)
+        return false;
+    return settingsGeneration != framesGeneration || framesSinceChange < frames;
+}
+
+//! Background worker reading and discarding stale frames.
+void WasatchVCPP::Spectrometer::runThrowaways()
+{
+    std::unique_lock<std::mutex> lock(mutThrowaway);
+    while (true)
+    {
+        cvThrowaway.wait(lock, [this] { return throwawayRequested || throwawayStopping; });
+        if (throwawayStopping)
+            return;
+        throwawayRequested = false;
+        lock.unlock();
+
+        {
+            // queues behind any acquisition already in flight
+            std::lock_guard<std::mutex> acquisitionLock(mutAcquisition);
+            {
+                std::lock_guard<std::mutex> drainingLock(mutThrowaway);
+                throwawayDraining = !throwawayStopping;
+            }
+
+            PooledFrame frame(getFramePool(), pixels);
+            while (!throwawayStopping && needsThrowaway() && areaScan == nullptr &&
+                   !(triggeredAcquisition && triggeredAcquisition->isRunning()))
+            {
+                uint32_t generation = 0;
+                if (!acquireSpectrum(frame.data(), generation))
+                    break;
+                if (noteFrame(generation))
+                    throwawayCount++;
+                logger.debug("runThrowaways: discarded stale frame (generation %u)", generation);
+            }
+        }
+
+        lock.lock();
+        throwawayDraining = false;
+        cvThrowaway.notify_all();
+    }
+}
+
+//! Stop the worker without waiting out a throwaway it's integrating: while it
+//! holds mutAcquisition, the only acquisition in flight is its own, so that 
+//! is cancelled (repeatedly, in case the next was about to start).
+void WasatchVCPP::Spectrometer::stopThrowaways()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutThrowaway);
+        throwawayStopping = true;
+        cvThrowaway.notify_all();
+        while (throwawayDraining)
+        {
+            lock.unlock();
+            cancelOperation(false);
+            lock.lock();
+            cvThrowaway.wait_for(lock, std::chrono::milliseconds(10), [this] { return !throwawayDraining; });
+        }
+    }
+    if (throwawayWorker.joinable())
+        throwawayWorker.join();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Flight Recorder
+////////////////////////////////////////////////////////////////////////////////
+
+//! Keep the most recent 'frames' spectra in memory (0 to disable).  Any 
+//! existing history is discarded.
+bool WasatchVCPP::Spectrometer::setFlightRecorder(int frames)
+{
+    if (frames < 0)
+        return false;
+
+    // the ring shrinks to fit the memory budget
+    size_t fixed = FlightRecorder::getMemoryBytes(0, pixels);
+    size_t perFrame = FlightRecorder::getMemoryBytes(1, pixels) - fixed;
+    if (frames > 0)
+    {
+        frames = fitMemoryBudget("setFlightRecorder", fixed, perFrame, frames, memFlightRecorder, getMemoryUsed());
+        if (frames < 1)
+            return false;
+    }
+
+    std::shared_ptr<FlightRecorder> recorder;
+    if (frames > 0)
+        recorder = std::make_shared<FlightRecorder>(logger, frames, pixels);
+
+    std::lock_guard<std::mutex> lock(mutFlightRecorder);
+    flightRecorder = recorder;
+    memFlightRecorder = frames > 0 ? fixed + perFrame * frames : 0;
+    return true;
+}
+
+std::shared_ptr<WasatchVCPP::FlightRecorder> WasatchVCPP::Spectrometer::getFlightRecorder()
+{
+    std::lock_guard<std::mutex> lock(mutFlightRecorder);
+    return flightRecorder;
+}
+
+//! Write the recorded history to disk (asynchronously).
+bool WasatchVCPP::Spectrometer::dumpFlightRecorder(const string& pathname)
+{
+    auto recorder = getFlightRecorder();
+    if (recorder == nullptr)
+    {
+        logger.error("dumpFlightRecorder: flight recorder not enabled on %s", eeprom.serialNumber.c_str());
+        return false;
+    }
+    return recorder->dump(pathname, eeprom.serialNumber);
+}
+
+//! Pass a spectrum being delivered (software- or hardware-triggered) to the
+//! flight recorder and display stream.  Averaged acquisitions record each 
+//! scan but display only the result, so either may be omitted.
+//!
+//! @param spectrum (Input) as delivered, for the display stream (or nullptr)
+//! @param raw      (Input) the frame as read from the detector (little-
+//!                 endian, before postProcessSpectrum), for the flight 
+//!                 recorder (or nullptr)
+void WasatchVCPP::Spectrometer::recordFrame(const double* spectrum, const uint8_t* raw, int len, uint32_t generation)
+{
+    if (raw != nullptr)
+    {
+        auto recorder = getFlightRecorder();
+        if (recorder != nullptr)
+            recorder->record(raw, len, generation, integrationTimeMS, laserEnabled);
+    }
+    if (spectrum != nullptr)
+        display.offer(spectrum, len, generation);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Memory
+////////////////////////////////////////////////////////////////////////////////
+
+WasatchVCPP::Spectrometer::MemoryUsage WasatchVCPP::Spectrometer::getMemoryUsage()
+{
+    MemoryUsage usage;
+    std::lock_guard<std::mutex> lock(mutEEPROM);
+    usage.core = sizeof(Spectrometer) - sizeof(EEPROM) + bufSubspectrum.capacity()
+               + pipeline.getMemoryBytes() + deadband.getMemoryBytes() + display.getMemoryBytes()
+               + expression.getMemoryBytes()
+               + processFrame.capacity() * sizeof(uint16_t) + processSums.capacity() * sizeof(uint32_t)
+               + bufConvert.capacity() * sizeof(double);
+    usage.eeprom = eeprom.getMemoryBytes();
+    usage.axes = (wavelengths.capacity() + wavenumbers.capacity()) * sizeof(double)
+               + (wavelengthsFloat.capacity() + wavenumbersFloat.capacity()) * sizeof(float);
+    usage.triggered = memTriggered;
+    usage.areaScan = memAreaScan;
+    usage.flightRecorder = memFlightRecorder;
+
+    auto pool = getFramePool();
+    if (pool != nullptr)
+        usage.framePool = pool->getMemoryBytes();
+    return usage;
+}
+
+//! Drop (or restore) the EEPROM string views, and hold the axes in single
+//! rather than double precision.  Readers hold mutEEPROM (@see lockEEPROM),
+//! so this is safe on an open spectrometer.  It doesn't take mutAcquisition:
+//! the Driver calls it holding its own lock, which acquisitions take in turn
+//! when checking the memory budget.
+void WasatchVCPP::Spectrometer::setCompact(bool flag)
+{
+    std::lock_guard<std::mutex> lock(mutEEPROM);
+    eeprom.compact = flag;
+    eeprom.stringifyAll();
+    computeAxes();
+}
+
+//! @returns bytes held across the open spectrometers, as counted against the
+//!          Driver's memory budget (0 if there's no budget); not for callers
+//!          holding the Driver's lock, which must count them itself
+size_t WasatchVCPP::Spectrometer::getMemoryUsed()
+{
+    if (driver == nullptr || driver->getMemoryBudget() == 0)
+        return 0;
+    return driver->getMemoryUsage().total();
+}
+
+//! How many units of an optional buffer fit within the Driver's memory
+//! budget, so features degrade predictably rather than driving the host 
+//! into swap.
+//!
+//! @param feature      (Input) for logging
+//! @param fixed        (Input) bytes needed regardless of size
+//! @param perUnit      (Input) bytes per frame (or whatever the unit is)
+//! @param requested    (Input) units wanted
+//! @param replacing    (Input) bytes which will be freed by the replacement
+//! @param memoryUsed   (Input) bytes held across the open spectrometers, 
+//!                     'replacing' included (@see getMemoryUsed)
+//! @returns units to allocate (up to requested), or 0 if even one won't fit
+int WasatchVCPP::Spectrometer::fitMemoryBudget(const char* feature, size_t fixed, size_t perUnit, int requested, size_t replacing, size_t memoryUsed)
+{
+    size_t budget = driver != nullptr ? driver->getMemoryBudget() : 0;
+    if (budget == 0)
+        return requested;
+
+    // what everything else holds, whether or not it's already over budget
+    size_t others = memoryUsed > replacing ? memoryUsed - replacing : 0;
+    size_t available = budget > others ? budget - others : 0;
+    if (fixed + perUnit > available)
+    {
+        logger.error("%s: needs %llu bytes, but only %llu remain within the memory budget", feature, 
+            (unsigned long long)(fixed + perUnit), (unsigned long long)available);
+        return 0;
+    }
+
+    size_t fit = (available - fixed) / std::max((size_t)1, perUnit);
+    if (fit < (size_t)requested)
+    {
+        logger.info("%s: reduced from %d to %d to fit the memory budget", feature, requested, (int)fit);
+        return (int)fit;
+    }
+    return requested;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Frame Pool
+////////////////////////////////////////////////////////////////////////////////
+
+//! Replace the frame pool (@see FramePool).  Frames drawn from the old pool
+//! remain valid until they're returned.  If not even one frame fits the 
+//! memory budget, the request fails and the current pool is kept.
+//!
+//! @param frames (Input) frames to preallocate (0 to draw every frame from
+//!               the heap)
+//! @param flags  (Input) FramePool::Flags
+bool WasatchVCPP::Spectrometer::setFramePool(int frames, int flags)
+{
+    return setFramePool(frames, flags, getMemoryUsed());
+}
+
+//! As above, for the Driver, which already holds the lock needed to count
+//! what the open spectrometers use.
+//!
+//! @param memoryUsed (Input) bytes held across the open spectrometers 
+//!                   (@see fitMemoryBudget)
+bool WasatchVCPP::Spectrometer::setFramePool(int frames, int flags, size_t memoryUsed)
+{
+    if (frames < 0)
+        return false;
+
+    size_t replacing = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutFramePool);
+        if (framePool != nullptr)
+            replacing = framePool->getMemoryBytes();
+    }
+
+    int requested = frames;
+    frames = fitMemoryBudget("setFramePool", 0, FramePool::getMemoryBytes(pixels, 1), frames, replacing, memoryUsed);
+    if (frames == 0 && requested > 0)
+        return false; // refused: keep the pool we have
+
+    std::shared_ptr<FramePool> pool;
+    if (frames > 0)
+    {
+        pool = std::make_shared<FramePool>(logger, pixels, frames, flags);
+        if (pool->getMemoryBytes() == 0)
+            return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutFramePool);
+    framePool = pool;
+    return true;
+}
+
+std::shared_ptr<WasatchVCPP::FramePool> WasatchVCPP::Spectrometer::getFramePool()
+{
+    std::lock_guard<std::mutex> lock(mutFramePool);
+    return framePool;
+}
+
+WasatchVCPP::FramePool::Stats WasatchVCPP::Spectrometer::getFramePoolStats()
+{
+    auto pool = getFramePool();
+    return pool != nullptr ? pool->getStats() : FramePool::Stats();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Auto-Dark
+////////////////////////////////////////////////////////////////////////////////
+
+//! Take a laser-off (dark) and laser-on (sample) pair, and return the sample 
+//! with the dark subtracted.
+//!
+//! The previous dark is reused if it was taken at the current integration 
+//! time, within autoDark.maxAgeMS, and (for cooled detectors, if configured) 
+//! within autoDark.maxTempDeltaDegC of the current detector temperature.
+//! The laser is always left off on return.
+//!
+//! The whole sequence holds mutAcquisition, so no other acquisition can be
+//! triggered between the dark and the sample (or with the laser on).
+//!
+//! @param corrected (Output) raw - dark
+//! @param dark      (Output) the dark used
+//! @param raw       (Output) the laser-on spectrum
+//! @returns true on success
+bool WasatchVCPP::Spectrometer::getAutoDarkSpectrum(vector<double>& corrected, vector<double>& dark, vector<double>& raw)
+{
+    if (!eeprom.hasLaser)
+    {
+        logger.error("getAutoDarkSpectrum: %s has no laser", eeprom.serialNumber.c_str());
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutAcquisition);
+    std::lock_guard<std::mutex> lockAutoDark(mutAutoDark);
+
+    auto now = std::chrono::steady_clock::now();
+    bool checkTemp = eeprom.hasCooling && autoDark.maxTempDeltaDegC > 0;
+    float degC = checkTemp ? getDetectorTemperatureDegC() : 0;
+
+    autoDark.reused = false;
+    if (!autoDark.dark.empty() && autoDark.maxAgeMS > 0 && autoDark.integrationTimeMS == (unsigned long)integrationTimeMS)
+    {
+        auto ageMS = std::chrono::duration_cast<std::chrono::milliseconds>(now - autoDark.timestamp).count();
+        autoDark.reused = ageMS <= autoDark.maxAgeMS
+                       && (!checkTemp || fabs(degC - autoDark.detectorTempDegC) <= autoDark.maxTempDeltaDegC);
+    }
+
+    if (!autoDark.reused)
+    {
+        if (laserEnabled)
+            setLaserEnable(false);
+
+        vector<double> newDark(pixels);
+        if (newDark.empty() || !readSpectrumAs(SpectrumFormat::Double, &newDark[0], pixels, 1, nullptr))
+        {
+            logger.error("getAutoDarkSpectrum: failed to read dark");
+            return false;
+        }
+        autoDark.dark.swap(newDark);
+        autoDark.timestamp = std::chrono::steady_clock::now();
+        autoDark.integrationTimeMS = integrationTimeMS;
+        autoDark.detectorTempDegC = degC;
+    }
+
+    setLaserEnable(true);
+    if (autoDark.laserWarmupMS > 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(autoDark.laserWarmupMS));
+    raw.resize(pixels);
+    if (!readSpectrumAs(SpectrumFormat::Double, &raw[0], pixels, 1, nullptr))
+        raw.clear();
+    setLaserEnable(false);
+
+    if (raw.size() != autoDark.dark.size())
+    {
+        logger.error("getAutoDarkSpectrum: failed to read sample (%d pixels, dark %d)", 
+            (int)raw.size(), (int)autoDark.dark.size());
+        return false;
+    }
+
+    dark = autoDark.dark;
+    corrected.resize(raw.size());
+    for (size_t i = 0; i < raw.size(); i++)
+        corrected[i] = raw[i] - dark[i];
+
+    logger.debug("getAutoDarkSpectrum: %s dark", autoDark.reused ? "reused" : "new");
+    return true;
+}
+
+//! Configure getAutoDarkSpectrum.  Also discards any stored dark.
+bool WasatchVCPP::Spectrometer::setAutoDarkConfig(int laserWarmupMS, int maxAgeMS, float maxTempDeltaDegC)
+{
+    if (laserWarmupMS < 0 || maxAgeMS < 0 || maxTempDeltaDegC < 0)
+        return false;
+
+    std::lock_guard<std::mutex> lock(mutAutoDark);
+    autoDark.laserWarmupMS = laserWarmupMS;
+    autoDark.maxAgeMS = maxAgeMS;
+    autoDark.maxTempDeltaDegC = maxTempDeltaDegC;
+    autoDark.dark.clear();
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Recipes
+////////////////////////////////////////////////////////////////////////////////
+
+//! Parse and begin executing a measurement recipe.  Results from any previous
+//! recipe which were not yet read are discarded.
+//!
+//! @see Recipe
+bool WasatchVCPP::Spectrometer::startRecipe(const string& text)
+{
+    if (triggeredAcquisition && triggeredAcquisition->isRunning())
+    {
+        logger.error("startRecipe: triggered acquisition is running");
+        return false;
+    }
+
+    // a reader still holding the previous recipe can drain its results
+    auto next = std::make_shared<Recipe>(*this, logger);
+    std::shared_ptr<Recipe> previous;
+    {
+        std::lock_guard<std::mutex> lock(mutRecipe);
+        previous = recipe;
+        recipe = next;
+    }
+    if (previous)
+        previous->stop();
+
+    if (!next->parse(text))
+        return false;
+    return next->start();
+}
+
+//! Interrupt the current recipe, if any.  Results already emitted can still
+//! be read.
+bool WasatchVCPP::Spectrometer::stopRecipe()
+{
+    auto current = getRecipe();
+    if (current == nullptr)
+        return false;
+    current->stop();
+    return true;
+}
+
+std::shared_ptr<WasatchVCPP::Recipe> WasatchVCPP::Spectrometer::getRecipe()
+{
+    std::lock_guard<std::mutex> lock(mutRecipe);
+    return recipe;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Area Scan
+////////////////////////////////////////////////////////////////////////////////
+
+//! In area-scan mode, each ACQUIRE reads out the full 2D detector one row at 
+//! a time, rather than a single vertically-binned spectrum.
+//!
+//! The frame buffer (activePixelsVert x pixels) and the queued row reads 
+//! are allocated here, once, and reused for every frame.
+bool WasatchVCPP::Spectrometer::setAreaScanEnable(bool flag)
+{
+    std::lock_guard<std::mutex> lock(mutAcquisition);
+    if (flag && eeprom.activePixelsVert <= 1)
+    {
+        logger.error("setAreaScanEnable: %s has no vertical pixels configured", eeprom.serialNumber.c_str());
+        return false;
+    }
+
+    size_t bytes = AreaScan::getMemoryBytes(eeprom.activePixelsVert, pixels)
+                 + (AREA_SCAN_ROWS_QUEUED + 1) * pixels * sizeof(uint16_t);
+    if (flag && fitMemoryBudget("setAreaScanEnable", 0, bytes, 1, memAreaScan, getMemoryUsed()) < 1)
+        return false;
+
+    if (flag && !configureAreaScanReads())
+        return false;
+
+    if (!isSuccess(0xeb, sendCmd(0xeb, flag ? 1 : 0)))
+    {
+        if (areaScan == nullptr)
+            releaseAreaScanReads();
+        return false;
+    }
+
+    if (flag)
+        areaScan.reset(new AreaScan(eeprom.activePixelsVert, pixels));
+    else
+    {
+        areaScan.reset();
+        releaseAreaScanReads();
+    }
+    memAreaScan = flag ? bytes : 0;
+    return true;
+}
+
+//! Acquire one complete area-scan frame, and copy it to the caller.
+//!
+//! @param frame     (Output) row-major, 'cols' values per row
+//! @param rows      (Input)  rows in 'frame' (at least activePixelsVert)
+//! @param cols      (Input)  columns in 'frame' (at least pixels)
+//! @param timeoutMS (Input)  how long to wait for each row
+//! @returns true on success (nothing is acquired if 'frame' is too small)
+bool WasatchVCPP::Spectrometer::getAreaScanFrame(double* frame, int rows, int cols, int timeoutMS)
+{
+    std::lock_guard<std::mutex> lock(mutAcquisition);
+    if (areaScan != nullptr && (frame == nullptr || rows < areaScan->rows || cols < areaScan->cols))
+    {
+        logger.error("getAreaScanFrame: %d x %d buffer can't hold %d x %d frame", rows, cols, areaScan->rows, areaScan->cols);
+        return false;
+    }
+
+    if (!acquireAreaScanFrame(timeoutMS))
+        return false;
+
+    const vector<double>& src = areaScan->getFrame();
+    for (int row = 0; row < areaScan->rows; row++)
+        std::copy(src.begin() + (size_t)row * areaScan->cols, src.begin() + (size_t)(row + 1) * areaScan->cols, frame + (size_t)row * cols);
+    return true;
+}
+
+//! Acquire one complete area-scan frame, and sum rows firstRow..lastRow
+//! (inclusive) into a spectrum.
+//!
+//! @param spectrum  (Output) at least 'pixels' values
+//! @param len       (Input)  length of 'spectrum'
+//! @returns true on success (nothing is acquired if the rows or 'len' are 
+//!          out of range)
+bool WasatchVCPP::Spectrometer::getAreaScanBinned(double* spectrum, int len, int firstRow, int lastRow, int timeoutMS)
+{
+    std::lock_guard<std::mutex> lock(mutAcquisition);
+    if (areaScan != nullptr && (spectrum == nullptr || len < areaScan->cols))
+    {
+        logger.error("getAreaScanBinned: %d-pixel buffer can't hold %d pixels", len, areaScan->cols);
+        return false;
+    }
+    if (areaScan != nullptr && (firstRow < 0 || lastRow >= areaScan->rows || firstRow > lastRow))
+    {
+        logger.error("getAreaScanBinned: invalid rows %d..%d of %d", firstRow, lastRow, areaScan->rows);
+        return false;
+    }
+
+    if (!acquireAreaScanFrame(timeoutMS))
+        return false;
+
+    vector<double> binned;
+    if (!areaScan->bin(firstRow, lastRow, binned))
+        return false;
+    std::copy(binned.begin(), binned.end(), spectrum);
+    return true;
+}
+
+//! Sends a single ACQUIRE, then streams rows from the bulk endpoint(s) into
+//! the preallocated frame until every row has been received.
+//!
+//! Caller holds mutAcquisition; the frame is valid until it's released.
+bool WasatchVCPP::Spectrometer::acquireAreaScanFrame(int timeoutMS)
+{
+    if (areaScan == nullptr)
+    {
+        logger.error("getAreaScanFrame: area scan not enabled");
+        return false;
+    }
+    if (triggeredAcquisition && triggeredAcquisition->isRunning())
+    {
+        logger.error("getAreaScanFrame: acquisition already in progress");
+        return false;
+    }
+
+    if (!beginAcquisition())
+        return false;
+    areaScan->reset();
+
+    sendCmd(0xad);
+
+    // a cancel landing since beginAcquisition must stand
+    auto armed = AcquisitionState::Armed;
+    acquisitionState.compare_exchange_strong(armed, AcquisitionState::Reading);
+
+    bool ok = readAreaScanRows(timeoutMS);
+    acquisitionState = AcquisitionState::Idle;
+    return ok;
+}
+
+#if !USE_LIBUSB_WIN32
+//! libusb-1.0 completion callback for readSubspectra and readAreaScanRows
+static void LIBUSB_CALL onBulkReadComplete(libusb_transfer* transfer)
+{ *(int*)transfer->user_data = 1; }
+#endif
+
+//! @returns false if the reads couldn't be allocated
+bool WasatchVCPP::Spectrometer::configureAreaScanReads()
+{
+    releaseAreaScanReads();
+    if (udev == nullptr)
+        return false;
+
+    areaScanReads.resize(AREA_SCAN_ROWS_QUEUED * endpoints.size());
+    bufAreaScan.resize(AREA_SCAN_ROWS_QUEUED * endpoints.size() * pixelsPerEndpoint * 2);
+    areaScanLine.resize(endpoints.size() * pixelsPerEndpoint);
+    for (size_t i = 0; i < areaScanReads.size(); i++)
+    {
+        uint8_t ep = endpoints[i % endpoints.size()];
+#if USE_LIBUSB_WIN32
+        if (usb_bulk_setup_async(udev, &areaScanReads[i].context, ep) < 0)
+#else
+        areaScanReads[i].xfer = libusb_alloc_transfer(0);
+        if (areaScanReads[i].xfer == nullptr)
+#endif
+        {
+            logger.error("configureAreaScanReads: unable to set up reads on endpoint 0x%02x", ep);
+            releaseAreaScanReads();
+            return false;
+        }
+    }
+    return true;
+}
+
+void WasatchVCPP::Spectrometer::releaseAreaScanReads()
+{
+    for (auto& r : areaScanReads)
+    {
+#if USE_LIBUSB_WIN32
+        if (r.context != nullptr)
+            usb_free_async(&r.context);
+#else
+        if (r.xfer != nullptr)
+            libusb_free_transfer(r.xfer);
+#endif
+    }
+    areaScanReads.clear();
+}
+
+//! Stream one frame's rows from the spectral endpoint(s) into areaScan.
+//!
+//! AREA_SCAN_ROWS_QUEUED row reads are kept queued on every endpoint, so the
+//! following rows are already transferring while one is demarshalled and 
+//! filed, and the host keeps up with the detector's line rate.  Rows are 
+//! reaped in the order queued.  Up to two frames' worth of rows are read, in
+//! case the readout began mid-frame.
+//!
+//! @param timeoutMS (Input) how long to wait for each row
+//! @returns true if the frame completed
+bool WasatchVCPP::Spectrometer::readAreaScanRows(int timeoutMS)
+{
+    const int bytesPerEndpoint = pixelsPerEndpoint * 2;
+    const int endpointCount = (int)endpoints.size();
+    const int maxLines = 2 * areaScan->rows;
+
+    if (areaScanReads.size() != (size_t)(AREA_SCAN_ROWS_QUEUED * endpointCount) || 
+        areaScanLine.size() != (size_t)(endpointCount * pixelsPerEndpoint))
+    {
+        logger.error("readAreaScanRows: row reads not configured for %d endpoints", endpointCount);
+        return false;
+    }
+
+    // queue the row in 'slot' on every endpoint
+    auto submit = [&](int slot) -> bool
+    {
+        for (int e = 0; e < endpointCount; e++)
+        {
+            BulkRead& r = areaScanReads[slot * endpointCount + e];
+            uint8_t* buf = &bufAreaScan[(slot * endpointCount + e) * bytesPerEndpoint];
+            r.completed = 0;
+#if USE_LIBUSB_WIN32
+            r.submitted = usb_submit_async(r.context, (char*)buf, bytesPerEndpoint) >= 0;
+#else
+            // timeout 0: rows stay queued until they arrive or are cancelled
+            libusb_fill_bulk_transfer(r.xfer, udev, endpoints[e], buf, bytesPerEndpoint, onBulkReadComplete, &r.completed, 0);
+            r.submitted = libusb_submit_transfer(r.xfer) == 0;
+#endif
+            if (!r.submitted)
+            {
+                logger.error("readAreaScanRows: unable to queue read on endpoint 0x%02x", endpoints[e]);
+                return false;
+            }
+        }
+        return true;
+    };
+
+    // wait for one queued read; @returns bytes read, or -1 on timeout / cancel
+    auto reap = [&](BulkRead& r, std::chrono::steady_clock::time_point deadline) -> int
+    {
+#if USE_LIBUSB_WIN32
+        const int LIBUSB_WIN32_ERROR_TIMEOUT = -116;
+        int bytesRead = LIBUSB_WIN32_ERROR_TIMEOUT;
+        while ((bytesRead = usb_reap_async_nocancel(r.context, BULK_POLL_MS)) == LIBUSB_WIN32_ERROR_TIMEOUT)
+            if (isCancelling() || std::chrono::steady_clock::now() >= deadline)
+                return -1;
+        r.submitted = false;
+        return bytesRead;
+#else
+        while (!r.completed)
+        {
+            if (isCancelling() || std::chrono::steady_clock::now() >= deadline)
+                return -1;
+            struct timeval tv = { 0, BULK_POLL_MS * 1000 };
+            libusb_handle_events_timeout_completed(nullptr, &tv, &r.completed);
+        }
+        r.submitted = false;
+        return r.xfer->status == LIBUSB_TRANSFER_COMPLETED ? r.xfer->actual_length : -1;
+#endif
+    };
+
+    bool ok = true;
+    int queued = 0;
+    while (ok && queued < AREA_SCAN_ROWS_QUEUED && queued < maxLines)
+        ok = submit(queued++);
+
+    for (int line = 0; ok && line < maxLines && !areaScan->isComplete(); line++)
+    {
+        const int slot = line % AREA_SCAN_ROWS_QUEUED;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMS);
+        for (int e = 0; e < endpointCount && ok; e++)
+        {
+            int bytesRead = reap(areaScanReads[slot * endpointCount + e], deadline);
+            if (bytesRead != bytesPerEndpoint)
+            {
+                if (!isCancelling())
+                    logger.error("readAreaScanRows: endpoint 0x%02x returned %d of %d bytes (%d of %d rows received)", 
+                        endpoints[e], bytesRead, bytesPerEndpoint, areaScan->getRowsReceived(), areaScan->rows);
+                ok = false;
+                break;
+            }
+            demarshal(&bufAreaScan[(slot * endpointCount + e) * bytesPerEndpoint], &areaScanLine[e * pixelsPerEndpoint]);
+        }
+        if (!ok)
+            break;
+        areaScan->addRow(areaScanLine);
+
+        // refill the slot, unless the rows already queued will finish the frame
+        const int inFlight = queued - line - 1;
+        if (queued < maxLines && inFlight < areaScan->rows - areaScan->getRowsReceived())
+        {
+            ok = submit(slot);
+            queued++;
+        }
+    }
+
+    // abandon whatever is still queued
+#if USE_LIBUSB_WIN32
+    for (auto& r : areaScanReads)
+        if (r.submitted)
+        {
+            usb_cancel_async(r.context);
+            r.submitted = false;
+        }
+#else
+    for (auto& r : areaScanReads)
+        if (r.submitted && !r.completed)
+            libusb_cancel_transfer(r.xfer);
+    for (auto& r : areaScanReads)
+    {
+        while (r.submitted && !r.completed)
+        {
+            struct timeval tv = { 0, BULK_POLL_MS * 1000 };
+            libusb_handle_events_timeout_completed(nullptr, &tv, &r.completed);
+        }
+        r.submitted = false;
+    }
+#endif
+
+    if (isCancelling())
+    {
+        logger.error("readAreaScanRows: cancellation detected");
+        return false;
+    }
+    if (ok && !areaScan->isComplete())
+    {
+        logger.error("getAreaScanFrame: incomplete frame (%d of %d rows)", areaScan->getRowsReceived(), areaScan->rows);
+        return false;
+    }
+    return ok;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Hardware Triggering
+////////////////////////////////////////////////////////////////////////////////
+
+//! Select whether acquisitions are started by software (ACQUIRE opcode) or by
+//! a pulse on the Gen 1.5 accessory connector.
+bool WasatchVCPP::Spectrometer::setTriggerSource(bool external)
+{
+    return isSuccess(0xd2, sendCmd(0xd2, external ? 1 : 0));
+}
+
+//! Arm the spectrometer for external triggering, and start continuously 
+//! collecting the resulting frames in the background.
+//!
+//! @param transfersPerEndpoint (Input) how many bulk reads to keep queued per endpoint
+//! @param maxFrames (Input) how many frames to buffer before dropping the oldest
+//! @see TriggeredAcquisition
+bool WasatchVCPP::Spectrometer::startTriggeredAcquisition(int transfersPerEndpoint, int maxFrames)
+{
+    if (!eeprom.featureMask.gen15)
+    {
+        logger.error("startTriggeredAcquisition: %s lacks Gen 1.5 accessory connector", eeprom.serialNumber.c_str());
+        return false;
+    }
+
+    // don't arm in the middle of a software-triggered acquisition
+    std::lock_guard<std::mutex> lock(mutAcquisition);
+    if (triggeredAcquisition && triggeredAcquisition->isRunning())
+    {
+        logger.error("startTriggeredAcquisition: already running");
+        return false;
+    }
+    auto current = getRecipe();
+    if (current && current->getState() == Recipe::Running)
+    {
+        logger.error("startTriggeredAcquisition: recipe is running");
+        return false;
+    }
+
+    // the queue (not the queued transfers) shrinks to fit the memory budget
+    int endpointCount = (int)endpoints.size();
+    transfersPerEndpoint = std::max(1, transfersPerEndpoint);
+    size_t fixed = TriggeredAcquisition::getMemoryBytes(pixels, endpointCount, transfersPerEndpoint, 0);
+    size_t perFrame = TriggeredAcquisition::getMemoryBytes(pixels, endpointCount, transfersPerEndpoint, 1) - fixed;
+    maxFrames = fitMemoryBudget("startTriggeredAcquisition", fixed, perFrame, std::max(1, maxFrames), memTriggered, getMemoryUsed());
+    if (maxFrames < 1)
+        return false;
+
+    auto acq = std::make_shared<TriggeredAcquisition>(*this, logger, transfersPerEndpoint, maxFrames);
+    {
+        std::lock_guard<std::mutex> lockPtr(mutTriggeredAcquisition);
+        triggeredAcquisition = acq;
+    }
+    memTriggered = fixed + perFrame * maxFrames;
+    if (!acq->start())
+        return false;
+
+    // queue the reads before arming, so the first frame can't be missed
+    if (!setTriggerSource(true))
+    {
+        acq->stop();
+        return false;
+    }
+    return true;
+}
+
+//! Disarm the external trigger and stop background reads.  Frames already 
+//! buffered can still be read from getTriggeredAcquisition().
+bool WasatchVCPP::Spectrometer::stopTriggeredAcquisition()
+{
+    auto acq = getTriggeredAcquisition();
+    if (!acq || !acq->isRunning())
+        return false;
+
+    setTriggerSource(false);
+    acq->stop();
+    return true;
+}
+
+//! @returns the latest triggered acquisition (running or not), or nullptr
+void WasatchVCPP::Spectrometer::setBusReadout(std::shared_ptr<std::mutex> mut)
+{
+    std::lock_guard<std::mutex> lock(mutBusReadout);
+    busReadout = mut;
+}
+
+std::shared_ptr<std::mutex> WasatchVCPP::Spectrometer::getBusReadout()
+{
+    std::lock_guard<std::mutex> lock(mutBusReadout);
+    return busReadout;
+}
+
+std::shared_ptr<WasatchVCPP::TriggeredAcquisition> WasatchVCPP::Spectrometer::getTriggeredAcquisition()
+{
+    std::lock_guard<std::mutex> lock(mutTriggeredAcquisition);
+    return triggeredAcquisition;
+}
+
+
+//! Build the table of candidate spectral endpoints from the bulk IN 
+//! endpoints of interface 0: the primary endpoint (0x82) first, then the one
+//! FX2 units split 2048-pixel spectra onto (0x86), then any others in 
+//! address order.  If the descriptor can't be read, assume 0x82 and 0x86.
+void WasatchVCPP::Spectrometer::readEndpointTable()
+{
+    bulkEndpoints.clear();
+    if (udev != nullptr)
+    {
+#if USE_LIBUSB_WIN32
+        struct usb_device* dev = usb_device(udev);
+        if (dev != nullptr && dev->config != nullptr && dev->config[0].bNumInterfaces > 0 
+                && dev->config[0].interface[0].num_altsetting > 0)
+        {
+            const struct usb_interface_descriptor& alt = dev->config[0].interface[0].altsetting[0];
+            for (int i = 0; i < alt.bNumEndpoints; i++)
+            {
+                const struct usb_endpoint_descriptor& desc = alt.endpoint[i];
+                if ((desc.bEndpointAddress & USB_ENDPOINT_DIR_MASK) && (desc.bmAttributes & USB_ENDPOINT_TYPE_MASK) == USB_ENDPOINT_TYPE_BULK)
+                    bulkEndpoints.push_back(desc.bEndpointAddress);
+            }
+        }
+#else
+        libusb_config_descriptor* config = nullptr;
+        libusb_device* dev = libusb_get_device(udev);
+        if (dev != nullptr && libusb_get_active_config_descriptor(dev, &config) == 0 && config != nullptr)
+        {
+            if (config->bNumInterfaces > 0 && config->interface[0].num_altsetting > 0)
+            {
+                const libusb_interface_descriptor& alt = config->interface[0].altsetting[0];
+                for (int i = 0; i < alt.bNumEndpoints; i++)
+                {
+                    const libusb_endpoint_descriptor& desc = alt.endpoint[i];
+                    if ((desc.bEndpointAddress & LIBUSB_ENDPOINT_DIR_MASK) == LIBUSB_ENDPOINT_IN 
+                            && (desc.bmAttributes & 0x03) == LIBUSB_TRANSFER_TYPE_BULK)
+                        bulkEndpoints.push_back(desc.bEndpointAddress);
+                }
+            }
+            libusb_free_config_descriptor(config);
+        }
+#endif
+    }
+
+    if (bulkEndpoints.empty())
+    {
+        logger.debug("readEndpointTable: no configuration descriptor, assuming 0x%02x and 0x%02x", PRIMARY_ENDPOINT, SECONDARY_ENDPOINT);
+        bulkEndpoints.push_back(PRIMARY_ENDPOINT);
+        bulkEndpoints.push_back(SECONDARY_ENDPOINT);
+        return;
+    }
+
+    auto rank = [](uint8_t ep) { return ep == PRIMARY_ENDPOINT ? 0 : ep == SECONDARY_ENDPOINT ? 1 : 2 + ep; };
+    std::sort(bulkEndpoints.begin(), bulkEndpoints.end(), [&rank](uint8_t a, uint8_t b) { return rank(a) < rank(b); });
+
+    string found;
+    for (auto ep : bulkEndpoints)
+        found += Util::sprintf(found.empty() ? "0x%02x" : ", 0x%02x", ep);
+    logger.debug("readEndpointTable: bulk IN endpoints %s", found.c_str());
+}
+
+//! Allocate one queued read per spectral endpoint, once per geometry, so 
+//! readSubspectra doesn't allocate per frame.  Single-endpoint units read
+//! synchronously and need none.
+void WasatchVCPP::Spectrometer::configureBulkReads()
+{
+    releaseBulkReads();
+    if (endpoints.size() < 2 || udev == nullptr)
+        return;
+
+    bulkReads.resize(endpoints.size());
+    for (size_t e = 0; e < endpoints.size(); e++)
     {
-        auto subspectrum = getSubspectrum(ep, subspectrumTimeoutMS);
-        if (subspectrum.size() != pixelsPerEndpoint)
+#if USE_LIBUSB_WIN32
+        if (usb_bulk_setup_async(udev, &bulkReads[e].context, endpoints[e]) < 0)
+#else
+        bulkReads[e].xfer = libusb_alloc_transfer(0);
+        if (bulkReads[e].xfer == nullptr)
+#endif
         {
-            if (operationCancelled)
-                logger.debug("getSpectrum: operation cancelled");
-            else
-                logger.error("failed reading subspectrum (%d of %d pixels read)", 
-                    subspectrum.size(), pixelsPerEndpoint);
-            operationCancelled = false;
-            acquiring = false;
-            mutAcquisition.unlock();
-            return vector<double>();
+            logger.error("configureBulkReads: unable to set up reads on endpoint 0x%02x; reading endpoints in turn", endpoints[e]);
+            releaseBulkReads();
+            return;
         }
+    }
+}
+
+void WasatchVCPP::Spectrometer::releaseBulkReads()
+{
+    for (auto& r : bulkReads)
+    {
+#if USE_LIBUSB_WIN32
+        if (r.context != nullptr)
+            usb_free_async(&r.context);
+#else
+        if (r.xfer != nullptr)
+            libusb_free_transfer(r.xfer);
+#endif
+    }
+    bulkReads.clear();
+}
 
-        for (auto word : subspectrum)
-            spectrum.push_back(word);
+//! Read one frame from every spectral endpoint into its slice of 
+//! bufSubspectrum.
+//!
+//! With several endpoints, a read is queued on each at once and they fill
+//! their slices concurrently, so splitting a spectrum across endpoints adds
+//! no serial latency.  A short read is re-queued for the remainder.
+//!
+//! @param allocatedMS (Input) total time allocated in milliseconds, 
+//!                    including the integration
+//! @returns true if every endpoint returned all its pixels
+bool WasatchVCPP::Spectrometer::readSubspectra(long allocatedMS)
+{
+    if (bulkReads.empty())
+    {
+        // one endpoint (or no queued reads available): synchronous, in turn
+        for (int e = 0; e < (int)endpoints.size(); e++)
+        {
+            if (!readSubspectrum(e, allocatedMS))
+                return false;
 
-        // subspectra from subsequent endpoints should be nearly instantaneous 
-        // (USB comms only)
-        subspectrumTimeoutMS = 100 * driver->getNumberOfSpectrometers();
+            // subspectra from subsequent endpoints should be nearly 
+            // instantaneous (USB comms only)
+            allocatedMS = 100 * (driver != nullptr ? driver->getNumberOfSpectrometers() : 1);
+        }
+        return true;
     }
 
-    ////////////////////////////////////////////////////////////////////////////
-    // post-processing
-    ////////////////////////////////////////////////////////////////////////////
+    const int bytesPerEndpoint = pixelsPerEndpoint * 2;
+    const int count = (int)bulkReads.size();
+    bool ok = true;
 
-    // stomp first pixel -- only required if start-of-frame marker enabled
-    // spectrum[0] = spectrum[1];
+    // short reads are re-queued with whatever remains of allocatedMS
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(allocatedMS);
 
-    if (eeprom.featureMask.invertXAxis)
-        std::reverse(spectrum.begin(), spectrum.end());
+#if USE_LIBUSB_WIN32
+    const int LIBUSB_WIN32_ERROR_TIMEOUT = -116;
 
-    if (eeprom.featureMask.bin2x2)
+    for (int e = 0; e < count && ok; e++)
     {
-        vector<double> binned;
-        for (int i = 0; i < (int)spectrum.size() - 1; i++)
-            binned.push_back((spectrum[i] + spectrum[i + 1]) / 2.0);
-        binned.push_back(spectrum[spectrum.size() - 1]);
+        BulkRead& r = bulkReads[e];
+        r.received = 0;
+        r.submitted = usb_submit_async(r.context, (char*)&bufSubspectrum[e * bytesPerEndpoint], bytesPerEndpoint) >= 0;
+        if (!r.submitted)
+        {
+            logger.error("readSubspectra: unable to queue read on endpoint 0x%02x (%s)", endpoints[e], usb_strerror());
+            ok = false;
+        }
     }
 
-    logger.debug("getSpectrum: returning spectrum of %d pixels", spectrum.size());
-    acquiring = false;
-    mutAcquisition.unlock();
-    return spectrum;
-}
+    // reap each in turn; the others keep filling meanwhile
+    for (int e = 0; e < count && ok; e++)
+    {
+        BulkRead& r = bulkReads[e];
+        while (ok && r.received < bytesPerEndpoint)
+        {
+            int bytesRead = usb_reap_async_nocancel(r.context, BULK_POLL_MS);
+            if (bytesRead == LIBUSB_WIN32_ERROR_TIMEOUT)
+            {
+                if (isCancelling() || std::chrono::steady_clock::now() >= deadline)
+                    ok = false;
+                continue;
+            }
+
+            r.submitted = false;
+            if (bytesRead <= 0 || bytesRead % 2 != 0)
+            {
+                logger.error("readSubspectra: endpoint 0x%02x returned %d bytes (%d of %d so far): %s", 
+                    endpoints[e], bytesRead, r.received, bytesPerEndpoint, usb_strerror());
+                ok = false;
+                break;
+            }
+
+            r.received += bytesRead;
+            if (r.received < bytesPerEndpoint)
+            {
+                r.submitted = usb_submit_async(r.context, (char*)&bufSubspectrum[e * bytesPerEndpoint + r.received], 
+                    bytesPerEndpoint - r.received) >= 0;
+                ok = r.submitted;
+            }
+        }
+    }
+
+    // abandon whatever is still queued
+    for (auto& r : bulkReads)
+        if (r.submitted)
+        {
+            usb_cancel_async(r.context);
+            r.submitted = false;
+        }
+#else
+    for (int e = 0; e < count && ok; e++)
+    {
+        BulkRead& r = bulkReads[e];
+        r.received = 0;
+        r.completed = 0;
+        libusb_fill_bulk_transfer(r.xfer, udev, endpoints[e], &bufSubspectrum[e * bytesPerEndpoint], bytesPerEndpoint,
+            onBulkReadComplete, &r.completed, (unsigned)allocatedMS);
+        int result = libusb_submit_transfer(r.xfer);
+        r.submitted = result == 0;
+        if (!r.submitted)
+        {
+            logger.error("readSubspectra: unable to queue read on endpoint 0x%02x (%s)", endpoints[e], libusb_strerror(libusb_error(result)));
+            ok = false;
+        }
+    }
+
+    // wait on each in turn; the others keep filling meanwhile
+    for (int e = 0; e < count && ok; e++)
+    {
+        BulkRead& r = bulkReads[e];
+        while (ok && r.received < bytesPerEndpoint)
+        {
+            while (!r.completed && !isCancelling())
+            {
+                struct timeval tv = { 0, BULK_POLL_MS * 1000 };
+                libusb_handle_events_timeout_completed(nullptr, &tv, &r.completed);
+            }
+            if (!r.completed)
+            {
+                ok = false;
+                break;
+            }
+
+            r.submitted = false;
+            int bytesRead = r.xfer->actual_length;
+            if (r.xfer->status != LIBUSB_TRANSFER_COMPLETED || bytesRead <= 0 || bytesRead % 2 != 0)
+            {
+                logger.error("readSubspectra: endpoint 0x%02x returned %d bytes (%d of %d so far, status %d)", 
+                    endpoints[e], bytesRead, r.received, bytesPerEndpoint, r.xfer->status);
+                ok = false;
+                break;
+            }
+
+            r.received += bytesRead;
+            if (r.received < bytesPerEndpoint)
+            {
+                long remainingMS = (long)std::chrono::duration_cast<std::chrono::milliseconds>(
+                    deadline - std::chrono::steady_clock::now()).count();
+                if (remainingMS <= 0)
+                {
+                    logger.error("readSubspectra: endpoint 0x%02x timed out after %d of %d bytes", endpoints[e], r.received, bytesPerEndpoint);
+                    ok = false;
+                    break;
+                }
+
+                r.completed = 0;
+                r.xfer->buffer = &bufSubspectrum[e * bytesPerEndpoint + r.received];
+                r.xfer->length = bytesPerEndpoint - r.received;
+                r.xfer->timeout = (unsigned)remainingMS;
+                r.submitted = libusb_submit_transfer(r.xfer) == 0;
+                ok = r.submitted;
+            }
+        }
+    }
+
+    // cancel anything still queued, and wait for the cancellations to land
+    for (auto& r : bulkReads)
+        if (r.submitted && !r.completed)
+            libusb_cancel_transfer(r.xfer);
+    for (auto& r : bulkReads)
+    {
+        while (r.submitted && !r.completed)
+        {
+            struct timeval tv = { 0, BULK_POLL_MS * 1000 };
+            libusb_handle_events_timeout_completed(nullptr, &tv, &r.completed);
+        }
+        r.submitted = false;
+    }
+#endif
 
+    if (isCancelling())
+    {
+        logger.error("readSubspectra: cancellation detected");
+        return false;
+    }
+    return ok;
+}
 
+//! Read one endpoint's worth of raw (little-endian) pixels into its slice
+//! of bufSubspectrum.
+//!
+//! @param e           (Input) index into 'endpoints'
 //! @param allocatedMS (Input) total time allocated in milliseconds (wall-clock)
-//! @returns either a populated subspectrum of exactly 'pixelsPerEndpoint' 
-//!          deserialized pixels, or an empty vector on error
-std::vector<uint16_t> WasatchVCPP::Spectrometer::getSubspectrum(uint8_t ep, long allocatedMS)
+//! @returns true if all 'pixelsPerEndpoint' pixels were read
+bool WasatchVCPP::Spectrometer::readSubspectrum(int e, long allocatedMS)
 {
     //! @see https://sourceforge.net/p/libusb-win32/code/HEAD/tree/trunk/libusb/src/windows.c#l493
     //! @see https://sourceforge.net/p/libusb-win32/code/HEAD/tree/trunk/libusb/src/error.h#l41
     const int LIBUSB_WIN32_ERROR_TIMEOUT = -116;
     const int LIBUSB_ERROR_TIMEOUT = -7;
 
-    vector<uint16_t> subspectrum;
-
-    int bytesExpected = (int)bufSubspectrum.size();
+    const uint8_t ep = endpoints[e];
+    uint8_t* buf = &bufSubspectrum[e * pixelsPerEndpoint * 2];
+    int bytesExpected = pixelsPerEndpoint * 2;
     int bytesLeftToRead = bytesExpected;
     int totalBytesRead = 0;
 
@@ -695,10 +2658,10 @@ std::vector<uint16_t> WasatchVCPP::Spectrometer::getSubspectrum(uint8_t ep, long
 
 #if USE_LIBUSB_WIN32
         int result = 0;
-        int bytesRead = usb_bulk_read(udev, ep, (char*)&bufSubspectrum[0], bytesLeftToRead, timeoutMS);
+        int bytesRead = usb_bulk_read(udev, ep, (char*)&buf[totalBytesRead], bytesLeftToRead, timeoutMS);
 #else
         int bytesRead = 0;
-        int result = libusb_bulk_transfer(udev, ep, (unsigned char*)&bufSubspectrum[0], bytesLeftToRead, &bytesRead, timeoutMS);
+        int result = libusb_bulk_transfer(udev, ep, (unsigned char*)&buf[totalBytesRead], bytesLeftToRead, &bytesRead, timeoutMS);
 #endif
 
         logger.debug("read %d bytes from endpoint 0x%02x (result %d)", bytesRead, ep, result);
@@ -711,10 +2674,10 @@ std::vector<uint16_t> WasatchVCPP::Spectrometer::getSubspectrum(uint8_t ep, long
         remainingMS -= elapsedThisReadMS;
 
         // have we been cancelled?
-        if (operationCancelled)
+        if (isCancelling())
         {
-            logger.error("getSubspectrum: cancellation detected");
-            return vector<uint16_t>();
+            logger.error("readSubspectrum: cancellation detected");
+            return false;
         }
 
         // did an error occur?
@@ -726,14 +2689,14 @@ std::vector<uint16_t> WasatchVCPP::Spectrometer::getSubspectrum(uint8_t ep, long
                 // do we still have time to spend on this?
                 if (remainingMS > 0)
                 {
-                    logger.debug("getSubspectrum: still waiting after timeout (allocated %ldms, period %dms, elapsed %ldms, remaining %ldms",
+                    logger.debug("readSubspectrum: still waiting after timeout (allocated %ldms, period %dms, elapsed %ldms, remaining %ldms",
                         allocatedMS, periodMS, elapsedMS, remainingMS);
                     continue;
                 }
             }
 
             // either it wasn't a timeout, or we're out of time
-            logger.error("getSubspectrum: bytesRead negative or zero, giving up (allocated %ldms, period %dms, elapsed %ldms, remaining %ldms (%s)", 
+            logger.error("readSubspectrum: bytesRead negative or zero, giving up (allocated %ldms, period %dms, elapsed %ldms, remaining %ldms (%s)", 
                 allocatedMS, periodMS, elapsedMS, remainingMS, 
 #if USE_LIBUSB_WIN32
                 usb_strerror()
@@ -741,33 +2704,25 @@ std::vector<uint16_t> WasatchVCPP::Spectrometer::getSubspectrum(uint8_t ep, long
                 libusb_strerror(libusb_error(result))
 #endif
             );
-            return vector<uint16_t>();
+            return false;
         }
 
         // doesn't seem worth supporting this case; doubt it occurs
         if (bytesRead % 2 != 0)
         {
-            logger.error("getSubspectrum: read odd number of bytes (%d)", bytesRead);
-            return vector<uint16_t>();
+            logger.error("readSubspectrum: read odd number of bytes (%d)", bytesRead);
+            return false;
         }
 
-        ////////////////////////////////////////////////////////////////////////
-        // we received aligned data, so demarshall
-        ////////////////////////////////////////////////////////////////////////
-
-        // demarshal little-endian pixels
-        for (int i = 0; i + 1 < bytesRead; i += 2)
-            subspectrum.push_back(bufSubspectrum[i] | (bufSubspectrum[i + 1] << 8));
-
         totalBytesRead += bytesRead;
         bytesLeftToRead -= bytesRead;
 
         if (bytesLeftToRead != 0)
-            logger.debug("getSubspectrum: totalBytesRead %d, bytesLeftToRead %d", 
+            logger.debug("readSubspectrum: totalBytesRead %d, bytesLeftToRead %d", 
                 totalBytesRead, bytesLeftToRead);
     }
 
-    return subspectrum;
+    return true;
 }
 
 unsigned long WasatchVCPP::Spectrometer::getIntegrationTimeMS()
@@ -826,6 +2781,90 @@ int WasatchVCPP::Spectrometer::getDetectorTECSetpointDegC()
 bool WasatchVCPP::Spectrometer::getHighGainModeEnable()
 { return isInGaAs() ? ParseData::toBool(getCmd(0xec, 1)) : false; }
 
+//! Gather commonly-polled state in one call.
+//!
+//! Settings the library wrote itself (integration time, TEC setpoint, gain,
+//! offset, TEC and high-gain enables) are reported from cache, so on a warm
+//! cache this costs at most two control transfers: the detector temperature
+//! and the laser enable (always read from the device, as the firmware may
+//! disable the laser on its own).
+bool WasatchVCPP::Spectrometer::getStatus(Status& status)
+{
+    SettingsCache cache;
+    {
+        std::lock_guard<std::mutex> lock(mutStatus);
+        cache = settingsCache;
+    }
+
+    // read anything not yet set through this library, outside mutStatus so 
+    // the transfers don't hold up the setters
+    if (!cache.hasGain)
+    {
+        float gain = getDetectorGain();
+        if (gain != (float)ErrorCodes::InvalidGain)
+        {
+            cache.gain = gain;
+            cache.hasGain = true;
+        }
+    }
+    if (!cache.hasOffset)
+    {
+        auto data = getCmd(0xc4, 2);
+        if (data.size() == 2)
+        {
+            cache.offset = ParseData::toInt16(data);
+            cache.hasOffset = true;
+        }
+    }
+    if (!cache.hasTECEnable)
+    {
+        cache.tecEnable = getDetectorTECEnable();
+        cache.hasTECEnable = true;
+    }
+    if (!cache.hasHighGainMode)
+    {
+        cache.highGainMode = getHighGainModeEnable();
+        cache.hasHighGainMode = true;
+    }
+
+    // fill the cache, unless a setter got there first
+    {
+        std::lock_guard<std::mutex> lock(mutStatus);
+        if (!settingsCache.hasGain && cache.hasGain)
+        {
+            settingsCache.gain = cache.gain;
+            settingsCache.hasGain = true;
+        }
+        if (!settingsCache.hasOffset && cache.hasOffset)
+        {
+            settingsCache.offset = cache.offset;
+            settingsCache.hasOffset = true;
+        }
+        if (!settingsCache.hasTECEnable)
+        {
+            settingsCache.tecEnable = cache.tecEnable;
+            settingsCache.hasTECEnable = true;
+        }
+        if (!settingsCache.hasHighGainMode)
+        {
+            settingsCache.highGainMode = cache.highGainMode;
+            settingsCache.hasHighGainMode = true;
+        }
+        cache = settingsCache;
+    }
+
+    status.integrationTimeMS = integrationTimeMS;
+    status.detectorTECSetpointDegC = getDetectorTECSetpointDegC();
+    status.detectorGain = cache.hasGain ? cache.gain : (float)ErrorCodes::InvalidGain;
+    status.detectorOffset = cache.hasOffset ? cache.offset : (int)ErrorCodes::InvalidOffset;
+    status.detectorTECEnable = cache.tecEnable;
+    status.highGainModeEnable = cache.highGainMode;
+
+    status.laserEnable = getLaserEnable();
+    status.detectorTemperatureDegC = eeprom.hasCooling ? getDetectorTemperatureDegC() : (float)ErrorCodes::InvalidTemperature;
+    return true;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Control Messages
 ////////////////////////////////////////////////////////////////////////////////
@@ -846,13 +2885,26 @@ bool WasatchVCPP::Spectrometer::getHighGainModeEnable()
 //!        than 32 bits, such as the uint40 values used for laser modulation),
 //!        can provide additional bits of precision atop wValue and wIndex
 //! @param len (Input) number of bytes provided in data
+//! @param priority (Input) class in which to wait for the bus (@see lockComm)
 //! @returns number of bytes written (not really indicative of success/failure).
 //!
 //! @note I *think* this actually indicates the number of DATA bytes 
 //!       transferred, and is not actually intended to include the "control
 //!       packet" itself; therefore, bytes written will be ZERO for most 
 //!       successful setters, and negative for comms failures.
-int WasatchVCPP::Spectrometer::sendCmd(uint8_t bRequest, uint16_t wValue, uint16_t wIndex, uint8_t* data, int len)
+int WasatchVCPP::Spectrometer::sendCmd(uint8_t bRequest, uint16_t wValue, uint16_t wIndex, uint8_t* data, int len, CommandPriority priority)
+{
+    if (!lockComm(priority))
+        return -1;
+
+    int bytesWritten = sendCmdLocked(bRequest, wValue, wIndex, data, len);
+
+    unlockComm();
+    return bytesWritten;
+}
+
+//! As sendCmd, for a caller already holding the comm lock (@see lockComm).
+int WasatchVCPP::Spectrometer::sendCmdLocked(uint8_t bRequest, uint16_t wValue, uint16_t wIndex, uint8_t* data, int len)
 {
     // ARM firmware expects all commands to include at least 8 payload bytes
     uint8_t buf[MIN_ARM_LEN] = { 0 };
@@ -866,26 +2918,21 @@ int WasatchVCPP::Spectrometer::sendCmd(uint8_t bRequest, uint16_t wValue, uint16
     if (len > 0)
         dataStr = Util::sprintf(" (data: %s)", Util::toHex(data, len).c_str());
 
-    if (!lockComm())
-        return -1;
-
 #if USE_LIBUSB_WIN32
     int bytesWritten = usb_control_msg        (udev, HOST_TO_DEVICE, bRequest, wValue, wIndex, (char*)data, len, maxTimeoutMS);
 #else
     int bytesWritten = libusb_control_transfer(udev, HOST_TO_DEVICE, bRequest, wValue, wIndex,        data, len, maxTimeoutMS);
 #endif
 
-    unlockComm();
-
     logger.debug("sendCmd(bRequest 0x%02x, wValue 0x%04x, wIndex 0x%04x, len %d, timeout %dms)%s (wrote %d bytes)", 
         bRequest, wValue, wIndex, len, maxTimeoutMS, dataStr.c_str(), bytesWritten);
     return bytesWritten;
 }
 
 //! Convenience wrapper over sendCmd if payload is in a vector.
-int WasatchVCPP::Spectrometer::sendCmd(uint8_t bRequest, uint16_t wValue, uint16_t wIndex, vector<uint8_t> data)
+int WasatchVCPP::Spectrometer::sendCmd(uint8_t bRequest, uint16_t wValue, uint16_t wIndex, vector<uint8_t> data, CommandPriority priority)
 {
-    return sendCmd(bRequest, wValue, wIndex, &data[0], (int)data.size());
+    return sendCmd(bRequest, wValue, wIndex, &data[0], (int)data.size(), priority);
 }
 
 //! This is the standard "getter opcode" function.  It doesn't take a "wValue" 
@@ -913,12 +2960,12 @@ vector<uint8_t> WasatchVCPP::Spectrometer::getCmd(uint8_t bRequest, int len, uin
 //! @param fullLen (Input) how many bytes we think the spectrometer will send, 
 //!        with padding
 //! @returns vector of just the 'len' bytes requested
-vector<uint8_t> WasatchVCPP::Spectrometer::getCmd2(uint16_t wValue, int len, uint16_t wIndex, int fullLen)
+vector<uint8_t> WasatchVCPP::Spectrometer::getCmd2(uint16_t wValue, int len, uint16_t wIndex, int fullLen, CommandPriority priority)
 {
     const uint8_t bRequest = 0xff;
     logger.debug("relaying getCmd2(wValue 0x%04x, len %d, wIndex 0x%04x, fullLen %d)",
         wValue, len, wIndex, fullLen);
-    return getCmdReal(bRequest, wValue, wIndex, len, fullLen);
+    return getCmdReal(bRequest, wValue, wIndex, len, fullLen, priority);
 }
 
 //! The actual "gettor" function, typically called through either the getCmd or 
@@ -947,24 +2994,120 @@ vector<uint8_t> WasatchVCPP::Spectrometer::getCmdReal(
         uint16_t wValue, 
         uint16_t wIndex, 
         int len, 
-        int fullLen)
+        int fullLen,
+        CommandPriority priority)
 {
-    // this is what we'll return
-    vector<uint8_t> retval;
-
     // ARM firmware expects all commands to provide at least 8 payload bytes
     int bytesToRead = max(len, fullLen);
     if (isARM())
         bytesToRead = max(MIN_ARM_LEN, bytesToRead);
 
-    // this is our temporary (often somewhat larger) buffer
+    // receive buffer (often somewhat larger than 'len'), which is trimmed and
+    // returned in place rather than copied
     vector<uint8_t> data(bytesToRead); 
 
-    if (!lockComm())
-        return retval;
+    int bytesRead = readControl(bRequest, wValue, wIndex, data, len, priority);
+
+    // skip hex-formatting the response unless someone will read it
+    if (logger.level == Logger::Levels::LOG_LEVEL_DEBUG)
+        logger.debug("getCmdReal(0x%02x): read %d bytes: %s", bRequest, bytesRead, Util::toHex(data).c_str());
+
+    if (bytesRead < 0)
+    {
+        logger.error("getCmdReal(0x%02x): no data", bRequest);
+        return vector<uint8_t>();
+    }
+    else if (bytesRead < len) 
+    {
+        logger.error("getCmdReal: incomplete response (%d bytes read, %d needed, %d expected)", 
+            bytesRead, len, bytesToRead);
+        return vector<uint8_t>();
+    }
+
+    data.resize(len);
+    return data;
+}
+
+//! Perform a device-to-host control transfer, coalescing concurrent identical
+//! reads.
+//!
+//! If another thread is already waiting on the comm lock to read the same
+//! (bRequest, wValue, wIndex), this call waits for and shares that result
+//! rather than issuing its own transfer.  Once that transfer has the bus, 
+//! later readers issue their own, so no caller receives a response read 
+//! before its call began; nothing is cached once a transfer completes.
+//!
+//! @param data (In/Out) receive buffer, sized to the bytes to request (a 
+//!        coalesced result may be longer)
+//! @param len (Input) bytes the caller needs; if a shared response was 
+//!        shorter, the caller falls back to its own transfer
+//! @returns bytes read, or negative on error
+int WasatchVCPP::Spectrometer::readControl(uint8_t bRequest, uint16_t wValue, uint16_t wIndex, vector<uint8_t>& data, int len, CommandPriority priority)
+{
+    const uint64_t key = ((uint64_t)bRequest << 32) | ((uint64_t)wValue << 16) | wIndex;
+    std::shared_ptr<ControlFlight> flight;
+    {
+        std::unique_lock<std::mutex> lock(mutFlights);
+        auto iter = flights.find(key);
+        if (iter == flights.end() || iter->second->started)
+            flights[key] = flight = std::make_shared<ControlFlight>();
+        else
+        {
+            // another thread is already reading this; wait for its result
+            auto leader = iter->second;
+            leader->waiters++;
+            cvFlights.wait(lock, [&leader] { return leader->done; });
+            if (leader->bytesRead >= len)
+            {
+                coalescedReads++;
+                logger.debug("getCmdReal(0x%02x): shared in-flight response (%llu coalesced)", 
+                    bRequest, (unsigned long long)coalescedReads);
+                data = leader->data;
+                return leader->bytesRead;
+            }
+        }
+    }
+
+    // The leader completes its flight on every return path, failed or not, 
+    // so followers never wait on it forever.  (A follower which fell back to
+    // its own transfer doesn't lead a flight.)
+    struct FlightCompletion
+    {
+        Spectrometer& spec;
+        uint64_t key;
+        std::shared_ptr<ControlFlight> flight;
+        const vector<uint8_t>& data;
+        int bytesRead;
+
+        ~FlightCompletion()
+        {
+            if (flight == nullptr)
+                return;
+            std::lock_guard<std::mutex> lock(spec.mutFlights);
+            flight->done = true;
+            flight->bytesRead = bytesRead;
+            if (flight->waiters > 0 && bytesRead > 0)
+                flight->data = data;
+            auto iter = spec.flights.find(key);
+            if (iter != spec.flights.end() && iter->second == flight)
+                spec.flights.erase(iter);
+            spec.cvFlights.notify_all();
+        }
+    } completion = { *this, key, flight, data, -1 };
+
+    if (!lockComm(priority))
+        return -1;
+
+    // a read arriving from here on may follow a write this transfer won't
+    // reflect, so it leads its own flight
+    if (flight != nullptr)
+    {
+        std::lock_guard<std::mutex> lock(mutFlights);
+        flight->started = true;
+    }
 
     logger.debug("getCmdReal(bRequest 0x%02x, wValue 0x%04x, wIndex 0x%04x, len %d, timeout %dms)", 
-        bRequest, wValue, wIndex, bytesToRead, maxTimeoutMS);
+        bRequest, wValue, wIndex, (int)data.size(), maxTimeoutMS);
 
 #if USE_LIBUSB_WIN32
     int bytesRead = usb_control_msg        (udev, DEVICE_TO_HOST, bRequest, wValue, wIndex, (char*)&data[0], (int)data.size(), maxTimeoutMS);
@@ -974,25 +3117,112 @@ vector<uint8_t> WasatchVCPP::Spectrometer::getCmdReal(
 
     unlockComm();
 
-    logger.debug("getCmdReal(0x%02x): read %d bytes: %s", bRequest, bytesRead, Util::toHex(data).c_str());
+    completion.bytesRead = bytesRead;
+    return bytesRead;
+}
 
-    if (bytesRead < 0)
-    {
-        logger.error("getCmdReal(0x%02x): no data", bRequest);
-        return retval;
-    }
-    else if (bytesRead < len) 
-    {
-        logger.error("getCmdReal: incomplete response (%d bytes read, %d needed, %d expected)", 
-            bytesRead, len, bytesToRead);
-        return retval;
-    }
+////////////////////////////////////////////////////////////////////////////////
+// Asynchronous Control
+////////////////////////////////////////////////////////////////////////////////
+
+//! Queue a write to the spectrometer, returning immediately.
+//!
+//! @see sendCmd
+//! @see AsyncControl
+//! @param callback (Input) optional; if provided, the handle can't be waited on
+//! @returns handle to pass to asyncControl.wait(), or negative on error
+int WasatchVCPP::Spectrometer::sendCmdAsync(uint8_t bRequest, uint16_t wValue, uint16_t wIndex, const uint8_t* data, int len,
+    AsyncControl::Callback callback, void* userData)
+{
+    auto op = std::make_shared<AsyncControl::Operation>();
+    op->bRequest = bRequest;
+    op->wValue = wValue;
+    op->wIndex = wIndex;
+    if (data != nullptr && len > 0)
+        op->data.assign(data, data + len);
+    op->callback = callback;
+    op->userData = userData;
+    return asyncControl.submit(op);
+}
+
+//! Queue a read from the spectrometer, returning immediately.  The response
+//! is passed to the callback, or returned by asyncControl.wait().
+//!
+//! @see getCmd
+int WasatchVCPP::Spectrometer::getCmdAsync(uint8_t bRequest, int len, uint16_t wIndex,
+    AsyncControl::Callback callback, void* userData)
+{
+    auto op = std::make_shared<AsyncControl::Operation>();
+    op->read = true;
+    op->bRequest = bRequest;
+    op->wIndex = wIndex;
+    op->data.resize(len);
+    op->len = len;
+    op->callback = callback;
+    op->userData = userData;
+    return asyncControl.submit(op);
+}
+
+//! As setIntegrationTimeMS, but the cached value is only updated once the 
+//! spectrometer has accepted it.
+int WasatchVCPP::Spectrometer::setIntegrationTimeMSAsync(unsigned long ms, AsyncControl::Callback callback, void* userData)
+{
+    ms = clamp(ms, 1, MAX_UINT24 - 1);
+
+    auto op = std::make_shared<AsyncControl::Operation>();
+    op->bRequest = 0xb2;
+    op->wValue = ms & 0xffff;
+    op->wIndex = (ms >> 16) & 0x00ff;
+    op->callback = callback;
+    op->userData = userData;
+    op->onComplete = [this, ms](int result) 
+    { 
+        if (result >= 0)
+        {
+            integrationTimeMS = (int)ms;
+            bumpSettingsGeneration();
+        }
+    };
+    return asyncControl.submit(op);
+}
+
+//! As setLaserEnable, disabling is urgent and supersedes earlier enables, 
+//! whether synchronous or asynchronous.
+int WasatchVCPP::Spectrometer::setLaserEnableAsync(bool flag, AsyncControl::Callback callback, void* userData)
+{
+    const uint64_t sequence = beginLaserCommand(flag);
+    if (!flag)
+        asyncControl.cancelQueued([](const AsyncControl::Operation& op) { return op.bRequest == 0xbe && op.wValue != 0; });
+
+    auto op = std::make_shared<AsyncControl::Operation>();
+    op->bRequest = 0xbe;
+    op->wValue = flag ? 1 : 0;
+    op->priority = flag ? CommandPriority::Normal : CommandPriority::Urgent;
+    op->callback = callback;
+    op->userData = userData;
+    op->isCurrent = [this, sequence, flag]() { return isLaserCommandCurrent(sequence, flag); };
+    op->onComplete = [this, sequence, flag](int result) { if (result >= 0) recordLaserEnable(sequence, flag); };
+    return asyncControl.submit(op);
+}
 
-    retval.resize(len);
-    for (int i = 0; i < len; i++)
-        retval[i] = data[i];
+//! @param priority (Input) which class
+//! @param latency (Output) time spent waiting for the bus since the last reset
+bool WasatchVCPP::Spectrometer::getCommandLatency(CommandPriority priority, CommandLatency& latency)
+{
+    int p = (int)priority;
+    if (p < 0 || p >= COMMAND_PRIORITIES)
+        return false;
+
+    std::lock_guard<std::mutex> lock(mutComm);
+    latency = commLatency[p];
+    return true;
+}
 
-    return retval;
+void WasatchVCPP::Spectrometer::resetCommandLatency()
+{
+    std::lock_guard<std::mutex> lock(mutComm);
+    for (auto& latency : commLatency)
+        latency = CommandLatency();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -1026,16 +3256,127 @@ unsigned long WasatchVCPP::Spectrometer::clamp(unsigned long value, unsigned lon
     return value;
 }
 
-bool WasatchVCPP::Spectrometer::lockComm()
+//! Wait for exclusive use of the control endpoint.
+//!
+//! The bus is granted by priority class: a caller only proceeds once nobody
+//! of a higher class is waiting (including the head of the asynchronous 
+//! queue), and callers within a class proceed in arrival order.  Multi-
+//! transfer operations (EEPROM writes, laser power) take the lock per 
+//! transfer, so an urgent command waits for at most the one transfer
+//! already on the bus.
+//!
+//! Each grant's wait is recorded per class (@see getCommandLatency).
+//!
+//! @returns false once the spectrometer has been closed
+bool WasatchVCPP::Spectrometer::lockComm(CommandPriority priority)
+{
+    auto requested = std::chrono::steady_clock::now();
+    const int p = (int)priority;
+
+    std::unique_lock<std::mutex> lock(mutComm);
+    const uint64_t ticket = commTickets[p]++;
+    commWaiters[p]++;
+    cvComm.wait(lock, [this, p, ticket] 
+    { 
+        if (commBusy || ticket != commServing[p] || asyncControl.getNextPriority() > p)
+            return false;
+        for (int higher = p + 1; higher < COMMAND_PRIORITIES; higher++)
+            if (commWaiters[higher] > 0)
+                return false;
+        return true;
+    });
+    commWaiters[p]--;
+    commServing[p]++;
+    if (udev == nullptr)
+    {
+        // closed while waiting: pass the turn on, so the rest refuse too
+        lock.unlock();
+        cvComm.notify_all();
+        return false;
+    }
+    commBusy = true;
+    recordCommLatency(priority, requested);
+    return true;
+}
+
+//! Used by AsyncControl to submit without blocking.
+//!
+//! @returns false if a control transfer is in progress, or a synchronous 
+//!          caller of the same or higher priority is waiting
+bool WasatchVCPP::Spectrometer::tryLockComm(CommandPriority priority, std::chrono::steady_clock::time_point requested)
 {
-    mutComm.lock();
+    std::lock_guard<std::mutex> lock(mutComm);
+    if (commBusy)
+        return false;
+    for (int p = (int)priority; p < COMMAND_PRIORITIES; p++)
+        if (commWaiters[p] > 0)
+            return false;
+    commBusy = true;
+    recordCommLatency(priority, requested);
     return true;
 }
 
+//! call with mutComm held
+void WasatchVCPP::Spectrometer::recordCommLatency(CommandPriority priority, std::chrono::steady_clock::time_point requested)
+{
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - requested).count();
+    auto& latency = commLatency[(int)priority];
+    latency.avgMS = (latency.avgMS * latency.count + ms) / (latency.count + 1);
+    latency.maxMS = max(latency.maxMS, ms);
+    latency.lastMS = ms;
+    latency.count++;
+}
+
 #ifdef _WIN32
 #pragma warning(disable : 26110) // caller failing to hold lock before calling unlock
 #endif
-void WasatchVCPP::Spectrometer::unlockComm()
+//! Release the comm lock to whichever waiter has the highest priority: a
+//! synchronous caller, or the head of the asynchronous queue.  On a tie the
+//! synchronous caller goes first, so the two alternate rather than either 
+//! starving the other.
+//!
+//! @param resumeAsync (Input) false when called by AsyncControl itself
+void WasatchVCPP::Spectrometer::unlockComm(bool resumeAsync)
+{
+    int highestWaiting = -1;
+    {
+        std::lock_guard<std::mutex> lock(mutComm);
+        commBusy = false;
+        for (int p = 0; p < COMMAND_PRIORITIES; p++)
+            if (commWaiters[p] > 0)
+                highestWaiting = p;
+    }
+
+    cvComm.notify_all();
+    if (resumeAsync && asyncControl.getNextPriority() > highestWaiting)
+        asyncControl.resume();
+}
+
+//! Number a laser command as it's issued.
+uint64_t WasatchVCPP::Spectrometer::beginLaserCommand(bool flag)
 {
-    mutComm.unlock();
+    std::lock_guard<std::mutex> lock(mutComm);
+    const uint64_t sequence = ++laserSequence;
+    if (!flag)
+        laserDisableSequence = sequence;
+    return sequence;
+}
+
+//! @returns false if this is an enable issued before the latest disable
+bool WasatchVCPP::Spectrometer::isLaserCommandCurrent(uint64_t sequence, bool flag)
+{
+    std::lock_guard<std::mutex> lock(mutComm);
+    return !flag || sequence > laserDisableSequence;
+}
+
+//! Cache a laser command the spectrometer accepted, unless a later one
+//! already completed.
+void WasatchVCPP::Spectrometer::recordLaserEnable(uint64_t sequence, bool flag)
+{
+    std::lock_guard<std::mutex> lock(mutComm);
+    if (sequence > laserStateSequence)
+    {
+        laserStateSequence = sequence;
+        laserEnabled = flag;
+    }
 }
@@ -16,11 +16,29 @@
 #define WPVCPP_UDEV_TYPE libusb_device_handle
 #endif
 
+#include "AreaScan.h"
+#include "AsyncControl.h"
+#include "Deadband.h"
+#include "DisplayStream.h"
 #include "EEPROM.h"
+#include "Expression.h"
+#include "FlightRecorder.h"
+#include "FramePool.h"
+#include "Kernels.h"
 #include "Logger.h"
+#include "Recipe.h"
+#include "SpectrumFormat.h"
+#include "SpectrumPipeline.h"
+#include "TriggeredAcquisition.h"
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
 #include <vector>
+#include <memory>
 #include <mutex>
+#include <thread>
 
 namespace WasatchVCPP
 {
@@ -64,10 +82,23 @@ namespace WasatchVCPP
             int index = -1;
             std::vector<double> wavelengths;
             std::vector<double> wavenumbers;
+            std::vector<float> wavelengthsFloat;    //!< held instead of 'wavelengths' in compact mode
+            std::vector<float> wavenumbersFloat;    //!< held instead of 'wavenumbers' in compact mode
             bool isARM();
             bool isInGaAs();
             bool isMicro();
 
+            // USB topology (set by Driver::openAllSpectrometers)
+            int usbBus = -1;
+            std::string usbPorts;       //!< port path from the root hub, e.g. "1.4.2"
+            int usbSpeedMbps = 0;       //!< 0 if unknown
+
+            //! If set, bulk reads are serialized against other spectrometers
+            //! on the same bus, and not started until integration should be 
+            //! complete (@see Scheduler)
+            void setBusReadout(std::shared_ptr<std::mutex> mut);
+            std::shared_ptr<std::mutex> getBusReadout();
+
             //! Other Wasatch drivers don't really have this concept...basically,
             //! all blocking reads to bulk endpoints (spectral reads) wait no
             //! longer than this, and loop over multiple reads if necessary, to
@@ -84,8 +115,15 @@ namespace WasatchVCPP
             int pixels = 0;
             std::string firmwareVersion;
             std::string fpgaVersion;
-            int integrationTimeMS = 1;
-            bool laserEnabled = false;
+            std::atomic<int> integrationTimeMS;     //!< as configured (not as shortened by cancelOperation)
+            std::atomic<bool> laserEnabled;
+
+            //! Incremented by each change to a setting that affects the 
+            //! spectrum (integration time, detector gain and offset, high-gain
+            //! mode, laser power and modulation).  Every spectrum is tagged with the generation it was 
+            //! triggered under.
+            std::atomic<uint32_t> settingsGeneration;
+
             bool laserPowerHighResolution = true;
             bool laserPowerRequireModulation = false;
             bool modEnabled = false;
@@ -123,8 +161,51 @@ namespace WasatchVCPP
             int getDetectorTECSetpointDegC();
             bool getHighGainModeEnable();
 
+            //! commonly-polled state, gathered with as few transfers as possible
+            struct Status
+            {
+                float detectorTemperatureDegC = ErrorCodes::InvalidTemperature;
+                bool detectorTECEnable = false;
+                int detectorTECSetpointDegC = ErrorCodes::InvalidTemperature;
+                bool laserEnable = false;
+                int integrationTimeMS = 0;
+                float detectorGain = ErrorCodes::InvalidGain;
+                int detectorOffset = ErrorCodes::InvalidOffset;
+                bool highGainModeEnable = false;
+            };
+            bool getStatus(Status& status);
+
+            //! Settings which survive a reconnect.  When a spectrometer is 
+            //! closed, the Driver keeps these by serial number; if the same
+            //! unit is reopened, they're applied in place of the EEPROM 
+            //! startup defaults.  The laser is never re-enabled, but its power 
+            //! and modulation are restored.
+            struct Settings
+            {
+                unsigned long integrationTimeMS = 0;    //!< 0 to leave unset
+                float detectorGain = 0;
+                float detectorGainOdd = 0;
+                int16_t detectorOffset = 0;
+                int16_t detectorOffsetOdd = 0;
+                bool hasTEC = false;
+                int detectorTECSetpointDegC = 0;
+                bool detectorTECEnable = false;
+                bool hasHighGainMode = false;
+                bool highGainModeEnable = false;
+                bool hasLaserPower = false;
+                float laserPowerPerc = 0;
+                bool hasLaserModulation = false;    //!< any of the following were written
+                bool laserModulationEnable = false;
+                int laserModPeriodUS = 0;           //!< 0 to leave unset
+                int laserModWidthUS = 0;            //!< 0 to leave unset
+            };
+            Settings getSettings();
+            bool applySettings(const Settings& settings);
+            bool warmRestored = false;  //!< whether the constructor applied saved Settings
+
             // public to support wp_send/read_control_msg()
-            int sendCmd(uint8_t bRequest, uint16_t wValue = 0, uint16_t wIndex = 0, uint8_t* data = NULL, int len = 0);
+            int sendCmd(uint8_t bRequest, uint16_t wValue = 0, uint16_t wIndex = 0, uint8_t* data = NULL, int len = 0,
+                CommandPriority priority = CommandPriority::Normal);
             bool setModEnable(bool flag);
             bool setModPeriodus(int us);
             bool setModWidthus(int us);
@@ -133,9 +214,152 @@ namespace WasatchVCPP
             bool setLaserPowermW(float mW_in);
             std::vector<uint8_t> getCmd(uint8_t bRequest, int len, uint16_t wIndex=0, int fullLen=0);
 
+            // asynchronous control (@see AsyncControl)
+            AsyncControl asyncControl;
+            int sendCmdAsync(uint8_t bRequest, uint16_t wValue, uint16_t wIndex, const uint8_t* data, int len,
+                AsyncControl::Callback callback = nullptr, void* userData = nullptr);
+            int getCmdAsync(uint8_t bRequest, int len, uint16_t wIndex = 0, 
+                AsyncControl::Callback callback = nullptr, void* userData = nullptr);
+            int setIntegrationTimeMSAsync(unsigned long ms, AsyncControl::Callback callback = nullptr, void* userData = nullptr);
+            int setLaserEnableAsync(bool flag, AsyncControl::Callback callback = nullptr, void* userData = nullptr);
+
+            //! Time control transfers spent waiting for the bus, per priority
+            //! class (@see lockComm)
+            struct CommandLatency
+            {
+                uint64_t count = 0;
+                double avgMS = 0;
+                double maxMS = 0;
+                double lastMS = 0;
+            };
+            bool getCommandLatency(CommandPriority priority, CommandLatency& latency);
+            void resetCommandLatency();
+
+            // EEPROM
+            bool writeEEPROMPage(int page, const std::vector<uint8_t>& data);
+            bool commitEEPROM(const EEPROM& modified, int* pagesWritten = nullptr, double* elapsedMS = nullptr);
+            bool commitEEPROMPages(const std::vector<std::vector<uint8_t> >& image, int* pagesWritten = nullptr, double* elapsedMS = nullptr);
+            bool setEEPROMField(const std::string& name, const std::string& value);
+            bool commitStagedEEPROM(int* pagesWritten = nullptr, double* elapsedMS = nullptr);
+
+            //! Hold while reading 'eeprom' or the axes, as commitEEPROMPages
+            //! and setCompact replace them.
+            std::unique_lock<std::mutex> lockEEPROM() { return std::unique_lock<std::mutex>(mutEEPROM); }
+
             // acquisition
-            std::vector<double> getSpectrum();
+
+            //! Lifecycle of one software-triggered acquisition.
+            //!
+            //! Only one acquisition may be in flight (Idle -> Armed is the 
+            //! single entry point, made under mutAcquisition).  Control 
+            //! messages are serialized only on the comm lock, never on this state, 
+            //! so getters and setters may run in any state, concurrently with
+            //! an in-flight bulk read:
+            //!
+            //! - integration time changes reach the FPGA immediately (which is
+            //!   how cancelOperation shortens an integration)
+            //! - laser, gain, offset and TEC changes take effect mid-acquisition
+            //!   and may affect the spectrum being read
+            //! - cancelOperation is only valid from Armed, Integrating or Reading
+            //! - EEPROM writes, area scan and triggered acquisition wait for Idle
+            //!   (via mutAcquisition)
+            enum class AcquisitionState { Idle, Armed, Integrating, Reading, Cancelling };
+            AcquisitionState getAcquisitionState() const { return acquisitionState; }
+
+            std::vector<double> getSpectrum(uint32_t* generation = nullptr);
+            bool getSpectrum(double* spectrum, int len, uint32_t* generation = nullptr);
+            bool getSpectrumAs(SpectrumFormat::Format format, void* spectrum, int len, double scale = 1, 
+                uint32_t* generation = nullptr);
             bool cancelOperation(bool blocking);
+            void postProcessSpectrum(double* spectrum, int len);
+            void postProcessSpectrum(uint16_t* spectrum, int len);
+
+            // averaging, dark and gain correction (@see SpectrumPipeline)
+            SpectrumPipeline pipeline;
+            bool getProcessedSpectrum(float* spectrum, int len);
+
+            // change detection on triggered acquisitions (@see Deadband)
+            Deadband deadband;
+
+            // decimated envelopes for live plots (@see DisplayStream)
+            DisplayStream display;
+
+            // per-pixel formulas (@see Expression)
+            Expression expression;
+            bool getExpressionSpectrum(double* spectrum, int len);
+
+            // frame pool
+            bool setFramePool(int frames, int flags);
+            bool setFramePool(int frames, int flags, size_t memoryUsed);
+            FramePool::Stats getFramePoolStats();
+            std::shared_ptr<FramePool> getFramePool();
+
+            // throwaways
+            bool setThrowawayFrames(int frames);
+            int getThrowawayFrames() const { return throwawayFrames; }
+            uint64_t getThrowawayCount() const { return throwawayCount; }
+
+            // flight recorder
+            bool setFlightRecorder(int frames);
+            bool dumpFlightRecorder(const std::string& pathname);
+            std::shared_ptr<FlightRecorder> getFlightRecorder();
+
+            // memory
+            //! Approximate heap held by one spectrometer, by subsystem (bytes).
+            struct MemoryUsage
+            {
+                size_t core = 0;            //!< this object and its read buffer
+                size_t eeprom = 0;          //!< page cache, parsed fields and string views
+                size_t axes = 0;            //!< wavelengths and wavenumbers
+                size_t triggered = 0;       //!< hardware-triggering transfers and queue
+                size_t areaScan = 0;
+                size_t flightRecorder = 0;
+                size_t framePool = 0;
+
+                size_t total() const { return core + eeprom + axes + triggered + areaScan + flightRecorder + framePool; }
+
+                MemoryUsage& operator+=(const MemoryUsage& rhs)
+                {
+                    core += rhs.core; eeprom += rhs.eeprom; axes += rhs.axes; triggered += rhs.triggered;
+                    areaScan += rhs.areaScan; flightRecorder += rhs.flightRecorder; framePool += rhs.framePool;
+                    return *this;
+                }
+            };
+            MemoryUsage getMemoryUsage();
+            void setCompact(bool flag);
+
+            // hardware triggering
+            bool setTriggerSource(bool external);
+            bool startTriggeredAcquisition(int transfersPerEndpoint, int maxFrames);
+            bool stopTriggeredAcquisition();
+            std::shared_ptr<TriggeredAcquisition> getTriggeredAcquisition();
+
+            // auto-dark
+            struct AutoDark
+            {
+                int laserWarmupMS = 0;          //!< delay between laser-on and the sample acquisition
+                int maxAgeMS = 0;               //!< reuse a dark no older than this (0 for a fresh dark every time)
+                float maxTempDeltaDegC = 0;     //!< ...and within this of the current detector temperature (0 to ignore)
+
+                std::vector<double> dark;       //!< most recent dark (empty if none)
+                std::chrono::steady_clock::time_point timestamp;
+                unsigned long integrationTimeMS = 0;
+                float detectorTempDegC = 0;
+                bool reused = false;            //!< whether the last auto-dark sample reused a dark
+            };
+            bool setAutoDarkConfig(int laserWarmupMS, int maxAgeMS, float maxTempDeltaDegC);
+            bool getAutoDarkSpectrum(std::vector<double>& corrected, std::vector<double>& dark, std::vector<double>& raw);
+
+            // recipes
+            bool startRecipe(const std::string& text);
+            bool stopRecipe();
+            std::shared_ptr<Recipe> getRecipe();
+
+            // area scan
+            bool setAreaScanEnable(bool flag);
+            bool getAreaScanEnable() const { return areaScan != nullptr; }
+            bool getAreaScanFrame(double* frame, int rows, int cols, int timeoutMS);
+            bool getAreaScanBinned(double* spectrum, int len, int firstRow, int lastRow, int timeoutMS);
 
         ////////////////////////////////////////////////////////////////////////
         // Private attributes
@@ -143,18 +367,159 @@ namespace WasatchVCPP
         private:
             WPVCPP_UDEV_TYPE* udev = nullptr;
 
-            std::vector<uint8_t> endpoints;
-            std::vector<uint8_t> bufSubspectrum; 
+            std::vector<uint8_t> bulkEndpoints;     //!< bulk IN endpoints in the configuration descriptor, in preference order
+            std::vector<uint8_t> endpoints;         //!< those read for spectra, each returning pixelsPerEndpoint
+            std::vector<uint8_t> bufSubspectrum;    //!< one frame, each endpoint's share in its own slice
             int pixelsPerEndpoint = 0;
 
+            //! one endpoint's read within a multi-endpoint frame (@see readSubspectra)
+            struct BulkRead
+            {
+                int received = 0;           //!< bytes so far
+                int completed = 0;          //!< set when the queued read finishes
+                bool submitted = false;
+#ifdef USE_LIBUSB_WIN32
+                void* context = nullptr;
+#else
+                libusb_transfer* xfer = nullptr;
+#endif
+            };
+            std::vector<BulkRead> bulkReads;        //!< one per endpoint when there are several
+            std::vector<BulkRead> areaScanReads;    //!< AREA_SCAN_ROWS_QUEUED row slots, each one read per endpoint
+            std::vector<uint8_t> bufAreaScan;       //!< the raw rows of those reads
+            std::vector<uint16_t> areaScanLine;     //!< one demarshalled row
+
             bool detectorTECSetpointHasBeenSet = false;
-            bool acquiring = false;
-            bool operationCancelled = false;
-            int cancelledIntegrationTimeMS = 0;
-            bool lastAcquisitionWasCancelled = false;
+
+            //! Write-only settings remembered for getStatus.  Each is read 
+            //! from the spectrometer the first time it's needed, if it hasn't
+            //! already been set.
+            struct SettingsCache
+            {
+                bool hasGain = false;
+                float gain = 0;
+                bool hasGainOdd = false;
+                float gainOdd = 0;
+                bool hasOffset = false;
+                int offset = 0;
+                bool hasOffsetOdd = false;
+                int offsetOdd = 0;
+                bool hasTECEnable = false;
+                bool tecEnable = false;
+                bool hasHighGainMode = false;
+                bool highGainMode = false;
+                bool hasLaserPower = false;
+                bool hasModEnable = false;
+                bool hasModPeriod = false;  //!< modPeriodus was written
+                bool hasModWidth = false;   //!< modWidthus was written
+            } settingsCache;
+            std::mutex mutStatus;
+
+            std::atomic<AcquisitionState> acquisitionState;
+            std::atomic<bool> restoreIntegrationTime;   //!< the FPGA holds a shortened integration time
+            int cancelsInFlight;                        //!< cancelOperation calls still writing to the FPGA
+            std::mutex mutCancel;                       //!< guards cancelsInFlight
+            std::condition_variable cvCancel;           //!< signalled as each cancel finishes writing
 
             std::mutex mutAcquisition;
+            std::mutex mutEEPROM;       //!< @see lockEEPROM (taken after mutAcquisition and the Driver's lock)
+
+            //! shared with the Scheduler, which may replace it mid-acquisition
+            std::shared_ptr<std::mutex> busReadout;
+            std::mutex mutBusReadout;
+
+            //! taken after mutAcquisition, for a whole auto-dark sequence
+            AutoDark autoDark;
+            std::mutex mutAutoDark;
+
+            //! field changes awaiting commitStagedEEPROM (under mutAcquisition)
+            std::unique_ptr<EEPROM> stagedEEPROM;
+
+            // getProcessedSpectrum buffers (under mutAcquisition)
+            std::vector<uint16_t> processFrame;
+            std::vector<uint32_t> processSums;
+
+            //! getSpectrumAs frame when the pool has none (under mutAcquisition)
+            std::vector<double> bufConvert;
+
+            //! Frames to discard after each settings change.  Stale frames 
+            //! are read in the background as soon as a setting changes (so 
+            //! the throwaway overlaps whatever the caller does next), and 
+            //! otherwise by getSpectrum before it returns.
+            std::atomic<int> throwawayFrames;
+            std::atomic<uint64_t> throwawayCount;
+            uint32_t framesGeneration = 0;  //!< generation of the last frame read (under mutAcquisition)
+            int framesSinceChange = 0;      //!< frames read under framesGeneration, including throwaways
+            std::thread throwawayWorker;
+            std::mutex mutThrowaway;
+            std::condition_variable cvThrowaway;
+            bool throwawayRequested = false;
+            bool throwawayDraining = false; //!< the worker holds mutAcquisition (under mutThrowaway)
+            std::atomic<bool> throwawayStopping;
+
+            //! Serializes control transfers.  An asynchronous transfer holds 
+            //! this from submission until its completion callback, which may
+            //! run on another thread, so it's a flag rather than a held mutex.
             std::mutex mutComm;
+            std::condition_variable cvComm;
+            bool commBusy = false;
+            int commWaiters[COMMAND_PRIORITIES] = { 0 };
+            uint64_t commTickets[COMMAND_PRIORITIES] = { 0 };   //!< issued per class, for FIFO order
+            uint64_t commServing[COMMAND_PRIORITIES] = { 0 };
+            CommandLatency commLatency[COMMAND_PRIORITIES];
+
+            //! Laser commands are numbered under mutComm, so an enable issued
+            //! before the latest disable is dropped wherever it's still 
+            //! waiting (for the bus, or in the asynchronous queue), and a late
+            //! completion can't overwrite a newer laserEnabled.
+            uint64_t laserSequence = 0;         //!< last issued
+            uint64_t laserDisableSequence = 0;  //!< latest disable issued
+            uint64_t laserStateSequence = 0;    //!< last reflected in laserEnabled
+
+            //! a control read shared by concurrent identical callers
+            struct ControlFlight
+            {
+                bool started = false;   //!< has the bus, so admits no more followers
+                bool done = false;
+                int waiters = 0;
+                int bytesRead = -1;
+                std::vector<uint8_t> data;
+            };
+            std::mutex mutFlights;
+            std::condition_variable cvFlights;
+            std::map<uint64_t, std::shared_ptr<ControlFlight> > flights; //!< keyed on bRequest, wValue, wIndex
+            uint64_t coalescedReads = 0;
+
+            //! Shared so a caller of getTriggeredAcquisition can finish 
+            //! reading while a new acquisition is started.  Replaced under 
+            //! both mutAcquisition and mutTriggeredAcquisition.
+            std::shared_ptr<TriggeredAcquisition> triggeredAcquisition;
+            std::mutex mutTriggeredAcquisition;
+            std::unique_ptr<AreaScan> areaScan;
+
+            //! Shared so a caller of getRecipe can finish reading while a new
+            //! recipe is started.
+            std::shared_ptr<Recipe> recipe;
+            std::mutex mutRecipe;
+
+            //! Recent spectra (software- and hardware-triggered).  Shared so
+            //! a recorder being replaced can finish an in-progress dump.
+            std::shared_ptr<FlightRecorder> flightRecorder;
+            std::mutex mutFlightRecorder;
+
+            //! Preallocated frame buffers for every acquisition path.  Shared
+            //! so frames drawn from a pool being replaced stay valid until 
+            //! they're returned.
+            std::shared_ptr<FramePool> framePool;
+            std::mutex mutFramePool;
+
+            // bytes held by optional buffers, for getMemoryUsage
+            std::atomic<size_t> memTriggered;
+            std::atomic<size_t> memAreaScan;
+            std::atomic<size_t> memFlightRecorder;
+
+            friend class TriggeredAcquisition;
+            friend class AsyncControl;
 
             Logger& logger;
 
@@ -164,22 +529,64 @@ namespace WasatchVCPP
         private:
             // initialization
             bool readEEPROM();
+            void applyEEPROM();
+            void computeAxes();
+            Settings getStartupSettings();
+            size_t getMemoryUsed();
+            int fitMemoryBudget(const char* feature, size_t fixed, size_t perUnit, int requested, size_t replacing, size_t memoryUsed);
 
             // acquisition 
-            std::vector<uint16_t> getSubspectrum(uint8_t ep, long allocatedMS);
+            void readEndpointTable();
+            void configureBulkReads();
+            void releaseBulkReads();
+            bool readSubspectra(long allocatedMS);
+            bool configureAreaScanReads();
+            void releaseAreaScanReads();
+            bool acquireAreaScanFrame(int timeoutMS);
+            bool readAreaScanRows(int timeoutMS);
+            bool readSubspectrum(int e, long allocatedMS);
+            template <typename T> bool acquireSpectrum(T* spectrum, uint32_t& generation);
+            template <typename T> bool acquireFreshSpectrum(T* spectrum, uint32_t& generation);
+            bool readSpectrumAs(SpectrumFormat::Format format, void* spectrum, int len, double scale, uint32_t* generation);
+            void demarshal(const uint8_t* in, double* out) { Kernels::demarshal(in, out, pixelsPerEndpoint); }
+            void demarshal(const uint8_t* in, uint16_t* out) { Kernels::demarshalRaw(in, out, pixelsPerEndpoint); }
+            bool beginAcquisition();
+            bool isCancelling() const { return acquisitionState == AcquisitionState::Cancelling; }
+            void endCancel();
+            bool writeIntegrationTimeMS(unsigned long ms, CommandPriority priority = CommandPriority::Normal);
             long generateTotalWaitMS();
 
+            // throwaways
+            void bumpSettingsGeneration();
+            void cacheLaserPowerPerc(float percent);
+            bool noteFrame(uint32_t generation);
+            bool needsThrowaway();
+            void runThrowaways();
+            void stopThrowaways();
+            void recordFrame(const double* spectrum, const uint8_t* raw, int len, uint32_t generation);
+
             // control messages
-            int sendCmd(uint8_t bRequest, uint16_t wValue, uint16_t wIndex, std::vector<uint8_t> data);
-            std::vector<uint8_t> getCmd2(uint16_t wValue, int len, uint16_t wIndex=0, int fullLen=0);
-            std::vector<uint8_t> getCmdReal(uint8_t bRequest, uint16_t wValue, uint16_t wIndex, int len, int fullLen);
+            int sendCmd(uint8_t bRequest, uint16_t wValue, uint16_t wIndex, std::vector<uint8_t> data, 
+                CommandPriority priority = CommandPriority::Normal);
+            int sendCmdLocked(uint8_t bRequest, uint16_t wValue, uint16_t wIndex, uint8_t* data, int len);
+            std::vector<uint8_t> getCmd2(uint16_t wValue, int len, uint16_t wIndex=0, int fullLen=0, 
+                CommandPriority priority = CommandPriority::Normal);
+            std::vector<uint8_t> getCmdReal(uint8_t bRequest, uint16_t wValue, uint16_t wIndex, int len, int fullLen,
+                CommandPriority priority = CommandPriority::Normal);
+            int readControl(uint8_t bRequest, uint16_t wValue, uint16_t wIndex, std::vector<uint8_t>& data, int len,
+                CommandPriority priority = CommandPriority::Normal);
 
             // utility
             bool isSuccess(unsigned char opcode, int result);
             uint16_t serializeGain(float value);
             float deserializeGain(const std::vector<uint8_t>& data);
             inline unsigned long clamp(unsigned long value, unsigned long min, unsigned long max);
-            bool lockComm();
-            void unlockComm();
+            bool lockComm(CommandPriority priority = CommandPriority::Normal);
+            bool tryLockComm(CommandPriority priority, std::chrono::steady_clock::time_point requested);
+            void recordCommLatency(CommandPriority priority, std::chrono::steady_clock::time_point requested);
+            void unlockComm(bool resumeAsync = true);
+            uint64_t beginLaserCommand(bool flag);
+            bool isLaserCommandCurrent(uint64_t sequence, bool flag);
+            void recordLaserEnable(uint64_t sequence, bool flag);
     };
 }
@@ -0,0 +1,285 @@
+/**
+    @file   SpectrumFormat.cpp
+    @author Mark Zieg <mzieg@wasatchphotonics.com>
+    @brief  implementation of WasatchVCPP::SpectrumFormat
+    @note   customers normally wouldn't access this file; use WasatchVCPP.h instead
+*/
+
+#include "pch.h"
+#include "SpectrumFormat.h"
+
+#include <cstring>
+
+#include "SIMD.h"
+
+// F16C intrinsics, and the CPUID query that detects them at runtime
+#if WPVCPP_SSE2
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+//! largest finite binary16 value
+const float HALF_MAX = 65504.f;
+
+static uint32_t floatBits(float f)
+{
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+static float bitsFloat(uint32_t u)
+{
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Half-precision kernels
+////////////////////////////////////////////////////////////////////////////////
+
+#if WPVCPP_SSE2
+
+//! whether the CPU (and OS) support F16C and the AVX registers it uses
+static bool detectF16C()
+{
+    unsigned ecx = 0;
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    ecx = (unsigned)info[2];
+#else
+    unsigned eax, ebx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return false;
+#endif
+
+    const unsigned OSXSAVE = 1u << 27, AVX = 1u << 28, F16C = 1u << 29;
+    if ((ecx & (OSXSAVE | AVX | F16C)) != (OSXSAVE | AVX | F16C))
+        return false;
+
+    // has the OS enabled saving the YMM registers?
+#ifdef _MSC_VER
+    unsigned long long xcr0 = _xgetbv(0);
+#else
+    unsigned lo, hi;
+    __asm__ volatile ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    unsigned long long xcr0 = ((unsigned long long)hi << 32) | lo;
+#endif
+    return (xcr0 & 6) == 6;
+}
+
+static const bool hasF16C = detectF16C();
+
+#ifndef _MSC_VER
+__attribute__((target("avx,f16c")))
+#endif
+static int toFloat16F16C(const double* in, uint16_t* out, int n)
+{
+    const __m256 hi = _mm256_set1_ps(HALF_MAX);
+    const __m256 lo = _mm256_set1_ps(-HALF_MAX);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128 a = _mm256_cvtpd_ps(_mm256_loadu_pd(in + i));
+        __m128 b = _mm256_cvtpd_ps(_mm256_loadu_pd(in + i + 4));
+        __m256 f = _mm256_insertf128_ps(_mm256_castps128_ps256(a), b, 1);
+        f = _mm256_max_ps(_mm256_min_ps(f, hi), lo);
+        _mm_storeu_si128((__m128i*)(out + i), _mm256_cvtps_ph(f, _MM_FROUND_TO_NEAREST_INT));
+    }
+    return i;
+}
+
+#elif WPVCPP_NEON
+
+static int toFloat16Neon(const double* in, uint16_t* out, int n)
+{
+    const float32x4_t hi = vdupq_n_f32(HALF_MAX);
+    const float32x4_t lo = vdupq_n_f32(-HALF_MAX);
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        float32x4_t f = vcombine_f32(vcvt_f32_f64(vld1q_f64(in + i)), vcvt_f32_f64(vld1q_f64(in + i + 2)));
+        f = vmaxq_f32(vminq_f32(f, hi), lo);
+        vst1_u16(out + i, vreinterpret_u16_f16(vcvt_f16_f32(f)));
+    }
+    return i;
+}
+
+#endif
+
+//! Round-to-nearest-even binary32 to binary16, saturating finite values at
+//! +/-65504 (NaN stays NaN).
+uint16_t WasatchVCPP::SpectrumFormat::floatToHalf(float f)
+{
+    if (f > HALF_MAX)
+        f = HALF_MAX;
+    else if (f < -HALF_MAX)
+        f = -HALF_MAX;
+
+    uint32_t u = floatBits(f);
+    uint16_t sign = (uint16_t)((u >> 16) & 0x8000);
+    u &= 0x7fffffff;
+
+    if (u > 0x7f800000)
+        return sign | 0x7e00;                   // NaN
+
+    if (u < (113u << 23))
+    {
+        // subnormal (or zero) result: let the FPU do the rounding, by adding
+        // a constant which aligns the half's LSB with the float's
+        const uint32_t magic = ((127 - 15) + (23 - 10) + 1) << 23;
+        return sign | (uint16_t)(floatBits(bitsFloat(u) + bitsFloat(magic)) - magic);
+    }
+
+    // normal: rebias the exponent and round the mantissa to 10 bits
+    uint32_t odd = (u >> 13) & 1;
+    u += ((uint32_t)(15 - 127) << 23) + 0xfff + odd;
+    return sign | (uint16_t)(u >> 13);
+}
+
+float WasatchVCPP::SpectrumFormat::halfToFloat(uint16_t h)
+{
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1f;
+    uint32_t mantissa = h & 0x3ff;
+
+    if (exponent == 0)
+        return bitsFloat(sign | floatBits(mantissa * (1.f / 16777216.f)));    // subnormal: mantissa * 2^-24
+    if (exponent == 31)
+        return bitsFloat(sign | 0x7f800000 | (mantissa << 13));
+    return bitsFloat(sign | ((exponent + 127 - 15) << 23) | (mantissa << 13));
+}
+
+//! @returns which half-precision kernel toFloat16 uses on this host
+const char* WasatchVCPP::SpectrumFormat::getFloat16Kernel()
+{
+#if WPVCPP_SSE2
+    return hasF16C ? "F16C" : "scalar";
+#elif WPVCPP_NEON
+    return "NEON";
+#else
+    return "scalar";
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Conversions
+////////////////////////////////////////////////////////////////////////////////
+
+size_t WasatchVCPP::SpectrumFormat::getElementSize(Format format)
+{
+    switch (format)
+    {
+        case Double:    return sizeof(double);
+        case Float:     return sizeof(float);
+        case Float16:   return sizeof(uint16_t);
+        case BFloat16:  return sizeof(uint16_t);
+        case Int32:     return sizeof(int32_t);
+    }
+    return 0;
+}
+
+//! Convert 'n' intensities to 'format'.
+//!
+//! @param scale (Input) multiplier applied before rounding (Int32 only)
+//! @returns false for an unknown format
+bool WasatchVCPP::SpectrumFormat::convert(Format format, const double* in, void* out, int n, double scale)
+{
+    switch (format)
+    {
+        case Double:    memcpy(out, in, n * sizeof(double)); return true;
+        case Float:     toFloat(in, (float*)out, n); return true;
+        case Float16:   toFloat16(in, (uint16_t*)out, n); return true;
+        case BFloat16:  toBFloat16(in, (uint16_t*)out, n); return true;
+        case Int32:     toInt32(in, (int32_t*)out, n, scale); return true;
+    }
+    return false;
+}
+
+void WasatchVCPP::SpectrumFormat::toFloat(const double* in, float* out, int n)
+{
+    for (int i = 0; i < n; i++)
+        out[i] = (float)in[i];
+}
+
+void WasatchVCPP::SpectrumFormat::toFloat16(const double* in, uint16_t* out, int n)
+{
+    int i = 0;
+#if WPVCPP_SSE2
+    if (hasF16C)
+        i = toFloat16F16C(in, out, n);
+#elif WPVCPP_NEON
+    i = toFloat16Neon(in, out, n);
+#endif
+    for (; i < n; i++)
+        out[i] = floatToHalf((float)in[i]);
+}
+
+//! Round-to-nearest-even to the upper 16 bits of binary32.  bfloat16 covers
+//! the full float range, so nothing saturates; with 8 significant bits,
+//! counts above 256 are rounded to a multiple of a power of two.
+void WasatchVCPP::SpectrumFormat::toBFloat16(const double* in, uint16_t* out, int n)
+{
+    int i = 0;
+#if WPVCPP_SSE2
+    // SSE2 (baseline on x86-64) packs signed, so shift arithmetically to
+    // keep the upper halves within int16 and their bits intact
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i bias = _mm_set1_epi32(0x7fff);
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 f = _mm_movelh_ps(_mm_cvtpd_ps(_mm_loadu_pd(in + i)), _mm_cvtpd_ps(_mm_loadu_pd(in + i + 2)));
+        __m128i u = _mm_castps_si128(f);
+        u = _mm_add_epi32(u, _mm_add_epi32(bias, _mm_and_si128(_mm_srli_epi32(u, 16), one)));
+        _mm_storel_epi64((__m128i*)(out + i), _mm_packs_epi32(_mm_srai_epi32(u, 16), _mm_setzero_si128()));
+    }
+#endif
+    for (; i < n; i++)
+    {
+        uint32_t u = floatBits((float)in[i]);
+        out[i] = (uint16_t)((u + 0x7fff + ((u >> 16) & 1)) >> 16);
+    }
+}
+
+//! Round half away from zero, saturating at the int32 limits (NaN converts
+//! to 0).
+void WasatchVCPP::SpectrumFormat::toInt32(const double* in, int32_t* out, int n, double scale)
+{
+    const double hi = 2147483647.0;
+    const double lo = -2147483648.0;
+    int i = 0;
+#if WPVCPP_SSE2
+    const __m128d vScale = _mm_set1_pd(scale);
+    const __m128d vHi = _mm_set1_pd(hi);
+    const __m128d vLo = _mm_set1_pd(lo);
+    const __m128d half = _mm_set1_pd(0.5);
+    const __m128d signMask = _mm_set1_pd(-0.0);
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128d a = _mm_mul_pd(_mm_loadu_pd(in + i), vScale);
+        __m128d b = _mm_mul_pd(_mm_loadu_pd(in + i + 2), vScale);
+        a = _mm_and_pd(a, _mm_cmpord_pd(a, a));
+        b = _mm_and_pd(b, _mm_cmpord_pd(b, b));
+        a = _mm_add_pd(a, _mm_or_pd(half, _mm_and_pd(a, signMask)));
+        b = _mm_add_pd(b, _mm_or_pd(half, _mm_and_pd(b, signMask)));
+        a = _mm_max_pd(_mm_min_pd(a, vHi), vLo);
+        b = _mm_max_pd(_mm_min_pd(b, vHi), vLo);
+        _mm_storeu_si128((__m128i*)(out + i), _mm_unpacklo_epi64(_mm_cvttpd_epi32(a), _mm_cvttpd_epi32(b)));
+    }
+#endif
+    for (; i < n; i++)
+    {
+        double v = in[i] * scale;
+        if (v != v)
+            v = 0;
+        v = v < 0 ? v - 0.5 : v + 0.5;
+        v = v > hi ? hi : (v < lo ? lo : v);
+        out[i] = (int32_t)v;
+    }
+}
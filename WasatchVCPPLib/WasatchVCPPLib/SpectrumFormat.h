@@ -0,0 +1,48 @@
+/**
+    @file   SpectrumFormat.h
+    @author Mark Zieg <mzieg@wasatchphotonics.com>
+    @brief  interface of WasatchVCPP::SpectrumFormat
+    @note   customers normally wouldn't access this file; use WasatchVCPP.h instead
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace WasatchVCPP
+{
+    //! Internal class converting spectra to the output formats offered by the
+    //! C API, so callers wanting compact spectra don't make their own pass
+    //! over a buffer of doubles.
+    //!
+    //! Half-precision conversion uses F16C (x86, detected at runtime) or NEON
+    //! (AArch64) where available, with a bit-exact scalar fallback.  bfloat16
+    //! and int32 use SSE2 on x86, which every x86-64 CPU has.
+    //! Detector counts are integers up to 65535, so they convert to float
+    //! exactly, and then to half precision with a single rounding.
+    class SpectrumFormat
+    {
+        public:
+            enum Format
+            {
+                Double,     //!< as read
+                Float,
+                Float16,    //!< IEEE 754 binary16, saturating at +/-65504
+                BFloat16,   //!< bfloat16 (truncated binary32 exponent range)
+                Int32       //!< counts * scale, rounded and saturated
+            };
+
+            static size_t getElementSize(Format format);
+            static bool convert(Format format, const double* in, void* out, int n, double scale = 1);
+
+            static void toFloat(const double* in, float* out, int n);
+            static void toFloat16(const double* in, uint16_t* out, int n);
+            static void toBFloat16(const double* in, uint16_t* out, int n);
+            static void toInt32(const double* in, int32_t* out, int n, double scale);
+
+            static uint16_t floatToHalf(float f);
+            static float halfToFloat(uint16_t h);
+            static const char* getFloat16Kernel();
+    };
+}
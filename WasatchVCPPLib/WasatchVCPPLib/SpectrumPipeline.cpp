@@ -0,0 +1,209 @@
+/**
+    @file   SpectrumPipeline.cpp
+    @author Mark Zieg <mzieg@wasatchphotonics.com>
+    @brief  implementation of WasatchVCPP::SpectrumPipeline
+    @note   customers normally wouldn't access this file; use WasatchVCPP.h instead
+*/
+
+#include "pch.h"
+#include "SpectrumPipeline.h"
+
+#include <algorithm>
+#include <cmath>
+
+using std::vector;
+
+//! largest raw count
+const int32_t MAX_COUNT = 65535;
+
+WasatchVCPP::SpectrumPipeline::SpectrumPipeline(Logger& logger)
+    : logger(logger)
+{
+    // where double arithmetic is likely to be emulated or slow
+#if defined(__arm__) || defined(_M_ARM)
+    fixedPoint = true;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Configuration
+////////////////////////////////////////////////////////////////////////////////
+
+bool WasatchVCPP::SpectrumPipeline::setScansToAverage(int scans)
+{
+    if (scans < 1 || scans > MaxScans)
+    {
+        logger.error("SpectrumPipeline: scansToAverage must be 1 to %d (not %d)", MaxScans, scans);
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mut);
+    scansToAverage = scans;
+    return true;
+}
+
+int WasatchVCPP::SpectrumPipeline::getScansToAverage()
+{
+    std::lock_guard<std::mutex> lock(mut);
+    return scansToAverage;
+}
+
+//! @param dark (Input) per-pixel dark in counts (nullptr to disable);
+//!             clamped to the raw range of 0-65535
+bool WasatchVCPP::SpectrumPipeline::setDark(const double* dark, int len)
+{
+    std::lock_guard<std::mutex> lock(mut);
+    this->dark.clear();
+    darkSum.clear();
+    darkSumScans = 0;
+    if (dark == nullptr || len <= 0)
+        return true;
+
+    this->dark.resize(len);
+    for (int i = 0; i < len; i++)
+        this->dark[i] = std::min((double)MAX_COUNT, std::max(0.0, dark[i]));
+    return true;
+}
+
+//! @param gain (Input) per-pixel multiplier (nullptr to disable); the fixed-
+//!             point path can't represent magnitudes above MaxGain
+bool WasatchVCPP::SpectrumPipeline::setGain(const double* gain, int len)
+{
+    vector<double> factors;
+    vector<int32_t> factorsQ;
+    if (gain != nullptr && len > 0)
+    {
+        for (int i = 0; i < len; i++)
+        {
+            if (!std::isfinite(gain[i]) || std::fabs(gain[i]) > MaxGain)
+            {
+                logger.error("SpectrumPipeline: gain[%d] %g out of range (+/-%d)", i, gain[i], MaxGain);
+                return false;
+            }
+        }
+        factors.assign(gain, gain + len);
+        factorsQ.resize(len);
+        for (int i = 0; i < len; i++)
+            factorsQ[i] = (int32_t)std::floor(gain[i] * (1 << GainBits) + 0.5);
+    }
+
+    std::lock_guard<std::mutex> lock(mut);
+    this->gain.swap(factors);
+    gainQ.swap(factorsQ);
+    return true;
+}
+
+void WasatchVCPP::SpectrumPipeline::setFixedPoint(bool flag)
+{
+    std::lock_guard<std::mutex> lock(mut);
+    fixedPoint = flag;
+}
+
+bool WasatchVCPP::SpectrumPipeline::getFixedPoint()
+{
+    std::lock_guard<std::mutex> lock(mut);
+    return fixedPoint;
+}
+
+size_t WasatchVCPP::SpectrumPipeline::getMemoryBytes()
+{
+    std::lock_guard<std::mutex> lock(mut);
+    return (dark.capacity() + gain.capacity()) * sizeof(double)
+         + (gainQ.capacity() + darkSum.capacity()) * sizeof(int32_t);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Processing
+////////////////////////////////////////////////////////////////////////////////
+
+//! Average, dark-correct and gain-correct accumulated sums.
+//!
+//! @param sums   (Input)  per-pixel totals of 'scans' frames
+//! @param out    (Output) 'pixels' corrected intensities
+//! @returns false if the dark or gain doesn't cover 'pixels'
+bool WasatchVCPP::SpectrumPipeline::finish(const uint32_t* sums, int scans, float* out, int pixels)
+{
+    std::lock_guard<std::mutex> lock(mut);
+    if ((!dark.empty() && (int)dark.size() < pixels) || (!gain.empty() && (int)gain.size() < pixels))
+    {
+        logger.error("SpectrumPipeline: dark (%d) or gain (%d) shorter than spectrum (%d)",
+            (int)dark.size(), (int)gain.size(), pixels);
+        return false;
+    }
+    if (scans < 1 || scans > MaxScans)
+        return false;
+
+    if (fixedPoint)
+        finishFixed(sums, scans, out, pixels);
+    else
+        finishDouble(sums, scans, out, pixels);
+    return true;
+}
+
+void WasatchVCPP::SpectrumPipeline::finishDouble(const uint32_t* sums, int scans, float* out, int pixels)
+{
+    for (int i = 0; i < pixels; i++)
+    {
+        double value = (double)sums[i] / scans;
+        if (!dark.empty())
+            value -= dark[i];
+        if (!gain.empty())
+            value *= gain[i];
+        out[i] = (float)value;
+    }
+}
+
+//! The largest left shift which keeps 'scans' full-scale sums within int32,
+//! so the dark is subtracted with as many fractional bits as possible.
+int WasatchVCPP::SpectrumPipeline::getShift(int scans)
+{
+    int shift = 0;
+    while (((uint64_t)MAX_COUNT * scans << (shift + 1)) <= (uint64_t)INT32_MAX)
+        shift++;
+    return shift;
+}
+
+//! Recomputed only when the dark or scan count changes.
+void WasatchVCPP::SpectrumPipeline::computeDarkSum(int scans)
+{
+    darkShift = getShift(scans);
+    darkSum.resize(dark.size());
+    double scale = (double)scans * ((int64_t)1 << darkShift);
+    for (size_t i = 0; i < dark.size(); i++)
+        darkSum[i] = (int32_t)std::floor(dark[i] * scale + 0.5);
+    darkSumScans = scans;
+}
+
+void WasatchVCPP::SpectrumPipeline::finishFixed(const uint32_t* sums, int scans, float* out, int pixels)
+{
+    if (darkSumScans != scans)
+        computeDarkSum(scans);
+
+    const int shift = darkShift;
+    const int32_t* darks = darkSum.empty() ? nullptr : &darkSum[0];
+    const int32_t* gains = gainQ.empty() ? nullptr : &gainQ[0];
+
+    // (sum << shift) - dark fits int32; with a Q7.24 gain the product needs
+    // 64 bits, which 32-bit ARM does in one multiply
+    if (gains == nullptr)
+    {
+        const float k = 1.f / ((float)scans * ((int64_t)1 << shift));
+        for (int i = 0; i < pixels; i++)
+        {
+            int32_t value = (int32_t)(sums[i] << shift);
+            if (darks != nullptr)
+                value -= darks[i];
+            out[i] = (float)value * k;
+        }
+    }
+    else
+    {
+        const float k = 1.f / ((float)scans * ((int64_t)1 << shift) * (1 << GainBits));
+        for (int i = 0; i < pixels; i++)
+        {
+            int32_t value = (int32_t)(sums[i] << shift);
+            if (darks != nullptr)
+                value -= darks[i];
+            out[i] = (float)((int64_t)value * gains[i]) * k;
+        }
+    }
+}
@@ -0,0 +1,81 @@
+/**
+    @file   SpectrumPipeline.h
+    @author Mark Zieg <mzieg@wasatchphotonics.com>
+    @brief  interface of WasatchVCPP::SpectrumPipeline
+    @note   customers normally wouldn't access this file; use WasatchVCPP.h instead
+*/
+
+#pragma once
+
+#include "Logger.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace WasatchVCPP
+{
+    //! Internal class averaging, dark-subtracting and gain-correcting spectra
+    //! for wp_get_processed_spectrum.
+    //!
+    //! Scans are summed by the caller as raw counts into uint32 accumulators
+    //! (@see Kernels::accumulate).  At the end, either path subtracts the 
+    //! dark and applies the per-pixel gain, and produces floats:
+    //!
+    //! - the double path computes (sum / scans - dark) * gain in double
+    //! - the fixed-point path does the same in integers (an int32 dark sum
+    //!   carrying as many fractional bits as the scan count leaves room for,
+    //!   Q7.24 gains and a 64-bit product), converting to float only for
+    //!   the result
+    //!
+    //! The fixed-point path is for targets where double arithmetic is slow
+    //! or emulated (it's the default on 32-bit ARM).  Its results differ from
+    //! the double path's by at most
+    //!
+    //!     2^-15 * |gain| + 2^-25 * |mean - dark| + 2^-22 * |result|
+    //!
+    //! from rounding the dark, the gain and the final conversion: under 0.01
+    //! count plus a few parts in 10^7 of the result.
+    class SpectrumPipeline
+    {
+        public:
+            static const int MaxScans = 32768;  //!< keeps sum - dark within int32
+            static const int GainBits = 24;     //!< fractional bits of fixed-point gains
+            static const int MaxGain = 127;     //!< largest fixed-point gain magnitude
+
+            SpectrumPipeline(Logger& logger);
+
+            bool setScansToAverage(int scans);
+            int getScansToAverage();
+            bool setDark(const double* dark, int len);
+            bool setGain(const double* gain, int len);
+            void setFixedPoint(bool flag);
+            bool getFixedPoint();
+
+            bool finish(const uint32_t* sums, int scans, float* out, int pixels);
+
+            size_t getMemoryBytes();
+
+        private:
+            Logger& logger;
+            std::mutex mut;
+
+            int scansToAverage = 1;
+            bool fixedPoint = false;
+
+            std::vector<double> dark;       //!< empty if none
+            std::vector<double> gain;       //!< empty if none
+            std::vector<int32_t> gainQ;     //!< 'gain' in Q7.24
+
+            //! dark * scans << darkShift, for the scan count last finished
+            std::vector<int32_t> darkSum;
+            int darkSumScans = 0;
+            int darkShift = 0;
+
+            static int getShift(int scans);
+            void computeDarkSum(int scans);
+            void finishDouble(const uint32_t* sums, int scans, float* out, int pixels);
+            void finishFixed(const uint32_t* sums, int scans, float* out, int pixels);
+    };
+}
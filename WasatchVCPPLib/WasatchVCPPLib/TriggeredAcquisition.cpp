@@ -0,0 +1,481 @@
+/**
+    @file   TriggeredAcquisition.cpp
+    @author Mark Zieg <mzieg@wasatchphotonics.com>
+    @brief  implementation of WasatchVCPP::TriggeredAcquisition
+    @note   customers normally wouldn't access this file; use WasatchVCPP.h instead
+*/
+
+#include "pch.h"
+#include "TriggeredAcquisition.h"
+#include "Spectrometer.h"
+
+#include <algorithm>
+
+using std::vector;
+using std::unique_lock;
+using std::mutex;
+
+typedef WasatchVCPP::TriggeredAcquisition::Clock Clock;
+
+//! how long the worker waits on a queued read before re-checking for stop()
+const int POLL_MS = 100;
+
+static double elapsedMS(Clock::time_point from, Clock::time_point to)
+{ return std::chrono::duration<double, std::milli>(to - from).count(); }
+
+////////////////////////////////////////////////////////////////////////////////
+// Lifecycle
+////////////////////////////////////////////////////////////////////////////////
+
+//! acquire from a real spectrometer
+WasatchVCPP::TriggeredAcquisition::TriggeredAcquisition(Spectrometer& spec, Logger& logger, int transfersPerEndpoint, int maxFrames)
+    : spec(&spec), deadband(&spec.deadband), logger(logger), transfersPerEndpoint(std::max(1, transfersPerEndpoint)), maxFrames(std::max(1, maxFrames)), running(false)
+{
+}
+
+//! acquire from a simulated device emitting a frame every periodUS
+WasatchVCPP::TriggeredAcquisition::TriggeredAcquisition(int pixels, int periodUS, Logger& logger, int maxFrames, Deadband* deadband)
+    : deadband(deadband), logger(logger), maxFrames(std::max(1, maxFrames)), simulatedPixels(pixels), simulatedPeriodUS(std::max(1, periodUS)), running(false)
+{
+}
+
+WasatchVCPP::TriggeredAcquisition::~TriggeredAcquisition()
+{
+    stop();
+}
+
+//! heap held when running with a full queue: the queued bulk transfers, plus
+//! the buffered frames
+size_t WasatchVCPP::TriggeredAcquisition::getMemoryBytes(int pixels, int endpoints, int transfersPerEndpoint, int maxFrames)
+{
+    size_t transfers = (size_t)endpoints * transfersPerEndpoint * (pixels / std::max(1, endpoints)) * 2;
+    size_t queue = (size_t)maxFrames * (sizeof(Frame) + pixels * sizeof(double));
+    return sizeof(TriggeredAcquisition) + transfers + queue + pixels * 2;
+}
+
+//! Draw the ring (and the frame being assembled) from the spectrometer's 
+//! frame pool, or the heap for any the pool can't supply.
+void WasatchVCPP::TriggeredAcquisition::allocate()
+{
+    pixels = spec != nullptr ? spec->pixels : simulatedPixels;
+    auto pool = spec != nullptr ? spec->getFramePool() : nullptr;
+
+    ring.resize(maxFrames);
+    int pooled = 0;
+    for (auto& slot : ring)
+    {
+        slot.spectrum.reset(new PooledFrame(pool, pixels));
+        pooled += slot.spectrum->isPooled();
+    }
+    working.reset(new PooledFrame(pool, pixels));
+    pooled += working->isPooled();
+    if (spec != nullptr)
+        raw.resize(pixels * 2);
+
+    if (pool != nullptr && pooled < maxFrames + 1)
+        logger.error("TriggeredAcquisition: frame pool supplied %d of %d frames (the rest are on the heap)", pooled, maxFrames + 1);
+}
+
+bool WasatchVCPP::TriggeredAcquisition::start()
+{
+    if (running)
+        return false;
+
+    if (ring.empty())
+        allocate();
+
+    {
+        std::lock_guard<mutex> lock(mut);
+        head = count = 0;
+        triggers.clear();
+        stats = Stats();
+    }
+    nextFrameId = 0;
+    if (deadband != nullptr)
+        deadband->reset();
+    startTime = Clock::now();
+    running = true;
+
+    if (spec == nullptr)
+        worker = std::thread(&TriggeredAcquisition::runSimulated, this);
+    else
+        worker = std::thread(&TriggeredAcquisition::runUSB, this);
+
+    logger.debug("TriggeredAcquisition::start: started (%s)", spec ? "USB" : "simulated");
+    return true;
+}
+
+//! Blocks until the worker thread has cancelled its queued reads and exited.
+//! Buffered frames remain available to read().
+void WasatchVCPP::TriggeredAcquisition::stop()
+{
+    running = false;
+    cv.notify_all();
+    if (worker.joinable())
+        worker.join();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Consumer
+////////////////////////////////////////////////////////////////////////////////
+
+//! Collect buffered frames, oldest first.
+//!
+//! @param frames    (Output) frames read (replaced)
+//! @param maxFrames (Input)  most frames to return
+//! @param timeoutMS (Input)  how long to wait if no frames are yet buffered
+//! @returns number of frames read
+int WasatchVCPP::TriggeredAcquisition::read(vector<Frame>& out, int maxFramesOut, int timeoutMS)
+{
+    out.clear();
+    unique_lock<mutex> lock(mut);
+    if (count == 0 && timeoutMS > 0)
+        cv.wait_for(lock, std::chrono::milliseconds(timeoutMS), [this] { return count > 0 || !running; });
+
+    while (count > 0 && (int)out.size() < maxFramesOut)
+    {
+        Slot& slot = ring[head];
+        out.push_back(slot.frame);
+        out.back().spectrum.assign(slot.spectrum->data(), slot.spectrum->data() + pixels);
+        head = (head + 1) % maxFrames;
+        count--;
+    }
+    return (int)out.size();
+}
+
+//! Record when the application fired an external trigger, so the resulting
+//! frame's trigger-to-data latency can be reported.  Triggers are matched to
+//! frames in order.
+void WasatchVCPP::TriggeredAcquisition::markTrigger(Clock::time_point when)
+{
+    std::lock_guard<mutex> lock(mut);
+    triggers.push_back(when);
+
+    // don't accumulate marks indefinitely if frames aren't arriving
+    while ((int)triggers.size() > maxFrames)
+        triggers.pop_front();
+}
+
+WasatchVCPP::TriggeredAcquisition::Stats WasatchVCPP::TriggeredAcquisition::getStats()
+{
+    std::lock_guard<mutex> lock(mut);
+    return stats;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Producer
+////////////////////////////////////////////////////////////////////////////////
+
+//! timestamp the completed frame in 'working' and add it to the buffer 
+//! (dropping the oldest if the consumer has fallen behind), unless it's 
+//! within the deadband
+//!
+//! @param pageFaults (Input) value of FramePool::getThreadPageFaults when 
+//!                   the frame was started
+void WasatchVCPP::TriggeredAcquisition::publish(Frame& frame, int64_t pageFaults)
+{
+    if (spec != nullptr)
+        frame.settingsGeneration = spec->settingsGeneration;
+    if (deadband != nullptr && !deadband->accept(working->data(), pixels, frame.settingsGeneration, frame.arrival))
+    {
+        suppressFrame(frame);
+        return;
+    }
+
+    std::lock_guard<mutex> lock(mut);
+
+    frame.frameId = nextFrameId++;
+    if (spec != nullptr)
+        spec->recordFrame(working->data(), &raw[0], pixels, frame.settingsGeneration);
+    if (!frame.hasTrigger && !triggers.empty())
+    {
+        frame.trigger = triggers.front();
+        frame.hasTrigger = true;
+        triggers.pop_front();
+    }
+
+    if (frame.hasTrigger)
+    {
+        frame.latencyMS = elapsedMS(frame.trigger, frame.arrival);
+
+        double n = (double)++stats.latencyCount;
+        stats.lastLatencyMS = frame.latencyMS;
+        stats.avgLatencyMS += (frame.latencyMS - stats.avgLatencyMS) / n;
+        if (n == 1 || frame.latencyMS < stats.minLatencyMS)
+            stats.minLatencyMS = frame.latencyMS;
+        if (n == 1 || frame.latencyMS > stats.maxLatencyMS)
+            stats.maxLatencyMS = frame.latencyMS;
+    }
+
+    stats.framesReceived++;
+    if (count >= maxFrames)
+    {
+        head = (head + 1) % maxFrames;
+        count--;
+        stats.framesDropped++;
+    }
+
+    // the frame's spectrum trades places with the slot's
+    Slot& slot = ring[(head + count) % maxFrames];
+    slot.frame = frame;
+    slot.spectrum.swap(working);
+    count++;
+
+    if (slot.spectrum->isPooled())
+        slot.spectrum->getPool()->addPageFaults(FramePool::getThreadPageFaults() - pageFaults);
+    cv.notify_all();
+}
+
+void WasatchVCPP::TriggeredAcquisition::dropFrame()
+{
+    std::lock_guard<mutex> lock(mut);
+    nextFrameId++;
+    stats.framesDropped++;
+    if (!triggers.empty())
+        triggers.pop_front();
+}
+
+//! a complete frame which didn't change enough to deliver; its trigger (if
+//! marked) is consumed, so later frames still pair with theirs
+void WasatchVCPP::TriggeredAcquisition::suppressFrame(const Frame& frame)
+{
+    std::lock_guard<mutex> lock(mut);
+    nextFrameId++;
+    stats.framesReceived++;
+    stats.framesSuppressed++;
+    if (!frame.hasTrigger && !triggers.empty())
+        triggers.pop_front();
+}
+
+//! Emit a synthetic frame every simulatedPeriodUS.  Pixel values are a
+//! function of pixel and frame number, so tests can check frame ordering.
+void WasatchVCPP::TriggeredAcquisition::runSimulated()
+{
+    auto period = std::chrono::microseconds(simulatedPeriodUS);
+    auto tick = startTime;
+    uint64_t frameCount = 0;
+    while (running)
+    {
+        tick += period;
+        std::this_thread::sleep_until(tick);
+        if (!running)
+            break;
+
+        auto faults = FramePool::getThreadPageFaults();
+        Frame frame;
+        frame.trigger = tick;
+        frame.hasTrigger = true;
+        double* spectrum = working->data();
+        for (int i = 0; i < simulatedPixels; i++)
+            spectrum[i] = (double)((frameCount + i) & 0xffff);
+        frame.arrival = Clock::now();
+        publish(frame, faults);
+        frameCount++;
+    }
+}
+
+#if USE_LIBUSB_WIN32
+
+//! Keep transfersPerEndpoint asynchronous reads submitted on each endpoint;
+//! reap the oldest of each in turn to assemble a frame, then resubmit it.
+void WasatchVCPP::TriggeredAcquisition::runUSB()
+{
+    const int LIBUSB_WIN32_ERROR_TIMEOUT = -116;
+
+    const int bytesPerEndpoint = spec->pixelsPerEndpoint * 2;
+    const int endpointCount = (int)spec->endpoints.size();
+
+    vector<vector<void*> > contexts(endpointCount, vector<void*>(transfersPerEndpoint, nullptr));
+    vector<vector<vector<uint8_t> > > bufs(endpointCount, vector<vector<uint8_t> >(transfersPerEndpoint, vector<uint8_t>(bytesPerEndpoint)));
+
+    bool ok = true;
+    for (int e = 0; e < endpointCount && ok; e++)
+        for (int t = 0; t < transfersPerEndpoint && ok; t++)
+            ok = usb_bulk_setup_async(spec->udev, &contexts[e][t], spec->endpoints[e]) >= 0
+              && usb_submit_async(contexts[e][t], (char*)&bufs[e][t][0], bytesPerEndpoint) >= 0;
+    if (!ok)
+    {
+        logger.error("TriggeredAcquisition: unable to queue bulk reads (%s)", usb_strerror());
+        running = false;
+    }
+
+    vector<int> next(endpointCount, 0);
+    while (running)
+    {
+        auto faults = FramePool::getThreadPageFaults();
+        Frame frame;
+        double* spectrum = working->data();
+        int pixelsRead = 0;
+        bool complete = true;
+        for (int e = 0; e < endpointCount && running; e++)
+        {
+            void* context = contexts[e][next[e]];
+            int bytesRead = LIBUSB_WIN32_ERROR_TIMEOUT;
+            while (running && (bytesRead = usb_reap_async_nocancel(context, POLL_MS)) == LIBUSB_WIN32_ERROR_TIMEOUT)
+                ;
+            if (!running)
+                break;
+
+            const uint8_t* buf = &bufs[e][next[e]][0];
+            if (bytesRead == bytesPerEndpoint)
+            {
+                std::copy(buf, buf + bytesPerEndpoint, &raw[pixelsRead * 2]);
+                spec->demarshal(buf, spectrum + pixelsRead);
+                pixelsRead += spec->pixelsPerEndpoint;
+            }
+            else
+            {
+                logger.error("TriggeredAcquisition: endpoint 0x%02x returned %d of %d bytes",
+                    spec->endpoints[e], bytesRead, bytesPerEndpoint);
+                complete = false;
+            }
+
+            usb_submit_async(context, (char*)&bufs[e][next[e]][0], bytesPerEndpoint);
+            next[e] = (next[e] + 1) % transfersPerEndpoint;
+        }
+        if (!running)
+            break;
+
+        frame.arrival = Clock::now();
+        if (complete)
+        {
+            spec->postProcessSpectrum(spectrum, pixelsRead);
+            publish(frame, faults);
+        }
+        else
+            dropFrame();
+    }
+
+    for (auto& row : contexts)
+        for (auto& context : row)
+            if (context != nullptr)
+            {
+                usb_cancel_async(context);
+                usb_free_async(&context);
+            }
+}
+
+#else
+
+//! libusb-1.0 completion callback; flags the transfer as reaped-able
+static void LIBUSB_CALL onTransferComplete(libusb_transfer* transfer)
+{ *(int*)transfer->user_data = 1; }
+
+//! Keep transfersPerEndpoint asynchronous reads submitted on each endpoint;
+//! wait on the oldest of each in turn to assemble a frame, then resubmit it.
+void WasatchVCPP::TriggeredAcquisition::runUSB()
+{
+    struct Transfer
+    {
+        libusb_transfer* xfer = nullptr;
+        vector<uint8_t> buf;
+        int completed = 0;
+        bool submitted = false;
+    };
+
+    const int bytesPerEndpoint = spec->pixelsPerEndpoint * 2;
+    const int endpointCount = (int)spec->endpoints.size();
+
+    // Transfer objects must not move once submitted, hence the fixed sizes
+    vector<vector<Transfer> > transfers(endpointCount, vector<Transfer>(transfersPerEndpoint));
+
+    bool ok = true;
+    for (int e = 0; e < endpointCount && ok; e++)
+        for (auto& t : transfers[e])
+        {
+            t.buf.resize(bytesPerEndpoint);
+            t.xfer = libusb_alloc_transfer(0);
+            if (t.xfer == nullptr)
+            {
+                ok = false;
+                break;
+            }
+
+            // timeout 0: reads remain queued until a triggered frame arrives
+            libusb_fill_bulk_transfer(t.xfer, spec->udev, spec->endpoints[e], &t.buf[0], bytesPerEndpoint,
+                onTransferComplete, &t.completed, 0);
+            int result = libusb_submit_transfer(t.xfer);
+            if (result != 0)
+            {
+                logger.error("TriggeredAcquisition: unable to queue bulk read (%s)", libusb_strerror(libusb_error(result)));
+                ok = false;
+                break;
+            }
+            t.submitted = true;
+        }
+    if (!ok)
+        running = false;
+
+    vector<int> next(endpointCount, 0);
+    while (running)
+    {
+        auto faults = FramePool::getThreadPageFaults();
+        Frame frame;
+        double* spectrum = working->data();
+        int pixelsRead = 0;
+        bool complete = true;
+        for (int e = 0; e < endpointCount && running; e++)
+        {
+            Transfer& t = transfers[e][next[e]];
+            while (running && !t.completed)
+            {
+                struct timeval tv = { 0, POLL_MS * 1000 };
+                libusb_handle_events_timeout_completed(nullptr, &tv, &t.completed);
+            }
+            if (!running)
+                break;
+
+            if (t.xfer->status == LIBUSB_TRANSFER_COMPLETED && t.xfer->actual_length == bytesPerEndpoint)
+            {
+                std::copy(t.buf.begin(), t.buf.end(), &raw[pixelsRead * 2]);
+                spec->demarshal(&t.buf[0], spectrum + pixelsRead);
+                pixelsRead += spec->pixelsPerEndpoint;
+            }
+            else
+            {
+                logger.error("TriggeredAcquisition: endpoint 0x%02x returned %d of %d bytes (status %d)",
+                    spec->endpoints[e], t.xfer->actual_length, bytesPerEndpoint, t.xfer->status);
+                complete = false;
+            }
+
+            t.completed = 0;
+            t.submitted = libusb_submit_transfer(t.xfer) == 0;
+            if (!t.submitted)
+            {
+                logger.error("TriggeredAcquisition: unable to re-queue bulk read on endpoint 0x%02x", spec->endpoints[e]);
+                running = false;
+            }
+            next[e] = (next[e] + 1) % transfersPerEndpoint;
+        }
+        if (!running)
+            break;
+
+        frame.arrival = Clock::now();
+        if (complete)
+        {
+            spec->postProcessSpectrum(spectrum, pixelsRead);
+            publish(frame, faults);
+        }
+        else
+            dropFrame();
+    }
+
+    // cancel anything still queued, and wait for the cancellations to land
+    for (auto& row : transfers)
+        for (auto& t : row)
+            if (t.submitted && !t.completed)
+                libusb_cancel_transfer(t.xfer);
+    for (auto& row : transfers)
+        for (auto& t : row)
+        {
+            while (t.submitted && !t.completed)
+            {
+                struct timeval tv = { 0, POLL_MS * 1000 };
+                libusb_handle_events_timeout_completed(nullptr, &tv, &t.completed);
+            }
+            if (t.xfer != nullptr)
+                libusb_free_transfer(t.xfer);
+        }
+}
+
+#endif
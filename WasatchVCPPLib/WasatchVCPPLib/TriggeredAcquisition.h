@@ -0,0 +1,133 @@
+/**
+    @file   TriggeredAcquisition.h
+    @author Mark Zieg <mzieg@wasatchphotonics.com>
+    @brief  interface of WasatchVCPP::TriggeredAcquisition
+    @note   customers normally wouldn't access this file; use WasatchVCPP.h instead
+*/
+
+#pragma once
+
+#include "Deadband.h"
+#include "FramePool.h"
+#include "Logger.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace WasatchVCPP
+{
+    class Spectrometer;
+
+    //! Internal class implementing hardware-triggered continuous acquisition.
+    //!
+    //! Once started, a background thread keeps several bulk reads queued on
+    //! each of the spectrometer's spectral endpoints, so frames are collected
+    //! as fast as external triggers arrive on the Gen 1.5 accessory connector,
+    //! with no per-frame control traffic.  Each frame is timestamped on arrival
+    //! and buffered until collected through read().  The buffer is a ring of
+    //! spectra drawn from the spectrometer's FramePool when started, so the
+    //! worker never allocates.
+    //!
+    //! If the Deadband is enabled, frames which barely differ from the last
+    //! one delivered are suppressed: they're neither buffered nor recorded,
+    //! though they still consume a frame ID.
+    //!
+    //! The spectrometer has no way to report when a trigger occurred, so
+    //! trigger-to-data latency is only known where the trigger time is: for
+    //! simulated frames, or where the application fires the trigger itself and
+    //! reports the time through markTrigger().
+    //!
+    //! For testing without hardware, the second constructor creates a simulated
+    //! device which emits synthetic frames on a timer.
+    class TriggeredAcquisition
+    {
+        public:
+            typedef std::chrono::steady_clock Clock;
+
+            struct Frame
+            {
+                uint64_t frameId = 0;               //!< sequential from start(), including dropped frames
+                uint32_t settingsGeneration = 0;    //!< Spectrometer::settingsGeneration on arrival
+                std::vector<double> spectrum;       //!< (as returned by read)
+                Clock::time_point arrival;          //!< when the frame's last byte was received
+                Clock::time_point trigger;          //!< when the trigger fired (if hasTrigger)
+                bool hasTrigger = false;            //!< whether the trigger time is known
+                double latencyMS = -1;              //!< trigger-to-data, or negative if unknown
+            };
+
+            struct Stats
+            {
+                uint64_t framesReceived = 0;        //!< complete frames read from the device
+                uint64_t framesDropped = 0;         //!< incomplete, or overwritten before being read
+                uint64_t framesSuppressed = 0;      //!< complete, but within the deadband
+                uint64_t latencyCount = 0;          //!< frames with a known trigger time
+                double minLatencyMS = 0;
+                double maxLatencyMS = 0;
+                double avgLatencyMS = 0;
+                double lastLatencyMS = 0;
+            };
+
+            TriggeredAcquisition(Spectrometer& spec, Logger& logger, int transfersPerEndpoint = 4, int maxFrames = 100);
+            TriggeredAcquisition(int pixels, int periodUS, Logger& logger, int maxFrames = 100, Deadband* deadband = nullptr);
+            ~TriggeredAcquisition();
+
+            bool start();
+            void stop();
+            bool isRunning() const { return running; }
+
+            int read(std::vector<Frame>& frames, int maxFrames, int timeoutMS);
+            void markTrigger(Clock::time_point when = Clock::now());
+            Stats getStats();
+            Clock::time_point getStartTime() const { return startTime; }
+
+            static size_t getMemoryBytes(int pixels, int endpoints, int transfersPerEndpoint, int maxFrames);
+
+        private:
+            Spectrometer* spec = nullptr;   //!< nullptr when simulated
+            Deadband* deadband = nullptr;   //!< change detection (optional when simulated)
+            Logger& logger;
+
+            int transfersPerEndpoint = 4;
+            int maxFrames = 100;
+
+            int simulatedPixels = 0;
+            int simulatedPeriodUS = 0;
+
+            std::atomic<bool> running;
+            std::thread worker;
+            Clock::time_point startTime;
+            uint64_t nextFrameId = 0;
+
+            //! buffered frames, oldest at 'head'
+            struct Slot
+            {
+                Frame frame;                            //!< all but the spectrum
+                std::unique_ptr<PooledFrame> spectrum;
+            };
+
+            std::mutex mut;
+            std::condition_variable cv;
+            int pixels = 0;
+            std::vector<Slot> ring;
+            int head = 0;
+            int count = 0;
+            std::unique_ptr<PooledFrame> working;       //!< being assembled by the worker
+            std::vector<uint8_t> raw;                   //!< 'working' as read, for the flight recorder
+            std::deque<Clock::time_point> triggers;
+            Stats stats;
+
+            void allocate();
+            void runUSB();
+            void runSimulated();
+            void publish(Frame& frame, int64_t pageFaults);
+            void dropFrame();
+            void suppressFrame(const Frame& frame);
+    };
+}
@@ -18,6 +18,7 @@
 #include "WasatchVCPP.h"
 
 #include <algorithm>
+#include <chrono>
 #include <vector>
 #include <string>
 #include <map>
@@ -31,6 +32,7 @@
 #include "Spectrometer.h"
 
 using WasatchVCPP::Util;
+using WasatchVCPP::EEPROM;
 using WasatchVCPP::Driver;
 using WasatchVCPP::Spectrometer;
 using WasatchVCPP::Logger;
@@ -68,6 +70,21 @@ int exportString(string s, char* buf, int len)
     return WP_SUCCESS;
 }
 
+//! copy an axis to a C array, from whichever precision the spectrometer holds
+//! (@see wp_set_compact_mode)
+template<typename T>
+int exportAxis(const vector<double>& axis, const vector<float>& compact, T* buf, int len)
+{
+    int size = axis.empty() ? (int)compact.size() : (int)axis.size();
+    for (int i = 0; i < size; i++)
+        if (i < len)
+            buf[i] = axis.empty() ? (T)compact[i] : (T)axis[i];
+        else
+            return WP_ERROR_INSUFFICIENT_STORAGE;
+
+    return WP_SUCCESS;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Lifecycle
 ////////////////////////////////////////////////////////////////////////////////
@@ -91,6 +108,85 @@ int wp_close_all_spectrometers()
     return driver->closeAllSpectrometers() ? WP_SUCCESS : WP_ERROR;
 }
 
+int wp_set_warm_restore(int flag)
+{
+    driver->setWarmRestore(flag != 0);
+    return WP_SUCCESS;
+}
+
+int wp_get_warm_restored(int specIndex)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+    return spec->warmRestored ? 1 : 0;
+}
+
+int wp_get_memory_usage(int specIndex, long long* bytes, int len)
+{
+    if (bytes == nullptr || len <= 0)
+        return WP_ERROR;
+
+    Spectrometer::MemoryUsage total;
+    if (specIndex < 0)
+        total = driver->getMemoryUsage();
+    else
+    {
+        auto spec = driver->getSpectrometer(specIndex);
+        if (spec == nullptr)
+            return WP_ERROR_INVALID_SPECTROMETER;
+        total = spec->getMemoryUsage();
+    }
+
+    size_t values[WP_MEMORY_SUBSYSTEMS] = { total.core, total.eeprom, total.axes, total.triggered, total.areaScan, 
+                                            total.flightRecorder, total.framePool };
+    for (int i = 0; i < len && i < WP_MEMORY_SUBSYSTEMS; i++)
+        bytes[i] = (long long)values[i];
+    return WP_SUCCESS;
+}
+
+int wp_set_memory_budget(long long bytes)
+{
+    if (bytes < 0)
+        return WP_ERROR;
+    driver->setMemoryBudget((size_t)bytes);
+    return WP_SUCCESS;
+}
+
+int wp_set_compact_mode(int flag)
+{
+    driver->setCompactMode(flag != 0);
+    return WP_SUCCESS;
+}
+
+int wp_set_frame_pool(int specIndex, int frames, int flags)
+{
+    if (specIndex < 0)
+        return driver->setFramePool(frames, flags) ? WP_SUCCESS : WP_ERROR;
+
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+    return spec->setFramePool(frames, flags) ? WP_SUCCESS : WP_ERROR;
+}
+
+int wp_get_frame_pool_stats(int specIndex, long long* stats, int len)
+{
+    if (stats == nullptr || len <= 0)
+        return WP_ERROR;
+
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    auto pool = spec->getFramePoolStats();
+    long long values[WP_FRAME_POOL_STATS] = { pool.frames, pool.inUse, pool.highWater, (long long)pool.acquired,
+        (long long)pool.exhausted, (long long)pool.bytes, (long long)pool.lockedBytes, (long long)pool.pageType, pool.pageFaults };
+    for (int i = 0; i < len && i < WP_FRAME_POOL_STATS; i++)
+        stats[i] = values[i];
+    return WP_SUCCESS;
+}
+
 void wp_destroy_driver()
 {
     driver->destroy();
@@ -123,6 +219,7 @@ int wp_get_model(int specIndex, char* value, int len)
     auto spec = driver->getSpectrometer(specIndex);
     if (spec == nullptr)
         return WP_ERROR_INVALID_SPECTROMETER;
+    auto lock = spec->lockEEPROM();
     return exportString(spec->eeprom.model, value, len);
 }
 
@@ -131,6 +228,7 @@ int wp_get_serial_number(int specIndex, char* value, int len)
     auto spec = driver->getSpectrometer(specIndex);
     if (spec == nullptr)
         return WP_ERROR_INVALID_SPECTROMETER;
+    auto lock = spec->lockEEPROM();
     return exportString(spec->eeprom.serialNumber, value, len);
 }
 
@@ -140,13 +238,8 @@ int wp_get_wavelengths(int specIndex, double* wavelengths, int len)
     if (spec == nullptr)
         return WP_ERROR_INVALID_SPECTROMETER;
 
-    for (int i = 0; i < (int)spec->wavelengths.size(); i++)
-        if (i < len)
-            wavelengths[i] = spec->wavelengths[i];
-        else
-            return WP_ERROR_INSUFFICIENT_STORAGE;
-
-    return WP_SUCCESS;
+    auto lock = spec->lockEEPROM();
+    return exportAxis(spec->wavelengths, spec->wavelengthsFloat, wavelengths, len);
 }
 
 int wp_get_wavelengths_float(int specIndex, float* wavelengths, int len)
@@ -155,13 +248,8 @@ int wp_get_wavelengths_float(int specIndex, float* wavelengths, int len)
     if (spec == nullptr)
         return WP_ERROR_INVALID_SPECTROMETER;
 
-    for (int i = 0; i < (int)spec->wavelengths.size(); i++)
-        if (i < len)
-            wavelengths[i] = (float) spec->wavelengths[i];
-        else
-            return WP_ERROR_INSUFFICIENT_STORAGE;
-
-    return WP_SUCCESS;
+    auto lock = spec->lockEEPROM();
+    return exportAxis(spec->wavelengths, spec->wavelengthsFloat, wavelengths, len);
 }
 
 int wp_get_wavenumbers(int specIndex, double* wavenumbers, int len)
@@ -170,16 +258,11 @@ int wp_get_wavenumbers(int specIndex, double* wavenumbers, int len)
     if (spec == nullptr)
         return WP_ERROR_INVALID_SPECTROMETER;
 
+    auto lock = spec->lockEEPROM();
     if (spec->eeprom.excitationNM <= 0)
         return WP_ERROR_NO_LASER;
 
-    for (int i = 0; i < (int)spec->wavenumbers.size(); i++)
-        if (i < len)
-            wavenumbers[i] = spec->wavenumbers[i];
-        else
-            return WP_ERROR_INSUFFICIENT_STORAGE;
-
-    return WP_SUCCESS;
+    return exportAxis(spec->wavenumbers, spec->wavenumbersFloat, wavenumbers, len);
 }
 
 int wp_get_wavenumbers_float(int specIndex, float* wavenumbers, int len)
@@ -188,16 +271,11 @@ int wp_get_wavenumbers_float(int specIndex, float* wavenumbers, int len)
     if (spec == nullptr)
         return WP_ERROR_INVALID_SPECTROMETER;
 
+    auto lock = spec->lockEEPROM();
     if (spec->eeprom.excitationNM <= 0)
         return WP_ERROR_NO_LASER;
 
-    for (int i = 0; i < (int)spec->wavenumbers.size(); i++)
-        if (i < len)
-            wavenumbers[i] = (float) spec->wavenumbers[i];
-        else
-            return WP_ERROR_INSUFFICIENT_STORAGE;
-
-    return WP_SUCCESS;
+    return exportAxis(spec->wavenumbers, spec->wavenumbersFloat, wavenumbers, len);
 }
 
 int wp_get_spectrum(int specIndex, double* spectrum, int len)
@@ -209,53 +287,244 @@ int wp_get_spectrum(int specIndex, double* spectrum, int len)
         return WP_ERROR_INVALID_SPECTROMETER;
     }
 
-    auto intensities = spec->getSpectrum();
-    if (intensities.empty())
+    if (len < spec->pixels)
+    {
+        driver->logger.error("wp_get_spectrum: insufficient storage");
+        return WP_ERROR_INSUFFICIENT_STORAGE;
+    }
+
+    if (!spec->getSpectrum(spectrum, len))
     {
         driver->logger.error("wp_get_spectrum: error generating spectrum");
         return WP_ERROR;
     }
 
-    if (len < (int)intensities.size())
+    return WP_SUCCESS;
+}
+
+int wp_get_spectrum_with_generation(int specIndex, double* spectrum, int len, int* generation)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    if (len < spec->pixels)
     {
-        driver->logger.error("wp_get_spectrum: insufficient storage");
+        driver->logger.error("wp_get_spectrum_with_generation: insufficient storage");
         return WP_ERROR_INSUFFICIENT_STORAGE;
     }
 
-    for (int i = 0; i < (int)intensities.size(); i++)
-        spectrum[i] = intensities[i];
+    uint32_t triggered = 0;
+    if (!spec->getSpectrum(spectrum, len, &triggered))
+    {
+        driver->logger.error("wp_get_spectrum_with_generation: error generating spectrum");
+        return WP_ERROR;
+    }
+
+    if (generation != nullptr)
+        *generation = (int)(triggered & 0x7fffffff);
 
     return WP_SUCCESS;
 }
 
-int wp_get_spectrum_float(int specIndex, float* spectrum, int len)
+int wp_get_settings_generation(int specIndex)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+    return (int)(spec->settingsGeneration & 0x7fffffff);
+}
+
+int wp_set_throwaway_frames(int specIndex, int frames)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+    return spec->setThrowawayFrames(frames) ? WP_SUCCESS : WP_ERROR;
+}
+
+int wp_get_throwaway_count(int specIndex)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+    return (int)spec->getThrowawayCount();
+}
+
+int wp_get_processed_spectrum(int specIndex, float* spectrum, int len)
 {
     auto spec = driver->getSpectrometer(specIndex);
     if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    if (spectrum == nullptr || len < spec->pixels)
     {
-        driver->logger.error("wp_get_spectrum: invalid specIndex %d", specIndex);
+        driver->logger.error("wp_get_processed_spectrum: insufficient storage");
+        return WP_ERROR_INSUFFICIENT_STORAGE;
+    }
+
+    if (!spec->getProcessedSpectrum(spectrum, len))
+    {
+        driver->logger.error("wp_get_processed_spectrum: error generating spectrum");
+        return WP_ERROR;
+    }
+    return WP_SUCCESS;
+}
+
+int wp_set_scans_to_average(int specIndex, int scans)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
         return WP_ERROR_INVALID_SPECTROMETER;
+    return spec->pipeline.setScansToAverage(scans) ? WP_SUCCESS : WP_ERROR;
+}
+
+int wp_set_dark_correction(int specIndex, double* dark, int len)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    if (dark != nullptr && len != spec->pixels)
+    {
+        driver->logger.error("wp_set_dark_correction: dark has %d pixels (expected %d)", len, spec->pixels);
+        return WP_ERROR_INSUFFICIENT_STORAGE;
     }
+    return spec->pipeline.setDark(dark, len) ? WP_SUCCESS : WP_ERROR;
+}
+
+int wp_set_gain_correction(int specIndex, double* gain, int len)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
 
-    auto intensities = spec->getSpectrum();
-    if (intensities.empty())
+    if (gain != nullptr && len != spec->pixels)
     {
-        driver->logger.error("wp_get_spectrum: error generating spectrum");
+        driver->logger.error("wp_set_gain_correction: gain has %d pixels (expected %d)", len, spec->pixels);
+        return WP_ERROR_INSUFFICIENT_STORAGE;
+    }
+    return spec->pipeline.setGain(gain, len) ? WP_SUCCESS : WP_ERROR;
+}
+
+int wp_set_fixed_point_processing(int specIndex, int flag)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+    spec->pipeline.setFixedPoint(flag != 0);
+    return WP_SUCCESS;
+}
+
+int wp_set_expression(int specIndex, const char* expression)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+    return spec->expression.compile(expression == nullptr ? "" : expression) ? WP_SUCCESS : WP_ERROR;
+}
+
+int wp_set_expression_buffer(int specIndex, const char* name, double* values, int len)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    if (name == nullptr)
+        return WP_ERROR;
+    if (values != nullptr && len != spec->pixels)
+    {
+        driver->logger.error("wp_set_expression_buffer: %s has %d pixels (expected %d)", name, len, spec->pixels);
+        return WP_ERROR_INSUFFICIENT_STORAGE;
+    }
+    return spec->expression.setBuffer(name, values, len) ? WP_SUCCESS : WP_ERROR;
+}
+
+int wp_set_expression_constant(int specIndex, const char* name, double value)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    if (name == nullptr)
         return WP_ERROR;
+    return spec->expression.setConstant(name, value) ? WP_SUCCESS : WP_ERROR;
+}
+
+int wp_get_expression_spectrum(int specIndex, double* spectrum, int len)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    if (spectrum == nullptr || len < spec->pixels)
+    {
+        driver->logger.error("wp_get_expression_spectrum: insufficient storage");
+        return WP_ERROR_INSUFFICIENT_STORAGE;
     }
 
-    if (len < (int)intensities.size())
+    if (!spec->getExpressionSpectrum(spectrum, len))
     {
-        driver->logger.error("wp_get_spectrum: insufficient storage");
+        driver->logger.error("wp_get_expression_spectrum: error generating spectrum");
+        return WP_ERROR;
+    }
+    return WP_SUCCESS;
+}
+
+int wp_get_spectrum_float(int specIndex, float* spectrum, int len)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+    {
+        driver->logger.error("wp_get_spectrum_float: invalid specIndex %d", specIndex);
+        return WP_ERROR_INVALID_SPECTROMETER;
+    }
+
+    if (len < spec->pixels)
+    {
+        driver->logger.error("wp_get_spectrum_float: insufficient storage");
         return WP_ERROR_INSUFFICIENT_STORAGE;
     }
 
-    for (int i = 0; i < (int)intensities.size(); i++)
-        spectrum[i] = (float) intensities[i];
+    if (!spec->getSpectrumAs(WasatchVCPP::SpectrumFormat::Float, spectrum, len))
+    {
+        driver->logger.error("wp_get_spectrum_float: error generating spectrum");
+        return WP_ERROR;
+    }
+
+    return WP_SUCCESS;
+}
+
+//! shared by the compact spectrum formats
+static int getSpectrumAs(const char* caller, int specIndex, WasatchVCPP::SpectrumFormat::Format format, 
+    void* spectrum, int len, double scale = 1)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    if (spectrum == nullptr || len < spec->pixels)
+    {
+        driver->logger.error("%s: insufficient storage", caller);
+        return WP_ERROR_INSUFFICIENT_STORAGE;
+    }
 
+    if (!spec->getSpectrumAs(format, spectrum, len, scale))
+    {
+        driver->logger.error("%s: error generating spectrum", caller);
+        return WP_ERROR;
+    }
     return WP_SUCCESS;
 }
 
+int wp_get_spectrum_fp16(int specIndex, unsigned short* spectrum, int len)
+{ return getSpectrumAs("wp_get_spectrum_fp16", specIndex, WasatchVCPP::SpectrumFormat::Float16, spectrum, len); }
+
+int wp_get_spectrum_bf16(int specIndex, unsigned short* spectrum, int len)
+{ return getSpectrumAs("wp_get_spectrum_bf16", specIndex, WasatchVCPP::SpectrumFormat::BFloat16, spectrum, len); }
+
+int wp_get_spectrum_int32(int specIndex, int* spectrum, int len, double scale)
+{ return getSpectrumAs("wp_get_spectrum_int32", specIndex, WasatchVCPP::SpectrumFormat::Int32, spectrum, len, scale); }
 
 int wp_get_eeprom_field_count(int specIndex)
 {
@@ -263,6 +532,7 @@ int wp_get_eeprom_field_count(int specIndex)
     if (spec == nullptr)
         return WP_ERROR_INVALID_SPECTROMETER;
 
+    auto lock = spec->lockEEPROM();
     return (int)spec->eeprom.stringified.size();
 }
 
@@ -272,6 +542,7 @@ int wp_get_eeprom_field_name(int specIndex, int index, char* value, int len)
     if (spec == nullptr)
         return WP_ERROR_INVALID_SPECTROMETER;
 
+    auto lock = spec->lockEEPROM();
     if (index < 0 || index >= (int)spec->eeprom.stringified.size())
         return WP_ERROR; // invalid index
 
@@ -291,6 +562,7 @@ int wp_get_eeprom(int specIndex, const char** names, const char** values, int le
         return WP_ERROR_INVALID_SPECTROMETER;
     
     int count = 0;
+    auto lock = spec->lockEEPROM();
     const map<string, string>& entries = spec->eeprom.stringified;
     for (map<string, string>::const_iterator i = entries.begin(); i != entries.end(); i++, count++)
     {
@@ -324,6 +596,7 @@ int wp_get_eeprom_field(int specIndex, const char* name, char* valueOut, int len
     }
     */
 
+    auto lock = spec->lockEEPROM();
     const map<string, string>& entries = spec->eeprom.stringified;
     for (map<string, string>::const_iterator i = entries.begin(); i != entries.end(); i++)
     {
@@ -357,7 +630,8 @@ int wp_get_eeprom_page(int specIndex, int page, uint8_t* buf, int len)
     if (spec == nullptr)
         return WP_ERROR_INVALID_SPECTROMETER;
 
-    if (page < 0 || page > WasatchVCPP::EEPROM::MAX_PAGES)
+    auto lock = spec->lockEEPROM();
+    if (page < 0 || page >= (int)spec->eeprom.pages.size())
         return WP_ERROR;
 
     const vector<uint8_t>& data = spec->eeprom.pages[page];
@@ -663,6 +937,30 @@ int wp_get_high_gain_mode_enable(int specIndex)
     return spec->getHighGainModeEnable() ? 1 : 0;
 }
 
+int wp_get_status(int specIndex, wp_status* status)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    if (status == nullptr)
+        return WP_ERROR;
+
+    Spectrometer::Status s;
+    if (!spec->getStatus(s))
+        return WP_ERROR;
+
+    status->detectorTemperatureDegC = s.detectorTemperatureDegC;
+    status->detectorTECEnable       = s.detectorTECEnable ? 1 : 0;
+    status->detectorTECSetpointDegC = s.detectorTECSetpointDegC;
+    status->laserEnable             = s.laserEnable ? 1 : 0;
+    status->integrationTimeMS       = s.integrationTimeMS;
+    status->detectorGain            = s.detectorGain;
+    status->detectorOffset          = s.detectorOffset;
+    status->highGainModeEnable      = s.highGainModeEnable ? 1 : 0;
+    return WP_SUCCESS;
+}
+
 int wp_cancel_operation(int specIndex, int blocking)
 {
     auto spec = driver->getSpectrometer(specIndex);
@@ -691,50 +989,499 @@ int wp_get_max_timeout_ms(int specIndex)
     return spec->maxTimeoutMS;
 }
 
-int wp_write_eeprom_page(int specIndex, int pageIndex, unsigned char* data, int dataLen)
+int wp_set_auto_dark_config(int specIndex, int laserWarmupMS, int maxDarkAgeMS, float maxDarkTempDeltaDegC)
 {
     auto spec = driver->getSpectrometer(specIndex);
     if (spec == nullptr)
         return WP_ERROR_INVALID_SPECTROMETER;
 
-    if (pageIndex < 0)
-    {
-        return WP_ERROR;
-    }
-    if (dataLen != 64)
-    {
-        return WP_ERROR;
-    }
-
-    bool specType = spec->isARM();
-    int resVal;
-    if (specType) 
-    {
-       resVal = wp_send_control_msg(specIndex, 0xff, 0x02, 4, data, dataLen);
-    }
-    else
-    {
-        unsigned int pageValue = (0x3c << 8) | (0x40 * pageIndex);
-        resVal = wp_send_control_msg(specIndex, 0xa2, pageValue, 0, data, dataLen);
-    }
-    
-    return resVal;
+    return spec->setAutoDarkConfig(laserWarmupMS, maxDarkAgeMS, maxDarkTempDeltaDegC) ? WP_SUCCESS : WP_ERROR;
 }
 
-int wp_send_control_msg(int specIndex, unsigned char bRequest, unsigned int wValue,
-    unsigned int wIndex, unsigned char* data, int len)
+int wp_get_auto_dark_spectrum(int specIndex, double* corrected, double* dark, double* raw, int len)
 {
     auto spec = driver->getSpectrometer(specIndex);
     if (spec == nullptr)
         return WP_ERROR_INVALID_SPECTROMETER;
 
-    return spec->sendCmd(bRequest, wValue, wIndex, data, len);
-}
+    if (!spec->eeprom.hasLaser)
+        return WP_ERROR_NO_LASER;
 
-int wp_read_control_msg(int specIndex, unsigned char bRequest, unsigned int wIndex,
-    unsigned char* data, int len)
-{
-    auto spec = driver->getSpectrometer(specIndex);
+    if (corrected == nullptr)
+        return WP_ERROR;
+
+    vector<double> correctedVec, darkVec, rawVec;
+    if (!spec->getAutoDarkSpectrum(correctedVec, darkVec, rawVec))
+        return WP_ERROR;
+
+    if (len < (int)correctedVec.size())
+        return WP_ERROR_INSUFFICIENT_STORAGE;
+
+    const size_t bytes = correctedVec.size() * sizeof(double);
+    memcpy(corrected, &correctedVec[0], bytes);
+    if (dark != nullptr)
+        memcpy(dark, &darkVec[0], bytes);
+    if (raw != nullptr)
+        memcpy(raw, &rawVec[0], bytes);
+    return WP_SUCCESS;
+}
+
+int wp_start_recipe(int specIndex, const char* recipe)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    if (recipe == nullptr)
+        return WP_ERROR;
+
+    return spec->startRecipe(recipe) ? WP_SUCCESS : WP_ERROR;
+}
+
+int wp_read_recipe_result(int specIndex, char* name, int nameLen, double* spectrum, int pixels, int timeoutMS)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    auto recipe = spec->getRecipe();
+    if (recipe == nullptr || name == nullptr || nameLen <= 0 || spectrum == nullptr)
+        return WP_ERROR;
+
+    if (pixels < spec->pixels)
+        return WP_ERROR_INSUFFICIENT_STORAGE;
+
+    WasatchVCPP::Recipe::Result result;
+    if (!recipe->read(result, timeoutMS))
+        return 0;
+
+    memset(name, 0, nameLen);
+    strncpy(name, result.name.c_str(), nameLen - 1);
+    for (int i = 0; i < pixels; i++)
+        spectrum[i] = i < (int)result.spectrum.size() ? result.spectrum[i] : 0;
+    return 1;
+}
+
+int wp_get_recipe_state(int specIndex)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    auto recipe = spec->getRecipe();
+    return recipe == nullptr ? WP_RECIPE_IDLE : (int)recipe->getState();
+}
+
+int wp_stop_recipe(int specIndex)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    return spec->stopRecipe() ? WP_SUCCESS : WP_ERROR;
+}
+
+int wp_get_usb_topology(int specIndex, int* bus, char* ports, int portsLen, int* speedMbps)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    if (bus == nullptr)
+        return WP_ERROR;
+
+    *bus = spec->usbBus;
+    if (speedMbps != nullptr)
+        *speedMbps = spec->usbSpeedMbps;
+    if (ports != nullptr && portsLen > 0)
+    {
+        if (portsLen <= (int)spec->usbPorts.size())
+            return WP_ERROR_INSUFFICIENT_STORAGE;
+        memset(ports, 0, portsLen);
+        strncpy(ports, spec->usbPorts.c_str(), portsLen - 1);
+    }
+    return WP_SUCCESS;
+}
+
+int wp_set_schedule_plan(int specIndex, float cadenceHz, int integrationTimeMS)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    WasatchVCPP::Scheduler::Plan plan;
+    plan.cadenceHz = cadenceHz;
+    plan.integrationTimeMS = integrationTimeMS;
+    return driver->scheduler.setPlan(specIndex, plan) ? WP_SUCCESS : WP_ERROR;
+}
+
+int wp_clear_schedule_plans()
+{
+    if (driver->scheduler.isRunning())
+        return WP_ERROR;
+    driver->scheduler.clearPlans();
+    return WP_SUCCESS;
+}
+
+int wp_start_schedule()
+{
+    return driver->startSchedule() ? WP_SUCCESS : WP_ERROR;
+}
+
+int wp_stop_schedule()
+{
+    driver->scheduler.stop();
+    return WP_SUCCESS;
+}
+
+int wp_get_schedule_stats(int specIndex, float* requestedHz, float* grantedHz, float* achievedHz, int* frames, int* late)
+{
+    WasatchVCPP::Scheduler::Stats stats;
+    if (!driver->scheduler.getStats(specIndex, stats))
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    if (requestedHz != nullptr) *requestedHz = (float)stats.requestedHz;
+    if (grantedHz   != nullptr) *grantedHz   = (float)stats.grantedHz;
+    if (achievedHz  != nullptr) *achievedHz  = (float)stats.achievedHz;
+    if (frames      != nullptr) *frames      = (int)stats.frames;
+    if (late        != nullptr) *late        = (int)stats.late;
+    return WP_SUCCESS;
+}
+
+int wp_get_scheduled_spectrum(int specIndex, double* spectrum, int len)
+{
+    if (spectrum == nullptr)
+        return WP_ERROR;
+
+    vector<double> latest;
+    auto frames = driver->scheduler.getLatest(specIndex, latest);
+    if (frames < 0)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    if (len < (int)latest.size())
+        return WP_ERROR_INSUFFICIENT_STORAGE;
+
+    if (!latest.empty())
+        memcpy(spectrum, &latest[0], latest.size() * sizeof(double));
+    return (int)frames;
+}
+
+int wp_set_area_scan_enable(int specIndex, int value)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    return spec->setAreaScanEnable(value != 0) ? WP_SUCCESS : WP_ERROR;
+}
+
+int wp_get_area_scan_rows(int specIndex)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    auto lock = spec->lockEEPROM();
+    return spec->eeprom.activePixelsVert;
+}
+
+int wp_get_area_scan_frame(int specIndex, double* frame, int rows, int cols, int timeoutMS)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    if (frame == nullptr)
+        return WP_ERROR;
+
+    if (rows < spec->eeprom.activePixelsVert || cols < spec->pixels)
+        return WP_ERROR_INSUFFICIENT_STORAGE;
+
+    if (!spec->getAreaScanFrame(frame, rows, cols, timeoutMS))
+        return WP_ERROR;
+    return WP_SUCCESS;
+}
+
+int wp_get_area_scan_binned(int specIndex, double* spectrum, int len, int firstRow, int lastRow, int timeoutMS)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    if (spectrum == nullptr)
+        return WP_ERROR;
+
+    if (len < spec->pixels)
+        return WP_ERROR_INSUFFICIENT_STORAGE;
+
+    if (!spec->getAreaScanBinned(spectrum, len, firstRow, lastRow, timeoutMS))
+        return WP_ERROR;
+    return WP_SUCCESS;
+}
+
+int wp_start_triggered_acquisition(int specIndex, int queueDepth, int maxFrames)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    if (queueDepth <= 0 || maxFrames <= 0)
+        return WP_ERROR;
+
+    return spec->startTriggeredAcquisition(queueDepth, maxFrames) ? WP_SUCCESS : WP_ERROR;
+}
+
+int wp_read_triggered_spectra(int specIndex, double* spectra, int pixels, int maxFrames, 
+    double* arrivalMS, double* latencyMS, int timeoutMS)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    auto acq = spec->getTriggeredAcquisition();
+    if (acq == nullptr || spectra == nullptr || maxFrames <= 0)
+        return WP_ERROR;
+
+    if (pixels < spec->pixels)
+        return WP_ERROR_INSUFFICIENT_STORAGE;
+
+    vector<WasatchVCPP::TriggeredAcquisition::Frame> frames;
+    int count = acq->read(frames, maxFrames, timeoutMS);
+    for (int i = 0; i < count; i++)
+    {
+        const auto& frame = frames[i];
+        double* dest = spectra + i * pixels;
+        for (int j = 0; j < pixels; j++)
+            dest[j] = j < (int)frame.spectrum.size() ? frame.spectrum[j] : 0;
+
+        if (arrivalMS != nullptr)
+            arrivalMS[i] = std::chrono::duration<double, std::milli>(frame.arrival - acq->getStartTime()).count();
+        if (latencyMS != nullptr)
+            latencyMS[i] = frame.latencyMS;
+    }
+    return count;
+}
+
+int wp_mark_external_trigger(int specIndex)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    auto acq = spec->getTriggeredAcquisition();
+    if (acq == nullptr || !acq->isRunning())
+        return WP_ERROR;
+
+    acq->markTrigger();
+    return WP_SUCCESS;
+}
+
+int wp_get_triggered_acquisition_stats(int specIndex, int* framesReceived, int* framesDropped, 
+    float* avgLatencyMS, float* maxLatencyMS)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    auto acq = spec->getTriggeredAcquisition();
+    if (acq == nullptr)
+        return WP_ERROR;
+
+    auto stats = acq->getStats();
+    if (framesReceived != nullptr) *framesReceived = (int)stats.framesReceived;
+    if (framesDropped  != nullptr) *framesDropped  = (int)stats.framesDropped;
+    if (avgLatencyMS   != nullptr) *avgLatencyMS   = (float)stats.avgLatencyMS;
+    if (maxLatencyMS   != nullptr) *maxLatencyMS   = (float)stats.maxLatencyMS;
+    return WP_SUCCESS;
+}
+
+int wp_stop_triggered_acquisition(int specIndex)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    return spec->stopTriggeredAcquisition() ? WP_SUCCESS : WP_ERROR;
+}
+
+int wp_set_deadband(int specIndex, int metric, double threshold, int heartbeatMS)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    if (metric < WP_DEADBAND_OFF || metric > WP_DEADBAND_RMS)
+        return WP_ERROR;
+
+    return spec->deadband.configure((WasatchVCPP::Deadband::Metric)metric, threshold, heartbeatMS) ? WP_SUCCESS : WP_ERROR;
+}
+
+int wp_set_deadband_regions(int specIndex, int* bounds, int count)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    return spec->deadband.setRegions(bounds, count) ? WP_SUCCESS : WP_ERROR;
+}
+
+int wp_get_deadband_stats(int specIndex, int* framesDelivered, int* framesSuppressed, double* lastChange)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    auto stats = spec->deadband.getStats();
+    if (framesDelivered  != nullptr) *framesDelivered  = (int)stats.framesEmitted;
+    if (framesSuppressed != nullptr) *framesSuppressed = (int)stats.framesSuppressed;
+    if (lastChange       != nullptr) *lastChange       = stats.lastChange;
+    return WP_SUCCESS;
+}
+
+int wp_set_display_stream(int specIndex, int width, float maxHz)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    return spec->display.configure(width, maxHz) ? WP_SUCCESS : WP_ERROR;
+}
+
+int wp_read_display_envelope(int specIndex, float* mins, float* maxs, int len, int timeoutMS)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    if (mins == nullptr || maxs == nullptr || len <= 0)
+        return WP_ERROR;
+
+    int buckets = spec->display.read(mins, maxs, len, timeoutMS);
+    return buckets < 0 ? WP_ERROR : buckets;
+}
+
+int wp_set_flight_recorder(int specIndex, int frames)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    return spec->setFlightRecorder(frames) ? WP_SUCCESS : WP_ERROR;
+}
+
+int wp_dump_flight_recorder(int specIndex, const char* pathname, int len)
+{
+    if (pathname == nullptr || len <= 0)
+        return WP_ERROR;
+
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    string s;
+    for (int i = 0; i < len && pathname[i]; i++)
+        s += pathname[i];
+
+    return spec->dumpFlightRecorder(s) ? WP_SUCCESS : WP_ERROR;
+}
+
+int wp_get_flight_recorder_status(int specIndex, int* frames, int* dumping)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    auto recorder = spec->getFlightRecorder();
+    if (recorder == nullptr)
+        return WP_ERROR;
+
+    if (frames  != nullptr) *frames  = recorder->getCount();
+    if (dumping != nullptr) *dumping = recorder->isDumping() ? 1 : 0;
+    return WP_SUCCESS;
+}
+
+int wp_write_eeprom_page(int specIndex, int pageIndex, unsigned char* data, int dataLen)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    if (pageIndex < 0 || pageIndex >= EEPROM::MAX_PAGES || data == nullptr || dataLen != EEPROM::PAGE_SIZE)
+        return WP_ERROR;
+
+    // the current image with just this page changed
+    vector<vector<uint8_t> > pages;
+    {
+        auto lock = spec->lockEEPROM();
+        pages = spec->eeprom.pages;
+    }
+    pages.resize(EEPROM::MAX_PAGES);
+    pages[pageIndex].assign(data, data + dataLen);
+
+    return spec->commitEEPROMPages(pages) ? dataLen : WP_ERROR;
+}
+
+int wp_set_eeprom_field(int specIndex, const char* name, const char* value)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    if (name == nullptr || value == nullptr)
+        return WP_ERROR;
+
+    return spec->setEEPROMField(name, value) ? WP_SUCCESS : WP_ERROR;
+}
+
+int wp_commit_eeprom(int specIndex, int* pagesWritten, float* elapsedMS)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    double ms = 0;
+    bool ok = spec->commitStagedEEPROM(pagesWritten, &ms);
+    if (elapsedMS != nullptr)
+        *elapsedMS = (float)ms;
+
+    return ok ? WP_SUCCESS : WP_ERROR;
+}
+
+int wp_write_eeprom(int specIndex, const unsigned char* image, int len, int* pagesWritten, float* elapsedMS)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    if (image == nullptr || len != EEPROM::MAX_PAGES * EEPROM::PAGE_SIZE)
+        return WP_ERROR;
+
+    vector<vector<uint8_t> > pages;
+    for (int page = 0; page < EEPROM::MAX_PAGES; page++)
+        pages.push_back(vector<uint8_t>(image + page * EEPROM::PAGE_SIZE, image + (page + 1) * EEPROM::PAGE_SIZE));
+
+    double ms = 0;
+    bool ok = spec->commitEEPROMPages(pages, pagesWritten, &ms);
+    if (elapsedMS != nullptr)
+        *elapsedMS = (float)ms;
+
+    return ok ? WP_SUCCESS : WP_ERROR;
+}
+
+int wp_send_control_msg(int specIndex, unsigned char bRequest, unsigned int wValue,
+    unsigned int wIndex, unsigned char* data, int len)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    return spec->sendCmd(bRequest, wValue, wIndex, data, len);
+}
+
+int wp_read_control_msg(int specIndex, unsigned char bRequest, unsigned int wIndex,
+    unsigned char* data, int len)
+{
+    auto spec = driver->getSpectrometer(specIndex);
     if (spec == nullptr)
         return WP_ERROR_INVALID_SPECTROMETER;
 
@@ -750,11 +1497,115 @@ int wp_read_control_msg(int specIndex, unsigned char bRequest, unsigned int wInd
     return (int)response.size();
 }
 
+int wp_send_control_msg_async(int specIndex, unsigned char bRequest, unsigned int wValue,
+    unsigned int wIndex, unsigned char* data, int len, wp_async_callback callback, void* userData)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    return spec->sendCmdAsync(bRequest, wValue, wIndex, data, len, callback, userData);
+}
+
+int wp_read_control_msg_async(int specIndex, unsigned char bRequest, unsigned int wIndex,
+    int len, wp_async_callback callback, void* userData)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    if (len <= 0)
+        return WP_ERROR_INSUFFICIENT_STORAGE;
+
+    return spec->getCmdAsync(bRequest, len, wIndex, callback, userData);
+}
+
+int wp_set_integration_time_ms_async(int specIndex, unsigned long ms, wp_async_callback callback, void* userData)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    return spec->setIntegrationTimeMSAsync(ms, callback, userData);
+}
+
+int wp_set_laser_enable_async(int specIndex, int value, wp_async_callback callback, void* userData)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    return spec->setLaserEnableAsync(value != 0, callback, userData);
+}
+
+int wp_wait_async(int specIndex, int handle, int timeoutMS, int* result, unsigned char* data, int len)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    WasatchVCPP::AsyncControl::Operation op;
+    int status = spec->asyncControl.wait(handle, timeoutMS, op);
+    if (status < 0)
+        return WP_ERROR;
+    if (status == 0)
+        return WP_ASYNC_PENDING;
+
+    if (result != nullptr)
+        *result = op.result;
+    if (data != nullptr)
+        for (int i = 0; i < len && i < (int)op.data.size(); i++)
+            data[i] = op.data[i];
+    return WP_SUCCESS;
+}
+
+int wp_get_async_pending(int specIndex)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    return spec->asyncControl.getPending();
+}
+
+int wp_get_command_latency(int specIndex, int priority, int* count, float* avgMS, float* maxMS)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    if (priority < WP_PRIORITY_BACKGROUND || priority > WP_PRIORITY_URGENT)
+        return WP_ERROR;
+
+    WasatchVCPP::Spectrometer::CommandLatency latency;
+    if (!spec->getCommandLatency((WasatchVCPP::CommandPriority)priority, latency))
+        return WP_ERROR;
+
+    if (count != nullptr)
+        *count = (int)latency.count;
+    if (avgMS != nullptr)
+        *avgMS = (float)latency.avgMS;
+    if (maxMS != nullptr)
+        *maxMS = (float)latency.maxMS;
+    return WP_SUCCESS;
+}
+
+int wp_reset_command_latency(int specIndex)
+{
+    auto spec = driver->getSpectrometer(specIndex);
+    if (spec == nullptr)
+        return WP_ERROR_INVALID_SPECTROMETER;
+
+    spec->resetCommandLatency();
+    return WP_SUCCESS;
+}
+
 int wp_get_vignetted_spectrum_length(int specIndex) 
 {
     auto spec = driver->getSpectrometer(specIndex);
         if (spec == nullptr)
             return WP_ERROR_INVALID_SPECTROMETER;
+    auto lock = spec->lockEEPROM();
     auto eeprom = spec->eeprom;
 
     return eeprom.ROIHorizEnd - eeprom.ROIHorizStart + 1;
@@ -766,7 +1617,9 @@ int wp_get_raman_intensity_factors(int specIndex, double* factors, int factorsLe
     if (spec == nullptr)
         return WP_ERROR_INVALID_SPECTROMETER;
     double* out_factor; 
+    auto lock = spec->lockEEPROM();
     auto eeprom = spec->eeprom;
+    lock.unlock();
     float logTen;
     float x_to_i;
     float scaled;
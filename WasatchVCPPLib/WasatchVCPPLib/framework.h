@@ -1,6 +1,7 @@
 #pragma once
 
 #define WIN32_LEAN_AND_MEAN             // Exclude rarely-used stuff from Windows headers
+#define NOMINMAX                        // std::min / std::max, not the Windows macros
 
 #ifdef _WINDOWS
 // Windows Header Files
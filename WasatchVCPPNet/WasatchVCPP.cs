@@ -324,54 +324,168 @@ class WasatchVCPP
     const string DLL = "WasatchVCPP.dll";
     public const int WP_SUCCESS = 0;
 
+    [StructLayout(LayoutKind.Sequential)]
+    public struct wp_status
+    {
+        public float detectorTemperatureDegC;
+        public int   detectorTECEnable;
+        public int   detectorTECSetpointDegC;
+        public int   laserEnable;
+        public int   integrationTimeMS;
+        public float detectorGain;
+        public int   detectorOffset;
+        public int   highGainModeEnable;
+    }
+
+    public const int WP_ASYNC_PENDING = 1;
+
+    public const int WP_PRIORITY_BACKGROUND = 0;
+    public const int WP_PRIORITY_NORMAL = 1;
+    public const int WP_PRIORITY_URGENT = 2;
+
+    public const int WP_MEMORY_CORE = 0;
+    public const int WP_MEMORY_EEPROM = 1;
+    public const int WP_MEMORY_AXES = 2;
+    public const int WP_MEMORY_TRIGGERED = 3;
+    public const int WP_MEMORY_AREA_SCAN = 4;
+    public const int WP_MEMORY_FLIGHT_RECORDER = 5;
+    public const int WP_MEMORY_FRAME_POOL = 6;
+    public const int WP_MEMORY_SUBSYSTEMS = 7;
+
+    public const int WP_FRAME_POOL_LOCK = 0x01;
+    public const int WP_FRAME_POOL_HUGE_PAGES = 0x02;
+
+    public const int WP_FRAME_POOL_STAT_FRAMES = 0;
+    public const int WP_FRAME_POOL_STAT_IN_USE = 1;
+    public const int WP_FRAME_POOL_STAT_HIGH_WATER = 2;
+    public const int WP_FRAME_POOL_STAT_ACQUIRED = 3;
+    public const int WP_FRAME_POOL_STAT_EXHAUSTED = 4;
+    public const int WP_FRAME_POOL_STAT_BYTES = 5;
+    public const int WP_FRAME_POOL_STAT_LOCKED_BYTES = 6;
+    public const int WP_FRAME_POOL_STAT_PAGE_TYPE = 7;
+    public const int WP_FRAME_POOL_STAT_PAGE_FAULTS = 8;
+    public const int WP_FRAME_POOL_STATS = 9;
+
+    public const int WP_DEADBAND_OFF = 0;
+    public const int WP_DEADBAND_MAX_ABS = 1;
+    public const int WP_DEADBAND_RMS = 2;
+
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+    public delegate void wp_async_callback(int specIndex, int handle, int result, IntPtr data, IntPtr userData);
+
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int   /* tested */ wp_cancel_operation(int specIndex);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_clear_schedule_plans();
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int   /* tested */ wp_close_all_spectrometers();
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int   /* tested */ wp_close_spectrometer(int specIndex);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_commit_eeprom(int specIndex, ref int pagesWritten, ref float elapsedMS);
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern void               wp_destroy_driver();
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_dump_flight_recorder(int specIndex, ref byte pathname, int len);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_get_area_scan_binned(int specIndex, ref double spectrum, int len, int firstRow, int lastRow, int timeoutMS);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_get_area_scan_frame(int specIndex, ref double frame, int rows, int cols, int timeoutMS);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_get_area_scan_rows(int specIndex);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_get_async_pending(int specIndex);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_get_auto_dark_spectrum(int specIndex, ref double corrected, ref double dark, ref double raw, int len);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_get_command_latency(int specIndex, int priority, ref int count, ref float avgMS, ref float maxMS);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_get_deadband_stats(int specIndex, ref int framesDelivered, ref int framesSuppressed, ref double lastChange);
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern float /* tested */ wp_get_detector_gain(int specIndex);
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern float /* tested */ wp_get_detector_gain_odd(int specIndex);
-    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int   /* tested */ wp_get_detector_tec_setpoint_deg_c(int specIndex);
-    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern float /* tested */ wp_get_detector_temperature_deg_c(int specIndex);
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int   /* tested */ wp_get_detector_offset(int specIndex);
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int   /* tested */ wp_get_detector_offset_odd(int specIndex);
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int   /* tested */ wp_get_detector_tec_enable(int specIndex);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int   /* tested */ wp_get_detector_tec_setpoint_deg_c(int specIndex);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern float /* tested */ wp_get_detector_temperature_deg_c(int specIndex);
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_get_eeprom(int specIndex, ref byte names, ref byte values, int len);
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int   /* tested */ wp_get_eeprom_field(int specIndex, ref byte name, ref byte value, int len);
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int   /* tested */ wp_get_eeprom_field_count(int specIndex);
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int   /* tested */ wp_get_eeprom_field_name(int specIndex, int index, ref byte name, int len);
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int   /* tested */ wp_get_eeprom_page(int specIndex, int page, ref byte buf, int len);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_get_expression_spectrum(int specIndex, ref double spectrum, int len);
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int   /* tested */ wp_get_firmware_version(int specIndex, ref byte value, int len);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_get_flight_recorder_status(int specIndex, ref int frames, ref int dumping);
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int   /* tested */ wp_get_fpga_version(int specIndex, ref byte value, int len);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_get_frame_pool_stats(int specIndex, ref long stats, int len);
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int   /* tested */ wp_get_high_gain_mode_enable(int specIndex);
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int   /* tested */ wp_get_integration_time_ms(int specIndex);
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int   /* tested */ wp_get_laser_enable(int specIndex);
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int   /* tested */ wp_get_library_version(ref byte value, int len);
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int   /* tested */ wp_get_max_timeout_ms(int specIndex);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_get_memory_usage(int specIndex, ref long bytes, int len);
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int   /* tested */ wp_get_model(int specIndex, ref byte value, int len);
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int   /* tested */ wp_get_number_of_spectrometers();
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int   /* tested */ wp_get_pixels(int specIndex);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_get_processed_spectrum(int specIndex, ref float spectrum, int len);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_get_recipe_state(int specIndex);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_get_schedule_stats(int specIndex, ref float requestedHz, ref float grantedHz, ref float achievedHz, ref int frames, ref int late);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_get_scheduled_spectrum(int specIndex, ref double spectrum, int len);
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int   /* tested */ wp_get_serial_number(int specIndex, ref byte value, int len);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_get_settings_generation(int specIndex);
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int   /* tested */ wp_get_spectrum(int specIndex, ref double spectrum, int len);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_get_spectrum_bf16(int specIndex, ref ushort spectrum, int len);
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_get_spectrum_float(int specIndex, ref float spectrum, int len);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_get_spectrum_fp16(int specIndex, ref ushort spectrum, int len);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_get_spectrum_int32(int specIndex, ref int spectrum, int len, double scale);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_get_spectrum_with_generation(int specIndex, ref double spectrum, int len, ref int generation);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_get_status(int specIndex, ref wp_status status);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_get_throwaway_count(int specIndex);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_get_triggered_acquisition_stats(int specIndex, ref int framesReceived, ref int framesDropped, ref float avgLatencyMS, ref float maxLatencyMS);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_get_usb_topology(int specIndex, ref int bus, ref byte ports, int portsLen, ref int speedMbps);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_get_warm_restored(int specIndex);
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int   /* tested */ wp_get_wavelengths(int specIndex, ref double wavelengths, int len);
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_get_wavelengths_float(int specIndex, ref float wavelengths, int len);
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int   /* tested */ wp_get_wavenumbers(int specIndex, ref double wavenumbers, int len);
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_get_wavenumbers_float(int specIndex, ref float wavenumbers, int len);
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int   /* tested */ wp_log_debug(ref byte msg, int len);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_mark_external_trigger(int specIndex);
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int   /* tested */ wp_open_all_spectrometers();
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_read_control_msg(byte bRequest, ushort wIndex, ref byte data, int len, int fullLen);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_read_control_msg_async(int specIndex, byte bRequest, uint wIndex, int len, wp_async_callback callback, IntPtr userData);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_read_display_envelope(int specIndex, ref float mins, ref float maxs, int len, int timeoutMS);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_read_recipe_result(int specIndex, ref byte name, int nameLen, ref double spectrum, int pixels, int timeoutMS);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_read_triggered_spectra(int specIndex, ref double spectra, int pixels, int maxFrames, ref double arrivalMS, ref double latencyMS, int timeoutMS);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_reset_command_latency(int specIndex);
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_send_control_msg(byte bRequest, ushort wValue, ushort wIndex, ref byte data, int len);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_send_control_msg_async(int specIndex, byte bRequest, uint wValue, uint wIndex, ref byte data, int len, wp_async_callback callback, IntPtr userData);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_set_area_scan_enable(int specIndex, int value);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_set_auto_dark_config(int specIndex, int laserWarmupMS, int maxDarkAgeMS, float maxDarkTempDeltaDegC);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_set_compact_mode(int flag);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_set_dark_correction(int specIndex, ref double dark, int len);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_set_deadband(int specIndex, int metric, double threshold, int heartbeatMS);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_set_deadband_regions(int specIndex, ref int bounds, int count);
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int   /* tested */ wp_set_detector_gain(int specIndex, float value);
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int   /* tested */ wp_set_detector_gain_odd(int specIndex, float value);
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int   /* tested */ wp_set_detector_offset(int specIndex, int value);
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int   /* tested */ wp_set_detector_offset_odd(int specIndex, int value);
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int   /* tested */ wp_set_detector_tec_enable(int specIndex, int value);
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int   /* tested */ wp_set_detector_tec_setpoint_deg_c(int specIndex, int value);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_set_display_stream(int specIndex, int width, float maxHz);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_set_eeprom_field(int specIndex, ref byte name, ref byte value);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_set_expression(int specIndex, ref byte expression);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_set_expression_buffer(int specIndex, ref byte name, ref double values, int len);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_set_expression_constant(int specIndex, ref byte name, double value);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_set_fixed_point_processing(int specIndex, int flag);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_set_flight_recorder(int specIndex, int frames);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_set_frame_pool(int specIndex, int frames, int flags);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_set_gain_correction(int specIndex, ref double gain, int len);
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int   /* tested */ wp_set_high_gain_mode_enable(int specIndex, int value);
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int   /* tested */ wp_set_integration_time_ms(int specIndex, uint ms);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_set_integration_time_ms_async(int specIndex, uint ms, wp_async_callback callback, IntPtr userData);
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int   /* tested */ wp_set_laser_enable(int specIndex, int value); 
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_set_laser_enable_async(int specIndex, int value, wp_async_callback callback, IntPtr userData);
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int   /* tested */ wp_set_log_level(int level);
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int   /* tested */ wp_set_logfile_path(ref byte pathname, int len);
-    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int   /* tested */ wp_cancel_operation(int specIndex);
     [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int   /* tested */ wp_set_max_timeout_ms(int specIndex, int maxTimeoutMS);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_set_memory_budget(long bytes);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_set_scans_to_average(int specIndex, int scans);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_set_schedule_plan(int specIndex, float cadenceHz, int integrationTimeMS);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_set_throwaway_frames(int specIndex, int frames);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_set_warm_restore(int flag);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_start_recipe(int specIndex, ref byte recipe);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_start_schedule();
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_start_triggered_acquisition(int specIndex, int queueDepth, int maxFrames);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_stop_recipe(int specIndex);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_stop_schedule();
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_stop_triggered_acquisition(int specIndex);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_wait_async(int specIndex, int handle, int timeoutMS, ref int result, ref byte data, int len);
+    [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)] public static extern int                wp_write_eeprom(int specIndex, ref byte image, int len, ref int pagesWritten, ref float elapsedMS);
 }
 
@@ -65,6 +65,75 @@
 #define WP_LOG_LEVEL_ERROR              2
 #define WP_LOG_LEVEL_NEVER              3
 
+#define WP_RECIPE_IDLE                  0     //!< no recipe has been started
+#define WP_RECIPE_RUNNING               1
+#define WP_RECIPE_COMPLETE              2
+#define WP_RECIPE_FAILED                3     //!< a step failed (see log)
+#define WP_RECIPE_CANCELLED             4     //!< wp_stop_recipe was called
+
+#define WP_ASYNC_PENDING                1     //!< wp_wait_async: the operation hasn't completed yet
+
+// control message priority classes (@see wp_get_command_latency)
+#define WP_PRIORITY_BACKGROUND          0     //!< EEPROM access
+#define WP_PRIORITY_NORMAL              1
+#define WP_PRIORITY_URGENT              2     //!< laser disable, wp_cancel_operation
+
+// subsystems reported by wp_get_memory_usage
+#define WP_MEMORY_CORE                  0     //!< spectrometer state and read buffers
+#define WP_MEMORY_EEPROM                1     //!< page cache, parsed fields and string views
+#define WP_MEMORY_AXES                  2     //!< wavelengths and wavenumbers
+#define WP_MEMORY_TRIGGERED             3     //!< hardware-triggering transfers and queue
+#define WP_MEMORY_AREA_SCAN             4     //!< area-scan frame
+#define WP_MEMORY_FLIGHT_RECORDER       5     //!< flight recorder ring and dump buffer
+#define WP_MEMORY_FRAME_POOL            6     //!< preallocated frame buffers
+#define WP_MEMORY_SUBSYSTEMS            7
+
+// wp_set_frame_pool flags
+#define WP_FRAME_POOL_LOCK              0x01  //!< lock the pool into RAM (mlock / VirtualLock)
+#define WP_FRAME_POOL_HUGE_PAGES        0x02  //!< back the pool with huge pages where available
+
+// statistics reported by wp_get_frame_pool_stats
+#define WP_FRAME_POOL_STAT_FRAMES       0     //!< frames in the pool
+#define WP_FRAME_POOL_STAT_IN_USE       1     //!< frames currently drawn
+#define WP_FRAME_POOL_STAT_HIGH_WATER   2     //!< most frames drawn at once
+#define WP_FRAME_POOL_STAT_ACQUIRED     3     //!< total frames drawn
+#define WP_FRAME_POOL_STAT_EXHAUSTED    4     //!< draws which found the pool empty (and used the heap)
+#define WP_FRAME_POOL_STAT_BYTES        5     //!< size of the pool
+#define WP_FRAME_POOL_STAT_LOCKED_BYTES 6     //!< bytes locked into RAM
+#define WP_FRAME_POOL_STAT_PAGE_TYPE    7     //!< 0 normal, 1 transparent huge, 2 explicit huge pages
+#define WP_FRAME_POOL_STAT_PAGE_FAULTS  8     //!< faults on acquisition threads while reading into the pool (-1 if unsupported)
+#define WP_FRAME_POOL_STATS             9
+
+// wp_set_deadband metrics
+#define WP_DEADBAND_OFF                 0     //!< deliver every frame (default)
+#define WP_DEADBAND_MAX_ABS             1     //!< largest per-pixel change
+#define WP_DEADBAND_RMS                 2     //!< root-mean-square change
+
+//! Commonly-polled spectrometer state, filled by wp_get_status.
+typedef struct
+{
+    float detectorTemperatureDegC;  //!< WP_ERROR_INVALID_TEMPERATURE if uncooled
+    int   detectorTECEnable;
+    int   detectorTECSetpointDegC;  //!< WP_ERROR_INVALID_TEMPERATURE if uncooled
+    int   laserEnable;
+    int   integrationTimeMS;
+    float detectorGain;             //!< WP_ERROR_INVALID_GAIN if unknown
+    int   detectorOffset;           //!< WP_ERROR_INVALID_OFFSET if unknown
+    int   highGainModeEnable;       //!< InGaAs only
+} wp_status;
+
+//! Completion callback for asynchronous control messages (@see wp_send_control_msg_async).
+//!
+//! Called on the library's USB event thread, so it must not block, nor call 
+//! any synchronous wp_* function (queueing further *_async operations is fine).
+//!
+//! @param specIndex which spectrometer
+//! @param handle as returned when the operation was queued
+//! @param result bytes transferred, or negative on error
+//! @param data response to a read (valid only during the callback, else NULL)
+//! @param userData as passed when the operation was queued
+typedef void (*wp_async_callback)(int specIndex, int handle, int result, const unsigned char* data, void* userData);
+
 // Although we're using a C++ compiler (as the library is written in C++), we 
 // want these function symbols to be compiled with C linkage (no C++ mangling). 
 // This will ensure that the broadest range of customer languages, compilers and
@@ -158,6 +227,95 @@ extern "C"
     //! @returns WP_SUCCESS or non-zero on error
     DLL_API int wp_close_spectrometer(int specIndex);
 
+    //! Whether to remember each spectrometer's settings when it's closed.
+    //!
+    //! When enabled (it's off by default), closing a spectrometer saves its 
+    //! integration time, detector gain and offsets, TEC setpoint and enable, 
+    //! high-gain mode, and laser power and modulation, keyed by serial number.
+    //! If the same unit is opened again later in the session (e.g. after it 
+    //! drops off the bus and wp_open_all_spectrometers() re-enumerates it), 
+    //! those settings are written in one pass in place of the EEPROM startup
+    //! defaults.  The laser is always left disabled.
+    //!
+    //! @param flag (Input) non-zero to enable; zero to disable (also forgets
+    //!        anything already saved)
+    //! @returns WP_SUCCESS
+    DLL_API int wp_set_warm_restore(int flag);
+
+    //! Whether the spectrometer was configured from saved settings when opened.
+    //! @param specIndex (Input) which spectrometer
+    //! @returns 1 if restored, 0 if initialized from EEPROM, negative on error
+    //! @see wp_set_warm_restore
+    DLL_API int wp_get_warm_restored(int specIndex);
+
+    //! Approximate heap held by the library, by subsystem.
+    //!
+    //! @param specIndex (Input) which spectrometer, or -1 for all those open
+    //!        (their indices needn't be contiguous, e.g. after closing one)
+    //! @param bytes (Output) pre-allocated array of 'len' values, indexed by
+    //!        the WP_MEMORY macros
+    //! @param len (Input) allocated length of 'bytes' (up to WP_MEMORY_SUBSYSTEMS)
+    //! @returns WP_SUCCESS or non-zero on error
+    DLL_API int wp_get_memory_usage(int specIndex, long long* bytes, int len);
+
+    //! Cap the memory the library's optional buffers may use.
+    //!
+    //! Hardware-triggering queues and flight recorders are shrunk to fit the 
+    //! remaining budget when created, and fail (rather than pushing the host
+    //! into swap) if not even one frame fits; area-scan mode fails to enable
+    //! if its frame doesn't fit.  Buffers already allocated are unaffected.
+    //!
+    //! @param bytes (Input) total for all spectrometers, or 0 for unlimited (default)
+    //! @returns WP_SUCCESS or non-zero on error
+    DLL_API int wp_set_memory_budget(long long bytes);
+
+    //! Reduce the per-spectrometer footprint for embedded hosts.
+    //!
+    //! In compact mode, EEPROM fields are not kept as strings (so 
+    //! wp_get_eeprom_field_count returns 0, and wp_get_eeprom_field fails; 
+    //! the typed accessors are unaffected), and wavelength and wavenumber axes
+    //! are held in single precision.  Applies to open spectrometers and any 
+    //! opened later (string pointers from wp_get_eeprom are invalidated).
+    //!
+    //! @param flag (Input) non-zero to enable
+    //! @returns WP_SUCCESS
+    DLL_API int wp_set_compact_mode(int flag);
+
+    //! Size each spectrometer's frame pool.
+    //!
+    //! Every acquisition path needing a frame of its own (the converting 
+    //! reads such as wp_get_spectrum_float, hardware triggering, throwaway
+    //! frames) reads into frames drawn from a pool preallocated when the 
+    //! spectrometer is opened, so the acquisition itself makes no heap 
+    //! allocations and, once the pool is locked, takes no page faults.
+    //! wp_get_spectrum reads straight into the caller's array.
+    //! Frames are cache-line aligned.  The default is 4 frames, unlocked,
+    //! which covers software-triggered acquisition; size it to the 
+    //! wp_start_triggered_acquisition maxFrames plus 1 to cover hardware 
+    //! triggering too.  If the pool runs out, frames come from the heap (see
+    //! WP_FRAME_POOL_STAT_EXHAUSTED).
+    //!
+    //! Locking needs RLIMIT_MEMLOCK (Linux) or a large enough working set 
+    //! (Windows).  Explicit huge pages need reserved pages (Linux 
+    //! vm.nr_hugepages) or SeLockMemoryPrivilege (Windows); failing those, 
+    //! Linux falls back to transparent huge pages.  Either option falls back
+    //! to normal behavior with an error logged.
+    //!
+    //! @param specIndex (Input) which spectrometer, or -1 for all open 
+    //!        spectrometers and any opened later
+    //! @param frames (Input) frames to preallocate (0 to disable pooling)
+    //! @param flags (Input) WP_FRAME_POOL_LOCK and/or WP_FRAME_POOL_HUGE_PAGES
+    //! @returns WP_SUCCESS or non-zero on error (e.g. not even one frame fits
+    //!          wp_set_memory_budget, in which case the current pool is kept)
+    DLL_API int wp_set_frame_pool(int specIndex, int frames, int flags);
+
+    //! @param specIndex (Input) which spectrometer
+    //! @param stats (Output) pre-allocated array of 'len' values, indexed by
+    //!        the WP_FRAME_POOL_STAT macros
+    //! @param len (Input) allocated length of 'stats' (up to WP_FRAME_POOL_STATS)
+    //! @returns WP_SUCCESS or non-zero on error
+    DLL_API int wp_get_frame_pool_stats(int specIndex, long long* stats, int len);
+
     //! Permanently releases all objects from memory.  It is recommended to 
     //! close and restart the application be after calling this function, before 
     //! wp_open_all_spectrometers can be called again.
@@ -194,14 +352,14 @@ extern "C"
     //!
     //! Note this doesn't actually copy any data...all it does is copy the 
     //! current pointer location of each EEPROM field name and stringified
-    //! value from the EEPROM::stringified map.  Currently, there is no 
-    //! use-case where those strings are changed after the spectrometer is
-    //! instantiated, partly because we're not yet supporting "EEPROM write".
-    //!
-    //! Therefore these character pointers SHOULD be valid until the 
-    //! spectrometers are closed and their EEPROM objects destroyed.  However,
-    //! it would probably be a good idea for calling code to make copies of
-    //! these values if it wants to persist them.  (This is what 
+    //! value from the EEPROM::stringified map.  Those strings are replaced
+    //! whenever the EEPROM is rewritten (wp_commit_eeprom, 
+    //! wp_write_eeprom_page) or compact mode changes (wp_set_compact_mode).
+    //!
+    //! Therefore these character pointers are only valid until one of those
+    //! calls, or until the spectrometers are closed and their EEPROM objects
+    //! destroyed.  Calling code should make copies of these values if it 
+    //! wants to persist them.  (This is what 
     //! WasatchVCPP::Proxy does, instantiating each field into a new 
     //! map<string, string> immediately after calling this function.)
     //!
@@ -229,8 +387,63 @@ extern "C"
     //! @see ENG-0034
     DLL_API int wp_get_eeprom_page(int specIndex, int page, unsigned char* buf, int len);
 
+    //! Write one page of the EEPROM in raw binary form.
+    //!
+    //! The page is verified by read-back (and skipped if unchanged), after 
+    //! which the library's cached copy of the EEPROM is updated and re-parsed.
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param pageIndex (Input) which page (0-7)
+    //! @param data (Input) the new page contents
+    //! @param dataLen (Input) length of data (must be 64)
+    //! @returns number of bytes written (64), or negative on error
+    //! @see wp_commit_eeprom for a verified, multi-page alternative
     DLL_API int wp_write_eeprom_page(int specIndex, int pageIndex, unsigned char* data, int dataLen);
 
+    //! Change one EEPROM field (in memory only) by name.
+    //!
+    //! Values are given in the same stringified form returned by 
+    //! wp_get_eeprom_field, and are range-checked against the EEPROM layout.
+    //! Changes are staged: they're not written to the spectrometer (or 
+    //! reported by wp_get_eeprom_field) until wp_commit_eeprom.
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param name (Input) case-insensitive name of the EEPROM field
+    //! @param value (Input) new value, as a string
+    //! @returns WP_SUCCESS or non-zero on error (unknown field, invalid value)
+    DLL_API int wp_set_eeprom_field(int specIndex, const char* name, const char* value);
+
+    //! Write all changes made through wp_set_eeprom_field to the spectrometer.
+    //!
+    //! Only the changed fields are re-encoded, so only pages holding them are
+    //! transferred (none, if nothing was changed), and each is verified by 
+    //! read-back.  If the commit fails, the changes remain staged.  The library's parsed
+    //! EEPROM, wavelengths and wavenumbers are updated in place, so there is
+    //! no need to re-open the spectrometer afterwards.  If anything is to be
+    //! written, a running triggered acquisition is stopped and area-scan mode
+    //! disabled first, since the detector geometry they were sized for may 
+    //! change.
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param pagesWritten (Output) optional number of pages transferred (may be NULL)
+    //! @param elapsedMS (Output) optional duration of the commit (may be NULL)
+    //! @returns WP_SUCCESS or non-zero on error
+    DLL_API int wp_commit_eeprom(int specIndex, int* pagesWritten, float* elapsedMS);
+
+    //! Write a complete raw EEPROM image to the spectrometer.
+    //!
+    //! Like wp_commit_eeprom, only changed pages are transferred and each is 
+    //! verified by read-back (stopping triggered and area-scan acquisition 
+    //! first).
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param image (Input) 8 pages of 64 bytes
+    //! @param len (Input) length of image (must be 512)
+    //! @param pagesWritten (Output) optional number of pages transferred (may be NULL)
+    //! @param elapsedMS (Output) optional duration of the commit (may be NULL)
+    //! @returns WP_SUCCESS or non-zero on error
+    DLL_API int wp_write_eeprom(int specIndex, const unsigned char* image, int len, int* pagesWritten, float* elapsedMS);
+
     //! Read one stringified EEPROM field by name.
     //!
     //! If you don't want to call wp_get_eeprom and only want one or two fields
@@ -335,6 +548,194 @@ extern "C"
     //! @returns WP_SUCCESS or non-zero on error
     DLL_API int wp_get_spectrum_float(int specIndex, float* spectrum, int len);
 
+    //! Read one spectrum as IEEE 754 half precision (binary16).
+    //!
+    //! Converted inside the library (with F16C or NEON where available), so
+    //! callers feeding fp16 transports or models don't make their own pass 
+    //! over a buffer of doubles.  Intensities round to nearest even, which is
+    //! exact for counts up to 2048 and within 1/2048 relative above; counts 
+    //! above 65504 (the largest half) saturate there.
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param spectrum (Output) pre-allocated buffer of 'len' binary16 values
+    //! @param len (Input) allocated length of 'spectrum' (should match 'pixels')
+    //! @returns WP_SUCCESS or non-zero on error
+    DLL_API int wp_get_spectrum_fp16(int specIndex, unsigned short* spectrum, int len);
+
+    //! Read one spectrum as bfloat16 (the upper half of an IEEE binary32).
+    //!
+    //! As wp_get_spectrum_fp16, but with float's range and 8 significant 
+    //! bits: exact for counts up to 256, within 1/256 relative above.
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param spectrum (Output) pre-allocated buffer of 'len' bfloat16 values
+    //! @param len (Input) allocated length of 'spectrum' (should match 'pixels')
+    //! @returns WP_SUCCESS or non-zero on error
+    DLL_API int wp_get_spectrum_bf16(int specIndex, unsigned short* spectrum, int len);
+
+    //! Read one spectrum as scaled integer counts.
+    //!
+    //! Each intensity is multiplied by 'scale', rounded half away from zero 
+    //! and saturated to the int range.  With a scale of 1, this is the raw 
+    //! counts at half the size of doubles; a power of two keeps fractional 
+    //! bits for fixed-point consumers.
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param spectrum (Output) pre-allocated buffer of 'len' ints
+    //! @param len (Input) allocated length of 'spectrum' (should match 'pixels')
+    //! @param scale (Input) multiplier applied before rounding
+    //! @returns WP_SUCCESS or non-zero on error
+    DLL_API int wp_get_spectrum_int32(int specIndex, int* spectrum, int len, double scale);
+
+    //! As wp_get_spectrum, also reporting the settings generation the spectrum
+    //! was taken under.
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param spectrum (Output) pre-allocated buffer of 'len' doubles 
+    //! @param len (Input) allocated length of 'spectrum' (should match 'pixels')
+    //! @param generation (Output) compare with wp_get_settings_generation
+    //! @returns WP_SUCCESS or non-zero on error
+    DLL_API int wp_get_spectrum_with_generation(int specIndex, double* spectrum, int len, int* generation);
+
+    //! The spectrometer's current settings generation.
+    //!
+    //! This is incremented by every change to integration time, detector gain,
+    //! detector offset, high-gain mode, or laser power (modulation), so a 
+    //! spectrum whose generation matches was taken entirely under the current
+    //! settings.
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @returns generation (wraps from 0x7fffffff to 0), or negative on error
+    DLL_API int wp_get_settings_generation(int specIndex);
+
+    //! Automatically discard frames taken too soon after a settings change.
+    //!
+    //! After each change counted by wp_get_settings_generation, the next 
+    //! 'frames' spectra (and any spectrum straddling the change) are read and
+    //! thrown away inside the library.  This starts in the background as soon
+    //! as the setting is written, so often the stale frame has already been
+    //! consumed by the time wp_get_spectrum is next called; otherwise 
+    //! wp_get_spectrum discards it first.  Applies to software-triggered 
+    //! acquisitions, not hardware triggering or area scan.
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param frames (Input) frames to discard per change (default 0, disabled)
+    //! @returns WP_SUCCESS or non-zero on error
+    DLL_API int wp_set_throwaway_frames(int specIndex, int frames);
+
+    //! @param specIndex (Input) which spectrometer
+    //! @returns frames discarded since the spectrometer was opened, or 
+    //!          negative on error
+    //! @see wp_set_throwaway_frames
+    DLL_API int wp_get_throwaway_count(int specIndex);
+
+    //! Read an averaged, dark-corrected and gain-corrected spectrum.
+    //!
+    //! Reads wp_set_scans_to_average spectra, then returns 
+    //! (mean - dark) * gain per pixel, using whatever has been configured 
+    //! through wp_set_dark_correction and wp_set_gain_correction.  Scans are
+    //! summed as raw integer counts; @see wp_set_fixed_point_processing for
+    //! how the result is computed.  wp_get_spectrum is unaffected.  Each scan
+    //! goes to the flight recorder (raw), and the result to the display 
+    //! stream.
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param spectrum (Output) pre-allocated buffer of 'len' floats
+    //! @param len (Input) allocated length of 'spectrum' (should match 'pixels')
+    //! @returns WP_SUCCESS or non-zero on error
+    DLL_API int wp_get_processed_spectrum(int specIndex, float* spectrum, int len);
+
+    //! @param specIndex (Input) which spectrometer
+    //! @param scans (Input) spectra averaged by wp_get_processed_spectrum 
+    //!        (1 to 32768, default 1)
+    //! @returns WP_SUCCESS or non-zero on error
+    DLL_API int wp_set_scans_to_average(int specIndex, int scans);
+
+    //! Set the dark subtracted by wp_get_processed_spectrum.
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param dark (Input) per-pixel dark counts (clamped to 0-65535), or 
+    //!        NULL to disable dark correction
+    //! @param len (Input) length of 'dark' (must match 'pixels')
+    //! @returns WP_SUCCESS or non-zero on error
+    DLL_API int wp_set_dark_correction(int specIndex, double* dark, int len);
+
+    //! Set the per-pixel multipliers (for instance Raman intensity 
+    //! calibration factors) applied by wp_get_processed_spectrum after dark 
+    //! subtraction.
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param gain (Input) per-pixel factors (magnitude at most 127), or NULL
+    //!        to disable gain correction
+    //! @param len (Input) length of 'gain' (must match 'pixels')
+    //! @returns WP_SUCCESS or non-zero on error
+    DLL_API int wp_set_gain_correction(int specIndex, double* gain, int len);
+
+    //! Choose how wp_get_processed_spectrum computes its result.
+    //!
+    //! The fixed-point pipeline subtracts the dark in int32 and applies gains
+    //! in Q7.24 fixed point, converting to float only for the output, which
+    //! is much faster on processors with slow or software-emulated double 
+    //! precision (e.g. 32-bit ARM).  Results differ from the double-precision
+    //! pipeline by under 0.01 count plus a few parts in 10^7.
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param flag (Input) non-zero for fixed point (the default on 32-bit 
+    //!        ARM), zero for double precision (the default elsewhere)
+    //! @returns WP_SUCCESS or non-zero on error
+    DLL_API int wp_set_fixed_point_processing(int specIndex, int flag);
+
+    //! Set a per-pixel formula applied by wp_get_expression_spectrum.
+    //!
+    //! The formula is arithmetic over per-pixel buffers, numbers and named
+    //! constants, e.g. "(s - dark) / (ref - dark) * k" or "log10(ref / s)".
+    //! Buffers are s (the spectrum), dark and ref (set through 
+    //! wp_set_expression_buffer), and wl and wn (the wavelength and 
+    //! wavenumber axes).  Operators are + - * / ^ and parentheses; functions
+    //! are abs, sqrt, exp, log, log10, min and max.  Constants must be
+    //! defined through wp_set_expression_constant first.
+    //!
+    //! The formula is compiled once, and evaluated in a single pass over 
+    //! each spectrum.  That pass still runs one loop per operation (over a
+    //! cache-resident chunk of pixels): it roughly matches the same formula
+    //! hand-written in C++ at -O2, but where the compiler vectorizes the
+    //! whole hand-written loop (e.g. gcc -O3), a formula of several
+    //! operations can take up to twice as long (tests/bench-expression 
+    //! measures both).  Write the loop by hand where every microsecond 
+    //! counts.
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param expression (Input) null-terminated formula, or NULL to clear
+    //! @returns WP_SUCCESS or non-zero on error (e.g. a syntax error, which
+    //!          is logged, and leaves any previous formula in place)
+    DLL_API int wp_set_expression(int specIndex, const char* expression);
+
+    //! Set a per-pixel buffer referenced by the formula.
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param name (Input) "dark" or "ref"
+    //! @param values (Input) per-pixel values, or NULL to clear
+    //! @param len (Input) length of 'values' (must match 'pixels')
+    //! @returns WP_SUCCESS or non-zero on error
+    DLL_API int wp_set_expression_buffer(int specIndex, const char* name, double* values, int len);
+
+    //! Define a named constant for formulas, or change its value (which 
+    //! takes effect without calling wp_set_expression again).
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param name (Input) letters, digits and underscores
+    //! @param value (Input) the constant's value
+    //! @returns WP_SUCCESS or non-zero on error
+    DLL_API int wp_set_expression_constant(int specIndex, const char* name, double value);
+
+    //! Read a spectrum and apply the formula set through wp_set_expression.
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param spectrum (Output) pre-allocated buffer of 'len' doubles
+    //! @param len (Input) allocated length of 'spectrum' (should match 'pixels')
+    //! @returns WP_SUCCESS or non-zero on error
+    DLL_API int wp_get_expression_spectrum(int specIndex, double* spectrum, int len);
+
     //! If an acquisition is currently in progress, cancel it.
     //!
     //! Note that while this function will return instantly, the current
@@ -386,6 +787,392 @@ extern "C"
     //! @returns configured maximum timeout (ms)
     DLL_API int wp_get_max_timeout_ms(int specIndex);
 
+    ////////////////////////////////////////////////////////////////////////////
+    // Auto-Dark (Raman)
+    ////////////////////////////////////////////////////////////////////////////
+
+    //! Configure wp_get_auto_dark_spectrum.  Also discards any stored dark.
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param laserWarmupMS (Input) delay after enabling the laser before the
+    //!        sample is acquired
+    //! @param maxDarkAgeMS (Input) reuse the previous dark if no older than this
+    //!        (0 to take a new dark for every sample)
+    //! @param maxDarkTempDeltaDegC (Input) on cooled detectors, only reuse the
+    //!        previous dark if the detector temperature has changed by no more 
+    //!        than this (0 to ignore temperature)
+    //! @returns WP_SUCCESS or non-zero on error
+    DLL_API int wp_set_auto_dark_config(int specIndex, int laserWarmupMS, int maxDarkAgeMS, float maxDarkTempDeltaDegC);
+
+    //! Acquire a dark-corrected Raman spectrum in one call.
+    //!
+    //! With the laser off, a dark is acquired (or a recent one reused, per 
+    //! wp_set_auto_dark_config).  The laser is then enabled, the sample 
+    //! acquired after laserWarmupMS, and the laser disabled again.  The laser
+    //! is always left off on return.
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param corrected (Output) pre-allocated buffer of 'len' doubles to 
+    //!        receive sample - dark
+    //! @param dark (Output) optional buffer of 'len' doubles for the dark (may be NULL)
+    //! @param raw (Output) optional buffer of 'len' doubles for the 
+    //!        uncorrected sample (may be NULL)
+    //! @param len (Input) allocated length of each buffer (should match 'pixels')
+    //! @returns WP_SUCCESS or non-zero on error
+    DLL_API int wp_get_auto_dark_spectrum(int specIndex, double* corrected, double* dark, double* raw, int len);
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Recipes
+    ////////////////////////////////////////////////////////////////////////////
+
+    //! Begin executing a multi-step measurement recipe inside the library.
+    //!
+    //! A recipe is plain text, one step per line ('#' starts a comment):
+    //!
+    //! @code
+    //!     integration_time_ms 100
+    //!     laser_power_perc 50
+    //!     wait_for_tec 0.5 30000      # tolerance degC, timeout ms
+    //!     laser on
+    //!     wait_ms 500
+    //!     acquire 10 sample           # average 10 spectra into "sample"
+    //!     laser off
+    //!     acquire 10 dark
+    //!     subtract sample dark corrected
+    //!     emit corrected              # return "corrected" to the caller
+    //! @endcode
+    //!
+    //! Also supported are laser_power_mw, detector_gain, tec_setpoint_degc
+    //! and at_ms (wait until N ms after the recipe started).
+    //!
+    //! The recipe runs on a background thread with no client round-trips 
+    //! between steps; settings matching the spectrometer's current state are
+    //! not re-sent.  If the recipe enabled the laser, the laser is disabled 
+    //! when the recipe ends, however it ends.
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param recipe (Input) null-terminated recipe text
+    //! @returns WP_SUCCESS or non-zero on error (e.g. parse error, logged 
+    //!          with its line number)
+    DLL_API int wp_start_recipe(int specIndex, const char* recipe);
+
+    //! Read the next result emitted by the running (or finished) recipe.
+    //!
+    //! Results are returned in the order emitted, as soon as each is computed.
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param name (Output) pre-allocated buffer to receive the buffer name
+    //! @param nameLen (Input) allocated length of name
+    //! @param spectrum (Output) pre-allocated buffer of 'pixels' doubles
+    //! @param pixels (Input) allocated length of spectrum
+    //! @param timeoutMS (Input) how long to wait for a result (0 to poll)
+    //! @returns 1 if a result was read, 0 if none (check wp_get_recipe_state),
+    //!          or negative on error
+    DLL_API int wp_read_recipe_result(int specIndex, char* name, int nameLen, double* spectrum, int pixels, int timeoutMS);
+
+    //! @param specIndex (Input) which spectrometer
+    //! @returns WP_RECIPE_* or negative on error
+    DLL_API int wp_get_recipe_state(int specIndex);
+
+    //! Interrupt the running recipe, aborting any integration in progress.
+    //!
+    //! Results already emitted can still be read.
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @returns WP_SUCCESS or non-zero on error
+    DLL_API int wp_stop_recipe(int specIndex);
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Multi-Spectrometer Scheduling
+    ////////////////////////////////////////////////////////////////////////////
+
+    //! Report where a spectrometer sits in the USB topology.
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param bus (Output) USB bus number
+    //! @param ports (Output) optional buffer for the port path from the root
+    //!        hub, e.g. "1.4.2" (may be NULL)
+    //! @param portsLen (Input) allocated length of ports
+    //! @param speedMbps (Output) optional negotiated link speed, or 0 if unknown
+    //! @returns WP_SUCCESS or non-zero on error
+    DLL_API int wp_get_usb_topology(int specIndex, int* bus, char* ports, int portsLen, int* speedMbps);
+
+    //! Plan scheduled acquisitions for one spectrometer.  
+    //!
+    //! Takes effect on the next wp_start_schedule().
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param cadenceHz (Input) requested spectra per second (0 for as fast as
+    //!        possible)
+    //! @param integrationTimeMS (Input) applied when the schedule starts (0 to
+    //!        leave unchanged)
+    //! @returns WP_SUCCESS or non-zero on error
+    DLL_API int wp_set_schedule_plan(int specIndex, float cadenceHz, int integrationTimeMS);
+
+    //! Discard all plans set by wp_set_schedule_plan.
+    //! @returns WP_SUCCESS or non-zero on error
+    DLL_API int wp_clear_schedule_plans();
+
+    //! Begin scheduled acquisitions on every planned spectrometer.
+    //!
+    //! Plans are admitted per USB bus: if the requested cadences on one bus
+    //! would exceed its bulk bandwidth, they are scaled down proportionally,
+    //! without affecting spectrometers on other buses.  Each spectrometer 
+    //! acquires in parallel; triggers on a shared bus are staggered and their
+    //! readouts serialized.
+    //!
+    //! @returns WP_SUCCESS or non-zero on error
+    DLL_API int wp_start_schedule();
+
+    //! Stop scheduled acquisitions.  Stats remain readable.
+    //! @returns WP_SUCCESS or non-zero on error
+    DLL_API int wp_stop_schedule();
+
+    //! Report requested versus achieved rates for one scheduled spectrometer.
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param requestedHz (Output) as planned
+    //! @param grantedHz (Output) after per-bus bandwidth admission
+    //! @param achievedHz (Output) measured since wp_start_schedule
+    //! @param frames (Output) spectra acquired
+    //! @param late (Output) acquisitions which missed their scheduled slot
+    //! @returns WP_SUCCESS or non-zero on error
+    DLL_API int wp_get_schedule_stats(int specIndex, float* requestedHz, float* grantedHz, float* achievedHz, int* frames, int* late);
+
+    //! Copy the latest scheduled spectrum from one spectrometer.
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param spectrum (Output) pre-allocated buffer of 'len' doubles
+    //! @param len (Input) allocated length of spectrum
+    //! @returns number of spectra acquired so far (0 if none yet; compare 
+    //!          with the previous call to detect a new one), or negative on error
+    DLL_API int wp_get_scheduled_spectrum(int specIndex, double* spectrum, int len);
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Area Scan
+    ////////////////////////////////////////////////////////////////////////////
+
+    //! Enable or disable area-scan mode.
+    //!
+    //! In area-scan mode, the spectrometer reads out the entire 2D detector
+    //! (wp_get_area_scan_rows x wp_get_pixels) rather than a single binned 
+    //! spectrum.  Use wp_get_area_scan_frame or wp_get_area_scan_binned to
+    //! acquire; wp_get_spectrum should not be used while area scan is enabled.
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param value (Input) non-zero to enable, zero to disable
+    //! @returns WP_SUCCESS or non-zero on error
+    DLL_API int wp_set_area_scan_enable(int specIndex, int value);
+
+    //! @param specIndex (Input) which spectrometer
+    //! @returns number of rows in an area-scan frame (negative on error)
+    DLL_API int wp_get_area_scan_rows(int specIndex);
+
+    //! Acquire one complete 2D area-scan frame.
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param frame (Output) pre-allocated buffer of rows * cols doubles, 
+    //!        filled row-major
+    //! @param rows (Input) should match wp_get_area_scan_rows
+    //! @param cols (Input) should match wp_get_pixels
+    //! @param timeoutMS (Input) how long to wait for each row
+    //! @returns WP_SUCCESS, WP_ERROR_INSUFFICIENT_STORAGE (before acquiring)
+    //!          if the buffer is too small, or non-zero on error
+    DLL_API int wp_get_area_scan_frame(int specIndex, double* frame, int rows, int cols, int timeoutMS);
+
+    //! Acquire one area-scan frame, and return the vertical sum of a range
+    //! of rows as a single spectrum.
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param spectrum (Output) pre-allocated buffer of 'len' doubles
+    //! @param len (Input) should match wp_get_pixels
+    //! @param firstRow (Input) first row to bin (0-indexed)
+    //! @param lastRow (Input) last row to bin (inclusive)
+    //! @param timeoutMS (Input) how long to wait for each row
+    //! @returns WP_SUCCESS, WP_ERROR_INSUFFICIENT_STORAGE (before acquiring)
+    //!          if the buffer is too small, or non-zero on error
+    DLL_API int wp_get_area_scan_binned(int specIndex, double* spectrum, int len, int firstRow, int lastRow, int timeoutMS);
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Hardware Triggering
+    ////////////////////////////////////////////////////////////////////////////
+
+    //! Arm the spectrometer for external (hardware) triggering and begin 
+    //! continuously collecting triggered spectra in the background.
+    //!
+    //! Requires a Gen 1.5 spectrometer (accessory connector).  Bulk reads are
+    //! kept permanently queued, so spectra are collected at whatever rate the
+    //! trigger fires, without any further calls into the library; use 
+    //! wp_read_triggered_spectra to collect them.  wp_get_spectrum is 
+    //! unavailable until wp_stop_triggered_acquisition.
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param queueDepth (Input) bulk reads to keep queued per endpoint (e.g. 4)
+    //! @param maxFrames (Input) spectra to buffer before the oldest are dropped
+    //! @returns WP_SUCCESS or non-zero on error
+    DLL_API int wp_start_triggered_acquisition(int specIndex, int queueDepth, int maxFrames);
+
+    //! Collect one or more buffered spectra from a triggered acquisition.
+    //!
+    //! Spectra are returned oldest-first, packed consecutively into 'spectra'.
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param spectra (Output) pre-allocated buffer of maxFrames * pixels doubles
+    //! @param pixels (Input) pixels per spectrum (should match wp_get_pixels)
+    //! @param maxFrames (Input) most spectra to return
+    //! @param arrivalMS (Output) optional per-spectrum arrival time, in ms since 
+    //!        the acquisition started (may be NULL)
+    //! @param latencyMS (Output) optional per-spectrum trigger-to-data latency
+    //!        in ms, or negative if the trigger time is unknown (may be NULL)
+    //! @param timeoutMS (Input) how long to wait if no spectra are buffered
+    //! @returns number of spectra read (0 on timeout), or negative on error
+    DLL_API int wp_read_triggered_spectra(int specIndex, double* spectra, int pixels, int maxFrames, 
+        double* arrivalMS, double* latencyMS, int timeoutMS);
+
+    //! Report that the application has just fired the external trigger.
+    //!
+    //! The spectrometer cannot report when a trigger occurred.  If your code
+    //! generates the trigger pulse, call this at the same time, and the next 
+    //! spectrum received will report trigger-to-data latency.
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @returns WP_SUCCESS or non-zero on error
+    DLL_API int wp_mark_external_trigger(int specIndex);
+
+    //! Statistics for the current (or most recent) triggered acquisition.
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param framesReceived (Output) spectra received (may be NULL)
+    //! @param framesDropped (Output) spectra which were incomplete, or 
+    //!        overwritten before being read (may be NULL)
+    //! @param avgLatencyMS (Output) mean trigger-to-data latency (may be NULL)
+    //! @param maxLatencyMS (Output) worst trigger-to-data latency (may be NULL)
+    //! @returns WP_SUCCESS or non-zero on error
+    DLL_API int wp_get_triggered_acquisition_stats(int specIndex, int* framesReceived, int* framesDropped, 
+        float* avgLatencyMS, float* maxLatencyMS);
+
+    //! Disarm the external trigger and stop background reads.
+    //!
+    //! Spectra already buffered can still be collected with 
+    //! wp_read_triggered_spectra.
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @returns WP_SUCCESS or non-zero on error
+    DLL_API int wp_stop_triggered_acquisition(int specIndex);
+
+    //! Only deliver triggered spectra which differ from the last one delivered.
+    //!
+    //! Each spectrum is compared against the last one delivered, over the 
+    //! regions set by wp_set_deadband_regions.  It's delivered (and recorded 
+    //! by the flight recorder) if the change exceeds the threshold, if 
+    //! heartbeatMS has passed since the last delivery, or if it was taken 
+    //! under different settings; otherwise it's silently discarded.  The 
+    //! first spectrum after wp_start_triggered_acquisition is always delivered.
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param metric (Input) WP_DEADBAND_MAX_ABS, WP_DEADBAND_RMS, or 
+    //!        WP_DEADBAND_OFF to deliver every spectrum
+    //! @param threshold (Input) change in counts a spectrum must exceed
+    //! @param heartbeatMS (Input) deliver at least this often (0 for no heartbeat)
+    //! @returns WP_SUCCESS or non-zero on error
+    DLL_API int wp_set_deadband(int specIndex, int metric, double threshold, int heartbeatMS);
+
+    //! Limit deadband comparisons to parts of the spectrum (for instance the 
+    //! peaks of interest, ignoring a noisy edge).
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param bounds (Input) first and last pixel (inclusive) of each region, 
+    //!        so 2 * count values, or NULL to compare whole spectra (default)
+    //! @param count (Input) number of regions
+    //! @returns WP_SUCCESS or non-zero on error
+    DLL_API int wp_set_deadband_regions(int specIndex, int* bounds, int count);
+
+    //! Deadband statistics since wp_set_deadband was last called.
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param framesDelivered (Output) spectra delivered (may be NULL)
+    //! @param framesSuppressed (Output) spectra discarded as unchanged (may be NULL)
+    //! @param lastChange (Output) change measured on the latest spectrum (may be NULL)
+    //! @returns WP_SUCCESS or non-zero on error
+    DLL_API int wp_get_deadband_stats(int specIndex, int* framesDelivered, int* framesSuppressed, double* lastChange);
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Display
+    ////////////////////////////////////////////////////////////////////////////
+
+    //! Have the library decimate spectra for a live plot.
+    //!
+    //! Each spectrum acquired (through wp_get_spectrum and friends, scheduling,
+    //! recipes or hardware triggering) is divided into 'width' buckets of 
+    //! adjacent pixels, and reduced to the lowest and highest value in each, 
+    //! so narrow peaks stay visible.  Envelopes are made at most maxHz times a
+    //! second, however fast spectra are acquired; collect them with 
+    //! wp_read_display_envelope.
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param width (Input) buckets per envelope, e.g. the plot's width in 
+    //!        screen pixels (capped at 'pixels'), or 0 to disable (default)
+    //! @param maxHz (Input) most envelopes per second (0 for one per spectrum)
+    //! @returns WP_SUCCESS or non-zero on error
+    DLL_API int wp_set_display_stream(int specIndex, int width, float maxHz);
+
+    //! Collect the latest display envelope, if it hasn't already been read.
+    //!
+    //! Only the latest envelope is kept, so a slow reader skips to it.  A 
+    //! reader waiting when the spectrometer is closed returns an error at 
+    //! once.
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param mins (Output) pre-allocated buffer of 'len' floats: the lowest
+    //!        value in each bucket
+    //! @param maxs (Output) pre-allocated buffer of 'len' floats: the highest
+    //!        value in each bucket
+    //! @param len (Input) allocated length of mins and maxs (at least 'width')
+    //! @param timeoutMS (Input) how long to wait for a new envelope
+    //! @returns number of buckets, 0 on timeout, or negative on error 
+    //!          (including if the display stream isn't enabled)
+    DLL_API int wp_read_display_envelope(int specIndex, float* mins, float* maxs, int len, int timeoutMS);
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Flight Recorder
+    ////////////////////////////////////////////////////////////////////////////
+
+    //! Keep the most recent spectra from a spectrometer in memory, so the 
+    //! history leading up to an alarm or process upset can be saved afterwards.
+    //!
+    //! Every spectrum acquired (through wp_get_spectrum and friends, scheduling,
+    //! recipes or hardware triggering) is copied into a fixed-size ring, along
+    //! with its settings generation, integration time and laser state.  The
+    //! spectra are recorded as the detector sent them (raw counts, before any
+    //! processing such as X-axis inversion).  All memory is allocated here, so
+    //! it stays constant while recording.
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param frames (Input) how many spectra to keep (0 to disable)
+    //! @returns WP_SUCCESS or non-zero on error
+    DLL_API int wp_set_flight_recorder(int specIndex, int frames);
+
+    //! Save the flight recorder's history to a CSV file.
+    //!
+    //! The history is snapshotted before this returns, and written to disk in
+    //! the background, so recording carries on undisturbed; use 
+    //! wp_get_flight_recorder_status to tell when the file is complete.  Each
+    //! line holds one spectrum, oldest first, timestamped in milliseconds 
+    //! before the dump.
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param pathname (Input) file to create
+    //! @param len (Input) length of pathname
+    //! @returns WP_SUCCESS, or non-zero if not enabled, nothing has been 
+    //!          recorded, or the previous dump is still being written
+    DLL_API int wp_dump_flight_recorder(int specIndex, const char* pathname, int len);
+
+    //! @param specIndex (Input) which spectrometer
+    //! @param frames (Output) spectra currently held (may be NULL)
+    //! @param dumping (Output) 1 while a dump is being written (may be NULL)
+    //! @returns WP_SUCCESS or non-zero on error (including if not enabled)
+    DLL_API int wp_get_flight_recorder_status(int specIndex, int* frames, int* dumping);
+
     ////////////////////////////////////////////////////////////////////////////
     // Opcodes
     ////////////////////////////////////////////////////////////////////////////
@@ -398,9 +1185,13 @@ extern "C"
 
     //! Turns the laser on or off.
     //!
+    //! Disabling the laser is sent ahead of other pending commands, and any
+    //! enable requested before it (but not yet sent) is dropped.
+    //!
     //! @param specIndex (Input) which spectrometer
     //! @param value (Input) whether laser should be off (zero) or on (non-zero)
-    //! @returns WP_SUCCESS or non-zero on error
+    //! @returns WP_SUCCESS or non-zero on error (including an enable dropped
+    //!          in favor of a later disable)
     DLL_API int wp_set_laser_enable(int specIndex, int value);
 
     //! Sets laser power as a percentage of max power.
@@ -576,6 +1367,20 @@ extern "C"
     //! @returns 1 if enabled, 0 if disabled, negative on error
     DLL_API int wp_get_high_gain_mode_enable(int specIndex);
 
+    //! Read all commonly-polled state in one call.
+    //!
+    //! Equivalent to calling wp_get_detector_temperature_deg_c, 
+    //! wp_get_detector_tec_enable, wp_get_detector_tec_setpoint_deg_c, 
+    //! wp_get_laser_enable, wp_get_integration_time_ms, wp_get_detector_gain,
+    //! wp_get_detector_offset and wp_get_high_gain_mode_enable, but settings 
+    //! written through this library are reported from cache, so normally only
+    //! the temperature and laser state are read from the spectrometer.
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param status (Output) caller-allocated struct to fill
+    //! @returns WP_SUCCESS or non-zero on error
+    DLL_API int wp_get_status(int specIndex, wp_status* status);
+
     //! Provide direct access to writing spectrometer opcodes via USB setup 
     //! packets (endpoint 0 control 
     //!
@@ -637,6 +1442,119 @@ extern "C"
                                     unsigned int wIndex,
                                     unsigned char* data,
                                     int len);
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Asynchronous Control
+    ////////////////////////////////////////////////////////////////////////////
+
+    //! Queue a control message to be written to the spectrometer, returning
+    //! immediately rather than blocking for the USB round-trip.
+    //!
+    //! Asynchronous operations on each spectrometer are sent one at a time,
+    //! in the order queued, interleaved with synchronous calls.  Each returns
+    //! a handle which can be polled or waited on through wp_wait_async, or
+    //! else reports completion through a callback.
+    //!
+    //! @warning the same cautions apply as for wp_send_control_msg
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param bRequest (Input) control packet request (uint8_t)
+    //! @param wValue (Input) control packet wValue (uint16_t)
+    //! @param wIndex (Input) control packet wIndex (uint16_t)
+    //! @param data (Input) control packet payload (copied before returning)
+    //! @param len (Input) length of control packet payload 
+    //! @param callback (Input) called on completion (NULL to use wp_wait_async 
+    //!        instead; handles with a callback can't be waited on)
+    //! @param userData (Input) passed through to callback
+    //! @returns handle (positive), or negative on error
+    DLL_API int wp_send_control_msg_async(int specIndex, 
+                                          unsigned char bRequest, 
+                                          unsigned int wValue,
+                                          unsigned int wIndex,
+                                          unsigned char* data,
+                                          int len,
+                                          wp_async_callback callback,
+                                          void* userData);
+
+    //! Queue a control message to be read from the spectrometer.
+    //!
+    //! @see wp_send_control_msg_async
+    //! @param specIndex (Input) which spectrometer
+    //! @param bRequest (Input) control packet request (uint8_t)
+    //! @param wIndex (Input) control packet wIndex (uint16_t)
+    //! @param len (Input) number of bytes to read
+    //! @param callback (Input) called on completion with the response (or NULL)
+    //! @param userData (Input) passed through to callback
+    //! @returns handle (positive), or negative on error
+    DLL_API int wp_read_control_msg_async(int specIndex, 
+                                          unsigned char bRequest, 
+                                          unsigned int wIndex,
+                                          int len,
+                                          wp_async_callback callback,
+                                          void* userData);
+
+    //! Queue an integration time change (@see wp_set_integration_time_ms).
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param ms (Input) integration time in milliseconds
+    //! @param callback (Input) called on completion (or NULL)
+    //! @param userData (Input) passed through to callback
+    //! @returns handle (positive), or negative on error
+    DLL_API int wp_set_integration_time_ms_async(int specIndex, unsigned long ms, wp_async_callback callback, void* userData);
+
+    //! Queue a laser enable change (@see wp_set_laser_enable).
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param value (Input) whether laser should be off (zero) or on (non-zero)
+    //! @param callback (Input) called on completion (or NULL)
+    //! @param userData (Input) passed through to callback
+    //! @returns handle (positive), or negative on error
+    DLL_API int wp_set_laser_enable_async(int specIndex, int value, wp_async_callback callback, void* userData);
+
+    //! Poll or wait for an asynchronous operation queued without a callback.
+    //!
+    //! Once reported complete, the handle is released.  Completed operations
+    //! are only held for collection up to the most recent 1024 per 
+    //! spectrometer; older ones are released uncollected (and then reported 
+    //! as unknown handles), so operations nobody waits on don't accumulate.
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param handle (Input) as returned when the operation was queued
+    //! @param timeoutMS (Input) how long to wait (0 to poll)
+    //! @param result (Output) bytes transferred, or negative on error
+    //! @param data (Output) response to a read (may be NULL for writes)
+    //! @param len (Input) size of data
+    //! @returns WP_SUCCESS if complete, WP_ASYNC_PENDING if not yet, or 
+    //!          negative on error (including an unknown handle)
+    DLL_API int wp_wait_async(int specIndex, int handle, int timeoutMS, int* result, unsigned char* data, int len);
+
+    //! @param specIndex (Input) which spectrometer
+    //! @returns number of asynchronous operations queued or in flight (negative on error)
+    DLL_API int wp_get_async_pending(int specIndex);
+
+    //! Report how long control messages have waited for the spectrometer's 
+    //! control endpoint, by priority class.
+    //!
+    //! Control messages, synchronous or asynchronous, are granted the endpoint
+    //! by class: urgent messages (disabling the laser, and the integration-
+    //! time write behind wp_cancel_operation) go ahead of anything else 
+    //! waiting, so wait for at most the one transfer already in progress; 
+    //! EEPROM access yields to everything else.  Within a class, messages go
+    //! in order.
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @param priority (Input) WP_PRIORITY_BACKGROUND, _NORMAL or _URGENT
+    //! @param count (Output) messages sent in that class since the last reset
+    //! @param avgMS (Output) average wait for the endpoint
+    //! @param maxMS (Output) longest wait for the endpoint
+    //! @returns WP_SUCCESS or non-zero on error
+    DLL_API int wp_get_command_latency(int specIndex, int priority, int* count, float* avgMS, float* maxMS);
+
+    //! Clear the statistics reported by wp_get_command_latency.
+    //!
+    //! @param specIndex (Input) which spectrometer
+    //! @returns WP_SUCCESS or non-zero on error
+    DLL_API int wp_reset_command_latency(int specIndex);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -862,6 +1780,12 @@ namespace WasatchVCPP
                 //! @see wp_get_high_gain_mode_enable
                 bool getHighGainModeEnable() { return 0 != wp_get_high_gain_mode_enable(specIndex); }
 
+                //! @see wp_get_status
+                bool getStatus(wp_status& status) { return WP_SUCCESS == wp_get_status(specIndex, &status); }
+
+                //! @see wp_get_warm_restored
+                bool getWarmRestored() { return 1 == wp_get_warm_restored(specIndex); }
+
                 //! @see wp_send_control_msg 
                 //! @warning no seriously, you need to follow that link
                 int sendControlMsg(uint8_t bRequest, uint16_t wValue, uint16_t wIndex, uint8_t* data, int len)
@@ -872,6 +1796,44 @@ namespace WasatchVCPP
                 int readControlMsg(uint8_t bRequest, uint16_t wIndex, uint8_t* data, int len)
                 { return wp_read_control_msg(specIndex, bRequest, wIndex, data, len); }
 
+                //! @see wp_send_control_msg_async
+                int sendControlMsgAsync(uint8_t bRequest, uint16_t wValue, uint16_t wIndex, uint8_t* data, int len,
+                        wp_async_callback callback = nullptr, void* userData = nullptr)
+                { return wp_send_control_msg_async(specIndex, bRequest, wValue, wIndex, data, len, callback, userData); }
+
+                //! @see wp_read_control_msg_async
+                int readControlMsgAsync(uint8_t bRequest, uint16_t wIndex, int len,
+                        wp_async_callback callback = nullptr, void* userData = nullptr)
+                { return wp_read_control_msg_async(specIndex, bRequest, wIndex, len, callback, userData); }
+
+                //! @see wp_set_integration_time_ms_async
+                int setIntegrationTimeMSAsync(unsigned long ms, wp_async_callback callback = nullptr, void* userData = nullptr)
+                { return wp_set_integration_time_ms_async(specIndex, ms, callback, userData); }
+
+                //! @see wp_set_laser_enable_async
+                int setLaserEnableAsync(bool flag, wp_async_callback callback = nullptr, void* userData = nullptr)
+                { return wp_set_laser_enable_async(specIndex, flag, callback, userData); }
+
+                //! @see wp_get_command_latency
+                bool getCommandLatency(int priority, int& count, float& avgMS, float& maxMS)
+                { return WP_SUCCESS == wp_get_command_latency(specIndex, priority, &count, &avgMS, &maxMS); }
+
+                //! @see wp_reset_command_latency
+                bool resetCommandLatency() { return WP_SUCCESS == wp_reset_command_latency(specIndex); }
+
+                //! @see wp_wait_async
+                //! @returns true if the operation completed (with its result in 'result')
+                bool waitAsync(int handle, int timeoutMS, int& result, std::vector<uint8_t>* response = nullptr)
+                {
+                    uint8_t* data = response != nullptr && !response->empty() ? &(*response)[0] : nullptr;
+                    int len = response != nullptr ? (int)response->size() : 0;
+                    if (WP_SUCCESS != wp_wait_async(specIndex, handle, timeoutMS, &result, data, len))
+                        return false;
+                    if (response != nullptr)
+                        response->resize(result < 0 ? 0 : result < len ? result : len);
+                    return true;
+                }
+
                 //! @see wp_set_max_timeout_ms
                 bool setMaxTimeoutMS(int maxTimeoutMS)
                 { return WP_SUCCESS == wp_set_max_timeout_ms(specIndex, maxTimeoutMS); }
@@ -916,6 +1878,296 @@ namespace WasatchVCPP
                     return result;
                 }
 
+                //! @see wp_get_spectrum_fp16
+                std::vector<uint16_t> getSpectrumFloat16()
+                {
+                    std::vector<uint16_t> result(pixels > 0 ? pixels : 0);
+                    if (result.empty() || WP_SUCCESS != wp_get_spectrum_fp16(specIndex, &result[0], pixels))
+                        result.clear();
+                    return result;
+                }
+
+                //! @see wp_get_spectrum_bf16
+                std::vector<uint16_t> getSpectrumBFloat16()
+                {
+                    std::vector<uint16_t> result(pixels > 0 ? pixels : 0);
+                    if (result.empty() || WP_SUCCESS != wp_get_spectrum_bf16(specIndex, &result[0], pixels))
+                        result.clear();
+                    return result;
+                }
+
+                //! @see wp_get_spectrum_int32
+                std::vector<int> getSpectrumInt32(double scale = 1)
+                {
+                    std::vector<int> result(pixels > 0 ? pixels : 0);
+                    if (result.empty() || WP_SUCCESS != wp_get_spectrum_int32(specIndex, &result[0], pixels, scale))
+                        result.clear();
+                    return result;
+                }
+
+                //! @see wp_get_spectrum_with_generation
+                std::vector<double> getSpectrum(int& generation)
+                {
+                    std::vector<double> result;
+                    if (pixels > 0)
+                        if (WP_SUCCESS == wp_get_spectrum_with_generation(specIndex, &(spectrumBuf[0]), pixels, &generation))
+                            result = spectrumBuf;
+                    return result;
+                }
+
+                //! @see wp_get_settings_generation
+                int getSettingsGeneration() { return wp_get_settings_generation(specIndex); }
+
+                //! @see wp_set_throwaway_frames
+                bool setThrowawayFrames(int frames) { return WP_SUCCESS == wp_set_throwaway_frames(specIndex, frames); }
+
+                //! @see wp_get_throwaway_count
+                int getThrowawayCount() { return wp_get_throwaway_count(specIndex); }
+
+                //! @see wp_get_processed_spectrum
+                std::vector<float> getProcessedSpectrum()
+                {
+                    std::vector<float> result(pixels > 0 ? pixels : 0);
+                    if (result.empty() || WP_SUCCESS != wp_get_processed_spectrum(specIndex, &result[0], pixels))
+                        result.clear();
+                    return result;
+                }
+
+                //! @see wp_set_scans_to_average
+                bool setScansToAverage(int scans) { return WP_SUCCESS == wp_set_scans_to_average(specIndex, scans); }
+
+                //! @see wp_set_dark_correction (empty to disable)
+                bool setDarkCorrection(std::vector<double> dark)
+                { return WP_SUCCESS == wp_set_dark_correction(specIndex, dark.empty() ? nullptr : &dark[0], (int)dark.size()); }
+
+                //! @see wp_set_gain_correction (empty to disable)
+                bool setGainCorrection(std::vector<double> gain)
+                { return WP_SUCCESS == wp_set_gain_correction(specIndex, gain.empty() ? nullptr : &gain[0], (int)gain.size()); }
+
+                //! @see wp_set_fixed_point_processing
+                bool setFixedPointProcessing(bool flag) { return WP_SUCCESS == wp_set_fixed_point_processing(specIndex, flag ? 1 : 0); }
+
+                //! @see wp_set_expression
+                bool setExpression(const std::string& expression) { return WP_SUCCESS == wp_set_expression(specIndex, expression.c_str()); }
+
+                //! @see wp_set_expression_buffer
+                bool setExpressionBuffer(const std::string& name, std::vector<double> values) 
+                { 
+                    return WP_SUCCESS == wp_set_expression_buffer(specIndex, name.c_str(), values.empty() ? nullptr : &values[0], (int)values.size()); 
+                }
+
+                //! @see wp_set_expression_constant
+                bool setExpressionConstant(const std::string& name, double value) { return WP_SUCCESS == wp_set_expression_constant(specIndex, name.c_str(), value); }
+
+                //! @see wp_get_expression_spectrum
+                std::vector<double> getExpressionSpectrum()
+                {
+                    std::vector<double> result(pixels);
+                    if (result.empty() || WP_SUCCESS != wp_get_expression_spectrum(specIndex, &result[0], pixels))
+                        result.clear();
+                    return result;
+                }
+
+                //! @see wp_set_auto_dark_config
+                bool setAutoDarkConfig(int laserWarmupMS, int maxDarkAgeMS = 0, float maxDarkTempDeltaDegC = 0)
+                { return WP_SUCCESS == wp_set_auto_dark_config(specIndex, laserWarmupMS, maxDarkAgeMS, maxDarkTempDeltaDegC); }
+
+                //! @see wp_get_auto_dark_spectrum
+                //! @param dark (Output) optional dark used
+                //! @param raw (Output) optional uncorrected sample
+                //! @returns dark-corrected spectrum (empty on error)
+                std::vector<double> getAutoDarkSpectrum(std::vector<double>* dark = nullptr, std::vector<double>* raw = nullptr)
+                {
+                    std::vector<double> result;
+                    if (pixels <= 0)
+                        return result;
+
+                    std::vector<double> darkBuf(pixels), rawBuf(pixels);
+                    if (WP_SUCCESS != wp_get_auto_dark_spectrum(specIndex, &(spectrumBuf[0]), &darkBuf[0], &rawBuf[0], pixels))
+                        return result;
+
+                    if (dark != nullptr)
+                        *dark = darkBuf;
+                    if (raw != nullptr)
+                        *raw = rawBuf;
+                    result = spectrumBuf;
+                    return result;
+                }
+
+                //! @see wp_start_recipe
+                bool startRecipe(const std::string& recipe)
+                { return WP_SUCCESS == wp_start_recipe(specIndex, recipe.c_str()); }
+
+                //! Execute a recipe to completion.
+                //!
+                //! @see wp_start_recipe
+                //! @param recipe (Input) recipe text
+                //! @param results (Output) each emitted buffer by name
+                //! @returns true if the recipe completed successfully
+                bool runRecipe(const std::string& recipe, std::map<std::string, std::vector<double> >& results)
+                {
+                    results.clear();
+                    if (pixels <= 0 || !startRecipe(recipe))
+                        return false;
+
+                    char name[256];
+                    while (true)
+                    {
+                        int state = wp_get_recipe_state(specIndex);
+                        int count = wp_read_recipe_result(specIndex, name, sizeof(name), &(spectrumBuf[0]), pixels, 1000);
+                        if (count < 0)
+                            return false;
+                        if (count > 0)
+                            results[name] = spectrumBuf;
+                        else if (state != WP_RECIPE_RUNNING)
+                            return state == WP_RECIPE_COMPLETE;
+                    }
+                }
+
+                //! @see wp_stop_recipe
+                bool stopRecipe() { return WP_SUCCESS == wp_stop_recipe(specIndex); }
+
+                //! @see wp_set_schedule_plan
+                bool setSchedulePlan(float cadenceHz, int integrationTimeMS = 0)
+                { return WP_SUCCESS == wp_set_schedule_plan(specIndex, cadenceHz, integrationTimeMS); }
+
+                //! @see wp_get_scheduled_spectrum
+                //! @param frames (Output) optional number of spectra acquired so far
+                //! @returns latest scheduled spectrum (empty if none)
+                std::vector<double> getScheduledSpectrum(int* frames = nullptr)
+                {
+                    std::vector<double> result;
+                    if (pixels <= 0)
+                        return result;
+
+                    int count = wp_get_scheduled_spectrum(specIndex, &(spectrumBuf[0]), pixels);
+                    if (frames != nullptr)
+                        *frames = count;
+                    if (count > 0)
+                        result = spectrumBuf;
+                    return result;
+                }
+
+                //! @see wp_set_area_scan_enable
+                bool setAreaScanEnable(bool flag)
+                { return WP_SUCCESS == wp_set_area_scan_enable(specIndex, flag ? 1 : 0); }
+
+                //! @see wp_get_area_scan_frame
+                //! @returns one vector per detector row (empty on error)
+                std::vector<std::vector<double> > getAreaScanFrame(int timeoutMS = 1000)
+                {
+                    std::vector<std::vector<double> > result;
+                    int rows = wp_get_area_scan_rows(specIndex);
+                    if (rows <= 0 || pixels <= 0)
+                        return result;
+
+                    std::vector<double> buf(rows * pixels);
+                    if (WP_SUCCESS != wp_get_area_scan_frame(specIndex, &buf[0], rows, pixels, timeoutMS))
+                        return result;
+
+                    for (int row = 0; row < rows; row++)
+                        result.push_back(std::vector<double>(buf.begin() + row * pixels, buf.begin() + (row + 1) * pixels));
+                    return result;
+                }
+
+                //! @see wp_get_area_scan_binned
+                std::vector<double> getAreaScanBinned(int firstRow, int lastRow, int timeoutMS = 1000)
+                {
+                    std::vector<double> result;
+                    if (pixels > 0)
+                        if (WP_SUCCESS == wp_get_area_scan_binned(specIndex, &(spectrumBuf[0]), pixels, firstRow, lastRow, timeoutMS))
+                            result = spectrumBuf;
+                    return result;
+                }
+
+                //! @see wp_start_triggered_acquisition
+                bool startTriggeredAcquisition(int queueDepth = 4, int maxFrames = 100)
+                { return WP_SUCCESS == wp_start_triggered_acquisition(specIndex, queueDepth, maxFrames); }
+
+                //! @see wp_read_triggered_spectra
+                //! @returns zero or more spectra, oldest first
+                std::vector<std::vector<double> > readTriggeredSpectra(int maxFrames, int timeoutMS)
+                {
+                    std::vector<std::vector<double> > result;
+                    if (pixels <= 0 || maxFrames <= 0)
+                        return result;
+
+                    std::vector<double> buf(maxFrames * pixels);
+                    int count = wp_read_triggered_spectra(specIndex, &buf[0], pixels, maxFrames, nullptr, nullptr, timeoutMS);
+                    for (int i = 0; i < count; i++)
+                        result.push_back(std::vector<double>(buf.begin() + i * pixels, buf.begin() + (i + 1) * pixels));
+                    return result;
+                }
+
+                //! @see wp_stop_triggered_acquisition
+                bool stopTriggeredAcquisition()
+                { return WP_SUCCESS == wp_stop_triggered_acquisition(specIndex); }
+
+                //! @see wp_set_deadband
+                bool setDeadband(int metric, double threshold, int heartbeatMS = 0)
+                { return WP_SUCCESS == wp_set_deadband(specIndex, metric, threshold, heartbeatMS); }
+
+                //! @param bounds (Input) first and last pixel of each region (empty for whole spectra)
+                //! @see wp_set_deadband_regions
+                bool setDeadbandRegions(std::vector<int> bounds)
+                {
+                    return WP_SUCCESS == wp_set_deadband_regions(specIndex,
+                        bounds.empty() ? nullptr : &bounds[0], (int)bounds.size() / 2);
+                }
+
+                //! @see wp_set_display_stream
+                bool setDisplayStream(int width, float maxHz)
+                {
+                    displayWidth = width > 0 ? width : 0;
+                    return WP_SUCCESS == wp_set_display_stream(specIndex, width, maxHz);
+                }
+
+                //! @see wp_read_display_envelope
+                //! @returns false on timeout or error
+                bool readDisplayEnvelope(std::vector<float>& mins, std::vector<float>& maxs, int timeoutMS)
+                {
+                    if (displayWidth <= 0)
+                        return false;
+                    mins.resize(displayWidth);
+                    maxs.resize(displayWidth);
+                    int buckets = wp_read_display_envelope(specIndex, &mins[0], &maxs[0], displayWidth, timeoutMS);
+                    if (buckets <= 0)
+                        return false;
+                    mins.resize(buckets);
+                    maxs.resize(buckets);
+                    return true;
+                }
+
+                //! @see wp_set_flight_recorder
+                bool setFlightRecorder(int frames)
+                { return WP_SUCCESS == wp_set_flight_recorder(specIndex, frames); }
+
+                //! @see wp_set_frame_pool
+                bool setFramePool(int frames, int flags)
+                { return WP_SUCCESS == wp_set_frame_pool(specIndex, frames, flags); }
+
+                //! @see wp_get_frame_pool_stats
+                std::vector<long long> getFramePoolStats()
+                {
+                    std::vector<long long> stats(WP_FRAME_POOL_STATS);
+                    if (WP_SUCCESS != wp_get_frame_pool_stats(specIndex, &stats[0], (int)stats.size()))
+                        stats.clear();
+                    return stats;
+                }
+
+                //! @see wp_dump_flight_recorder
+                bool dumpFlightRecorder(const std::string& pathname)
+                { return WP_SUCCESS == wp_dump_flight_recorder(specIndex, pathname.c_str(), (int)pathname.size()); }
+
+                //! @see wp_get_flight_recorder_status
+                bool getFlightRecorderStatus(int& frames, bool& dumping)
+                {
+                    int flag = 0;
+                    bool ok = WP_SUCCESS == wp_get_flight_recorder_status(specIndex, &frames, &flag);
+                    dumping = flag != 0;
+                    return ok;
+                }
+
                 //! @see wp_get_eeprom_page
                 std::vector<uint8_t> getEEPROMPage(int page)
                 {
@@ -932,6 +2184,30 @@ namespace WasatchVCPP
                     return result;
                 }
 
+                //! @see wp_set_eeprom_field
+                bool setEEPROMField(const std::string& name, const std::string& value)
+                { 
+                    return WP_SUCCESS == wp_set_eeprom_field(specIndex, name.c_str(), value.c_str());
+                }
+
+                //! @see wp_commit_eeprom
+                bool commitEEPROM(int* pagesWritten = nullptr, float* elapsedMS = nullptr)
+                {
+                    bool success = (WP_SUCCESS == wp_commit_eeprom(specIndex, pagesWritten, elapsedMS));
+                    refreshEEPROM();
+                    return success;
+                }
+
+                //! @see wp_write_eeprom
+                bool writeEEPROM(const std::vector<uint8_t>& image, int* pagesWritten = nullptr, float* elapsedMS = nullptr)
+                {
+                    if (image.empty())
+                        return false;
+                    bool success = (WP_SUCCESS == wp_write_eeprom(specIndex, &image[0], (int)image.size(), pagesWritten, elapsedMS));
+                    refreshEEPROM();
+                    return success;
+                }
+
                 //! @see wp_get_eeprom_field_name
                 std::string getEEPROMFieldName(int index)
                 {
@@ -951,8 +2227,34 @@ namespace WasatchVCPP
                 }
 
             private:
+                //! re-read everything derived from the EEPROM after a write
+                void refreshEEPROM()
+                {
+                    readEEPROMFields();
+                    model = eepromFields["model"];
+                    serialNumber = eepromFields["serialNumber"];
+                    excitationNM = (float)atof(eepromFields["excitationNM"].c_str());
+
+                    pixels = wp_get_pixels(specIndex);
+                    if (pixels <= 0)
+                        return;
+
+                    spectrumBuf.resize(pixels);
+                    wavelengths.resize(pixels);
+                    wp_get_wavelengths(specIndex, &wavelengths[0], pixels);
+
+                    wavenumbers.clear();
+                    if (excitationNM > 0)
+                    {
+                        wavenumbers.resize(pixels);
+                        wp_get_wavenumbers(specIndex, &wavenumbers[0], pixels);
+                    }
+                }
+
                 bool readEEPROMFields()
                 {
+                    eepromFields.clear();
+
                     int count = wp_get_eeprom_field_count(specIndex);
                     if (count <= 0)
                         return false;
@@ -975,6 +2277,7 @@ namespace WasatchVCPP
                     return true;
                 }
                 std::vector<double> spectrumBuf;
+                int displayWidth = 0;       //!< as last passed to setDisplayStream
         };
 
         ////////////////////////////////////////////////////////////////////////
@@ -1065,6 +2368,33 @@ namespace WasatchVCPP
                     return WP_SUCCESS == wp_close_all_spectrometers();
                 }
 
+                //! @see wp_set_warm_restore()
+                bool setWarmRestore(bool flag) { return WP_SUCCESS == wp_set_warm_restore(flag); }
+
+                //! @see wp_set_memory_budget()
+                bool setMemoryBudget(long long bytes) { return WP_SUCCESS == wp_set_memory_budget(bytes); }
+
+                //! @see wp_set_compact_mode()
+                bool setCompactMode(bool flag) { return WP_SUCCESS == wp_set_compact_mode(flag); }
+
+                //! @see wp_set_frame_pool() (all spectrometers)
+                bool setFramePool(int frames, int flags) { return WP_SUCCESS == wp_set_frame_pool(-1, frames, flags); }
+
+                //! @see wp_get_memory_usage() (all spectrometers)
+                std::vector<long long> getMemoryUsage()
+                {
+                    std::vector<long long> bytes(WP_MEMORY_SUBSYSTEMS);
+                    if (WP_SUCCESS != wp_get_memory_usage(-1, &bytes[0], (int)bytes.size()))
+                        bytes.clear();
+                    return bytes;
+                }
+
+                //! @see wp_start_schedule()
+                bool startSchedule() { return WP_SUCCESS == wp_start_schedule(); }
+
+                //! @see wp_stop_schedule()
+                bool stopSchedule() { return WP_SUCCESS == wp_stop_schedule(); }
+
                 //! @see wp_destroy_driver()
                 void destroy()
                 {
@@ -0,0 +1,33 @@
+/** @file   Check.h
+*   @brief  what every test program shares: CHECK, the failure count, a quiet
+*           logger and the closing report
+*
+*   Each test is a plain program: failed CHECKs are printed and counted as
+*   they happen, and main() ends with "return report(argv[0]);", so a test 
+*   exits non-zero if anything failed.
+*/
+
+#pragma once
+
+#include <stdio.h>
+
+#include "Logger.h"
+
+//! CHECKs failed so far
+static int failures = 0;
+
+#define CHECK(cond, ...) do { if (!(cond)) { failures++; printf("FAILED: " __VA_ARGS__); printf("\n"); } } while (0)
+
+//! silence a logger (tests report through CHECK)
+inline void quiet(WasatchVCPP::Logger& logger)
+{
+    logger.level = WasatchVCPP::Logger::Levels::LOG_LEVEL_NEVER;
+}
+
+//! print the failure count
+//! @returns the program's exit status
+inline int report(const char* program)
+{
+    printf("%s: %d failures\n", program, failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,681 @@
+/** @file   FakeUSB.cpp
+*   @brief  implementation of the simulated libusb-1.0 (@see FakeUSB.h)
+*
+*   All device state is guarded by one mutex.  As in libusb, one thread at a
+*   time handles events, and completion callbacks run on that thread (without
+*   the state lock held, so they may submit further transfers).
+*/
+
+#include "FakeUSB.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+
+using FakeUSB::Clock;
+using std::vector;
+
+struct libusb_context { int unused; };
+struct libusb_device { int index; };
+struct libusb_device_handle { int index; };
+
+namespace
+{
+    const uint8_t ENDPOINTS[] = { 0x82, 0x86, 0x88, 0x8a };
+
+    //! how long a transfer with no timeout waits before we call it a hang
+    const auto FOREVER = std::chrono::hours(24);
+
+    //! part of a frame queued on a spectral endpoint
+    struct Chunk
+    {
+        Clock::time_point ready;
+        vector<uint8_t> data;
+        size_t offset = 0;
+    };
+
+    struct Device
+    {
+        FakeUSB::Config config;
+        libusb_device dev;
+        vector<vector<uint8_t> > eeprom;
+        vector<std::deque<Chunk> > queues;      //!< by endpoint
+        vector<FakeUSB::Command> commands;
+        std::set<uint8_t> failing;
+
+        uint32_t integrationTimeMS = 1;
+        bool laser = false;
+        bool external = false;
+        bool areaScan = false;
+        uint64_t frames = 0;
+    };
+
+    struct Submitted
+    {
+        libusb_transfer* xfer;
+        int device;
+        Clock::time_point ready;        //!< control transfers
+        Clock::time_point deadline;     //!< bulk transfers
+        bool cancelled;
+    };
+
+    std::mutex mut;
+    std::condition_variable cv;
+    vector<std::unique_ptr<Device> > devices;
+    std::list<Submitted> submitted;
+
+    //! one event handler at a time, as with libusb's event lock
+    std::mutex mutDispatch;
+
+    void put16(vector<uint8_t>& page, int offset, uint16_t value)
+    {
+        page[offset] = value & 0xff;
+        page[offset + 1] = value >> 8;
+    }
+
+    void put32(vector<uint8_t>& page, int offset, uint32_t value)
+    {
+        for (int i = 0; i < 4; i++)
+            page[offset + i] = (value >> (8 * i)) & 0xff;
+    }
+
+    void putFloat(vector<uint8_t>& page, int offset, float value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        put32(page, offset, bits);
+    }
+
+    void putString(vector<uint8_t>& page, int offset, const char* s)
+    {
+        memcpy(&page[offset], s, strlen(s));
+    }
+
+    //! a format-9 EEPROM describing the configured detector
+    vector<vector<uint8_t> > buildEEPROM(const FakeUSB::Config& config, int index)
+    {
+        vector<vector<uint8_t> > pages(8, vector<uint8_t>(64));
+        char serial[17];
+        snprintf(serial, sizeof(serial), "FAKE%04d", index);
+
+        putString(pages[0], 0, "WP-FAKE");
+        putString(pages[0], 16, serial);
+        pages[0][36] = config.hasCooling ? 1 : 0;
+        pages[0][38] = config.hasLaser ? 1 : 0;
+        put16(pages[0], 39, (config.gen15 ? 0x04 : 0) | (config.invertXAxis ? 0x01 : 0));
+        put16(pages[0], 41, 50);                // slit
+        put16(pages[0], 43, 10);                // startup integration time
+        putFloat(pages[0], 48, 1.0f);           // gain
+        putFloat(pages[0], 54, 1.0f);           // gain (odd)
+        pages[0][63] = 9;
+
+        putFloat(pages[1], 0, 500.0f);          // wavecal
+        putFloat(pages[1], 4, 0.1f);
+
+        putString(pages[2], 0, "FAKE");
+        put16(pages[2], 16, (uint16_t)config.pixels);
+        put16(pages[2], 19, (uint16_t)config.rows);
+        put16(pages[2], 25, (uint16_t)config.pixels);
+
+        putFloat(pages[3], 36, config.hasLaser ? 785.0f : 0.0f);
+        put32(pages[3], 40, 1);                 // min integration time
+        put32(pages[3], 44, 60000);             // max integration time
+        return pages;
+    }
+
+    Device* find(int index)
+    {
+        return index >= 0 && index < (int)devices.size() ? devices[index].get() : nullptr;
+    }
+
+    int endpointIndex(const Device& d, uint8_t ep)
+    {
+        for (int e = 0; e < (int)d.queues.size(); e++)
+            if (ENDPOINTS[e] == ep)
+                return e;
+        return -1;
+    }
+
+    //! Queue the frame(s) one trigger produces: a spectrum, or in area-scan
+    //! mode one line per row.  Each endpoint streams its share of the pixels.
+    void acquire(Device& d, Clock::time_point ready)
+    {
+        const int pixels = d.config.pixels;
+        const int count = (int)d.queues.size();
+        const int share = pixels / count;
+        const bool areaScan = d.areaScan && d.config.rows > 0;
+
+        // area-scan readout may begin mid-frame (at firstRow), then sends a
+        // whole frame
+        const int firstRow = areaScan ? std::min(std::max(d.config.firstRow, 0), d.config.rows - 1) : 0;
+        const int lines = !areaScan ? 1 : firstRow > 0 ? 2 * d.config.rows - firstRow : d.config.rows;
+        for (int line = 0; line < lines; line++)
+        {
+            uint64_t frame = d.frames++;
+            int row = (firstRow + line) % std::max(d.config.rows, 1);
+            for (int e = 0; e < count; e++)
+            {
+                Chunk chunk;
+                chunk.ready = ready + std::chrono::microseconds((int64_t)line * d.config.lineUS);
+                chunk.data.resize(share * 2);
+                for (int i = 0; i < share; i++)
+                {
+                    uint16_t value = FakeUSB::pixelValue(frame, e * share + i, d.laser);
+                    if (areaScan && e == 0 && i == 0)
+                        value = (uint16_t)row;
+                    chunk.data[2 * i] = value & 0xff;
+                    chunk.data[2 * i + 1] = value >> 8;
+                }
+                d.queues[e].push_back(chunk);
+            }
+        }
+        cv.notify_all();
+    }
+
+    //! Apply one control transfer (call with mut held).
+    //!
+    //! @returns bytes transferred, or a libusb error
+    int control(Device& d, uint8_t requestType, uint8_t bRequest, uint16_t wValue, uint16_t wIndex, unsigned char* data, uint16_t len)
+    {
+        bool read = (requestType & LIBUSB_ENDPOINT_DIR_MASK) == LIBUSB_ENDPOINT_IN;
+
+        FakeUSB::Command command;
+        command.read = read;
+        command.bRequest = bRequest;
+        command.wValue = wValue;
+        command.wIndex = wIndex;
+        command.when = Clock::now();
+        d.commands.push_back(command);
+
+        if (d.failing.count(bRequest))
+            return LIBUSB_ERROR_PIPE;
+
+        if (read)
+        {
+            if (len > 0)
+                memset(data, 0, len);
+            vector<uint8_t> response;
+            switch (bRequest)
+            {
+                case 0xff:
+                    if (wValue == 0x01 && wIndex < d.eeprom.size())
+                        response = d.eeprom[wIndex];
+                    break;
+                case 0xc0: response = { 4, 3, 2, 1 }; break;
+                case 0xb4: response = { '1', '.', '0', '.', '0', 0, 0 }; break;
+                case 0xe2: response = { (uint8_t)d.laser }; break;
+                case 0xbf: response = { (uint8_t)d.integrationTimeMS, (uint8_t)(d.integrationTimeMS >> 8), (uint8_t)(d.integrationTimeMS >> 16) }; break;
+                default:   break;
+            }
+            memcpy(data, response.data(), std::min(response.size(), (size_t)len));
+            return len;
+        }
+
+        switch (bRequest)
+        {
+            case 0xb2:
+            {
+                // as the FPGA firmware cancelOperation relies on: a shorter 
+                // integration time ends the one in progress
+                d.integrationTimeMS = wValue | ((uint32_t)wIndex << 16);
+                auto end = Clock::now() + std::chrono::milliseconds(d.integrationTimeMS);
+                for (auto& queue : d.queues)
+                    for (auto& chunk : queue)
+                        chunk.ready = std::min(chunk.ready, end);
+                cv.notify_all();
+                break;
+            }
+            case 0xbe: d.laser = wValue != 0; break;
+            case 0xd2: d.external = wValue != 0; break;
+            case 0xeb: d.areaScan = wValue != 0; break;
+            case 0xad:
+                if (!d.external)
+                    acquire(d, Clock::now() + std::chrono::milliseconds(d.integrationTimeMS));
+                break;
+            case 0xa2:
+            {
+                int page = (wValue - 0x3c00) / 0x40;
+                if (page >= 0 && page < (int)d.eeprom.size() && len == 64)
+                    d.eeprom[page].assign(data, data + len);
+                break;
+            }
+        }
+        return len;
+    }
+
+    //! Move up to 'length' bytes of the endpoint's next chunk, if it's ready.
+    //!
+    //! @returns bytes moved, or -1 if nothing is ready
+    int take(Device& d, int e, unsigned char* data, int length, Clock::time_point now)
+    {
+        auto& queue = d.queues[e];
+        if (queue.empty() || queue.front().ready > now)
+            return -1;
+
+        Chunk& chunk = queue.front();
+        int n = (int)std::min((size_t)length, chunk.data.size() - chunk.offset);
+        memcpy(data, &chunk.data[chunk.offset], n);
+        chunk.offset += n;
+        if (chunk.offset == chunk.data.size())
+            queue.pop_front();
+        return n;
+    }
+
+    //! when the endpoint's next chunk becomes readable (or 'otherwise')
+    Clock::time_point nextReady(const Device& d, int e, Clock::time_point otherwise)
+    {
+        return d.queues[e].empty() ? otherwise : std::min(otherwise, d.queues[e].front().ready);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Test interface
+////////////////////////////////////////////////////////////////////////////////
+
+void FakeUSB::configure(const Config& config)
+{
+    std::lock_guard<std::mutex> lock(mut);
+    devices.clear();
+    submitted.clear();
+    for (int i = 0; i < config.devices; i++)
+    {
+        std::unique_ptr<Device> d(new Device());
+        d->config = config;
+        d->config.endpoints = std::max(1, std::min(config.endpoints, (int)sizeof(ENDPOINTS)));
+        d->config.extraEndpoints = std::max(0, std::min(config.extraEndpoints, (int)sizeof(ENDPOINTS) - d->config.endpoints));
+        d->dev.index = i;
+        d->eeprom = buildEEPROM(config, i);
+        d->queues.resize(d->config.endpoints);
+        devices.push_back(std::move(d));
+    }
+}
+
+libusb_device_handle* FakeUSB::open(int index)
+{
+    libusb_device_handle* handle = nullptr;
+    std::lock_guard<std::mutex> lock(mut);
+    Device* d = find(index);
+    if (d != nullptr)
+        handle = new libusb_device_handle{ index };
+    return handle;
+}
+
+vector<FakeUSB::Command> FakeUSB::getCommands(int index)
+{
+    std::lock_guard<std::mutex> lock(mut);
+    Device* d = find(index);
+    return d ? d->commands : vector<Command>();
+}
+
+void FakeUSB::clearCommands(int index)
+{
+    std::lock_guard<std::mutex> lock(mut);
+    if (Device* d = find(index))
+        d->commands.clear();
+}
+
+void FakeUSB::failOpcode(uint8_t bRequest, bool fail, int index)
+{
+    std::lock_guard<std::mutex> lock(mut);
+    if (Device* d = find(index))
+    {
+        if (fail)
+            d->failing.insert(bRequest);
+        else
+            d->failing.erase(bRequest);
+    }
+}
+
+void FakeUSB::trigger(int index)
+{
+    std::lock_guard<std::mutex> lock(mut);
+    Device* d = find(index);
+    if (d != nullptr && d->external)
+        acquire(*d, Clock::now());
+}
+
+bool FakeUSB::getLaserEnable(int index)
+{
+    std::lock_guard<std::mutex> lock(mut);
+    Device* d = find(index);
+    return d && d->laser;
+}
+
+uint32_t FakeUSB::getIntegrationTimeMS(int index)
+{
+    std::lock_guard<std::mutex> lock(mut);
+    Device* d = find(index);
+    return d ? d->integrationTimeMS : 0;
+}
+
+uint64_t FakeUSB::getFramesAcquired(int index)
+{
+    std::lock_guard<std::mutex> lock(mut);
+    Device* d = find(index);
+    return d ? d->frames : 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// libusb-1.0: devices
+////////////////////////////////////////////////////////////////////////////////
+
+extern "C"
+{
+
+int LIBUSB_CALL libusb_init(libusb_context**) { return 0; }
+void LIBUSB_CALL libusb_exit(libusb_context*) { }
+
+ssize_t LIBUSB_CALL libusb_get_device_list(libusb_context*, libusb_device*** list)
+{
+    std::lock_guard<std::mutex> lock(mut);
+    *list = new libusb_device*[devices.size() + 1];
+    for (size_t i = 0; i < devices.size(); i++)
+        (*list)[i] = &devices[i]->dev;
+    (*list)[devices.size()] = nullptr;
+    return (ssize_t)devices.size();
+}
+
+void LIBUSB_CALL libusb_free_device_list(libusb_device** list, int)
+{
+    delete[] list;
+}
+
+int LIBUSB_CALL libusb_get_device_descriptor(libusb_device* dev, struct libusb_device_descriptor* desc)
+{
+    std::lock_guard<std::mutex> lock(mut);
+    Device* d = find(dev->index);
+    if (d == nullptr)
+        return LIBUSB_ERROR_NO_DEVICE;
+    memset(desc, 0, sizeof(*desc));
+    desc->idVendor = 0x24aa;
+    desc->idProduct = d->config.pid;
+    desc->bNumConfigurations = 1;
+    return 0;
+}
+
+uint8_t LIBUSB_CALL libusb_get_bus_number(libusb_device*) { return 1; }
+
+int LIBUSB_CALL libusb_get_port_numbers(libusb_device* dev, uint8_t* ports, int len)
+{
+    if (len < 1)
+        return LIBUSB_ERROR_OVERFLOW;
+    ports[0] = (uint8_t)(dev->index + 1);
+    return 1;
+}
+
+int LIBUSB_CALL libusb_get_device_speed(libusb_device* dev)
+{
+    std::lock_guard<std::mutex> lock(mut);
+    Device* d = find(dev->index);
+    return d ? d->config.speed : LIBUSB_SPEED_UNKNOWN;
+}
+
+int LIBUSB_CALL libusb_open(libusb_device* dev, libusb_device_handle** handle)
+{
+    *handle = FakeUSB::open(dev->index);
+    return *handle ? 0 : LIBUSB_ERROR_NO_DEVICE;
+}
+
+void LIBUSB_CALL libusb_close(libusb_device_handle* handle) { delete handle; }
+
+libusb_device* LIBUSB_CALL libusb_get_device(libusb_device_handle* handle)
+{
+    std::lock_guard<std::mutex> lock(mut);
+    Device* d = find(handle->index);
+    return d ? &d->dev : nullptr;
+}
+
+int LIBUSB_CALL libusb_set_configuration(libusb_device_handle*, int) { return 0; }
+int LIBUSB_CALL libusb_claim_interface(libusb_device_handle*, int) { return 0; }
+int LIBUSB_CALL libusb_release_interface(libusb_device_handle*, int) { return 0; }
+
+//! one interface, whose bulk IN endpoints are the extra endpoints (listed 
+//! first, so the library must rank them), then the spectral ones
+struct FakeConfig
+{
+    libusb_config_descriptor config;
+    libusb_interface interface;
+    libusb_interface_descriptor alt;
+    libusb_endpoint_descriptor endpoints[sizeof(ENDPOINTS)];
+};
+
+int LIBUSB_CALL libusb_get_active_config_descriptor(libusb_device* dev, struct libusb_config_descriptor** config)
+{
+    std::lock_guard<std::mutex> lock(mut);
+    Device* d = find(dev->index);
+    if (d == nullptr)
+        return LIBUSB_ERROR_NO_DEVICE;
+
+    FakeConfig* fake = new FakeConfig();
+    const int extra = d->config.extraEndpoints;
+    const int total = d->config.endpoints + extra;
+    for (int e = 0; e < total; e++)
+    {
+        int slot = e < d->config.endpoints ? e + extra : e - d->config.endpoints;
+        fake->endpoints[slot].bEndpointAddress = ENDPOINTS[e];
+        fake->endpoints[slot].bmAttributes = LIBUSB_TRANSFER_TYPE_BULK;
+    }
+    fake->alt.bNumEndpoints = (uint8_t)total;
+    fake->alt.endpoint = fake->endpoints;
+    fake->interface.altsetting = &fake->alt;
+    fake->interface.num_altsetting = 1;
+    fake->config.bNumInterfaces = 1;
+    fake->config.interface = &fake->interface;
+    *config = &fake->config;
+    return 0;
+}
+
+void LIBUSB_CALL libusb_free_config_descriptor(struct libusb_config_descriptor* config)
+{
+    delete (FakeConfig*)config;
+}
+
+#if defined(LIBUSB_API_VERSION) && LIBUSB_API_VERSION >= 0x01000108
+const char* LIBUSB_CALL libusb_strerror(int code)
+#else
+const char* LIBUSB_CALL libusb_strerror(enum libusb_error code)
+#endif
+{
+    switch (code)
+    {
+        case LIBUSB_SUCCESS:            return "Success";
+        case LIBUSB_ERROR_TIMEOUT:      return "Operation timed out";
+        case LIBUSB_ERROR_PIPE:         return "Pipe error";
+        case LIBUSB_ERROR_NO_DEVICE:    return "No such device";
+        case LIBUSB_ERROR_NOT_FOUND:    return "Entity not found";
+        default:                        return "Other error";
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// libusb-1.0: synchronous transfers
+////////////////////////////////////////////////////////////////////////////////
+
+int LIBUSB_CALL libusb_control_transfer(libusb_device_handle* handle, uint8_t requestType, uint8_t bRequest,
+    uint16_t wValue, uint16_t wIndex, unsigned char* data, uint16_t len, unsigned int)
+{
+    int latencyUS = 0;
+    {
+        std::lock_guard<std::mutex> lock(mut);
+        Device* d = find(handle->index);
+        if (d == nullptr)
+            return LIBUSB_ERROR_NO_DEVICE;
+        latencyUS = d->config.controlLatencyUS;
+    }
+    if (latencyUS > 0)
+        std::this_thread::sleep_for(std::chrono::microseconds(latencyUS));
+
+    std::lock_guard<std::mutex> lock(mut);
+    Device* d = find(handle->index);
+    return d ? control(*d, requestType, bRequest, wValue, wIndex, data, len) : LIBUSB_ERROR_NO_DEVICE;
+}
+
+int LIBUSB_CALL libusb_bulk_transfer(libusb_device_handle* handle, unsigned char ep, unsigned char* data,
+    int length, int* transferred, unsigned int timeout)
+{
+    *transferred = 0;
+    std::unique_lock<std::mutex> lock(mut);
+    Device* d = find(handle->index);
+    int e = d ? endpointIndex(*d, ep) : -1;
+    if (e < 0)
+        return LIBUSB_ERROR_PIPE;
+
+    auto deadline = Clock::now() + (timeout ? Clock::duration(std::chrono::milliseconds(timeout)) : Clock::duration(FOREVER));
+    while (true)
+    {
+        auto now = Clock::now();
+        int n = take(*d, e, data, length, now);
+        if (n >= 0)
+        {
+            *transferred = n;
+            return 0;
+        }
+        if (now >= deadline)
+            return LIBUSB_ERROR_TIMEOUT;
+        cv.wait_until(lock, nextReady(*d, e, deadline));
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// libusb-1.0: asynchronous transfers
+////////////////////////////////////////////////////////////////////////////////
+
+struct libusb_transfer* LIBUSB_CALL libusb_alloc_transfer(int)
+{
+    return new libusb_transfer();
+}
+
+void LIBUSB_CALL libusb_free_transfer(struct libusb_transfer* xfer)
+{
+    {
+        std::lock_guard<std::mutex> lock(mut);
+        submitted.remove_if([xfer](const Submitted& s) { return s.xfer == xfer; });
+    }
+    delete xfer;
+}
+
+//! Control transfers take effect on the device at once, and complete after
+//! the configured latency; bulk reads complete when a frame is ready.
+int LIBUSB_CALL libusb_submit_transfer(struct libusb_transfer* xfer)
+{
+    std::lock_guard<std::mutex> lock(mut);
+    Device* d = find(xfer->dev_handle ? xfer->dev_handle->index : -1);
+    if (d == nullptr)
+        return LIBUSB_ERROR_NO_DEVICE;
+
+    auto now = Clock::now();
+    Submitted s = { xfer, xfer->dev_handle->index, now, now + FOREVER, false };
+    xfer->actual_length = 0;
+    if (xfer->type == LIBUSB_TRANSFER_TYPE_CONTROL)
+    {
+        unsigned char* setup = xfer->buffer;
+        int result = control(*d, setup[0], setup[1], (uint16_t)(setup[2] | (setup[3] << 8)),
+            (uint16_t)(setup[4] | (setup[5] << 8)), setup + LIBUSB_CONTROL_SETUP_SIZE, (uint16_t)(setup[6] | (setup[7] << 8)));
+        xfer->status = result >= 0 ? LIBUSB_TRANSFER_COMPLETED : LIBUSB_TRANSFER_STALL;
+        xfer->actual_length = result >= 0 ? result : 0;
+        s.ready = now + std::chrono::microseconds(d->config.controlLatencyUS);
+    }
+    else
+    {
+        if (endpointIndex(*d, xfer->endpoint) < 0)
+            return LIBUSB_ERROR_PIPE;
+        if (xfer->timeout > 0)
+            s.deadline = now + std::chrono::milliseconds(xfer->timeout);
+    }
+    submitted.push_back(s);
+    cv.notify_all();
+    return 0;
+}
+
+int LIBUSB_CALL libusb_cancel_transfer(struct libusb_transfer* xfer)
+{
+    std::lock_guard<std::mutex> lock(mut);
+    for (auto& s : submitted)
+        if (s.xfer == xfer && !s.cancelled)
+        {
+            s.cancelled = true;
+            cv.notify_all();
+            return 0;
+        }
+    return LIBUSB_ERROR_NOT_FOUND;
+}
+
+//! Wait (up to tv) for transfers to complete, and run their callbacks.
+int LIBUSB_CALL libusb_handle_events_timeout_completed(libusb_context*, struct timeval* tv, int* completed)
+{
+    auto deadline = Clock::now() + (tv ? Clock::duration(std::chrono::seconds(tv->tv_sec) + std::chrono::microseconds(tv->tv_usec))
+                                       : Clock::duration(std::chrono::seconds(60)));
+
+    std::lock_guard<std::mutex> dispatch(mutDispatch);
+    vector<libusb_transfer*> done;
+    {
+        std::unique_lock<std::mutex> lock(mut);
+        while (true)
+        {
+            if (completed != nullptr && *completed)
+                return 0;
+
+            auto now = Clock::now();
+            auto wake = deadline;
+            for (auto iter = submitted.begin(); iter != submitted.end(); )
+            {
+                libusb_transfer* xfer = iter->xfer;
+                Device* d = find(iter->device);
+                bool finished = true;
+                if (iter->cancelled || d == nullptr)
+                {
+                    xfer->status = d ? LIBUSB_TRANSFER_CANCELLED : LIBUSB_TRANSFER_NO_DEVICE;
+                    xfer->actual_length = 0;
+                }
+                else if (xfer->type == LIBUSB_TRANSFER_TYPE_CONTROL)
+                {
+                    finished = iter->ready <= now;
+                    wake = std::min(wake, iter->ready);
+                }
+                else
+                {
+                    int e = endpointIndex(*d, xfer->endpoint);
+                    int n = take(*d, e, xfer->buffer, xfer->length, now);
+                    if (n >= 0)
+                    {
+                        xfer->status = LIBUSB_TRANSFER_COMPLETED;
+                        xfer->actual_length = n;
+                    }
+                    else if (iter->deadline <= now)
+                        xfer->status = LIBUSB_TRANSFER_TIMED_OUT;
+                    else
+                    {
+                        finished = false;
+                        wake = std::min(wake, nextReady(*d, e, iter->deadline));
+                    }
+                }
+
+                if (finished)
+                {
+                    done.push_back(xfer);
+                    iter = submitted.erase(iter);
+                }
+                else
+                    iter++;
+            }
+
+            if (!done.empty() || now >= deadline)
+                break;
+            cv.wait_until(lock, wake);
+        }
+    }
+
+    for (auto xfer : done)
+        if (xfer->callback != nullptr)
+            xfer->callback(xfer);
+    return 0;
+}
+
+}
@@ -0,0 +1,78 @@
+/** @file   FakeUSB.h
+*   @brief  a libusb-1.0 stand-in simulating Wasatch spectrometers, for tests
+*
+*   Tests link FakeUSB.o in place of libusb.  Each simulated spectrometer
+*   answers the control opcodes the library uses (EEPROM, firmware versions,
+*   integration time, laser, triggering), and ACQUIRE queues a frame on its
+*   spectral endpoint(s) which becomes readable once the integration time has
+*   elapsed.  Synchronous and asynchronous (libusb_submit_transfer) transfers
+*   are both supported.
+*
+*   Pixel i of frame n reads (n + i) & 0xfff, plus 0x1000 while the laser is
+*   enabled, so tests can tell frames apart and see whether the laser was on.
+*   In area-scan mode every row is a frame, with its row number in pixel 0.
+*/
+
+#pragma once
+
+#include <libusb.h>
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace FakeUSB
+{
+    typedef std::chrono::steady_clock Clock;
+
+    struct Config
+    {
+        int devices = 1;
+        uint16_t pid = 0x1000;
+        int pixels = 1024;
+        int endpoints = 1;          //!< spectral endpoints (0x82, then 0x86...)
+        int extraEndpoints = 0;     //!< further bulk IN endpoints, carrying no spectra
+        int rows = 0;               //!< activePixelsVert (area scan)
+        int firstRow = 0;           //!< area-scan readout starts mid-frame at this row
+        int lineUS = 0;             //!< area-scan line period
+        bool hasLaser = true;
+        bool hasCooling = false;    //!< TEC, so the detector temperature is polled
+        bool gen15 = false;         //!< accessory connector (hardware triggering)
+        bool invertXAxis = false;   //!< EEPROM feature mask: pixels read out in reverse
+        int controlLatencyUS = 0;   //!< bus time of each control transfer
+        int speed = LIBUSB_SPEED_HIGH;
+    };
+
+    //! a control transfer as the device received it
+    struct Command
+    {
+        bool read = false;
+        uint8_t bRequest = 0;
+        uint16_t wValue = 0;
+        uint16_t wIndex = 0;
+        Clock::time_point when;
+    };
+
+    //! Replace the simulated devices (call before opening any).
+    void configure(const Config& config);
+
+    //! @returns a handle on device 'index', as libusb_open would
+    libusb_device_handle* open(int index = 0);
+
+    std::vector<Command> getCommands(int index = 0);
+    void clearCommands(int index = 0);
+
+    //! make the device fail control transfers with this opcode
+    void failOpcode(uint8_t bRequest, bool fail, int index = 0);
+
+    //! pulse the external trigger (frames only result while armed)
+    void trigger(int index = 0);
+
+    bool getLaserEnable(int index = 0);
+    uint32_t getIntegrationTimeMS(int index = 0);
+    uint64_t getFramesAcquired(int index = 0);
+
+    //! what the device returns for 'pixel' of frame 'frame'
+    inline uint16_t pixelValue(uint64_t frame, int pixel, bool laser)
+    { return (uint16_t)(((frame + pixel) & 0xfff) | (laser ? 0x1000 : 0)); }
+}
@@ -0,0 +1,122 @@
+/** @file   bench-expression.cpp
+*   @brief  times compiled expressions against the same formulas hand-written
+*           in C++
+*
+*   Each formula is evaluated over a 2048-pixel spectrum, once by Expression
+*   and once by a plain loop built with the same compiler flags; the largest
+*   difference between the two is reported alongside, as a sanity check.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "Expression.h"
+
+using WasatchVCPP::Expression;
+using WasatchVCPP::Logger;
+using std::vector;
+
+typedef std::chrono::steady_clock Clock;
+
+const int PIXELS = 2048;
+const double K = 1.25;
+
+vector<double> s(PIXELS), dark(PIXELS), ref(PIXELS), wl(PIXELS), wn(PIXELS);
+
+void subtractDark(double* out)
+{
+    for (int i = 0; i < PIXELS; i++)
+        out[i] = s[i] - dark[i];
+}
+
+void reflectance(double* out)
+{
+    for (int i = 0; i < PIXELS; i++)
+        out[i] = (s[i] - dark[i]) / (ref[i] - dark[i]) * K;
+}
+
+void absorbance(double* out)
+{
+    for (int i = 0; i < PIXELS; i++)
+        out[i] = std::log10(ref[i] / s[i]);
+}
+
+void clampedPerWavelength(double* out)
+{
+    for (int i = 0; i < PIXELS; i++)
+        out[i] = std::max(s[i] - dark[i], 0.0) * 1e7 / wl[i];
+}
+
+struct Case
+{
+    const char* formula;
+    void (*hand)(double*);
+};
+
+//! @returns nanoseconds per call
+template <typename F>
+double timeNS(F f, int iterations)
+{
+    for (int i = 0; i < iterations / 10 + 1; i++)     // warm up
+        f();
+    auto start = Clock::now();
+    for (int i = 0; i < iterations; i++)
+        f();
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / iterations;
+}
+
+int main(int argc, char** argv)
+{
+    Logger logger;
+    logger.level = Logger::Levels::LOG_LEVEL_NEVER;
+    int iterations = argc > 1 ? atoi(argv[1]) : 20000;
+
+    std::mt19937 rng(100);
+    for (int i = 0; i < PIXELS; i++)
+    {
+        dark[i] = 800 + (rng() % 400000) / 1000.0;
+        s[i] = dark[i] + 1 + rng() % 50000;
+        ref[i] = s[i] + 1 + rng() % 10000;
+        wl[i] = 780 + i * 0.1;
+        wn[i] = 1e7 / 785 - 1e7 / wl[i];
+    }
+
+    Expression expression(logger);
+    expression.setBuffer("dark", &dark[0], PIXELS);
+    expression.setBuffer("ref", &ref[0], PIXELS);
+    expression.setConstant("k", K);
+
+    const Case cases[] =
+    {
+        { "s - dark",                       subtractDark },
+        { "(s - dark) / (ref - dark) * k",  reflectance },
+        { "log10(ref / s)",                 absorbance },
+        { "max(s - dark, 0) * 1e7 / wl",    clampedPerWavelength },
+    };
+
+    vector<double> expected(PIXELS), actual(PIXELS);
+    printf("%d pixels, ns per spectrum:\n", PIXELS);
+    for (const auto& c : cases)
+    {
+        if (!expression.compile(c.formula))
+        {
+            printf("%s: failed to compile\n", c.formula);
+            return 1;
+        }
+
+        double handNS = timeNS([&]() { c.hand(&expected[0]); }, iterations);
+        double exprNS = timeNS([&]() { expression.evaluate(&s[0], &wl[0], &wn[0], &actual[0], PIXELS); }, iterations);
+
+        double worst = 0;
+        for (int i = 0; i < PIXELS; i++)
+            worst = std::max(worst, std::fabs(actual[i] - expected[i]) / std::max(std::fabs(expected[i]), 1e-300));
+        printf("  %-32s hand %7.0f, expression %7.0f (%.2fx), max relative difference %.1e\n",
+            c.formula, handNS, exprNS, exprNS / handNS, worst);
+    }
+    return 0;
+}
@@ -0,0 +1,69 @@
+/** @file   bench-pipeline.cpp
+*   @brief  times the double and fixed-point processing pipelines
+*
+*   Finishes a 2048-pixel, 10-scan average with dark and gain correction
+*   both ways.  Built with the host compiler by default; for an ARM board,
+*   cross-compile and copy the binary over, e.g.
+*
+*       make bench-pipeline CXX=aarch64-linux-gnu-g++ LDFLAGS=-static
+*       make bench-pipeline CXX=arm-linux-gnueabihf-g++ LDFLAGS=-static
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "SpectrumPipeline.h"
+
+using WasatchVCPP::Logger;
+using WasatchVCPP::SpectrumPipeline;
+using std::vector;
+
+typedef std::chrono::steady_clock Clock;
+
+const int PIXELS = 2048;
+const int SCANS = 10;
+
+//! @returns nanoseconds per finished spectrum
+double timeFinish(SpectrumPipeline& pipeline, const vector<uint32_t>& sums, vector<float>& out, int iterations)
+{
+    auto start = Clock::now();
+    for (int i = 0; i < iterations; i++)
+        pipeline.finish(&sums[0], SCANS, &out[0], PIXELS);
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / iterations;
+}
+
+int main(int argc, char** argv)
+{
+    Logger logger;
+    logger.level = Logger::Levels::LOG_LEVEL_NEVER;
+    SpectrumPipeline pipeline(logger);
+    int iterations = argc > 1 ? atoi(argv[1]) : 20000;
+
+    std::mt19937 rng(95);
+    vector<uint32_t> sums(PIXELS);
+    vector<double> dark(PIXELS), gain(PIXELS);
+    for (int i = 0; i < PIXELS; i++)
+    {
+        sums[i] = (uint32_t)(rng() % 60000) * SCANS;
+        dark[i] = 800 + (rng() % 400000) / 1000.0;
+        gain[i] = 0.5 + (rng() % 1000000) / 1000000.0;
+    }
+    pipeline.setDark(&dark[0], PIXELS);
+    pipeline.setGain(&gain[0], PIXELS);
+
+    vector<float> out(PIXELS);
+    double ns[2];
+    for (int fixed = 0; fixed < 2; fixed++)
+    {
+        pipeline.setFixedPoint(fixed != 0);
+        timeFinish(pipeline, sums, out, iterations / 10 + 1);   // warm up
+        ns[fixed] = timeFinish(pipeline, sums, out, iterations);
+    }
+
+    printf("%d pixels, %d scans, dark and gain: double %.0fns, fixed-point %.0fns per spectrum (%.2fx)\n",
+        PIXELS, SCANS, ns[0], ns[1], ns[0] / ns[1]);
+    return 0;
+}
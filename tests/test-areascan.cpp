@@ -0,0 +1,172 @@
+/** @file   test-areascan.cpp
+*   @brief  test of area-scan acquisition against a simulated spectrometer
+*
+*   Each row the simulated device streams is tagged with its row number in
+*   pixel 0 and otherwise reads as a consecutive frame, so row order, frame
+*   alignment and the copy to the caller can all be checked.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "Check.h"
+#include "FakeUSB.h"
+#include "Spectrometer.h"
+
+using WasatchVCPP::Logger;
+using WasatchVCPP::Spectrometer;
+using std::vector;
+
+typedef FakeUSB::Clock Clock;
+
+//! @returns how many ACQUIREs the device has received
+int acquires()
+{
+    int count = 0;
+    for (auto& command : FakeUSB::getCommands())
+        if (!command.read && command.bRequest == 0xad)
+            count++;
+    return count;
+}
+
+//! every row a consecutive frame, its tag (pixel 0) replaced by pixel 1
+bool frameMatches(const vector<double>& frame, int rows, int cols)
+{
+    for (int row = 0; row < rows; row++)
+    {
+        const double* line = &frame[(size_t)row * cols];
+        if (line[0] != line[1])
+            return false;
+        for (int i = 2; i < cols; i++)
+            if ((int)line[i] != (((int)line[i - 1] + 1) & 0xfff))
+                return false;
+        if (row > 0 && (int)line[1] != (((int)line[1 - cols] + 1) & 0xfff))
+            return false;
+    }
+    return true;
+}
+
+//! whole frames are assembled in order, however the readout is aligned
+void testFrame(Logger& logger, int endpoints, int firstRow)
+{
+    FakeUSB::Config config;
+    config.pixels = 1024 * endpoints;
+    config.endpoints = endpoints;
+    config.rows = 64;
+    config.firstRow = firstRow;
+    FakeUSB::configure(config);
+    Spectrometer spec(FakeUSB::open(), config.pid, 0, logger);
+
+    CHECK(spec.setAreaScanEnable(true), "frame (%d endpoints): enable failed", endpoints);
+    vector<double> frame((size_t)config.rows * config.pixels);
+    for (int i = 0; i < 3; i++)
+    {
+        bool ok = spec.getAreaScanFrame(&frame[0], config.rows, config.pixels, 1000);
+        CHECK(ok, "frame (%d endpoints, first row %d): acquisition %d failed", endpoints, firstRow, i);
+        CHECK(!ok || frameMatches(frame, config.rows, config.pixels),
+            "frame (%d endpoints, first row %d): acquisition %d content", endpoints, firstRow, i);
+    }
+
+    vector<double> binned(config.pixels);
+    CHECK(spec.getAreaScanBinned(&binned[0], config.pixels, 0, 1, 1000), "frame: binning failed");
+    CHECK(spec.setAreaScanEnable(false), "frame: disable failed");
+}
+
+//! buffers too small, or rows out of range, are refused before acquiring
+void testStorage(Logger& logger)
+{
+    FakeUSB::Config config;
+    config.rows = 16;
+    FakeUSB::configure(config);
+    Spectrometer spec(FakeUSB::open(), config.pid, 0, logger);
+    CHECK(spec.setAreaScanEnable(true), "storage: enable failed");
+    FakeUSB::clearCommands();
+
+    vector<double> frame((size_t)config.rows * config.pixels);
+    CHECK(!spec.getAreaScanFrame(&frame[0], config.rows - 1, config.pixels, 1000), "storage: short frame accepted");
+    CHECK(!spec.getAreaScanFrame(&frame[0], config.rows, config.pixels - 1, 1000), "storage: narrow frame accepted");
+    CHECK(!spec.getAreaScanFrame(nullptr, config.rows, config.pixels, 1000), "storage: null frame accepted");
+    CHECK(!spec.getAreaScanBinned(&frame[0], config.pixels - 1, 0, 1, 1000), "storage: short spectrum accepted");
+    CHECK(!spec.getAreaScanBinned(&frame[0], config.pixels, 0, config.rows, 1000), "storage: row out of range accepted");
+    CHECK(!spec.getAreaScanBinned(&frame[0], config.pixels, 2, 1, 1000), "storage: reversed rows accepted");
+    CHECK(acquires() == 0, "storage: %d acquisitions started for refused requests", acquires());
+
+    // a wider buffer is filled row by row at its own stride
+    const int cols = config.pixels + 8;
+    vector<double> wide((size_t)config.rows * cols, -1);
+    CHECK(spec.getAreaScanFrame(&wide[0], config.rows, cols, 1000), "storage: wide frame failed");
+    CHECK(wide[cols - 1] == -1 && wide[cols + 1] != -1, "storage: wide frame stride");
+}
+
+//! queued row reads keep up with the line rate
+void testLineRate(Logger& logger)
+{
+    FakeUSB::Config config;
+    config.rows = 200;
+    config.lineUS = 250;
+    FakeUSB::configure(config);
+    Spectrometer spec(FakeUSB::open(), config.pid, 0, logger);
+    CHECK(spec.setAreaScanEnable(true), "line rate: enable failed");
+
+    vector<double> frame((size_t)config.rows * config.pixels);
+    const int frames = 5;
+    auto start = Clock::now();
+    for (int i = 0; i < frames; i++)
+        CHECK(spec.getAreaScanFrame(&frame[0], config.rows, config.pixels, 1000), "line rate: acquisition %d failed", i);
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / frames;
+
+    // the integration time, then the device's readout
+    double nominalMS = FakeUSB::getIntegrationTimeMS() + config.rows * config.lineUS / 1000.0;
+    CHECK(ms < 1.5 * nominalMS, "line rate: %.1fms per frame (device readout %.1fms)", ms, nominalMS);
+    printf("line rate: %.1fms per %d-row frame (device readout %.1fms)\n", ms, config.rows, nominalMS);
+}
+
+//! disabling area scan while another thread acquires never exposes a freed
+//! frame (run under ThreadSanitizer / AddressSanitizer to be sure)
+void testDisableRace(Logger& logger)
+{
+    FakeUSB::Config config;
+    config.rows = 32;
+    FakeUSB::configure(config);
+    Spectrometer spec(FakeUSB::open(), config.pid, 0, logger);
+    CHECK(spec.setAreaScanEnable(true), "race: enable failed");
+
+    std::atomic<bool> done(false);
+    std::atomic<int> good(0), bad(0);
+    std::thread reader([&]()
+    {
+        vector<double> frame((size_t)config.rows * config.pixels);
+        while (!done)
+            if (spec.getAreaScanFrame(&frame[0], config.rows, config.pixels, 1000))
+                (frameMatches(frame, config.rows, config.pixels) ? good : bad)++;
+    });
+
+    for (int i = 0; i < 20; i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        spec.setAreaScanEnable(i % 2 == 1);
+    }
+    done = true;
+    reader.join();
+
+    CHECK(bad == 0, "race: %d corrupt frames (%d good)", (int)bad, (int)good);
+    printf("race: %d frames while toggling area scan\n", (int)good);
+}
+
+int main(int argc, char** argv)
+{
+    Logger logger;
+    quiet(logger);
+
+    testFrame(logger, 1, 0);
+    testFrame(logger, 1, 20);
+    testFrame(logger, 2, 0);
+    testStorage(logger);
+    testLineRate(logger);
+    testDisableRace(logger);
+
+    return report(argv[0]);
+}
@@ -0,0 +1,127 @@
+/** @file   test-async.cpp
+*   @brief  test of asynchronous control transfers against a simulated
+*           spectrometer
+*
+*   Operations must reach the device in the order queued, interleaved safely
+*   with synchronous traffic from other threads, and completed operations
+*   nobody collects must not accumulate.  Run under SANITIZE=thread to check
+*   for data races as well.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "Check.h"
+#include "FakeUSB.h"
+#include "Spectrometer.h"
+
+using WasatchVCPP::AsyncControl;
+using WasatchVCPP::Logger;
+using WasatchVCPP::Spectrometer;
+using std::vector;
+
+typedef FakeUSB::Clock Clock;
+
+std::atomic<int> callbacks(0);
+
+void onComplete(int specIndex, int handle, int result, const uint8_t* data, void* userData)
+{
+    if (result >= 0)
+        callbacks++;
+}
+
+//! @returns whether every write to the integration time arrived in order
+bool inOrder(int& count)
+{
+    count = 0;
+    int last = -1;
+    for (auto& command : FakeUSB::getCommands())
+        if (!command.read && command.bRequest == 0xb2)
+        {
+            if ((int)command.wValue <= last)
+                return false;
+            last = command.wValue;
+            count++;
+        }
+    return true;
+}
+
+//! queued order is kept, alongside synchronous traffic
+void testOrder(Spectrometer& spec)
+{
+    const int ops = 2000;
+    std::atomic<bool> done(false);
+    std::atomic<int> syncReads(0);
+    std::thread reader([&]()
+    {
+        while (!done)
+        {
+            spec.getFirmwareVersion();
+            syncReads++;
+        }
+    });
+
+    FakeUSB::clearCommands();
+    callbacks = 0;
+    vector<int> handles;
+    for (int i = 0; i < ops; i++)
+    {
+        int handle = spec.sendCmdAsync(0xb2, (uint16_t)(100 + i), 0, nullptr, 0, i % 2 ? onComplete : nullptr, nullptr);
+        CHECK(handle > 0, "order: submit %d failed", i);
+        if (i % 2 == 0)
+            handles.push_back(handle);
+    }
+
+    // only the latest of the callback-less operations are collectable
+    AsyncControl::Operation op;
+    CHECK(spec.asyncControl.wait(handles.back(), 5000, op) == 1 && op.result >= 0, "order: last operation failed");
+    auto end = Clock::now() + std::chrono::seconds(5);
+    while (callbacks < ops / 2 && Clock::now() < end)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    done = true;
+    reader.join();
+
+    int count = 0;
+    CHECK(inOrder(count), "order: integration time writes out of order");
+    CHECK(count == ops, "order: %d of %d writes reached the device", count, ops);
+    CHECK(callbacks == ops / 2, "order: %d of %d callbacks", (int)callbacks, ops / 2);
+    CHECK(spec.asyncControl.getPending() == 0, "order: %d still pending", spec.asyncControl.getPending());
+    printf("order: %d operations, %d synchronous reads interleaved\n", ops, (int)syncReads);
+}
+
+//! operations nobody waits on are released, oldest first
+void testUncollected(Spectrometer& spec)
+{
+    const int ops = 3000;
+    int first = 0, last = 0;
+    for (int i = 0; i < ops; i++)
+    {
+        last = spec.sendCmdAsync(0xb2, 10, 0, nullptr, 0, nullptr, nullptr);
+        if (i == 0)
+            first = last;
+    }
+
+    AsyncControl::Operation op;
+    CHECK(spec.asyncControl.wait(last, 5000, op) == 1, "uncollected: last operation not collectable");
+    CHECK(spec.asyncControl.wait(first, 0, op) == -1, "uncollected: oldest operation still held");
+    CHECK(spec.asyncControl.wait(last - 100, 0, op) == 1, "uncollected: recent operation released");
+}
+
+int main(int argc, char** argv)
+{
+    Logger logger;
+    quiet(logger);
+
+    FakeUSB::Config config;
+    config.controlLatencyUS = 20;
+    FakeUSB::configure(config);
+    Spectrometer spec(FakeUSB::open(), config.pid, 0, logger);
+
+    testOrder(spec);
+    testUncollected(spec);
+
+    return report(argv[0]);
+}
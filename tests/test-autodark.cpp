@@ -0,0 +1,114 @@
+/** @file   test-autodark.cpp
+*   @brief  test of the auto-dark sequence against a simulated spectrometer
+*
+*   The simulated device sets bit 12 of every pixel while its laser is on, so
+*   a spectrum shows whether it was read with the laser firing.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "Check.h"
+#include "FakeUSB.h"
+#include "Spectrometer.h"
+
+using WasatchVCPP::Logger;
+using WasatchVCPP::Spectrometer;
+using std::vector;
+
+bool laserOn(const vector<double>& spectrum)
+{
+    for (auto value : spectrum)
+        if (((int)value & 0x1000) == 0)
+            return false;
+    return !spectrum.empty();
+}
+
+bool laserOff(const vector<double>& spectrum)
+{
+    for (auto value : spectrum)
+        if (((int)value & 0x1000) != 0)
+            return false;
+    return !spectrum.empty();
+}
+
+//! dark with the laser off, sample with it on, and the laser left off
+void testSequence(Spectrometer& spec)
+{
+    CHECK(spec.setAutoDarkConfig(0, 0, 0), "sequence: config refused");
+    CHECK(!spec.setAutoDarkConfig(-1, 0, 0), "sequence: negative warmup accepted");
+
+    vector<double> corrected, dark, raw;
+    CHECK(spec.getAutoDarkSpectrum(corrected, dark, raw), "sequence: failed");
+    CHECK(laserOff(dark), "sequence: dark taken with the laser on");
+    CHECK(laserOn(raw), "sequence: sample taken with the laser off");
+    CHECK(!FakeUSB::getLaserEnable(), "sequence: laser left on");
+
+    // a dark younger than maxAgeMS is reused
+    CHECK(spec.setAutoDarkConfig(0, 60000, 0), "sequence: config refused");
+    vector<double> first;
+    CHECK(spec.getAutoDarkSpectrum(corrected, first, raw), "sequence: failed");
+    CHECK(spec.getAutoDarkSpectrum(corrected, dark, raw) && dark == first, "sequence: dark not reused");
+}
+
+//! other acquisitions never see the laser on, and reconfiguring mid-sequence
+//! is safe (run under ThreadSanitizer to be sure)
+void testConcurrent(Spectrometer& spec)
+{
+    std::atomic<bool> done(false);
+    std::atomic<int> spectra(0), lit(0);
+    std::thread reader([&]()
+    {
+        while (!done)
+        {
+            auto spectrum = spec.getSpectrum();
+            spectra++;
+            if (!laserOff(spectrum))
+                lit++;
+        }
+    });
+    std::thread configurer([&]()
+    {
+        for (int i = 0; !done; i++)
+        {
+            spec.setAutoDarkConfig(1, i % 2 ? 60000 : 0, 0);
+            std::this_thread::sleep_for(std::chrono::milliseconds(3));
+        }
+    });
+
+    int sequences = 0;
+    for (int i = 0; i < 20; i++)
+    {
+        vector<double> corrected, dark, raw;
+        if (spec.getAutoDarkSpectrum(corrected, dark, raw))
+        {
+            sequences++;
+            CHECK(laserOff(dark) && laserOn(raw), "concurrent: sequence %d read the wrong laser state", i);
+        }
+    }
+    done = true;
+    reader.join();
+    configurer.join();
+
+    CHECK(sequences == 20, "concurrent: %d of 20 sequences succeeded", sequences);
+    CHECK(lit == 0, "concurrent: %d of %d other spectra read with the laser on", (int)lit, (int)spectra);
+    printf("concurrent: %d sequences, %d other spectra\n", sequences, (int)spectra);
+}
+
+int main(int argc, char** argv)
+{
+    Logger logger;
+    quiet(logger);
+
+    FakeUSB::Config config;
+    FakeUSB::configure(config);
+    Spectrometer spec(FakeUSB::open(), config.pid, 0, logger);
+
+    testSequence(spec);
+    testConcurrent(spec);
+
+    return report(argv[0]);
+}
@@ -0,0 +1,104 @@
+/** @file   test-coalesce.cpp
+*   @brief  test of coalesced control reads against a simulated spectrometer
+*
+*   Identical reads queued behind the same transfer share one; a read made
+*   once that transfer has the bus issues its own, so it reflects any write
+*   made in between; and nothing reaches the bus once the spectrometer is
+*   closed.
+*/
+
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "Check.h"
+#include "FakeUSB.h"
+#include "Spectrometer.h"
+
+using WasatchVCPP::Logger;
+using WasatchVCPP::Spectrometer;
+using std::vector;
+
+// each control transfer holds the bus this long
+const int LATENCY_MS = 50;
+
+//! @returns reads of 'bRequest' the device received
+int reads(uint8_t bRequest)
+{
+    int count = 0;
+    for (auto& command : FakeUSB::getCommands())
+        if (command.read && command.bRequest == bRequest)
+            count++;
+    return count;
+}
+
+//! concurrent identical reads waiting on the bus become one transfer
+void testCoalesced(Spectrometer& spec)
+{
+    FakeUSB::clearCommands();
+
+    // hold the bus with another read while the identical ones queue
+    std::thread occupier([&]() { spec.getFirmwareVersion(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(LATENCY_MS / 3));
+
+    const int READERS = 4;
+    std::atomic<int> enabled(0);
+    vector<std::thread> readers;
+    for (int i = 0; i < READERS; i++)
+        readers.push_back(std::thread([&]() { enabled += spec.getLaserEnable() ? 1 : 0; }));
+    for (auto& reader : readers)
+        reader.join();
+    occupier.join();
+
+    CHECK(reads(0xe2) == 1, "coalesced: %d reads for %d callers", reads(0xe2), READERS);
+    CHECK(enabled == 0, "coalesced: %d callers saw the laser enabled", (int)enabled);
+}
+
+//! a read arriving once the transfer has the bus gets its own, as the 
+//! response may predate a write the caller made
+void testStarted(Spectrometer& spec)
+{
+    FakeUSB::clearCommands();
+    std::thread leader([&]() { spec.getLaserEnable(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(LATENCY_MS / 3));
+    spec.getLaserEnable();
+    leader.join();
+    CHECK(reads(0xe2) == 2, "started: %d reads, expected 2", reads(0xe2));
+
+    // a write queued behind a read in progress is seen by the next read
+    leader = std::thread([&]() { spec.getLaserEnable(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(LATENCY_MS / 3));
+    CHECK(spec.setLaserEnable(true), "started: enable failed");
+    CHECK(spec.getLaserEnable(), "started: read didn't reflect the enable");
+    leader.join();
+    spec.setLaserEnable(false);
+}
+
+//! once closed, nothing waits for or reaches the bus
+void testClosed(Spectrometer& spec)
+{
+    spec.close();
+    FakeUSB::clearCommands();
+
+    CHECK(!spec.getLaserEnable(), "closed: laser read as enabled");
+    CHECK(spec.getFirmwareVersion() == "ERROR", "closed: firmware version read");
+    CHECK(FakeUSB::getCommands().empty(), "closed: %d transfers after close", (int)FakeUSB::getCommands().size());
+}
+
+int main(int argc, char** argv)
+{
+    Logger logger;
+    quiet(logger);
+
+    FakeUSB::Config config;
+    config.controlLatencyUS = LATENCY_MS * 1000;
+    FakeUSB::configure(config);
+    Spectrometer spec(FakeUSB::open(), config.pid, 0, logger);
+
+    testCoalesced(spec);
+    testStarted(spec);
+    testClosed(spec);
+
+    return report(argv[0]);
+}
@@ -0,0 +1,87 @@
+/** @file   test-display.cpp
+*   @brief  test of the display stream against a simulated spectrometer
+*
+*   Envelopes follow the spectra acquired, and closing the spectrometer
+*   releases a reader waiting for one rather than destroying the stream 
+*   under it (run under SANITIZE=thread or address to be sure).
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "Check.h"
+#include "FakeUSB.h"
+#include "Spectrometer.h"
+
+using WasatchVCPP::Logger;
+using WasatchVCPP::Spectrometer;
+using std::vector;
+
+typedef FakeUSB::Clock Clock;
+
+FakeUSB::Config config;
+
+//! each spectrum read is offered, and reduced to its envelope
+void testEnvelope(Logger& logger)
+{
+    Spectrometer spec(FakeUSB::open(), config.pid, 0, logger);
+    const int width = 16;
+    CHECK(spec.display.configure(width, 0), "envelope: configure failed");
+
+    vector<double> spectrum = spec.getSpectrum();
+    vector<float> mins(width), maxs(width);
+    CHECK(spec.display.read(&mins[0], &maxs[0], width, 1000) == width, "envelope: no envelope");
+
+    const int perBucket = (int)spectrum.size() / width;
+    bool ok = true;
+    for (int b = 0; b < width; b++)
+        for (int i = b * perBucket; i < (b + 1) * perBucket; i++)
+            ok = ok && mins[b] <= spectrum[i] && spectrum[i] <= maxs[b];
+    CHECK(ok, "envelope: spectrum outside its envelope");
+    CHECK(spec.display.read(&mins[0], &maxs[0], width, 0) == 0, "envelope: same envelope read twice");
+}
+
+//! closing wakes a waiting reader, and waits for it to leave
+void testClose(Logger& logger)
+{
+    std::unique_ptr<Spectrometer> spec(new Spectrometer(FakeUSB::open(), config.pid, 0, logger));
+    const int width = 16;
+    CHECK(spec->display.configure(width, 0), "close: configure failed");
+
+    auto& display = spec->display;
+    std::atomic<int> result(1);
+    std::atomic<double> waitedMS(0);
+    std::thread reader([&]()
+    {
+        vector<float> mins(width), maxs(width);
+        auto start = Clock::now();
+        result = display.read(&mins[0], &maxs[0], width, 5000);
+        waitedMS = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    });
+
+    // let the reader start waiting
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    spec.reset();
+    reader.join();
+
+    CHECK(result < 0, "close: reader returned %d", (int)result);
+    CHECK(waitedMS < 1000, "close: reader waited %.0fms", (double)waitedMS);
+    printf("close: waiting reader released after %.0fms\n", (double)waitedMS);
+}
+
+int main(int argc, char** argv)
+{
+    Logger logger;
+    quiet(logger);
+
+    FakeUSB::configure(config);
+
+    testEnvelope(logger);
+    testClose(logger);
+
+    return report(argv[0]);
+}
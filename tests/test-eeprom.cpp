@@ -0,0 +1,274 @@
+/** @file   test-eeprom.cpp
+*   @brief  round-trip and fuzz test of the EEPROM layout engine
+*
+*   Every image, however malformed, must serialize back to exactly the bytes it
+*   was parsed from, and a typed write must change only the bytes of the field
+*   written (and read back as the value written).  Against a simulated 
+*   spectrometer, commits write only the changed page and re-parse the EEPROM
+*   (and axes) in place, while other threads read them through the API.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Check.h"
+#include "FakeUSB.h"
+#include "Driver.h"
+#include "EEPROM.h"
+#include "Spectrometer.h"
+#include "WasatchVCPP.h"
+
+using WasatchVCPP::Driver;
+using WasatchVCPP::EEPROM;
+using WasatchVCPP::Logger;
+using WasatchVCPP::Spectrometer;
+using std::string;
+using std::vector;
+
+typedef vector<vector<uint8_t> > Pages;
+
+Pages randomImage(std::mt19937& rng, uint8_t format)
+{
+    Pages pages(EEPROM::MAX_PAGES, vector<uint8_t>(EEPROM::PAGE_SIZE));
+    for (auto& page : pages)
+        for (auto& b : page)
+            b = (uint8_t)rng();
+    pages[0][63] = format;
+    return pages;
+}
+
+//! @returns the row describing 'name' in 'format', or nullptr
+const EEPROM::Field* findRow(const string& name, uint8_t format)
+{
+    for (auto& f : EEPROM::layout())
+        if (name == f.name && format >= f.minFormat && format <= f.maxFormat)
+            return &f;
+    return nullptr;
+}
+
+int rowBytes(const EEPROM::Field& f)
+{
+    switch (f.wire)
+    {
+        case EEPROM::FieldType::Bool:
+        case EEPROM::FieldType::UInt8:     return 1;
+        case EEPROM::FieldType::Int16:
+        case EEPROM::FieldType::UInt16:    return 2;
+        case EEPROM::FieldType::String:
+        case EEPROM::FieldType::Bytes:     return f.len;
+        case EEPROM::FieldType::PixelList: return 2 * f.len;
+        default:                           return 4;
+    }
+}
+
+void testLayout()
+{
+    vector<string> errors;
+    CHECK(EEPROM::validateLayout(&errors), "layout: %s", errors.empty() ? "" : errors[0].c_str());
+}
+
+//! parse -> serialize reproduces the input, for random images of every format
+void testRoundTrip(std::mt19937& rng, Logger& logger)
+{
+    int images = 0;
+    for (int i = 0; i < 2000; i++)
+    {
+        uint8_t format = i % 4 == 3 ? (uint8_t)rng() : (uint8_t)(i % (EEPROM::LATEST_FORMAT + 1));
+        Pages pages = randomImage(rng, format);
+
+        EEPROM eeprom(logger);
+        eeprom.parse(pages);
+
+        Pages out;
+        CHECK(eeprom.serialize(out), "round trip: serialize failed (format %u)", format);
+        CHECK(out == pages, "round trip: image changed (format %u)", format);
+        images++;
+    }
+    printf("round trip: %d images\n", images);
+}
+
+//! the format-9 feature mask shares an offset with the retired excitationNM
+void testFeatureMask(std::mt19937& rng, Logger& logger)
+{
+    Pages pages = randomImage(rng, 9);
+    pages[0][39] = 0x04;    // gen15
+    pages[0][40] = 0x00;
+
+    EEPROM eeprom(logger);
+    eeprom.parse(pages);
+    CHECK(eeprom.featureMask.gen15, "featureMask: gen15 not parsed");
+    CHECK(eeprom.stringified["gen15"] == "true", "featureMask: gen15 stringified as %s", eeprom.stringified["gen15"].c_str());
+
+    Pages out;
+    eeprom.serialize(out);
+    CHECK(out[0][39] == 0x04 && out[0][40] == 0x00, "featureMask: serialized as %02x %02x", out[0][39], out[0][40]);
+}
+
+//! setField changes only the bytes of the field, and reads back
+void testTypedWrites(std::mt19937& rng, Logger& logger)
+{
+    int writes = 0;
+    for (int i = 0; i < 300; i++)
+    {
+        uint8_t format = (uint8_t)(i % (EEPROM::LATEST_FORMAT + 1));
+        Pages pages = randomImage(rng, format);
+        EEPROM eeprom(logger);
+        eeprom.parse(pages);
+
+        // take every value from a second image of the same format
+        EEPROM donor(logger);
+        donor.parse(randomImage(rng, format));
+
+        for (auto& pair : donor.stringified)
+        {
+            const string& name = pair.first;
+            const EEPROM::Field* f = findRow(name, format);
+            if (f == nullptr || f->fmt == nullptr || name == "format" || name == "subformat")
+                continue;
+
+            EEPROM edited(eeprom);
+            if (!edited.setField(name, pair.second))
+                continue;   // e.g. a random string with embedded control bytes too long
+
+            Pages out;
+            CHECK(edited.serialize(out), "%s: serialize failed", name.c_str());
+            for (int p = 0; p < EEPROM::MAX_PAGES; p++)
+                for (int b = 0; b < EEPROM::PAGE_SIZE; b++)
+                {
+                    bool inField = p == f->page && b >= f->offset && b < f->offset + rowBytes(*f);
+                    if (!inField && out[p][b] != pages[p][b])
+                    {
+                        CHECK(false, "%s (format %u): page %d byte %d changed", name.c_str(), format, p, b);
+                        p = EEPROM::MAX_PAGES;
+                        break;
+                    }
+                }
+
+            // (the startup temperature is clamped to the detector's limits)
+            EEPROM reparsed(logger);
+            reparsed.parse(out);
+            if (name != "startupDetectorTemperatureDegC")
+                CHECK(reparsed.stringified[name] == pair.second, "%s (format %u): wrote %s, read %s",
+                    name.c_str(), format, pair.second.c_str(), reparsed.stringified[name].c_str());
+            writes++;
+        }
+    }
+    printf("typed writes: %d fields\n", writes);
+}
+
+//! values which can't be represented are refused, leaving the field unchanged
+void testRejectedWrites(std::mt19937& rng, Logger& logger)
+{
+    EEPROM eeprom(logger);
+    eeprom.parse(randomImage(rng, 9));
+    string model = eeprom.model;
+
+    CHECK(!eeprom.setField("model", "a string much longer than sixteen bytes"), "long model accepted");
+    CHECK(eeprom.model == model, "rejected model changed the field");
+    CHECK(!eeprom.setField("slitSizeUM", "70000"), "out-of-range slit accepted");
+    CHECK(!eeprom.setField("hasLaser", "maybe"), "non-boolean accepted");
+    CHECK(!eeprom.setField("noSuchField", "1"), "unknown field accepted");
+    CHECK(eeprom.setField("SLITSIZEUM", "50") && eeprom.slitSizeUM == 50, "case-insensitive write refused");
+}
+
+//! staged fields are written to the device and re-parsed, wavecal included
+void testCommit(Logger& logger)
+{
+    FakeUSB::Config config;
+    FakeUSB::configure(config);
+    Spectrometer spec(FakeUSB::open(), config.pid, 0, logger);
+
+    int pages = -1;
+    CHECK(spec.setEEPROMField("wavecalCoeffs[0]", "600"), "commit: wavecal refused");
+    CHECK(spec.commitStagedEEPROM(&pages) && pages == 1, "commit: wrote %d pages, expected 1", pages);
+    CHECK(spec.eeprom.wavecalCoeffs[0] == 600 && spec.eeprom.stringified["wavecalCoeffs[0]"] == "600", 
+        "commit: field not re-parsed");
+    CHECK(!spec.wavelengths.empty() && spec.wavelengths[0] == 600, "commit: wavelengths not recomputed");
+
+    // what the device now holds
+    Spectrometer reopened(FakeUSB::open(), config.pid, 0, logger);
+    CHECK(reopened.eeprom.wavecalCoeffs[0] == 600, "commit: device holds %g", reopened.eeprom.wavecalCoeffs[0]);
+}
+
+//! wp_write_eeprom_page and wp_commit_eeprom while another thread reads the
+//! EEPROM and axes (run under -fsanitize=thread to catch unguarded readers)
+void testWriteWhileReading(Driver* driver)
+{
+    FakeUSB::Config config;
+    FakeUSB::configure(config);
+    CHECK(driver->openAllSpectrometers() == 1, "api: open failed");
+
+    std::atomic<bool> done(false);
+    std::atomic<int> reads(0);
+    std::thread reader([&]()
+    {
+        vector<double> wavelengths(config.pixels);
+        unsigned char page[EEPROM::PAGE_SIZE];
+        char value[32];
+        const char* names[200];
+        const char* values[200];
+        while (!done)
+        {
+            bool ok = wp_get_wavelengths(0, &wavelengths[0], config.pixels) == WP_SUCCESS
+                   && wp_get_eeprom_field(0, "slitSizeUM", value, sizeof(value)) == WP_SUCCESS
+                   && wp_get_eeprom_page(0, 0, page, sizeof(page)) == WP_SUCCESS
+                   && wp_get_eeprom(0, names, values, 200) == WP_SUCCESS
+                   && wp_get_eeprom_field_count(0) > 0;
+            if (ok)
+                reads++;
+        }
+    });
+
+    unsigned char page[EEPROM::PAGE_SIZE];
+    char value[32] = { 0 };
+    for (int i = 0; i < 20; i++)
+    {
+        // slit size straight into page 0
+        CHECK(wp_get_eeprom_page(0, 0, page, sizeof(page)) == WP_SUCCESS, "api: page read failed");
+        page[41] = (uint8_t)(10 + i);
+        page[42] = 0;
+        CHECK(wp_write_eeprom_page(0, 0, page, sizeof(page)) == (int)sizeof(page), "api: page write failed");
+        CHECK(wp_get_eeprom_field(0, "slitSizeUM", value, sizeof(value)) == WP_SUCCESS && atoi(value) == 10 + i,
+            "api: slit %s after writing %d", value, 10 + i);
+
+        // wavecal through a staged field
+        int written = 0;
+        float ms = 0;
+        string wavecal = std::to_string(501 + i);
+        CHECK(wp_set_eeprom_field(0, "wavecalCoeffs[0]", wavecal.c_str()) == WP_SUCCESS, "api: field refused");
+        CHECK(wp_commit_eeprom(0, &written, &ms) == WP_SUCCESS && written == 1, "api: commit wrote %d pages", written);
+    }
+    done = true;
+    reader.join();
+    CHECK(reads > 0, "api: no reads completed");
+
+    vector<double> wavelengths(config.pixels);
+    CHECK(wp_get_wavelengths(0, &wavelengths[0], config.pixels) == WP_SUCCESS && wavelengths[0] == 520, 
+        "api: wavelength %g, expected 520", wavelengths[0]);
+    driver->closeAllSpectrometers();
+}
+
+int main(int argc, char** argv)
+{
+    Logger logger;
+    quiet(logger);
+    std::mt19937 rng(argc > 1 ? atoi(argv[1]) : 76);
+
+    testLayout();
+    testRoundTrip(rng, logger);
+    testFeatureMask(rng, logger);
+    testTypedWrites(rng, logger);
+    testRejectedWrites(rng, logger);
+    testCommit(logger);
+
+    Driver* driver = Driver::getInstance();
+    quiet(driver->logger);
+    testWriteWhileReading(driver);
+
+    return report(argv[0]);
+}
@@ -0,0 +1,174 @@
+/** @file   test-expression.cpp
+*   @brief  test of compiled per-pixel expressions against the same formulas
+*           in plain C++
+*
+*   Every formula must match its scalar equivalent at spectrum lengths which
+*   exercise whole and partial chunks, constants must take effect without a
+*   recompile (including one folded into a fused multiplication), and a 
+*   formula that doesn't parse must leave the previous one in place.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Check.h"
+#include "Expression.h"
+
+using WasatchVCPP::Expression;
+using WasatchVCPP::Logger;
+using std::string;
+using std::vector;
+
+const int PIXELS = 2048;
+
+vector<double> s(PIXELS), dark(PIXELS), ref(PIXELS), wl(PIXELS), wn(PIXELS);
+double k = 1.25;
+
+struct Case
+{
+    const char* formula;
+    std::function<double(int)> expected;
+};
+
+//! @returns whether 'actual' matches 'expected' to rounding
+bool close(double actual, double expected)
+{
+    if (std::isnan(expected))
+        return std::isnan(actual);
+    return std::fabs(actual - expected) <= 1e-12 * std::max(1.0, std::fabs(expected));
+}
+
+//! evaluate a compiled formula over the first 'pixels', and compare
+void compare(Expression& expression, const Case& c, int pixels)
+{
+    vector<double> out(pixels);
+    if (!expression.evaluate(&s[0], &wl[0], &wn[0], &out[0], pixels))
+    {
+        CHECK(false, "%s: evaluation failed at %d pixels", c.formula, pixels);
+        return;
+    }
+
+    int bad = 0;
+    for (int i = 0; i < pixels; i++)
+        if (!close(out[i], c.expected(i)))
+            bad++;
+    CHECK(bad == 0, "%s: %d of %d pixels differ (first %.17g vs %.17g)", c.formula, bad, pixels, out[0], c.expected(0));
+}
+
+//! formulas against plain C++, at whole and partial chunks
+void testFormulas(Expression& expression)
+{
+    const Case cases[] =
+    {
+        { "s",                              [](int i) { return s[i]; } },
+        { "42",                             [](int i) { return 42.0; } },
+        { "s - dark",                       [](int i) { return s[i] - dark[i]; } },
+        { "(s - dark) / (ref - dark) * k",  [](int i) { return (s[i] - dark[i]) / (ref[i] - dark[i]) * k; } },
+        { "k * (s - dark)",                 [](int i) { return k * (s[i] - dark[i]); } },
+        { "(s - dark) * 2 * k",             [](int i) { return (s[i] - dark[i]) * 2 * k; } },
+        { "log10(ref / s)",                 [](int i) { return std::log10(ref[i] / s[i]); } },
+        { "max(s - dark, 0) * 1e7 / wl",    [](int i) { return std::max(s[i] - dark[i], 0.0) * 1e7 / wl[i]; } },
+        { "min(s, ref) - -dark",            [](int i) { return std::min(s[i], ref[i]) + dark[i]; } },
+        { "sqrt(abs(wn)) + (s / 1000)^2",   [](int i) { return std::sqrt(std::fabs(wn[i])) + (s[i] / 1000) * (s[i] / 1000); } },
+        { "exp(-s / ref) * log(ref)",       [](int i) { return std::exp(-s[i] / ref[i]) * std::log(ref[i]); } },
+        { "2^3^0.5 * s",                    [](int i) { return std::pow(2, std::pow(3, 0.5)) * s[i]; } },
+        { "(s / ref)^1.5",                  [](int i) { return std::pow(s[i] / ref[i], 1.5); } },
+        { "(s - dark) * (ref - dark) * (s - ref) / (wl * wn + 1)",
+            [](int i) { return (s[i] - dark[i]) * (ref[i] - dark[i]) * (s[i] - ref[i]) / (wl[i] * wn[i] + 1); } },
+    };
+
+    for (const auto& c : cases)
+    {
+        CHECK(expression.compile(c.formula), "%s: failed to compile", c.formula);
+        for (int pixels : { 1, 3, Expression::ChunkPixels, Expression::ChunkPixels + 5, PIXELS })
+            compare(expression, c, pixels);
+    }
+}
+
+//! constants change without a recompile, fused or not
+void testConstants(Expression& expression)
+{
+    Case fused = { "(s - dark) / (ref - dark) * k", [](int i) { return (s[i] - dark[i]) / (ref[i] - dark[i]) * k; } };
+    CHECK(expression.compile(fused.formula), "constants: failed to compile");
+    CHECK(expression.disassemble().find("* k") != string::npos, "constants: scale not fused:\n%s", expression.disassemble().c_str());
+
+    k = -3.5;
+    CHECK(expression.setConstant("k", k), "constants: update refused");
+    compare(expression, fused, PIXELS);
+
+    Case plain = { "s + k", [](int i) { return s[i] + k; } };
+    CHECK(expression.compile(plain.formula), "constants: failed to compile");
+    k = 7;
+    CHECK(expression.setConstant("k", k), "constants: update refused");
+    compare(expression, plain, PIXELS);
+
+    CHECK(!expression.compile("s * undefined"), "constants: undefined constant accepted");
+    CHECK(!expression.setConstant("dark", 1), "constants: buffer name accepted");
+    CHECK(!expression.setConstant("2k", 1), "constants: invalid name accepted");
+}
+
+//! a syntax error keeps the previous formula
+void testErrors(Expression& expression)
+{
+    Case previous = { "s - dark", [](int i) { return s[i] - dark[i]; } };
+    CHECK(expression.compile(previous.formula), "errors: failed to compile");
+
+    for (const char* bad : { "s -", "(s - dark", "s dark", "foo(s)", "min(s)", "s $ 2", ")" })
+        CHECK(!expression.compile(bad), "errors: \"%s\" accepted", bad);
+    compare(expression, previous, PIXELS);
+
+    string deep;
+    for (int i = 0; i < 200; i++)
+        deep += "(";
+    CHECK(!expression.compile(deep + "s"), "errors: unbounded nesting accepted");
+
+    CHECK(expression.compile(""), "errors: clear refused");
+    CHECK(!expression.isCompiled(), "errors: clear kept the formula");
+}
+
+//! the spectrum may be overwritten in place
+void testInPlace(Expression& expression)
+{
+    CHECK(expression.compile("(s - dark) / (ref - dark) * k"), "in place: failed to compile");
+    vector<double> spectrum = s;
+    CHECK(expression.evaluate(&spectrum[0], &wl[0], &wn[0], &spectrum[0], PIXELS), "in place: evaluation failed");
+    int bad = 0;
+    for (int i = 0; i < PIXELS; i++)
+        if (!close(spectrum[i], (s[i] - dark[i]) / (ref[i] - dark[i]) * k))
+            bad++;
+    CHECK(bad == 0, "in place: %d pixels differ", bad);
+}
+
+int main(int argc, char** argv)
+{
+    Logger logger;
+    quiet(logger);
+
+    std::mt19937 rng(100);
+    for (int i = 0; i < PIXELS; i++)
+    {
+        dark[i] = 800 + (rng() % 400000) / 1000.0;
+        s[i] = dark[i] + (rng() % 50000) - 100.0;
+        ref[i] = s[i] + 1 + rng() % 10000;
+        wl[i] = 780 + i * 0.1;
+        wn[i] = 1e7 / 785 - 1e7 / wl[i];
+    }
+
+    Expression expression(logger);
+    CHECK(expression.setBuffer("dark", &dark[0], PIXELS), "dark refused");
+    CHECK(expression.setBuffer("ref", &ref[0], PIXELS), "ref refused");
+    CHECK(expression.setConstant("k", k), "k refused");
+
+    testFormulas(expression);
+    testConstants(expression);
+    testErrors(expression);
+    testInPlace(expression);
+
+    return report(argv[0]);
+}
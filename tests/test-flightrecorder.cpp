@@ -0,0 +1,151 @@
+/** @file   test-flightrecorder.cpp
+*   @brief  test of the flight recorder against a simulated spectrometer
+*
+*   Recorded spectra must be the frames exactly as the detector sent them,
+*   before any post-processing (here, X-axis inversion), including each scan
+*   of an averaged acquisition.  The C API refuses a missing pathname.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Check.h"
+#include "FakeUSB.h"
+#include "Driver.h"
+#include "Spectrometer.h"
+#include "WasatchVCPP.h"
+
+using WasatchVCPP::Driver;
+using WasatchVCPP::Logger;
+using WasatchVCPP::Spectrometer;
+using std::string;
+using std::vector;
+
+//! @returns the intensities of each frame in a dump, oldest first
+vector<vector<int> > readDump(const string& pathname)
+{
+    vector<vector<int> > frames;
+    std::ifstream infile(pathname.c_str());
+    string line;
+    while (std::getline(infile, line))
+    {
+        if (line.empty() || line[0] == '#' || line[0] == 'f')
+            continue;
+
+        // frameId, msBeforeDump, settingsGeneration, integrationTimeMS, laserEnabled
+        std::istringstream fields(line);
+        string field;
+        for (int i = 0; i < 5; i++)
+            std::getline(fields, field, ',');
+
+        vector<int> spectrum;
+        while (std::getline(fields, field, ','))
+            spectrum.push_back(atoi(field.c_str()));
+        frames.push_back(spectrum);
+    }
+    return frames;
+}
+
+void testRaw(Logger& logger)
+{
+    FakeUSB::Config config;
+    config.pixels = 64;
+    config.invertXAxis = true;
+    FakeUSB::configure(config);
+    Spectrometer spec(FakeUSB::open(), config.pid, 0, logger);
+    CHECK(spec.setFlightRecorder(4), "raw: recorder refused");
+
+    vector<vector<double> > delivered;
+    for (int i = 0; i < 3; i++)
+        delivered.push_back(spec.getSpectrum());
+
+    const string pathname = "test-flightrecorder.csv";
+    CHECK(spec.dumpFlightRecorder(pathname), "raw: dump refused");
+    auto recorder = spec.getFlightRecorder();
+    for (int i = 0; i < 200 && recorder->isDumping(); i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+    auto recorded = readDump(pathname);
+    remove(pathname.c_str());
+    CHECK(recorded.size() == delivered.size(), "raw: %d of %d frames recorded", (int)recorded.size(), (int)delivered.size());
+    for (size_t f = 0; f < recorded.size() && f < delivered.size(); f++)
+    {
+        bool raw = (int)recorded[f].size() == config.pixels;
+        for (int i = 0; raw && i < config.pixels; i++)
+            raw = recorded[f][i] == (int)delivered[f][config.pixels - 1 - i];
+        CHECK(raw, "raw: frame %d not recorded as read from the detector", (int)f);
+    }
+}
+
+//! every scan of an average is recorded, and the average displayed
+void testAveraged(Logger& logger)
+{
+    FakeUSB::Config config;
+    config.pixels = 64;
+    FakeUSB::configure(config);
+    Spectrometer spec(FakeUSB::open(), config.pid, 0, logger);
+    CHECK(spec.setFlightRecorder(8), "averaged: recorder refused");
+    CHECK(spec.pipeline.setScansToAverage(3), "averaged: scans refused");
+    CHECK(spec.display.configure(config.pixels, 1000), "averaged: display refused");
+
+    vector<float> averaged(config.pixels);
+    CHECK(spec.getProcessedSpectrum(&averaged[0], config.pixels), "averaged: acquisition failed");
+
+    const string pathname = "test-flightrecorder.csv";
+    CHECK(spec.dumpFlightRecorder(pathname), "averaged: dump refused");
+    auto recorder = spec.getFlightRecorder();
+    for (int i = 0; i < 200 && recorder->isDumping(); i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    auto recorded = readDump(pathname);
+    remove(pathname.c_str());
+    CHECK(recorded.size() == 3, "averaged: %d of 3 scans recorded", (int)recorded.size());
+
+    // one bucket per pixel, so the envelope is the spectrum
+    vector<float> mins(config.pixels), maxs(config.pixels);
+    int buckets = spec.display.read(&mins[0], &maxs[0], config.pixels, 1000);
+    CHECK(buckets == config.pixels && maxs[10] == averaged[10], "averaged: %d buckets, pixel 10 displayed %.1f of %.1f", 
+        buckets, maxs[10], averaged[10]);
+}
+
+//! the C API checks its pathname before reading it
+void testAPI(Driver* driver)
+{
+    FakeUSB::Config config;
+    FakeUSB::configure(config);
+    CHECK(driver->openAllSpectrometers() == 1, "api: open failed");
+    CHECK(wp_set_flight_recorder(0, 4) == WP_SUCCESS, "api: recorder refused");
+    vector<double> spectrum(config.pixels);
+    CHECK(wp_get_spectrum(0, &spectrum[0], config.pixels) == WP_SUCCESS, "api: acquisition failed");
+
+    const string pathname = "test-flightrecorder.csv";
+    CHECK(wp_dump_flight_recorder(0, nullptr, 64) == WP_ERROR, "api: null pathname accepted");
+    CHECK(wp_dump_flight_recorder(0, pathname.c_str(), 0) == WP_ERROR, "api: empty pathname accepted");
+    CHECK(wp_dump_flight_recorder(0, pathname.c_str(), (int)pathname.size()) == WP_SUCCESS, "api: dump refused");
+
+    auto recorder = driver->getSpectrometer(0)->getFlightRecorder();
+    for (int i = 0; i < 200 && recorder->isDumping(); i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    CHECK(readDump(pathname).size() == 1, "api: dump holds %d frames", (int)readDump(pathname).size());
+    remove(pathname.c_str());
+    driver->closeAllSpectrometers();
+}
+
+int main(int argc, char** argv)
+{
+    Logger logger;
+    quiet(logger);
+
+    testRaw(logger);
+    testAveraged(logger);
+
+    Driver* driver = Driver::getInstance();
+    quiet(driver->logger);
+    testAPI(driver);
+
+    return report(argv[0]);
+}
@@ -0,0 +1,214 @@
+/** @file   test-format.cpp
+*   @brief  test of the compact spectrum formats against known bit patterns
+*
+*   Half precision rounds to nearest even and saturates, and the vector
+*   kernel in use (F16C or NEON) matches the scalar conversion bit for bit.
+*   bfloat16 rounds to nearest even, and int32 rounds half away from zero
+*   and saturates, identically in the SSE2 and scalar paths.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "Check.h"
+#include "SpectrumFormat.h"
+
+using WasatchVCPP::SpectrumFormat;
+using std::vector;
+
+static float bitsFloat(uint32_t u)
+{
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+static uint32_t floatBits(float f)
+{
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+//! binary32 to binary16, against hand-computed patterns
+void testFloatToHalf()
+{
+    const struct { float in; uint16_t out; } cases[] =
+    {
+        { 0.f,                      0x0000 },
+        { -0.f,                     0x8000 },
+        { 1.f,                      0x3c00 },
+        { -2.f,                     0xc000 },
+        { 0.5f,                     0x3800 },
+        { 1.f / 3,                  0x3555 },
+        { 65504.f,                  0x7bff },   // largest finite
+        { 65520.f,                  0x7bff },   // would round to infinity: saturates
+        { 1e6f,                     0x7bff },
+        { -1e6f,                    0xfbff },
+        { std::numeric_limits<float>::infinity(), 0x7bff },
+        { 6.103515625e-05f,         0x0400 },   // smallest normal, 2^-14
+        { 5.9604644775390625e-08f,  0x0001 },   // smallest subnormal, 2^-24
+        { 2.98e-08f,                0x0000 },   // below half the smallest subnormal
+        { 2049.f,                   0x6800 },   // tie: down to the even 2048
+        { 2051.f,                   0x6802 },   // tie: up to the even 2052
+        { 2050.5f,                  0x6801 },   // nearest, no tie
+        { 1.00048828125f,           0x3c00 },   // tie at 1 + 2^-11: even
+        { 1.00146484375f,           0x3c02 },   // tie at 1 + 3 * 2^-11: even
+    };
+    for (auto& c : cases)
+    {
+        uint16_t h = SpectrumFormat::floatToHalf(c.in);
+        CHECK(h == c.out, "floatToHalf(%g): 0x%04x, expected 0x%04x", c.in, h, c.out);
+    }
+
+    uint16_t nan = SpectrumFormat::floatToHalf(std::numeric_limits<float>::quiet_NaN());
+    CHECK((nan & 0x7c00) == 0x7c00 && (nan & 0x3ff) != 0, "floatToHalf(NaN): 0x%04x", nan);
+}
+
+//! every half converts to the float it denotes, and back to itself
+void testHalfToFloat()
+{
+    CHECK(SpectrumFormat::halfToFloat(0x3c00) == 1.f, "halfToFloat(0x3c00)");
+    CHECK(SpectrumFormat::halfToFloat(0xc000) == -2.f, "halfToFloat(0xc000)");
+    CHECK(SpectrumFormat::halfToFloat(0x7bff) == 65504.f, "halfToFloat(0x7bff)");
+    CHECK(SpectrumFormat::halfToFloat(0x0001) == 5.9604644775390625e-08f, "halfToFloat(0x0001)");
+    CHECK(SpectrumFormat::halfToFloat(0x03ff) == 6.097555160522461e-05f, "halfToFloat(0x03ff)");
+    CHECK(SpectrumFormat::halfToFloat(0xfc00) == -std::numeric_limits<float>::infinity(), "halfToFloat(0xfc00)");
+    float nan = SpectrumFormat::halfToFloat(0x7e00);
+    CHECK(nan != nan, "halfToFloat(0x7e00) isn't NaN");
+
+    int mismatched = 0;
+    for (uint32_t h = 0; h < 0x10000; h++)
+    {
+        bool special = (h & 0x7c00) == 0x7c00;
+        if (!special && SpectrumFormat::floatToHalf(SpectrumFormat::halfToFloat((uint16_t)h)) != h)
+            mismatched++;
+    }
+    CHECK(mismatched == 0, "half round trip: %d mismatched", mismatched);
+}
+
+//! the vector kernel agrees with the scalar conversion everywhere
+void testFloat16Kernel()
+{
+    vector<double> in;
+    for (int count = 0; count <= 65535; count++)
+        in.push_back(count);
+    std::mt19937 rng(94);
+    std::uniform_real_distribution<double> wide(-1e5, 1e5);
+    std::uniform_real_distribution<double> narrow(-1, 1);
+    for (int i = 0; i < 100000; i++)
+        in.push_back(i % 2 ? wide(rng) : narrow(rng) * 1e-4);
+    in.push_back(std::numeric_limits<double>::infinity());
+    in.push_back(-std::numeric_limits<double>::infinity());
+    in.push_back(2049);
+    in.push_back(2051);
+    in.push_back(65520);
+
+    vector<uint16_t> out(in.size());
+    SpectrumFormat::toFloat16(&in[0], &out[0], (int)in.size());
+    int mismatched = 0;
+    size_t first = 0;
+    for (size_t i = 0; i < in.size(); i++)
+        if (out[i] != SpectrumFormat::floatToHalf((float)in[i]) && mismatched++ == 0)
+            first = i;
+    CHECK(mismatched == 0, "float16 (%s): %d of %d differ from scalar, first %g -> 0x%04x",
+        SpectrumFormat::getFloat16Kernel(), mismatched, (int)in.size(), in[first], out[first]);
+    printf("float16 kernel: %s\n", SpectrumFormat::getFloat16Kernel());
+}
+
+//! bfloat16 rounds to nearest even, in the vector lanes and the scalar tail
+void testBFloat16()
+{
+    const struct { uint32_t in; uint16_t out; } cases[] =
+    {
+        { 0x3f800000, 0x3f80 },     // 1
+        { 0x3f808000, 0x3f80 },     // tie: even stays
+        { 0x3f818000, 0x3f82 },     // tie: odd rounds up
+        { 0x3f808001, 0x3f81 },     // above the tie
+        { 0x3f807fff, 0x3f80 },     // below the tie
+        { 0xbf818000, 0xbf82 },     // negative tie
+        { 0x43808000, 0x4380 },     // 257: tie, down to 256
+        { 0x43818000, 0x4382 },     // 259: tie, up to 260
+        { 0x477fe000, 0x4780 },     // 65504 rounds up to 65536
+        { 0x00000000, 0x0000 },
+        { 0x80000000, 0x8000 },
+    };
+    for (auto& c : cases)
+    {
+        // seven copies: the SSE2 path converts four, the scalar tail three
+        vector<double> in(7, (double)bitsFloat(c.in));
+        vector<uint16_t> out(in.size());
+        SpectrumFormat::toBFloat16(&in[0], &out[0], (int)in.size());
+        for (size_t i = 0; i < out.size(); i++)
+            CHECK(out[i] == c.out, "bf16(0x%08x)[%d]: 0x%04x, expected 0x%04x", c.in, (int)i, out[i], c.out);
+    }
+
+    // counts, against truncation plus the rounding bit computed here
+    vector<double> counts(65536);
+    for (int i = 0; i < (int)counts.size(); i++)
+        counts[i] = i;
+    vector<uint16_t> out(counts.size());
+    SpectrumFormat::toBFloat16(&counts[0], &out[0], (int)counts.size());
+    int mismatched = 0;
+    for (int i = 0; i < (int)counts.size(); i++)
+    {
+        uint32_t u = floatBits((float)i);
+        uint32_t lower = u & 0xffff;
+        uint16_t expected = (uint16_t)(u >> 16);
+        if (lower > 0x8000 || (lower == 0x8000 && (expected & 1)))
+            expected++;
+        if (out[i] != expected)
+            mismatched++;
+    }
+    CHECK(mismatched == 0, "bf16 counts: %d mismatched", mismatched);
+}
+
+//! int32 rounds half away from zero and saturates, in both paths
+void testInt32()
+{
+    const double inf = std::numeric_limits<double>::infinity();
+    const struct { double in; double scale; int32_t out; } cases[] =
+    {
+        { 0,        1,  0 },
+        { 1.5,      1,  2 },
+        { 2.5,      1,  3 },
+        { -1.5,     1, -2 },
+        { -0.4,     1,  0 },
+        { 0.49,     1,  0 },
+        { 65535,    1,  65535 },
+        { 1.25,     4,  5 },
+        { 100,   0.01,  1 },
+        { 3e9,      1,  2147483647 },
+        { -3e9,     1, -2147483647 - 1 },
+        { 65535, 1e6,   2147483647 },
+        { inf,      1,  2147483647 },
+        { -inf,     1, -2147483647 - 1 },
+        { std::numeric_limits<double>::quiet_NaN(), 1, 0 },
+        { 1,      inf,  2147483647 },
+        { 0,      inf,  0 },        // 0 * inf is NaN
+    };
+    for (auto& c : cases)
+    {
+        // seven copies: the SSE2 path converts four, the scalar tail three
+        vector<double> in(7, c.in);
+        vector<int32_t> out(in.size());
+        SpectrumFormat::toInt32(&in[0], &out[0], (int)in.size(), c.scale);
+        for (size_t i = 0; i < out.size(); i++)
+            CHECK(out[i] == c.out, "int32(%g * %g)[%d]: %d, expected %d", c.in, c.scale, (int)i, out[i], c.out);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    testFloatToHalf();
+    testHalfToFloat();
+    testFloat16Kernel();
+    testBFloat16();
+    testInt32();
+
+    return report(argv[0]);
+}
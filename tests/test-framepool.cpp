@@ -0,0 +1,143 @@
+/** @file   test-framepool.cpp
+*   @brief  test of frame pool use by the spectrum readers, against a 
+*           simulated spectrometer
+*
+*   Doubles are read straight into the caller's buffer, converting reads draw
+*   from the pool, and converting reads still work with no pool at all.  With
+*   a memory budget, the Driver sizes pools as it opens spectrometers, and 
+*   resizes them, within the budget (both used to deadlock).
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "Check.h"
+#include "FakeUSB.h"
+#include "Driver.h"
+#include "Spectrometer.h"
+#include "WasatchVCPP.h"
+
+using WasatchVCPP::Driver;
+using WasatchVCPP::FramePool;
+using WasatchVCPP::Logger;
+using WasatchVCPP::Spectrometer;
+using WasatchVCPP::SpectrumFormat;
+using std::vector;
+
+//! which reads draw a frame from the pool
+void testDraws(Spectrometer& spec)
+{
+    CHECK(spec.setFramePool(2, 0), "draws: pool refused");
+
+    vector<double> doubles(spec.pixels);
+    CHECK(spec.getSpectrum(&doubles[0], spec.pixels), "draws: double read failed");
+    CHECK(spec.getFramePoolStats().acquired == 0, "draws: double read drew from the pool");
+
+    vector<float> floats(spec.pixels);
+    CHECK(spec.getSpectrumAs(SpectrumFormat::Float, &floats[0], spec.pixels), "draws: float read failed");
+    auto stats = spec.getFramePoolStats();
+    CHECK(stats.acquired == 1 && stats.inUse == 0, "draws: %llu frames drawn, %d in use", (unsigned long long)stats.acquired, stats.inUse);
+}
+
+//! without a pool, converting reads use the spectrometer's own frame
+void testNoPool(Spectrometer& spec)
+{
+    CHECK(spec.setFramePool(0, 0) && spec.getFramePool() == nullptr, "no pool: disable failed");
+
+    vector<double> doubles(spec.pixels);
+    vector<float> floats(spec.pixels);
+    for (int i = 0; i < 3; i++)
+    {
+        CHECK(spec.getSpectrum(&doubles[0], spec.pixels), "no pool: double read %d failed", i);
+        CHECK(spec.getSpectrumAs(SpectrumFormat::Float, &floats[0], spec.pixels), "no pool: float read %d failed", i);
+    }
+    bool same = true;
+    for (int i = 0; i < spec.pixels; i++)
+        same = same && floats[i] == (float)FakeUSB::pixelValue(FakeUSB::getFramesAcquired() - 1, i, false);
+    CHECK(same, "no pool: float read converted wrongly");
+}
+
+//! abandon the test if 'f' hangs (a deadlocked thread can't be joined)
+template <typename F>
+void withinSeconds(const char* label, int seconds, F f)
+{
+    std::atomic<bool> done(false);
+    std::thread watchdog([&]()
+    {
+        auto end = FakeUSB::Clock::now() + std::chrono::seconds(seconds);
+        while (!done && FakeUSB::Clock::now() < end)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        if (!done)
+        {
+            CHECK(false, "%s: still running after %ds", label, seconds);
+            int status = report("test-framepool");
+            fflush(stdout);
+            _exit(status);
+        }
+    });
+    f();
+    done = true;
+    watchdog.join();
+}
+
+//! pools opened and resized through the Driver fit its budget
+void testBudget(Driver* driver)
+{
+    driver->setMemoryBudget(64 * 1024 * 1024);
+
+    withinSeconds("budget: open", 10, [&]() 
+    { 
+        CHECK(driver->openAllSpectrometers() == 1, "budget: open failed"); 
+    });
+    Spectrometer* spec = driver->getSpectrometer(0);
+    if (spec == nullptr)
+        return;
+    auto pool = spec->getFramePool();
+    CHECK(pool != nullptr && pool->frames == driver->getFramePoolFrames(), "budget: no default pool");
+
+    withinSeconds("budget: resize", 10, [&]() 
+    { 
+        CHECK(driver->setFramePool(8, 0), "budget: resize refused"); 
+    });
+    pool = spec->getFramePool();
+    CHECK(pool != nullptr && pool->frames == 8, "budget: pool of %d frames", pool ? pool->frames : 0);
+
+    long long stats[WP_FRAME_POOL_STATS] = { 0 };
+    CHECK(wp_get_frame_pool_stats(0, stats, WP_FRAME_POOL_STATS) == WP_SUCCESS && stats[0] == 8, "budget: stats report %lld frames", stats[0]);
+    CHECK(wp_get_frame_pool_stats(0, nullptr, WP_FRAME_POOL_STATS) == WP_ERROR, "budget: null stats accepted");
+
+    // leave room for three frames beyond the current pool
+    size_t frameBytes = FramePool::getMemoryBytes(spec->pixels, 1);
+    driver->setMemoryBudget(driver->getMemoryUsage().total() - pool->getMemoryBytes() + 3 * frameBytes + frameBytes / 2);
+    CHECK(driver->setFramePool(100, 0), "budget: shrunk resize refused");
+    pool = spec->getFramePool();
+    CHECK(pool != nullptr && pool->frames == 3, "budget: pool of %d frames, expected 3", pool ? pool->frames : 0);
+
+    driver->closeAllSpectrometers();
+    driver->setMemoryBudget(0);
+    driver->setFramePool(4, 0);
+}
+
+int main(int argc, char** argv)
+{
+    Logger logger;
+    quiet(logger);
+
+    FakeUSB::Config config;
+    FakeUSB::configure(config);
+    Spectrometer spec(FakeUSB::open(), config.pid, 0, logger);
+
+    testDraws(spec);
+    testNoPool(spec);
+
+    Driver* driver = Driver::getInstance();
+    quiet(driver->logger);
+    testBudget(driver);
+
+    return report(argv[0]);
+}
@@ -0,0 +1,163 @@
+/** @file   test-memory.cpp
+*   @brief  test of the memory budget and compact mode, against a simulated
+*           spectrometer
+*
+*   Optional buffers shrink to fit the budget, and fail when not even one
+*   frame fits.  Compact mode drops the EEPROM strings and single-precision
+*   axes replace the double ones, on a spectrometer already open, while other
+*   threads read the EEPROM and axes and evaluate expressions over them (run
+*   under -fsanitize=thread to catch unguarded readers).
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "Check.h"
+#include "FakeUSB.h"
+#include "Driver.h"
+#include "FlightRecorder.h"
+#include "Spectrometer.h"
+#include "WasatchVCPP.h"
+
+using WasatchVCPP::Driver;
+using WasatchVCPP::FlightRecorder;
+using WasatchVCPP::Logger;
+using WasatchVCPP::Spectrometer;
+using std::vector;
+
+//! flight recorders shrink to fit the budget, or fail if nothing fits
+void testBudget(Driver* driver, Spectrometer* spec)
+{
+    CHECK(driver->getMemoryAvailable() == SIZE_MAX, "budget: limited without a budget");
+    CHECK(wp_set_memory_budget(-1) == WP_ERROR, "budget: negative budget accepted");
+
+    size_t fixed = FlightRecorder::getMemoryBytes(0, spec->pixels);
+    size_t perFrame = FlightRecorder::getMemoryBytes(1, spec->pixels) - fixed;
+    size_t used = driver->getMemoryUsage().total();
+
+    // room for five frames
+    CHECK(wp_set_memory_budget((long long)(used + fixed + 5 * perFrame + perFrame / 2)) == WP_SUCCESS, "budget: refused");
+    CHECK(driver->getMemoryAvailable() == fixed + 5 * perFrame + perFrame / 2, "budget: %llu bytes available",
+        (unsigned long long)driver->getMemoryAvailable());
+    CHECK(wp_set_flight_recorder(0, 1000) == WP_SUCCESS, "budget: shrunk recorder refused");
+
+    long long bytes[WP_MEMORY_SUBSYSTEMS] = { 0 };
+    CHECK(wp_get_memory_usage(0, bytes, WP_MEMORY_SUBSYSTEMS) == WP_SUCCESS
+        && bytes[WP_MEMORY_FLIGHT_RECORDER] == (long long)(fixed + 5 * perFrame),
+        "budget: recorder holds %lld bytes, expected %llu", bytes[WP_MEMORY_FLIGHT_RECORDER],
+        (unsigned long long)(fixed + 5 * perFrame));
+    CHECK(driver->getMemoryAvailable() < perFrame, "budget: %llu bytes still available",
+        (unsigned long long)driver->getMemoryAvailable());
+
+    // replacing the recorder counts the bytes it frees
+    CHECK(wp_set_flight_recorder(0, 1000) == WP_SUCCESS, "budget: replacement refused");
+
+    // not even one frame fits
+    CHECK(wp_set_flight_recorder(0, 0) == WP_SUCCESS, "budget: disable refused");
+    driver->setMemoryBudget(used + fixed);
+    CHECK(wp_set_flight_recorder(0, 1) == WP_ERROR, "budget: recorder allowed beyond the budget");
+
+    driver->setMemoryBudget(0);
+    CHECK(wp_set_flight_recorder(0, 1000) == WP_SUCCESS && wp_set_flight_recorder(0, 0) == WP_SUCCESS,
+        "budget: unlimited recorder refused");
+}
+
+//! compact mode drops the strings and halves the axes, on an open spectrometer
+void testCompact(Spectrometer* spec)
+{
+    int pixels = spec->pixels;
+    vector<double> wavelengths(pixels);
+    CHECK(wp_get_wavelengths(0, &wavelengths[0], pixels) == WP_SUCCESS, "compact: wavelengths failed");
+    int fields = wp_get_eeprom_field_count(0);
+    CHECK(fields > 0, "compact: no EEPROM fields");
+    auto before = spec->getMemoryUsage();
+
+    wp_set_compact_mode(1);
+    auto after = spec->getMemoryUsage();
+    CHECK(wp_get_eeprom_field_count(0) == 0, "compact: %d EEPROM fields", wp_get_eeprom_field_count(0));
+    CHECK(after.axes * 2 == before.axes, "compact: axes use %llu bytes, were %llu",
+        (unsigned long long)after.axes, (unsigned long long)before.axes);
+    CHECK(after.eeprom < before.eeprom, "compact: EEPROM still uses %llu bytes", (unsigned long long)after.eeprom);
+
+    vector<double> compact(pixels);
+    CHECK(wp_get_wavelengths(0, &compact[0], pixels) == WP_SUCCESS, "compact: wavelengths failed");
+    int mismatched = 0;
+    for (int i = 0; i < pixels; i++)
+        if (compact[i] != (double)(float)wavelengths[i])
+            mismatched++;
+    CHECK(mismatched == 0, "compact: %d wavelengths aren't the single-precision originals", mismatched);
+
+    wp_set_compact_mode(0);
+    CHECK(wp_get_eeprom_field_count(0) == fields, "compact: %d EEPROM fields restored of %d", wp_get_eeprom_field_count(0), fields);
+    CHECK(spec->getMemoryUsage().axes == before.axes, "compact: axes not restored");
+}
+
+//! switching modes while other threads read what it replaces
+void testCompactWhileReading(Spectrometer* spec)
+{
+    int pixels = spec->pixels;
+    CHECK(wp_set_expression(0, "s + wl") == WP_SUCCESS, "reading: expression refused");
+
+    std::atomic<bool> done(false);
+    std::atomic<int> reads(0);
+    std::atomic<int> evaluations(0);
+    std::thread reader([&]()
+    {
+        vector<double> wavelengths(pixels);
+        const char* names[200];
+        const char* values[200];
+        char value[32];
+        while (!done)
+        {
+            wp_get_eeprom(0, names, values, 200);
+            wp_get_eeprom_field(0, "model", value, sizeof(value));
+            wp_get_eeprom_field_count(0);
+            if (wp_get_wavelengths(0, &wavelengths[0], pixels) == WP_SUCCESS)
+                reads++;
+        }
+    });
+    std::thread evaluator([&]()
+    {
+        vector<double> spectrum(pixels);
+        while (!done)
+            if (wp_get_expression_spectrum(0, &spectrum[0], pixels) == WP_SUCCESS && spectrum[0] >= 500)
+                evaluations++;
+    });
+
+    for (int i = 0; i < 40; i++)
+    {
+        wp_set_compact_mode(i % 2 == 0);
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    wp_set_compact_mode(0);
+    done = true;
+    reader.join();
+    evaluator.join();
+
+    CHECK(reads > 0, "reading: no axes read");
+    CHECK(evaluations > 0, "reading: no expressions evaluated");
+    wp_set_expression(0, nullptr);
+}
+
+int main(int argc, char** argv)
+{
+    FakeUSB::Config config;
+    FakeUSB::configure(config);
+
+    Driver* driver = Driver::getInstance();
+    quiet(driver->logger);
+    CHECK(driver->openAllSpectrometers() == 1, "open failed");
+    Spectrometer* spec = driver->getSpectrometer(0);
+    if (spec == nullptr)
+        return report(argv[0]);
+
+    testBudget(driver, spec);
+    testCompact(spec);
+    testCompactWhileReading(spec);
+
+    driver->closeAllSpectrometers();
+    return report(argv[0]);
+}
@@ -0,0 +1,89 @@
+/** @file   test-pipeline.cpp
+*   @brief  accuracy of the fixed-point processing pipeline against the double
+*           path
+*
+*   Random sums, darks and gains are finished both ways, and every pixel 
+*   must agree within the bound documented in SpectrumPipeline.h.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "Check.h"
+#include "SpectrumPipeline.h"
+
+using WasatchVCPP::Logger;
+using WasatchVCPP::SpectrumPipeline;
+using std::vector;
+
+const int PIXELS = 2048;
+
+//! finish the same sums both ways, and compare
+void compare(SpectrumPipeline& pipeline, const char* label, const vector<uint32_t>& sums, int scans,
+    const vector<double>& dark, const vector<double>& gain)
+{
+    vector<float> expected(PIXELS), actual(PIXELS);
+    pipeline.setFixedPoint(false);
+    CHECK(pipeline.finish(&sums[0], scans, &expected[0], PIXELS), "%s: double path failed", label);
+    pipeline.setFixedPoint(true);
+    CHECK(pipeline.finish(&sums[0], scans, &actual[0], PIXELS), "%s: fixed-point path failed", label);
+
+    double worst = 0;
+    int bad = 0;
+    for (int i = 0; i < PIXELS; i++)
+    {
+        double mean = (double)sums[i] / scans;
+        double g = gain.empty() ? 1 : gain[i];
+        double d = dark.empty() ? 0 : dark[i];
+        double bound = std::ldexp(std::fabs(g), -15) + std::ldexp(std::fabs(mean - d), -25) + std::ldexp(std::fabs(expected[i]), -22);
+        double error = std::fabs((double)actual[i] - expected[i]);
+        worst = std::max(worst, error / bound);
+        if (error > bound && bad++ == 0)
+            CHECK(false, "%s: pixel %d fixed %.9g vs double %.9g (bound %.3g)", label, i, actual[i], expected[i], bound);
+    }
+    CHECK(bad == 0, "%s: %d pixels out of bounds", label, bad);
+    printf("%s: worst error %.2f of bound\n", label, worst);
+}
+
+int main(int argc, char** argv)
+{
+    Logger logger;
+    quiet(logger);
+    SpectrumPipeline pipeline(logger);
+    std::mt19937 rng(95);
+
+    const int scanCounts[] = { 1, 3, 10, 100, 1000, SpectrumPipeline::MaxScans };
+    for (int scans : scanCounts)
+    {
+        vector<uint32_t> sums(PIXELS);
+        vector<double> dark(PIXELS), gain(PIXELS);
+        for (int i = 0; i < PIXELS; i++)
+        {
+            // anywhere from dark to saturated
+            sums[i] = (uint32_t)(rng() % 65536) * scans + (uint32_t)(rng() % scans);
+            if (sums[i] > 65535u * scans)
+                sums[i] = 65535u * scans;
+            dark[i] = 800 + (rng() % 400000) / 1000.0;
+            gain[i] = ((int)(rng() % 2000000) - 1000000) / 250000.0;
+        }
+
+        char label[64];
+        snprintf(label, sizeof(label), "%d scans", scans);
+        pipeline.setDark(nullptr, 0);
+        pipeline.setGain(nullptr, 0);
+        compare(pipeline, label, sums, scans, vector<double>(), vector<double>());
+
+        snprintf(label, sizeof(label), "%d scans, dark", scans);
+        pipeline.setDark(&dark[0], PIXELS);
+        compare(pipeline, label, sums, scans, dark, vector<double>());
+
+        snprintf(label, sizeof(label), "%d scans, dark and gain", scans);
+        CHECK(pipeline.setGain(&gain[0], PIXELS), "%s: gain refused", label);
+        compare(pipeline, label, sums, scans, dark, gain);
+    }
+
+    return report(argv[0]);
+}
@@ -0,0 +1,113 @@
+/** @file   test-recipe.cpp
+*   @brief  test of the recipe engine against a simulated spectrometer
+*
+*   Checks which control writes a recipe actually sends, and that results can
+*   be read while recipes are replaced.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "Check.h"
+#include "FakeUSB.h"
+#include "Spectrometer.h"
+
+using WasatchVCPP::Logger;
+using WasatchVCPP::Recipe;
+using WasatchVCPP::Spectrometer;
+using std::vector;
+
+vector<FakeUSB::Command> writes(uint8_t bRequest)
+{
+    vector<FakeUSB::Command> matched;
+    for (auto& command : FakeUSB::getCommands())
+        if (!command.read && command.bRequest == bRequest)
+            matched.push_back(command);
+    return matched;
+}
+
+//! wait for the current recipe to finish
+Recipe::State finish(Spectrometer& spec)
+{
+    auto recipe = spec.getRecipe();
+    for (int i = 0; i < 200 && recipe && recipe->getState() == Recipe::Running; i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    return recipe ? recipe->getState() : Recipe::Idle;
+}
+
+//! only the last value of each setting in a run is written
+void testCoalesce(Spectrometer& spec)
+{
+    FakeUSB::clearCommands();
+    CHECK(spec.startRecipe(
+        "integration_time_ms 20\n"
+        "detector_gain 2\n"
+        "integration_time_ms 30\n"
+        "detector_gain 3\n"
+        "integration_time_ms 40\n"
+        "acquire 1 a\n"
+        "integration_time_ms 50\n"
+        "emit a\n"), "coalesce: start failed");
+    CHECK(finish(spec) == Recipe::Complete, "coalesce: recipe didn't complete");
+
+    auto integration = writes(0xb2);
+    CHECK(integration.size() == 2 && integration[0].wValue == 40 && integration[1].wValue == 50,
+        "coalesce: %d integration time writes", (int)integration.size());
+    CHECK(writes(0xb7).size() == 1, "coalesce: %d gain writes", (int)writes(0xb7).size());
+    CHECK(FakeUSB::getIntegrationTimeMS() == 50, "coalesce: integration time %u", FakeUSB::getIntegrationTimeMS());
+
+    // laser steps end a run, and are never dropped
+    FakeUSB::clearCommands();
+    CHECK(spec.startRecipe("laser on\nlaser off\nlaser on\nacquire 1 a\n"), "coalesce: laser recipe failed");
+    CHECK(finish(spec) == Recipe::Complete, "coalesce: laser recipe didn't complete");
+    CHECK(writes(0xbe).size() >= 3, "coalesce: %d laser writes", (int)writes(0xbe).size());
+    CHECK(!FakeUSB::getLaserEnable(), "coalesce: laser left on");
+}
+
+//! replacing a recipe while another thread reads its results is safe (run
+//! under ThreadSanitizer / AddressSanitizer to be sure)
+void testReplace(Spectrometer& spec)
+{
+    std::atomic<bool> done(false);
+    std::atomic<int> results(0);
+    std::thread reader([&]()
+    {
+        while (!done)
+        {
+            auto recipe = spec.getRecipe();
+            Recipe::Result result;
+            if (recipe && recipe->read(result, 20))
+                results++;
+        }
+    });
+
+    for (int i = 0; i < 20; i++)
+    {
+        spec.startRecipe("integration_time_ms 10\nacquire 1 a\nemit a\nwait_ms 20\nacquire 1 b\nemit b\n");
+        std::this_thread::sleep_for(std::chrono::milliseconds(15));
+    }
+    finish(spec);
+    done = true;
+    reader.join();
+
+    CHECK(results > 0, "replace: no results read");
+    printf("replace: %d results read across 20 recipes\n", (int)results);
+}
+
+int main(int argc, char** argv)
+{
+    Logger logger;
+    quiet(logger);
+
+    FakeUSB::Config config;
+    FakeUSB::configure(config);
+    Spectrometer spec(FakeUSB::open(), config.pid, 0, logger);
+
+    testCoalesce(spec);
+    testReplace(spec);
+
+    return report(argv[0]);
+}
@@ -0,0 +1,126 @@
+/** @file   test-scheduler.cpp
+*   @brief  test of the multi-spectrometer Scheduler against simulated devices
+*
+*   Restarts a schedule repeatedly while other threads read its stats and
+*   acquire outside it, which must be safe (run under ThreadSanitizer /
+*   AddressSanitizer to be sure).  Also checks library-wide memory reporting
+*   once the open spectrometers' indices are no longer contiguous.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "Check.h"
+#include "FakeUSB.h"
+#include "Driver.h"
+#include "Spectrometer.h"
+#include "WasatchVCPP.h"
+
+using WasatchVCPP::Driver;
+using WasatchVCPP::Logger;
+using WasatchVCPP::Scheduler;
+using WasatchVCPP::Spectrometer;
+using std::vector;
+
+//! every speed libusb reports is given its signaling rate
+void testTopology(Driver* driver, int devices)
+{
+    CHECK(driver->openAllSpectrometers() == devices, "topology: opened %d of %d", driver->getNumberOfSpectrometers(), devices);
+    for (int i = 0; i < driver->getNumberOfSpectrometers(); i++)
+    {
+        auto spec = driver->getSpectrometer(i);
+        CHECK(spec != nullptr && spec->usbSpeedMbps == 10000, "topology: spectrometer %d at %d Mbps", i, spec ? spec->usbSpeedMbps : -1);
+    }
+    CHECK(Scheduler::getBusBytesPerSec(10000) > Scheduler::getBusBytesPerSec(5000), "topology: SuperSpeed+ budget not above SuperSpeed");
+}
+
+void testRestart(Driver* driver)
+{
+    Scheduler& scheduler = driver->scheduler;
+    Scheduler::Plan plan;
+    plan.cadenceHz = 100;
+    plan.integrationTimeMS = 5;
+    for (int i = 0; i < driver->getNumberOfSpectrometers(); i++)
+        CHECK(scheduler.setPlan(i, plan), "restart: plan %d refused", i);
+
+    std::atomic<bool> done(false);
+    std::atomic<int> polls(0), spectra(0);
+    std::thread poller([&]()
+    {
+        vector<double> spectrum;
+        while (!done)
+        {
+            Scheduler::Stats stats;
+            scheduler.getStats(0, stats);
+            scheduler.getLatest(1, spectrum);
+            polls++;
+        }
+    });
+    std::thread client([&]()
+    {
+        auto spec = driver->getSpectrometer(0);
+        while (!done)
+            if (!spec->getSpectrum().empty())
+                spectra++;
+    });
+
+    uint64_t frames = 0;
+    for (int i = 0; i < 10; i++)
+    {
+        CHECK(driver->startSchedule(), "restart: start %d failed", i);
+        std::this_thread::sleep_for(std::chrono::milliseconds(30));
+        scheduler.stop();
+
+        Scheduler::Stats stats;
+        if (scheduler.getStats(2, stats))
+            frames += stats.frames;
+    }
+    done = true;
+    poller.join();
+    client.join();
+
+    CHECK(frames > 0, "restart: no scheduled frames");
+    printf("restart: %llu scheduled frames, %d unscheduled, %d polls\n", (unsigned long long)frames, (int)spectra, (int)polls);
+}
+
+//! -1 sums whichever spectrometers are open, after one is closed
+void testMemory(Driver* driver)
+{
+    CHECK(driver->removeSpectrometer(0), "memory: close failed");
+
+    long long bytes[WP_MEMORY_SUBSYSTEMS] = { 0 };
+    CHECK(wp_get_memory_usage(-1, bytes, WP_MEMORY_SUBSYSTEMS) == WP_SUCCESS, "memory: all spectrometers refused");
+    CHECK(wp_get_memory_usage(-1, nullptr, WP_MEMORY_SUBSYSTEMS) != WP_SUCCESS, "memory: null array accepted");
+    CHECK(wp_get_memory_usage(0, bytes, WP_MEMORY_SUBSYSTEMS) == WP_ERROR_INVALID_SPECTROMETER, "memory: closed spectrometer reported");
+
+    long long expected = 0;
+    for (int i = 1; i < 3; i++)
+    {
+        auto spec = driver->getSpectrometer(i);
+        CHECK(spec != nullptr, "memory: spectrometer %d missing", i);
+        if (spec != nullptr)
+            expected += (long long)spec->getMemoryUsage().core;
+    }
+    CHECK(expected > 0 && bytes[WP_MEMORY_CORE] == expected, "memory: core %lld bytes, expected %lld", bytes[WP_MEMORY_CORE], expected);
+}
+
+int main(int argc, char** argv)
+{
+    FakeUSB::Config config;
+    config.devices = 3;
+    config.speed = LIBUSB_SPEED_SUPER_PLUS;
+    FakeUSB::configure(config);
+
+    Driver* driver = Driver::getInstance();
+    quiet(driver->logger);
+
+    testTopology(driver, config.devices);
+    testRestart(driver);
+    testMemory(driver);
+    driver->closeAllSpectrometers();
+
+    return report(argv[0]);
+}
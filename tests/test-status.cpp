@@ -0,0 +1,107 @@
+/** @file   test-status.cpp
+*   @brief  test of status polling against a simulated spectrometer
+*
+*   On a warm cache, getStatus reads only the detector temperature and the
+*   laser enable from the device; everything else the library wrote itself.
+*   Settings written while another thread polls are reported as written.
+*/
+
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "Check.h"
+#include "FakeUSB.h"
+#include "Spectrometer.h"
+
+using WasatchVCPP::Logger;
+using WasatchVCPP::Spectrometer;
+using std::vector;
+
+//! @returns control transfers the device received
+int transfers(vector<FakeUSB::Command>* received = nullptr)
+{
+    auto commands = FakeUSB::getCommands();
+    if (received)
+        *received = commands;
+    return (int)commands.size();
+}
+
+//! a warm cache costs the two live reads, or one without a TEC
+void testWarm(Logger& logger, bool hasCooling)
+{
+    FakeUSB::Config config;
+    config.hasCooling = hasCooling;
+    FakeUSB::configure(config);
+    Spectrometer spec(FakeUSB::open(), config.pid, 0, logger);
+
+    // the first poll may fill the cache
+    Spectrometer::Status status;
+    CHECK(spec.getStatus(status), "warm: first poll failed");
+
+    for (int i = 0; i < 3; i++)
+    {
+        FakeUSB::clearCommands();
+        CHECK(spec.getStatus(status), "warm: poll failed");
+
+        vector<FakeUSB::Command> received;
+        int expected = hasCooling ? 2 : 1;
+        int count = transfers(&received);
+        CHECK(count == expected, "warm (%s): %d transfers, expected %d (first 0x%02x)", hasCooling ? "TEC" : "no TEC",
+            count, expected, received.empty() ? 0 : received[0].bRequest);
+    }
+
+    CHECK(status.integrationTimeMS == (int)FakeUSB::getIntegrationTimeMS(), "warm: integration time %d", status.integrationTimeMS);
+    CHECK(status.laserEnable == FakeUSB::getLaserEnable(), "warm: laser enable");
+    CHECK(hasCooling || status.detectorTemperatureDegC == Spectrometer::ErrorCodes::InvalidTemperature,
+        "warm: temperature %.1f without a TEC", status.detectorTemperatureDegC);
+
+    // settings written through the library come back without a transfer
+    CHECK(spec.setDetectorGain(2.5f) && spec.setDetectorOffset(12), "warm: setters failed");
+    FakeUSB::clearCommands();
+    CHECK(spec.getStatus(status) && status.detectorGain == 2.5f && status.detectorOffset == 12,
+        "warm: gain %.2f offset %d", status.detectorGain, status.detectorOffset);
+    CHECK(transfers() <= 2, "warm: %d transfers after setting", transfers());
+}
+
+//! setters aren't held up by, or lost to, a concurrent poll
+void testConcurrent(Logger& logger)
+{
+    FakeUSB::Config config;
+    config.hasCooling = true;
+    config.controlLatencyUS = 200;
+    FakeUSB::configure(config);
+    Spectrometer spec(FakeUSB::open(), config.pid, 0, logger);
+
+    std::atomic<bool> done(false);
+    std::atomic<int> polls(0);
+    std::thread poller([&]()
+    {
+        Spectrometer::Status status;
+        while (!done)
+            if (spec.getStatus(status))
+                polls++;
+    });
+
+    for (int i = 1; i <= 50; i++)
+        CHECK(spec.setDetectorGain((float)i), "concurrent: setter %d failed", i);
+    done = true;
+    poller.join();
+
+    Spectrometer::Status status;
+    CHECK(spec.getStatus(status) && status.detectorGain == 50, "concurrent: gain %.1f, expected 50", status.detectorGain);
+    CHECK(polls > 0, "concurrent: no polls completed");
+}
+
+int main(int argc, char** argv)
+{
+    Logger logger;
+    quiet(logger);
+
+    testWarm(logger, true);
+    testWarm(logger, false);
+    testConcurrent(logger);
+
+    return report(argv[0]);
+}
@@ -0,0 +1,111 @@
+/** @file   test-stress.cpp
+*   @brief  concurrency stress test of the acquisition state machine
+*
+*   Acquisitions, cancellations, setters and getters run on their own threads
+*   against one simulated spectrometer.  Nothing may deadlock, the state
+*   machine must come to rest at Idle, and a cancelled integration time must
+*   be restored before the next frame.  Run under SANITIZE=thread to check
+*   for data races as well.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "Check.h"
+#include "FakeUSB.h"
+#include "Spectrometer.h"
+
+using WasatchVCPP::Logger;
+using WasatchVCPP::Spectrometer;
+using std::vector;
+
+typedef FakeUSB::Clock Clock;
+typedef Spectrometer::AcquisitionState AcquisitionState;
+
+void testStress(Logger& logger, int durationMS)
+{
+    FakeUSB::Config config;
+    config.controlLatencyUS = 50;
+    FakeUSB::configure(config);
+    Spectrometer spec(FakeUSB::open(), config.pid, 0, logger);
+
+    std::atomic<bool> done(false);
+    std::atomic<int> spectra(0), failed(0), cancels(0), writes(0), reads(0);
+    vector<std::thread> threads;
+
+    for (int i = 0; i < 2; i++)
+        threads.push_back(std::thread([&]()
+        {
+            while (!done)
+                (spec.getSpectrum().empty() ? failed : spectra)++;
+        }));
+
+    threads.push_back(std::thread([&]()
+    {
+        std::mt19937 rng(85);
+        while (!done)
+        {
+            if (spec.cancelOperation(false))
+                cancels++;
+            std::this_thread::sleep_for(std::chrono::microseconds(2000 + rng() % 20000));
+        }
+    }));
+
+    threads.push_back(std::thread([&]()
+    {
+        for (int i = 0; !done; i++)
+        {
+            spec.setIntegrationTimeMS(i % 2 ? 5 : 8);
+            spec.setDetectorGain(i % 2 ? 1.5f : 2.0f);
+            spec.setLaserEnable(i % 3 == 0);
+            writes += 3;
+        }
+    }));
+
+    threads.push_back(std::thread([&]()
+    {
+        while (!done)
+        {
+            spec.getIntegrationTimeMS();
+            spec.getLaserEnable();
+            spec.getFirmwareVersion();
+            spec.getAcquisitionState();
+            reads++;
+        }
+    }));
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(durationMS));
+    done = true;
+
+    // every thread must finish within the longest acquisition timeout
+    auto deadline = Clock::now() + std::chrono::seconds(5);
+    for (auto& t : threads)
+        t.join();
+    CHECK(Clock::now() < deadline, "stress: threads took too long to stop");
+    CHECK(spec.getAcquisitionState() == AcquisitionState::Idle, "stress: state %d at rest", (int)spec.getAcquisitionState());
+
+    // a cancelled (shortened) integration is restored before the next frame
+    spec.setLaserEnable(false);
+    spec.setIntegrationTimeMS(8);
+    spec.cancelOperation(false);
+    CHECK(!spec.getSpectrum().empty(), "stress: acquisition failed after the run");
+    CHECK(FakeUSB::getIntegrationTimeMS() == 8, "stress: device integration time %u after cancel", FakeUSB::getIntegrationTimeMS());
+
+    CHECK(spectra > 0 && cancels > 0, "stress: %d spectra, %d cancels", (int)spectra, (int)cancels);
+    printf("stress: %d spectra (%d cancelled or failed), %d cancels, %d writes, %d reads\n",
+        (int)spectra, (int)failed, (int)cancels, (int)writes, (int)reads);
+}
+
+int main(int argc, char** argv)
+{
+    Logger logger;
+    quiet(logger);
+
+    testStress(logger, argc > 1 ? atoi(argv[1]) : 1000);
+
+    return report(argv[0]);
+}
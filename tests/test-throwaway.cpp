@@ -0,0 +1,77 @@
+/** @file   test-throwaway.cpp
+*   @brief  test of automatic throwaway frames against a simulated spectrometer
+*
+*   Stale frames after a settings change are discarded, in the background or
+*   by the next getSpectrum, and closing never waits out a throwaway
+*   integration.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "Check.h"
+#include "FakeUSB.h"
+#include "Spectrometer.h"
+
+using WasatchVCPP::Logger;
+using WasatchVCPP::Spectrometer;
+using std::vector;
+
+typedef FakeUSB::Clock Clock;
+
+FakeUSB::Config config;
+
+//! every returned frame was taken under the current settings
+void testDiscard(Logger& logger)
+{
+    Spectrometer spec(FakeUSB::open(), config.pid, 0, logger);
+    CHECK(spec.setThrowawayFrames(1), "discard: config refused");
+
+    for (int i = 0; i < 5; i++)
+    {
+        CHECK(spec.setIntegrationTimeMS(5 + i), "discard: integration time refused");
+        uint32_t generation = 0;
+        CHECK(!spec.getSpectrum(&generation).empty(), "discard: acquisition %d failed", i);
+        CHECK(generation == spec.settingsGeneration, "discard: frame %d from generation %u of %u", i, generation, (uint32_t)spec.settingsGeneration);
+    }
+    CHECK(spec.getThrowawayCount() >= 5, "discard: %llu frames thrown away", (unsigned long long)spec.getThrowawayCount());
+
+    // laser power changes the spectrum too
+    uint32_t before = spec.settingsGeneration;
+    CHECK(spec.setLaserPowerPerc(50), "discard: laser power refused");
+    CHECK(spec.settingsGeneration != before, "discard: laser power didn't change the generation");
+}
+
+//! closing cancels a throwaway in progress
+void testClose(Logger& logger)
+{
+    std::unique_ptr<Spectrometer> spec(new Spectrometer(FakeUSB::open(), config.pid, 0, logger));
+    spec->setThrowawayFrames(1);
+    spec->setIntegrationTimeMS(5000);
+
+    // let the worker start integrating
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    CHECK(spec->getAcquisitionState() != Spectrometer::AcquisitionState::Idle, "close: no throwaway in progress");
+
+    auto start = Clock::now();
+    spec.reset();
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    CHECK(ms < 1000, "close: took %.0fms", ms);
+    printf("close: %.0fms during a 5000ms throwaway\n", ms);
+}
+
+int main(int argc, char** argv)
+{
+    Logger logger;
+    quiet(logger);
+
+    FakeUSB::configure(config);
+
+    testDiscard(logger);
+    testClose(logger);
+
+    return report(argv[0]);
+}
@@ -0,0 +1,260 @@
+/** @file   test-triggered.cpp
+*   @brief  test of TriggeredAcquisition against its simulated device
+*
+*   The simulated device emits a frame on a timer, each pixel a function of
+*   the frame number, so ordering, drop-oldest buffering, latency reporting
+*   and deadband suppression can be checked without hardware, as can the 
+*   interaction with EEPROM writes.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+#include "Check.h"
+#include "FakeUSB.h"
+#include "Spectrometer.h"
+#include "TriggeredAcquisition.h"
+
+using WasatchVCPP::Deadband;
+using WasatchVCPP::Logger;
+using WasatchVCPP::Spectrometer;
+using WasatchVCPP::TriggeredAcquisition;
+using std::vector;
+
+typedef TriggeredAcquisition::Clock Clock;
+typedef TriggeredAcquisition::Frame Frame;
+
+//! the simulated device's value for 'pixel' of frame 'frameId'
+double expected(uint64_t frameId, int pixel) { return (double)((frameId + pixel) & 0xffff); }
+
+bool contentMatches(const Frame& frame, int pixels)
+{
+    if ((int)frame.spectrum.size() != pixels)
+        return false;
+    for (int i = 0; i < pixels; i++)
+        if (frame.spectrum[i] != expected(frame.frameId, i))
+            return false;
+    return true;
+}
+
+//! a consumer keeping up receives every frame, in order, at 2kHz
+void testSustained(Logger& logger)
+{
+    const int pixels = 1024;
+    TriggeredAcquisition acq(pixels, 500, logger, 100);
+    CHECK(acq.start(), "sustained: start failed");
+    CHECK(!acq.start(), "sustained: started twice");
+
+    int frames = 0;
+    bool ordered = true, content = true, latency = true;
+    uint64_t last = 0;
+    auto end = Clock::now() + std::chrono::milliseconds(500);
+    while (Clock::now() < end)
+    {
+        vector<Frame> batch;
+        acq.read(batch, 50, 100);
+        for (auto& frame : batch)
+        {
+            ordered &= frames == 0 ? frame.frameId == 0 : frame.frameId == last + 1;
+            content &= contentMatches(frame, pixels);
+            latency &= frame.hasTrigger && frame.latencyMS >= 0;
+            last = frame.frameId;
+            frames++;
+        }
+    }
+    acq.stop();
+    CHECK(!acq.isRunning(), "sustained: still running after stop");
+
+    auto stats = acq.getStats();
+    CHECK(ordered, "sustained: frames out of order");
+    CHECK(content, "sustained: frame content doesn't match frame ID");
+    CHECK(latency, "sustained: trigger latency not reported");
+    CHECK(frames > 500, "sustained: only %d frames in 500ms at 2kHz", frames);
+    CHECK(stats.framesDropped == 0, "sustained: %llu frames dropped", (unsigned long long)stats.framesDropped);
+    CHECK(stats.latencyCount == stats.framesReceived, "sustained: latency known for %llu of %llu frames",
+        (unsigned long long)stats.latencyCount, (unsigned long long)stats.framesReceived);
+    printf("sustained: %d frames, latency avg %.3fms max %.3fms\n", frames, stats.avgLatencyMS, stats.maxLatencyMS);
+}
+
+//! a consumer which falls behind keeps the newest frames
+void testSlowConsumer(Logger& logger)
+{
+    const int pixels = 16, depth = 5;
+    TriggeredAcquisition acq(pixels, 1000, logger, depth);
+    acq.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    acq.stop();
+
+    auto stats = acq.getStats();
+    vector<Frame> frames;
+    int n = acq.read(frames, 100, 0);
+    CHECK(n == depth, "slow consumer: kept %d frames, expected %d", n, depth);
+    CHECK(stats.framesDropped == stats.framesReceived - depth, "slow consumer: received %llu, dropped %llu",
+        (unsigned long long)stats.framesReceived, (unsigned long long)stats.framesDropped);
+    if (n > 0)
+        CHECK(frames[n - 1].frameId == stats.framesReceived - 1, "slow consumer: newest frame %llu not kept",
+            (unsigned long long)(stats.framesReceived - 1));
+    for (int i = 0; i < n; i++)
+        CHECK(contentMatches(frames[i], pixels), "slow consumer: frame %llu content", (unsigned long long)frames[i].frameId);
+
+    // frames remain readable after stop, and a read on an empty stopped 
+    // acquisition returns at once
+    auto start = Clock::now();
+    n = acq.read(frames, 100, 1000);
+    CHECK(n == 0 && Clock::now() - start < std::chrono::milliseconds(500), "slow consumer: read after drain blocked");
+}
+
+//! successive simulated frames differ by 1 count on every pixel, so a 1.5 
+//! count deadband delivers every other frame
+void testDeadband(Logger& logger)
+{
+    const int pixels = 64;
+    Deadband deadband(logger);
+    CHECK(deadband.configure(Deadband::MaxAbs, 1.5, 0), "deadband: configure failed");
+
+    TriggeredAcquisition acq(pixels, 1000, logger, 100, &deadband);
+    acq.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+    acq.stop();
+
+    vector<Frame> frames;
+    int n = acq.read(frames, 100, 0);
+    auto stats = acq.getStats();
+    CHECK(n > 10, "deadband: only %d frames delivered", n);
+    CHECK(stats.framesSuppressed + n == stats.framesReceived, "deadband: %d delivered + %llu suppressed != %llu received",
+        n, (unsigned long long)stats.framesSuppressed, (unsigned long long)stats.framesReceived);
+    for (int i = 1; i < n; i++)
+        CHECK(frames[i].frameId == frames[i - 1].frameId + 2, "deadband: frame %llu followed %llu",
+            (unsigned long long)frames[i].frameId, (unsigned long long)frames[i - 1].frameId);
+}
+
+//! frames are read from queued bulk transfers as external triggers arrive
+void testUSB(Logger& logger)
+{
+    const int pixels = 1024, frames = 20;
+    FakeUSB::Config config;
+    config.pixels = pixels;
+    config.gen15 = false;
+    FakeUSB::configure(config);
+    {
+        Spectrometer spec(FakeUSB::open(), config.pid, 0, logger);
+        CHECK(!spec.startTriggeredAcquisition(4, 100), "usb: started without an accessory connector");
+    }
+
+    config.gen15 = true;
+    FakeUSB::configure(config);
+    Spectrometer spec(FakeUSB::open(), config.pid, 0, logger);
+    CHECK(spec.eeprom.featureMask.gen15, "usb: gen15 not read from the EEPROM");
+    CHECK(spec.startTriggeredAcquisition(4, 100), "usb: start failed");
+    auto acq = spec.getTriggeredAcquisition();
+    CHECK(acq != nullptr && acq->isRunning(), "usb: not running");
+    if (acq == nullptr)
+        return;
+
+    for (int i = 0; i < frames; i++)
+    {
+        acq->markTrigger();
+        FakeUSB::trigger();
+        std::this_thread::sleep_for(std::chrono::microseconds(500));
+    }
+
+    vector<Frame> received;
+    auto end = Clock::now() + std::chrono::seconds(2);
+    while ((int)received.size() < frames && Clock::now() < end)
+    {
+        vector<Frame> batch;
+        acq->read(batch, frames, 100);
+        received.insert(received.end(), batch.begin(), batch.end());
+    }
+    CHECK((int)received.size() == frames, "usb: received %d of %d frames", (int)received.size(), frames);
+    for (auto& frame : received)
+    {
+        bool content = (int)frame.spectrum.size() == pixels;
+        for (int i = 0; content && i < pixels; i++)
+            content = frame.spectrum[i] == FakeUSB::pixelValue(frame.frameId, i, false);
+        CHECK(content, "usb: frame %llu content", (unsigned long long)frame.frameId);
+        CHECK(frame.hasTrigger && frame.latencyMS >= 0, "usb: frame %llu latency not reported", (unsigned long long)frame.frameId);
+    }
+
+    // a reader holding the old acquisition is unaffected by a restart
+    CHECK(spec.stopTriggeredAcquisition(), "usb: stop failed");
+    CHECK(spec.startTriggeredAcquisition(4, 10), "usb: restart failed");
+    CHECK(spec.getTriggeredAcquisition() != acq, "usb: restart reused the acquisition");
+    vector<Frame> none;
+    CHECK(acq->read(none, 1, 0) == 0 && !acq->isRunning(), "usb: old acquisition not stopped and drained");
+    CHECK(spec.stopTriggeredAcquisition(), "usb: second stop failed");
+}
+
+//! rewriting the EEPROM stops the acquisition before reconfiguring
+void testEEPROM(Logger& logger)
+{
+    FakeUSB::Config config;
+    config.pixels = 2048;
+    config.endpoints = 2;
+    config.gen15 = true;
+    FakeUSB::configure(config);
+    Spectrometer spec(FakeUSB::open(), config.pid, 0, logger);
+    CHECK(spec.startTriggeredAcquisition(4, 100), "eeprom: start failed");
+    auto acq = spec.getTriggeredAcquisition();
+
+    // nothing to write, nothing stopped
+    int pages = -1;
+    CHECK(spec.commitStagedEEPROM(&pages) && pages == 0 && acq->isRunning(), "eeprom: empty commit stopped the acquisition");
+
+    CHECK(spec.setEEPROMField("slitSizeUM", "25"), "eeprom: field refused");
+    CHECK(spec.commitStagedEEPROM(&pages) && pages > 0, "eeprom: commit failed (%d pages)", pages);
+    CHECK(!acq->isRunning(), "eeprom: acquisition still running after the commit");
+    CHECK(spec.eeprom.slitSizeUM == 25, "eeprom: slit %d after the commit", (int)spec.eeprom.slitSizeUM);
+
+    // reads are reconfigured, and acquisition works again
+    CHECK(spec.startTriggeredAcquisition(4, 100), "eeprom: restart failed");
+    acq = spec.getTriggeredAcquisition();
+    acq->markTrigger();
+    FakeUSB::trigger();
+    vector<Frame> received;
+    acq->read(received, 1, 1000);
+    CHECK(received.size() == 1 && (int)received[0].spectrum.size() == config.pixels, "eeprom: no frame after the restart");
+    spec.stopTriggeredAcquisition();
+}
+
+//! wide FX2 detectors split across the first two spectral endpoints, even
+//! when the descriptor lists others, and fall back to one without a second
+void testEndpoints(Logger& logger)
+{
+    const int layouts[][2] = { { 2, 2 }, { 2, 0 }, { 1, 0 } };  // spectral, extra
+    for (auto& layout : layouts)
+    {
+        FakeUSB::Config config;
+        config.pixels = 2048;
+        config.endpoints = layout[0];
+        config.extraEndpoints = layout[1];
+        FakeUSB::configure(config);
+        Spectrometer spec(FakeUSB::open(), config.pid, 0, logger);
+
+        // each endpoint streams its share, so content proves which were read
+        vector<double> spectrum(config.pixels);
+        CHECK(spec.getSpectrum(&spectrum[0], config.pixels), "endpoints (%d + %d): read failed", layout[0], layout[1]);
+        bool content = true;
+        uint64_t frame = FakeUSB::getFramesAcquired() - 1;
+        for (int i = 0; i < config.pixels && content; i++)
+            content = spectrum[i] == FakeUSB::pixelValue(frame, i, spec.laserEnabled);
+        CHECK(content, "endpoints (%d + %d): spectrum content", layout[0], layout[1]);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Logger logger;
+    quiet(logger);
+
+    testSustained(logger);
+    testSlowConsumer(logger);
+    testDeadband(logger);
+    testUSB(logger);
+    testEEPROM(logger);
+    testEndpoints(logger);
+
+    return report(argv[0]);
+}
@@ -0,0 +1,102 @@
+/** @file   test-warmrestore.cpp
+*   @brief  test of restoring a reopened spectrometer's settings, against a
+*           simulated spectrometer
+*
+*   Warm restore is opt-in; once enabled, reopening the same unit writes back
+*   what it had (laser power and modulation included, the laser itself never),
+*   and a setting the spectrometer refused is never remembered.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory>
+#include <vector>
+
+#include "Check.h"
+#include "FakeUSB.h"
+#include "Driver.h"
+#include "Spectrometer.h"
+
+using WasatchVCPP::Driver;
+using WasatchVCPP::Logger;
+using WasatchVCPP::Spectrometer;
+using std::vector;
+
+FakeUSB::Config config;
+
+std::unique_ptr<Spectrometer> open(Logger& logger)
+{
+    return std::unique_ptr<Spectrometer>(new Spectrometer(FakeUSB::open(), config.pid, 0, logger));
+}
+
+//! @returns the last value written with this opcode, or -1
+int lastWrite(uint8_t bRequest)
+{
+    int value = -1;
+    for (auto& command : FakeUSB::getCommands())
+        if (!command.read && command.bRequest == bRequest)
+            value = command.wValue;
+    return value;
+}
+
+//! nothing is restored unless asked for
+void testDefault(Logger& logger)
+{
+    auto spec = open(logger);
+    CHECK(spec->setIntegrationTimeMS(33), "default: integration time refused");
+    spec.reset();
+
+    spec = open(logger);
+    CHECK(!spec->warmRestored, "default: restored without opting in");
+    CHECK(FakeUSB::getIntegrationTimeMS() != 33, "default: integration time restored");
+}
+
+//! laser power and modulation come back, the laser doesn't
+void testRestore(Driver* driver, Logger& logger)
+{
+    driver->setWarmRestore(true);
+
+    auto spec = open(logger);
+    CHECK(spec->setIntegrationTimeMS(33), "restore: integration time refused");
+    CHECK(spec->setLaserPowerPerc(40), "restore: laser power refused");
+    CHECK(spec->setModWidthus(123), "restore: modulation width refused");
+    CHECK(spec->setLaserEnable(true), "restore: laser enable refused");
+    CHECK(spec->setLaserEnable(false), "restore: laser disable refused");
+    spec.reset();
+
+    FakeUSB::clearCommands();
+    spec = open(logger);
+    CHECK(spec->warmRestored, "restore: not restored");
+    CHECK(FakeUSB::getIntegrationTimeMS() == 33, "restore: integration time %u", FakeUSB::getIntegrationTimeMS());
+    CHECK(lastWrite(0xc7) == 1000, "restore: modulation period %d", lastWrite(0xc7));
+    CHECK(lastWrite(0xdb) == 123, "restore: modulation width %d", lastWrite(0xdb));
+    CHECK(lastWrite(0xbd) == 1, "restore: modulation enable %d", lastWrite(0xbd));
+    CHECK(lastWrite(0xbe) != 1 && !FakeUSB::getLaserEnable() && !spec->laserEnabled, "restore: laser re-enabled");
+
+    auto settings = spec->getSettings();
+    CHECK(settings.hasLaserPower && settings.laserPowerPerc == 40, "restore: laser power %.2f", settings.laserPowerPerc);
+
+    // a refused write isn't remembered
+    FakeUSB::failOpcode(0xc7, true);
+    CHECK(!spec->setLaserPowerPerc(70), "restore: failed laser power accepted");
+    FakeUSB::failOpcode(0xc7, false);
+    settings = spec->getSettings();
+    CHECK(settings.laserPowerPerc == 40, "restore: failed laser power cached as %.2f", settings.laserPowerPerc);
+
+    driver->setWarmRestore(false);
+}
+
+int main(int argc, char** argv)
+{
+    Logger logger;
+    quiet(logger);
+
+    FakeUSB::configure(config);
+    Driver* driver = Driver::getInstance();
+    quiet(driver->logger);
+
+    testDefault(logger);
+    testRestore(driver, logger);
+
+    return report(argv[0]);
+}